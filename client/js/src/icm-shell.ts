@@ -4,6 +4,7 @@ import * as fs from 'fs';
 import { createCanvas, loadImage } from '@napi-rs/canvas';
 import {
     IcmIpcMsgType,
+    IcmImageFilter,
     IcmMsgCreateBuffer,
     IcmMsgDestroyBuffer,
     IcmMsgDrawRect,
@@ -160,6 +161,7 @@ export interface DrawImageOptions {
     srcWidth?: number;
     srcHeight?: number;
     alpha?: number;
+    filter?: IcmImageFilter;
 }
 
 export interface DrawTextOptions {
@@ -535,7 +537,8 @@ export class IcmShell extends EventEmitter<IcmShellEventMap> {
             srcY: options.srcY || 0,
             srcWidth: options.srcWidth || 0,
             srcHeight: options.srcHeight || 0,
-            alpha: options.alpha || 255
+            alpha: options.alpha || 255,
+            filter: options.filter
         };
         this.sendMessage(IcmIpcMsgType.DRAW_UPLOADED_IMAGE, serializeDrawUploadedImage(draw));
     }
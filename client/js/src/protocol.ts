@@ -87,6 +87,13 @@ export enum IcmIpcMsgType {
   STOP_ANIMATION = 82
 }
 
+export enum IcmImageFilter {
+  AUTO = 0, // box when shrinking 2x or more, else bilinear
+  NEAREST = 1,
+  BILINEAR = 2,
+  BOX = 3
+}
+
 export interface IcmIpcHeader {
   length: number; // Total message length including header
   type: number;
@@ -173,6 +180,7 @@ export interface IcmMsgDrawUploadedImage {
   srcWidth: number;
   srcHeight: number;
   alpha: number;
+  filter?: IcmImageFilter;
 }
 
 export interface IcmMsgDrawText {
@@ -600,7 +608,7 @@ export function serializeDestroyImage(msg: IcmMsgDestroyImage): Buffer {
 }
 
 export function serializeDrawUploadedImage(msg: IcmMsgDrawUploadedImage): Buffer {
-  const buf = Buffer.alloc(32);
+  const buf = Buffer.alloc(48);
   buf.writeUInt32LE(msg.windowId, 0);
   buf.writeUInt32LE(msg.imageId, 4);
   buf.writeInt32LE(msg.x, 8);
@@ -612,6 +620,7 @@ export function serializeDrawUploadedImage(msg: IcmMsgDrawUploadedImage): Buffer
   buf.writeUInt32LE(msg.srcWidth, 32);
   buf.writeUInt32LE(msg.srcHeight, 36);
   buf.writeUInt8(msg.alpha, 40);
+  buf.writeUInt32LE(msg.filter ?? IcmImageFilter.AUTO, 44);
   return buf;
 }
 
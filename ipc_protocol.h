@@ -156,6 +156,42 @@ enum icm_ipc_msg_type {
     ICM_MSG_SET_WINDOW_DECORATIONS = 93,
     ICM_MSG_REQUEST_WINDOW_DECORATIONS = 94,
     ICM_MSG_LAUNCH_APP = 95,
+
+    /* Scheduling */
+    ICM_MSG_SET_CLIENT_PRIORITY = 96,
+
+    /* Bulk window updates */
+    ICM_MSG_SET_WINDOWS_PROPERTIES = 97,
+    ICM_MSG_QUERY_WINDOWS_BATCH = 98,
+    ICM_MSG_WINDOWS_BATCH_DATA = 99,
+
+    /* Window event stream */
+    ICM_MSG_WINDOW_APP_ID_CHANGED = 100,
+
+    /* Shared state page */
+    ICM_MSG_GET_STATE_PAGE = 101,
+    ICM_MSG_STATE_PAGE = 102,
+
+    /* Click region hover */
+    ICM_MSG_REGION_HOVER_EVENT = 103,
+
+    /* Multi-window input subscriptions */
+    ICM_MSG_REGISTER_INPUT_EVENTS = 104,
+    ICM_MSG_UNREGISTER_INPUT_EVENTS = 105,
+
+    /* Instanced drawing */
+    ICM_MSG_DRAW_RECTS = 106,
+    ICM_MSG_DRAW_LINES = 107,
+    ICM_MSG_DRAW_SPRITES = 108,
+
+    /* Window event stream */
+    ICM_MSG_WINDOW_SIZE_CHANGED = 109,
+
+    /* Shared-memory buffers */
+    ICM_MSG_BUFFER_INFO_DATA = 110,
+    ICM_MSG_COMMIT_BUFFER = 111,
+
+    ICM_MSG_TYPE_MAX = ICM_MSG_COMMIT_BUFFER,
 };
 
 struct icm_ipc_header {
@@ -193,6 +229,15 @@ struct icm_msg_set_layer {
     uint32_t layer;
 };
 
+/* A retained rect (ICM_DRAW_RECT_RETAINED with a nonzero rect_id) becomes a
+ * scene node above the window's pixels instead of being drawn into them.
+ * Sending its id again updates it in place, a zero size removes it and
+ * CLEAR_RECTS removes them all. It follows the window's position, scale and
+ * opacity, but not 3D transforms or pixel effects. */
+enum icm_draw_rect_flags {
+    ICM_DRAW_RECT_RETAINED = 1 << 0,
+};
+
 struct icm_msg_draw_rect {
     uint32_t window_id;
     uint32_t rect_id;
@@ -201,6 +246,7 @@ struct icm_msg_draw_rect {
     uint32_t width;
     uint32_t height;
     uint32_t color_rgba;
+    uint32_t flags;            /* icm_draw_rect_flags; optional */
 };
 
 struct icm_msg_put_pixels {
@@ -214,6 +260,7 @@ struct icm_msg_put_pixels {
     uint8_t pixels[];
 };
 
+/* Removes the window's retained rects */
 struct icm_msg_clear_rects {
     uint32_t window_id;
 };
@@ -253,32 +300,96 @@ struct icm_msg_export_dmabuf_reply {
 };
 
 /* Fast drawing primitives */
+/* Flags for DRAW_LINE and DRAW_CIRCLE. Without ANTIALIAS the color is
+ * stored like DRAW_RECT does, alpha included, so alpha 0 erases; with it
+ * the color is blended over the window. */
+enum icm_draw_flags {
+    ICM_DRAW_ANTIALIAS = 1 << 0,
+};
+
+/* Both endpoints are drawn; thick lines get square caps. A thickness of 0
+ * draws 1 pixel wide. */
 struct icm_msg_draw_line {
     uint32_t window_id;
     int32_t x0, y0, x1, y1;
     uint32_t color_rgba;
     uint32_t thickness;
+    uint32_t flags;            /* icm_draw_flags; optional */
 };
 
+/* The outline is centered on the radius; a filled circle reaches the outer
+ * edge of a 1 pixel outline. Trailing fields are optional. */
 struct icm_msg_draw_circle {
     uint32_t window_id;
     int32_t cx, cy;
     uint32_t radius;
     uint32_t color_rgba;
     uint32_t fill;             /* 0 = outline, 1 = filled */
+    uint32_t flags;            /* icm_draw_flags */
+    uint32_t thickness;        /* outline width; 0 draws 1 pixel */
+    uint32_t radius_y;         /* vertical radius for ellipses; 0 = radius */
 };
 
+enum icm_polygon_fill {
+    ICM_POLYGON_OUTLINE = 0,
+    ICM_POLYGON_FILL_NONZERO = 1,
+    ICM_POLYGON_FILL_EVENODD = 2,
+};
+
+/* Filled polygons are anti-aliased; whole-number points lie on pixel corners */
 struct icm_msg_draw_polygon {
     uint32_t window_id;
     uint32_t num_points;
     uint32_t color_rgba;
-    uint32_t fill;
+    uint32_t fill;             /* enum icm_polygon_fill */
     /* Points follow as array of (int32_t x, int32_t y) pairs */
 };
 
+/* Instanced drawing: one window and one frame update for many primitives.
+ * Records draw in message order wherever they overlap. */
+enum icm_draw_instanced_flags {
+    ICM_DRAW_INSTANCED_ANTIALIAS = ICM_DRAW_ANTIALIAS,  /* DRAW_LINES */
+    ICM_DRAW_INSTANCED_BLEND = 1 << 1,     /* DRAW_RECTS blend instead of storing */
+};
+
+struct icm_msg_draw_instanced {
+    uint32_t window_id;
+    uint32_t num_records;
+    uint32_t flags;            /* icm_draw_instanced_flags */
+    /* Followed by num_records records matching the message type */
+};
+
+struct icm_rect_record {       /* DRAW_RECTS */
+    int16_t x, y;
+    uint16_t width, height;
+    uint32_t color_rgba;
+};
+
+struct icm_line_record {       /* DRAW_LINES, as DRAW_LINE */
+    int16_t x0, y0, x1, y1;
+    uint32_t color_rgba;
+    uint16_t thickness;
+    uint16_t reserved;
+};
+
+/* A 1:1 blit of part of an uploaded image, e.g. an icon from an atlas. A
+ * zero width or height means the rest of the image. */
+struct icm_sprite_record {     /* DRAW_SPRITES */
+    uint32_t image_id;
+    int16_t x, y;
+    uint16_t src_x, src_y;
+    uint16_t width, height;
+    uint8_t alpha;
+    uint8_t reserved[3];
+};
+
+/* A DMABUF source stays on the GPU as a retained node over the window,
+ * refreshed by COMMIT_BUFFER; alpha 0 or CLEAR_RECTS removes it. An IPC
+ * window source is copied into the window's pixels. A zero width or height
+ * means the source size. */
 struct icm_msg_draw_image {
     uint32_t window_id;
-    uint32_t buffer_id;        /* Imported DMABUF buffer ID */
+    uint32_t buffer_id;        /* Imported DMABUF or IPC window */
     int32_t x, y;
     uint32_t width, height;
     uint32_t src_x, src_y;
@@ -332,18 +443,43 @@ struct icm_msg_destroy_buffer {
     uint32_t buffer_id;
 };
 
+/*
+ * Shared-memory buffers
+ *
+ * QUERY_BUFFER_INFO moves an IPC window's pixels into a memfd and answers
+ * with BUFFER_INFO_DATA, the memfd following as the message's only file
+ * descriptor. Map size bytes read-write with MAP_SHARED; pixels are
+ * straight-alpha ARGB8888 words (0xAARRGGBB), stride bytes per row.
+ * The memfd is sealed against shrinking and growing.
+ *
+ * After drawing into the mapping, send COMMIT_BUFFER with the rects that
+ * changed; the compositor uploads only those. Draw messages for the window
+ * keep working and write into the same memory. Resizing the window replaces
+ * the memfd: query again after WINDOW_SIZE_CHANGED.
+ */
 struct icm_msg_query_buffer_info {
     uint32_t buffer_id;
 };
 
-struct icm_msg_query_buffer_info_reply {
+struct icm_msg_query_buffer_info_reply {   /* BUFFER_INFO_DATA */
     uint32_t buffer_id;
     int32_t width;
     int32_t height;
-    uint32_t format;
+    uint32_t format;           /* DRM_FORMAT_ARGB8888 */
     uint32_t size;
     uint32_t stride;
-    int32_t mmap_fd;           /* For CPU access (sep.) */
+    int32_t mmap_fd;           /* Index of the memfd among the message's fds, always 0 */
+};
+
+struct icm_damage_rect {
+    int32_t x, y;
+    uint32_t width, height;
+};
+
+struct icm_msg_commit_buffer {
+    uint32_t buffer_id;
+    uint32_t num_rects;        /* 0 commits the whole buffer */
+    /* Followed by num_rects struct icm_damage_rect */
 };
 
 /* Event registration */
@@ -394,6 +530,20 @@ struct icm_msg_destroy_image {
     uint32_t image_id;
 };
 
+/* Scaling filters for DRAW_UPLOADED_IMAGE */
+enum icm_image_filter {
+    ICM_IMAGE_FILTER_AUTO = 0,      /* box when shrinking 2x or more, else bilinear */
+    ICM_IMAGE_FILTER_NEAREST = 1,
+    ICM_IMAGE_FILTER_BILINEAR = 2,
+    ICM_IMAGE_FILTER_BOX = 3,
+};
+
+/* The src rect is drawn scaled to width x height. A zero src_width/height
+ * means width/height (a 1:1 crop), and if that is zero too, the rest of the
+ * image; a zero width/height means the source size. Older compositors
+ * ignored src_width/height, so clients that filled them in now get scaled
+ * output. reserved is the old padding and is ignored, so the old 44-byte
+ * message never carries a filter. */
 struct icm_msg_draw_uploaded_image {
     uint32_t window_id;
     uint32_t image_id;
@@ -402,6 +552,8 @@ struct icm_msg_draw_uploaded_image {
     uint32_t src_x, src_y;
     uint32_t src_width, src_height;
     uint8_t alpha;
+    uint8_t reserved[3];
+    uint32_t filter;           /* icm_image_filter; optional, AUTO if omitted */
 };
 
 struct icm_msg_draw_text {
@@ -419,10 +571,16 @@ struct icm_msg_set_window_visible {
 };
 
 /* Keybinds */
+/* Keep the key from the focused client. Any consuming binding for a
+ * (modifiers, keycode) pair hides the press and its release from the seat. */
+#define ICM_KEYBIND_CONSUME 1
+
+/* flags is optional; 12-byte messages from older clients register without it */
 struct icm_msg_register_keybind {
     uint32_t keybind_id;
     uint32_t modifiers;
     uint32_t keycode;
+    uint32_t flags;             /* ICM_KEYBIND_* */
 };
 
 struct icm_msg_unregister_keybind {
@@ -447,11 +605,16 @@ struct icm_msg_window_destroyed {
 };
 
 /* Clickable regions */
+/* Also report pointer enter/leave for the region (REGION_HOVER_EVENT) */
+#define ICM_CLICK_REGION_HOVER 1
+
+/* flags is optional; 24-byte messages from older clients register without it */
 struct icm_msg_register_click_region {
     uint32_t window_id;
     uint32_t region_id;
     int32_t x, y;
     uint32_t width, height;
+    uint32_t flags;             /* ICM_CLICK_REGION_* */
 };
 
 struct icm_msg_unregister_click_region {
@@ -464,6 +627,13 @@ struct icm_msg_click_region_event {
     uint32_t state;
 };
 
+/* Window-local pointer position when the pointer entered or left the region */
+struct icm_msg_region_hover_event {
+    uint32_t region_id;
+    uint32_t entered;           /* 1 = enter, 0 = leave */
+    int32_t x, y;
+};
+
 /* Screen copy */
 struct icm_msg_request_screen_copy {
     uint32_t request_id;
@@ -502,9 +672,18 @@ struct icm_msg_set_window_position {
     int32_t x, y;
 };
 
+/* What an IPC window's pixels become when SET_WINDOW_SIZE resizes its
+ * buffer. Uncovered areas are transparent. */
+enum icm_resize_mode {
+    ICM_RESIZE_KEEP = 0,        /* keep the top-left corner in place */
+    ICM_RESIZE_CLEAR = 1,
+    ICM_RESIZE_SCALE = 2,       /* stretch the old contents to the new size */
+};
+
 struct icm_msg_set_window_size {
     uint32_t window_id;
     uint32_t width, height;
+    uint8_t resize_mode;        /* enum icm_resize_mode; optional, defaults to KEEP */
 };
 
 /* Window transformations */
@@ -771,8 +950,25 @@ struct icm_msg_toplevel_windows_data {
     /* Followed by num_windows * icm_msg_toplevel_window_entry structures */
 };
 
+/* Window event subscription bits.
+ *
+ * WINDOW_CREATED and WINDOW_DESTROYED are delivered to every client whether or
+ * not it subscribed; the CREATED bit only requests WINDOW_CREATED for windows
+ * that already exist at subscribe time. Every other event is sent only to
+ * clients holding the matching bit. Subscribing to a new bit first replays the
+ * current state of all windows for that bit, after which only changes follow. */
+enum icm_window_event {
+    ICM_WINDOW_EVENT_CREATED = 1,
+    ICM_WINDOW_EVENT_DESTROYED = 2,
+    ICM_WINDOW_EVENT_TITLE = 4,     /* WINDOW_TITLE_CHANGED */
+    ICM_WINDOW_EVENT_STATE = 8,     /* WINDOW_STATE_CHANGED on state or visibility change */
+    ICM_WINDOW_EVENT_FOCUS = 16,    /* WINDOW_STATE_CHANGED on focus change */
+    ICM_WINDOW_EVENT_APP_ID = 32,   /* WINDOW_APP_ID_CHANGED */
+    ICM_WINDOW_EVENT_SIZE = 64,     /* WINDOW_SIZE_CHANGED */
+};
+
 struct icm_msg_subscribe_window_events {
-    uint32_t event_mask; /* bitfield: 1=created, 2=destroyed, 4=title, 8=state, 16=focus */
+    uint32_t event_mask; /* enum icm_window_event bits */
 };
 
 struct icm_msg_unsubscribe_window_events {
@@ -781,16 +977,30 @@ struct icm_msg_unsubscribe_window_events {
 
 struct icm_msg_window_title_changed {
     uint32_t window_id;
-    char title[256];
+    uint16_t title_len;     /* UTF-8 bytes that follow, not NUL-terminated */
+    uint16_t reserved;
+    /* Followed by title_len bytes of title */
+};
+
+struct icm_msg_window_app_id_changed {
+    uint32_t window_id;
+    uint16_t app_id_len;    /* UTF-8 bytes that follow, not NUL-terminated */
+    uint16_t reserved;
+    /* Followed by app_id_len bytes of app_id */
 };
 
 struct icm_msg_window_state_changed {
     uint32_t window_id;
-    uint32_t state;
+    uint32_t state;         /* 1=minimized, 2=maximized, 4=fullscreen, 8=decorated */
     uint8_t visible;
     uint8_t focused;
 };
 
+struct icm_msg_window_size_changed {
+    uint32_t window_id;
+    uint32_t width, height;
+};
+
 /* Window decorations */
 struct icm_msg_set_window_decorations {
     uint32_t window_id;
@@ -810,4 +1020,176 @@ struct icm_msg_launch_app {
     char command[];
 };
 
+/* Scheduling: higher priority clients are served first and get a larger
+ * share of each event-loop wakeup when several clients have queued work */
+enum icm_client_priority {
+    ICM_CLIENT_PRIORITY_LOW = 0,
+    ICM_CLIENT_PRIORITY_NORMAL = 1,
+    ICM_CLIENT_PRIORITY_HIGH = 2,
+};
+
+struct icm_msg_set_client_priority {
+    uint32_t priority; /* enum icm_client_priority */
+};
+
+/* Bulk window updates: every record is applied in one pass and a single
+ * frame is scheduled, e.g. for overview or dock animations */
+enum icm_window_property {
+    ICM_WINDOW_PROP_POSITION = 1 << 0,   /* x, y */
+    ICM_WINDOW_PROP_OPACITY = 1 << 1,    /* opacity */
+    ICM_WINDOW_PROP_TRANSFORM = 1 << 2,  /* scale_x, scale_y, rotation */
+};
+
+struct icm_window_properties_record {
+    uint32_t window_id;
+    uint32_t mask;      /* enum icm_window_property bits; other fields are ignored */
+    int32_t x, y;
+    float opacity;
+    float scale_x, scale_y;
+    float rotation;     /* degrees */
+};
+
+struct icm_msg_set_windows_properties {
+    uint32_t num_records;
+    /* Followed by num_records * icm_window_properties_record */
+};
+
+/* Batched window query: one request, one variable-length reply */
+enum icm_window_query_field {
+    ICM_WINDOW_FIELD_GEOMETRY = 1 << 0,    /* int32 x, y; uint32 width, height */
+    ICM_WINDOW_FIELD_STATE = 1 << 1,       /* uint32 state; uint8 visible, focused, 2 pad */
+    ICM_WINDOW_FIELD_APPEARANCE = 1 << 2,  /* float opacity, scale_x, scale_y, rotation */
+    ICM_WINDOW_FIELD_TITLE = 1 << 3,       /* uint16 length + UTF-8 bytes, no NUL */
+    ICM_WINDOW_FIELD_APP_ID = 1 << 4,      /* uint16 length + UTF-8 bytes, no NUL */
+};
+
+enum icm_window_query_filter {
+    ICM_WINDOW_FILTER_IDS = 0,        /* the window ids following the request */
+    ICM_WINDOW_FILTER_ALL = 1,        /* IPC windows, toplevels and layer surfaces */
+    ICM_WINDOW_FILTER_TOPLEVELS = 2,  /* application toplevels only */
+};
+
+#define ICM_WINDOW_QUERY_VISIBLE_ONLY 1  /* icm_msg_query_windows_batch.flags */
+
+enum icm_window_kind {
+    ICM_WINDOW_KIND_IPC = 1,
+    ICM_WINDOW_KIND_TOPLEVEL = 2,
+    ICM_WINDOW_KIND_LAYER = 3,
+};
+
+struct icm_msg_query_windows_batch {
+    uint32_t fields;    /* icm_window_query_field bits */
+    uint32_t filter;    /* icm_window_query_filter */
+    uint32_t flags;     /* ICM_WINDOW_QUERY_VISIBLE_ONLY */
+    uint32_t num_ids;   /* ICM_WINDOW_FILTER_IDS only */
+    /* Followed by num_ids * uint32_t window ids */
+};
+
+#define ICM_WINDOWS_BATCH_TRUNCATED 1  /* icm_msg_windows_batch_data.flags */
+
+struct icm_msg_windows_batch_data {
+    uint32_t fields;       /* fields present in every record; unknown request bits dropped */
+    uint32_t num_windows;
+    uint32_t flags;        /* ICM_WINDOWS_BATCH_TRUNCATED if the reply hit the size limit */
+    /* Followed by num_windows records, each starting on a 4-byte boundary:
+     *   uint32 window_id; uint8 kind (icm_window_kind); 3 pad;
+     *   then each requested field in bit order as described above.
+     * Ids that do not resolve are omitted. */
+};
+
+/* Shared state page
+ *
+ * ICM_MSG_STATE_PAGE answers ICM_MSG_GET_STATE_PAGE with one file descriptor:
+ * a sealed memfd holding a struct icm_state_page that the compositor rewrites
+ * as state changes (at most once per output frame, plus cursor motion).
+ * Clients map it read-only (PROT_READ, MAP_SHARED) and sample it without
+ * further messages. Every client receives the same page.
+ *
+ * Writes are published under a seqlock. To take a consistent copy:
+ *
+ *   do {
+ *       seq = __atomic_load_n(&page->sequence, __ATOMIC_ACQUIRE);
+ *       if (seq & 1) continue;          // write in progress
+ *       memcpy(&copy, page, sizeof(copy));
+ *       __atomic_thread_fence(__ATOMIC_ACQUIRE);
+ *   } while (seq & 1 || seq != __atomic_load_n(&page->sequence, __ATOMIC_RELAXED));
+ *
+ * window_generation only moves when the window table changes, so a client can
+ * skip re-reading the table when it matches the last value it saw.
+ */
+
+#define ICM_STATE_PAGE_MAGIC 0x50534349  /* "ICSP" */
+#define ICM_STATE_PAGE_VERSION 1
+#define ICM_STATE_PAGE_MAX_OUTPUTS 8
+#define ICM_STATE_PAGE_MAX_WINDOWS 256
+
+#define ICM_STATE_PAGE_WINDOWS_TRUNCATED 1  /* icm_state_page.flags */
+
+struct icm_state_page_output {
+    int32_t x;
+    int32_t y;
+    uint32_t width;         /* Effective (scaled) size in layout coordinates */
+    uint32_t height;
+    float scale;
+    uint32_t enabled;
+};
+
+struct icm_state_page_window {
+    uint32_t window_id;
+    uint8_t kind;           /* icm_window_kind */
+    uint8_t visible;
+    uint8_t focused;
+    uint8_t reserved;
+    int32_t x;
+    int32_t y;
+    uint32_t width;
+    uint32_t height;
+    uint32_t state;         /* 1=minimized, 2=maximized, 4=fullscreen, 8=decorated */
+};
+
+struct icm_state_page {
+    uint32_t magic;             /* ICM_STATE_PAGE_MAGIC */
+    uint32_t version;           /* ICM_STATE_PAGE_VERSION */
+    uint32_t size;              /* sizeof(struct icm_state_page) as written */
+    uint32_t sequence;          /* Seqlock, odd while an update is in progress */
+    double cursor_x;
+    double cursor_y;
+    uint32_t focused_window_id;
+    uint32_t window_generation;
+    uint32_t flags;             /* ICM_STATE_PAGE_WINDOWS_TRUNCATED */
+    uint32_t num_outputs;
+    struct icm_state_page_output outputs[ICM_STATE_PAGE_MAX_OUTPUTS];
+    uint32_t num_windows;
+    uint32_t reserved;
+    struct icm_state_page_window windows[ICM_STATE_PAGE_MAX_WINDOWS];
+};
+
+struct icm_msg_state_page {
+    uint32_t size;              /* Bytes to map */
+    uint32_t version;           /* ICM_STATE_PAGE_VERSION */
+    /* The memfd follows as the message's only file descriptor */
+};
+
+/* Input subscriptions: a client gets POINTER_EVENTs for every window it
+ * subscribed to while the pointer is over it, and KEYBOARD_EVENTs tagged with
+ * the focused window if subscribed, otherwise its latest keyboard window.
+ * REGISTER_POINTER_EVENT / REGISTER_KEYBOARD_EVENT add a single window. */
+enum icm_input_event_type {
+    ICM_INPUT_EVENT_POINTER = 1,
+    ICM_INPUT_EVENT_KEYBOARD = 2,
+};
+
+struct icm_msg_register_input_events {
+    uint32_t types;         /* icm_input_event_type bits */
+    uint32_t num_windows;
+    /* Followed by num_windows * uint32_t window ids */
+};
+
+/* num_windows == 0 drops every window for the given types */
+struct icm_msg_unregister_input_events {
+    uint32_t types;         /* icm_input_event_type bits */
+    uint32_t num_windows;
+    /* Followed by num_windows * uint32_t window ids */
+};
+
 #endif
@@ -1,15 +1,21 @@
+#define _GNU_SOURCE
 #include "ipc_server.h"
 #include "ipc_protocol.h"
+#include "ipc_uring.h"
 #include "transform_matrix.h"
 #include "main.h"
+#include "raster.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <time.h>
 #include <errno.h>
 #include <math.h>
 #include <ctype.h>
@@ -18,6 +24,7 @@
 #include <wayland-server.h>
 #include <wayland-server-protocol.h>
 #include <wlr/util/log.h>
+#include <wlr/render/drm_format_set.h>
 #include <wlr/types/wlr_xdg_shell.h>
 #include <wlr/types/wlr_scene.h>
 #include <wlr/types/wlr_output.h>
@@ -27,31 +34,27 @@
 
 /* Forward declarations */
 void draw_window_decorations(struct BufferEntry *buffer);
-void start_buffer_animation(struct BufferEntry *buffer, uint32_t duration_ms);
+struct BufferAnimation *start_buffer_animation(struct BufferEntry *buffer, uint32_t duration_ms);
 void build_transform_matrix(float *matrix, float tx, float ty, float tz,
                            float rx, float ry, float rz, float sx, float sy, float sz);
 void update_buffer_animation(struct BufferEntry *buffer, uint32_t current_time);
 void update_animations(struct IPCServer *ipc_server);
 static int handle_set_window_matrix(struct IPCServer *ipc_server, struct IPCClient *client,
                                     const struct icm_msg_set_window_matrix *msg);
+static void ipc_client_drop_input(struct IPCClient *client);
 
 /* Socket I/O helpers */
-static ssize_t send_with_fds(int socket_fd, const void *data, size_t size,
+static ssize_t send_with_fds(int socket_fd, struct iovec *iov, int iovcnt,
                              const int *fds, int num_fds) {
-    if (num_fds == 0) {
-        return send(socket_fd, data, size, 0);
-    }
-
     struct cmsghdr *cmsg;
     struct msghdr msg = {0};
-    struct iovec iov = {
-        .iov_base = (void *)data,
-        .iov_len = size,
-    };
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iovcnt;
+    if (num_fds == 0) {
+        return sendmsg(socket_fd, &msg, MSG_NOSIGNAL);
+    }
 
     char cmsgbuf[CMSG_SPACE(num_fds * sizeof(int))];
-    msg.msg_iov = &iov;
-    msg.msg_iovlen = 1;
     msg.msg_control = cmsgbuf;
     msg.msg_controllen = sizeof(cmsgbuf);
 
@@ -63,7 +66,7 @@ static ssize_t send_with_fds(int socket_fd, const void *data, size_t size,
 
     msg.msg_controllen = cmsg->cmsg_len;
 
-    return sendmsg(socket_fd, &msg, 0);
+    return sendmsg(socket_fd, &msg, MSG_NOSIGNAL);
 }
 
 /* Simple expression evaluator for pixel effects */
@@ -721,13 +724,18 @@ void apply_pixel_effect(uint8_t *pixels, size_t width, size_t height,
 }
 
 int send_event_to_client(struct IPCClient *client, uint16_t type, const void *payload, size_t payload_size) {
+    return send_event_to_client_with_fds(client, type, payload, payload_size, NULL, 0);
+}
+
+int send_event_to_client_with_fds(struct IPCClient *client, uint16_t type, const void *payload,
+                                  size_t payload_size, const int *fds, int num_fds) {
     uint32_t msg_length = sizeof(struct icm_ipc_header) + payload_size;
     uint16_t msg_type = type;
     uint16_t msg_flags = 0;
     uint32_t msg_sequence = 0;
-    int32_t msg_num_fds = 0;
+    int32_t msg_num_fds = num_fds;
 
-    uint8_t buffer[sizeof(struct icm_ipc_header) + payload_size];
+    uint8_t buffer[sizeof(struct icm_ipc_header)];
     
     // Write header in little-endian format
     buffer[0] = msg_length & 0xFF;
@@ -751,16 +759,27 @@ int send_event_to_client(struct IPCClient *client, uint16_t type, const void *pa
     buffer[14] = (msg_num_fds >> 16) & 0xFF;
     buffer[15] = (msg_num_fds >> 24) & 0xFF;
 
-    if (payload_size > 0) {
-        memcpy(buffer + sizeof(struct icm_ipc_header), payload, payload_size);
-    }
+    /* The payload goes out from the caller's memory; large replies such as
+     * screen copies are not copied again */
+    struct iovec iov[2] = {
+        { .iov_base = buffer, .iov_len = sizeof(buffer) },
+        { .iov_base = (void *)payload, .iov_len = payload_size },
+    };
+    int iovcnt = payload_size > 0 ? 2 : 1;
+    struct iovec *pending = iov;
 
     size_t total_size = sizeof(struct icm_ipc_header) + payload_size;
     size_t sent_total = 0;
+
+    /* The ring batches this with everything else sent during the dispatch */
+    if (client->uring_attached) {
+        return ipc_uring_queue_send(client, iov, iovcnt, fds, num_fds);
+    }
     
-    /* Handle partial sends on non-blocking socket */
+    /* Handle partial sends on non-blocking socket; any fds go with the first chunk */
     while (sent_total < total_size) {
-        ssize_t sent = send(client->socket_fd, buffer + sent_total, total_size - sent_total, MSG_NOSIGNAL);
+        ssize_t sent = send_with_fds(client->socket_fd, pending, iovcnt,
+                                     fds, sent_total == 0 ? num_fds : 0);
         if (sent < 0) {
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
                 /* Socket buffer is full, wait and retry */
@@ -771,6 +790,16 @@ int send_event_to_client(struct IPCClient *client, uint16_t type, const void *pa
             return -1;
         }
         sent_total += sent;
+        /* Skip what went out */
+        while (iovcnt > 0 && (size_t)sent >= pending->iov_len) {
+            sent -= pending->iov_len;
+            pending++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            pending->iov_base = (uint8_t *)pending->iov_base + sent;
+            pending->iov_len -= sent;
+        }
     }
     
     return 0;
@@ -783,57 +812,440 @@ void ipc_server_broadcast_shutdown(struct IPCServer *ipc_server) {
     }
 }
 
-void ipc_check_keybind(struct IPCServer *ipc_server, uint32_t modifiers, uint32_t keycode) {
-    struct KeybindEntry *entry, *tmp;
-    wl_list_for_each_safe(entry, tmp, &ipc_server->keybinds, link) {
-        if (entry->modifiers == modifiers && entry->keycode == keycode) {
-            struct icm_msg_keybind_event event = {
-                .keybind_id = entry->keybind_id
-            };
-            if (send_event_to_client(entry->client, ICM_MSG_KEYBIND_EVENT, &event, sizeof(event)) < 0) {
-                /* Client disconnected, it will be cleaned up elsewhere */
-            }
+/* Keybinds are hashed on (modifiers, keycode) with chaining, so a key press
+ * only looks at bindings that can match and several clients can bind the
+ * same combination. */
+#define KEYBIND_MIN_BUCKETS 64
+
+static uint32_t keybind_bucket(const struct IPCServer *ipc_server, uint32_t modifiers,
+                               uint32_t keycode) {
+    uint32_t key = (modifiers << 16) ^ keycode;
+    return (key * 2654435769u) & (ipc_server->keybind_bucket_count - 1);
+}
+
+static int keybind_table_grow(struct IPCServer *ipc_server) {
+    uint32_t count = ipc_server->keybind_bucket_count ?
+        ipc_server->keybind_bucket_count * 2 : KEYBIND_MIN_BUCKETS;
+    struct KeybindEntry **buckets = calloc(count, sizeof(*buckets));
+    if (!buckets) return -1;
+
+    struct KeybindEntry **old = ipc_server->keybind_buckets;
+    uint32_t old_count = ipc_server->keybind_bucket_count;
+    ipc_server->keybind_buckets = buckets;
+    ipc_server->keybind_bucket_count = count;
+
+    for (uint32_t i = 0; i < old_count; i++) {
+        struct KeybindEntry *entry = old[i];
+        while (entry) {
+            struct KeybindEntry *next = entry->next;
+            uint32_t b = keybind_bucket(ipc_server, entry->modifiers, entry->keycode);
+            entry->next = buckets[b];
+            buckets[b] = entry;
+            entry = next;
+        }
+    }
+    free(old);
+    return 0;
+}
+
+static int keybind_add(struct IPCServer *ipc_server, struct KeybindEntry *entry) {
+    if (ipc_server->keybind_count >= ipc_server->keybind_bucket_count &&
+        keybind_table_grow(ipc_server) < 0 && ipc_server->keybind_bucket_count == 0) {
+        return -1;
+    }
+
+    uint32_t b = keybind_bucket(ipc_server, entry->modifiers, entry->keycode);
+    entry->next = ipc_server->keybind_buckets[b];
+    ipc_server->keybind_buckets[b] = entry;
+    ipc_server->keybind_count++;
+    wl_list_insert(&ipc_server->keybinds, &entry->link);
+    return 0;
+}
+
+static void keybind_remove(struct IPCServer *ipc_server, struct KeybindEntry *entry) {
+    uint32_t b = keybind_bucket(ipc_server, entry->modifiers, entry->keycode);
+    for (struct KeybindEntry **pp = &ipc_server->keybind_buckets[b]; *pp; pp = &(*pp)->next) {
+        if (*pp == entry) {
+            *pp = entry->next;
+            break;
+        }
+    }
+    ipc_server->keybind_count--;
+    wl_list_remove(&entry->link);
+    free(entry);
+}
+
+bool ipc_check_keybind(struct IPCServer *ipc_server, uint32_t modifiers, uint32_t keycode) {
+    if (ipc_server->keybind_count == 0) return false;
+
+    bool consume = false;
+    uint32_t b = keybind_bucket(ipc_server, modifiers, keycode);
+    for (struct KeybindEntry *entry = ipc_server->keybind_buckets[b]; entry; entry = entry->next) {
+        if (entry->modifiers != modifiers || entry->keycode != keycode) continue;
+
+        struct icm_msg_keybind_event event = {
+            .keybind_id = entry->keybind_id
+        };
+        if (send_event_to_client(entry->client, ICM_MSG_KEYBIND_EVENT, &event, sizeof(event)) < 0) {
+            /* Client disconnected, it will be cleaned up elsewhere */
+        }
+        if (entry->flags & ICM_KEYBIND_CONSUME) consume = true;
+    }
+    return consume;
+}
+
+/* Click regions are indexed per window in a RegionGrid hung off the window's
+ * registry slot; the click_regions list is only used for cleanup. */
+
+static struct RegionGridRect click_region_rect(const struct ClickRegion *region) {
+    return (struct RegionGridRect){ region->x, region->y, region->width, region->height };
+}
+
+static struct RegionGrid *click_region_grid(struct IPCServer *ipc_server, uint32_t window_id) {
+    struct WindowSlot *slot = window_registry_find(&ipc_server->windows, window_id);
+    return slot ? slot->regions : NULL;
+}
+
+static int click_region_add(struct IPCServer *ipc_server, struct ClickRegion *region) {
+    struct WindowSlot *slot = window_registry_insert(&ipc_server->windows, region->window_id);
+    if (!slot) return -1;
+
+    if (!slot->regions) {
+        slot->regions = calloc(1, sizeof(*slot->regions));
+        if (!slot->regions) {
+            window_registry_release(&ipc_server->windows, slot);
+            return -1;
+        }
+        region_grid_init(slot->regions);
+    }
+
+    struct RegionGridRect rect = click_region_rect(region);
+    if (region_grid_insert(slot->regions, &rect, region) < 0) {
+        if (slot->regions->count == 0) {
+            region_grid_finish(slot->regions);
+            free(slot->regions);
+            slot->regions = NULL;
+            window_registry_release(&ipc_server->windows, slot);
+        }
+        return -1;
+    }
+
+    wl_list_insert(&ipc_server->click_regions, &region->link);
+    wl_list_init(&region->hover_link);
+    if (region->flags & ICM_CLICK_REGION_HOVER) ipc_server->num_hover_regions++;
+    return 0;
+}
+
+static void click_region_remove(struct IPCServer *ipc_server, struct ClickRegion *region) {
+    struct WindowSlot *slot = window_registry_find(&ipc_server->windows, region->window_id);
+    if (slot && slot->regions) {
+        struct RegionGridRect rect = click_region_rect(region);
+        region_grid_remove(slot->regions, &rect, region);
+        if (slot->regions->count == 0) {
+            region_grid_finish(slot->regions);
+            free(slot->regions);
+            slot->regions = NULL;
+            window_registry_release(&ipc_server->windows, slot);
         }
     }
+
+    if (region->flags & ICM_CLICK_REGION_HOVER) ipc_server->num_hover_regions--;
+    wl_list_remove(&region->hover_link);
+    wl_list_remove(&region->link);
+    free(region);
+}
+
+/* Every region of the window under (x, y), in a scratch array that grows to
+ * fit however many overlap there */
+static size_t click_region_hits(struct RegionGrid *grid, int32_t x, int32_t y, void ***hits) {
+    static void **scratch;
+    static size_t capacity;
+    size_t n = region_grid_query_all(grid, x, y, &scratch, &capacity);
+    *hits = scratch;
+    return n;
 }
 
 void ipc_check_click_region(struct IPCServer *ipc_server, uint32_t window_id, int32_t x, int32_t y, uint32_t button, uint32_t state) {
+    struct RegionGrid *grid = click_region_grid(ipc_server, window_id);
+    if (!grid) return;
+
+    void **hits;
+    size_t n = click_region_hits(grid, x, y, &hits);
+
+    for (size_t i = 0; i < n; i++) {
+        struct ClickRegion *region = hits[i];
+        struct icm_msg_click_region_event event = {
+            .region_id = region->region_id,
+            .button = button,
+            .state = state
+        };
+        if (send_event_to_client(region->client, ICM_MSG_CLICK_REGION_EVENT, &event, sizeof(event)) < 0) {
+            /* Client disconnected, it will be cleaned up elsewhere */
+        }
+    }
+}
+
+static void send_region_hover(struct ClickRegion *region, uint32_t entered, int32_t x, int32_t y) {
+    struct icm_msg_region_hover_event event = {
+        .region_id = region->region_id,
+        .entered = entered,
+        .x = x,
+        .y = y
+    };
+    if (send_event_to_client(region->client, ICM_MSG_REGION_HOVER_EVENT, &event, sizeof(event)) < 0) {
+        /* Client disconnected, it will be cleaned up elsewhere */
+    }
+}
+
+void ipc_update_region_hover(struct IPCServer *ipc_server, uint32_t window_id, int32_t x, int32_t y) {
+    if (ipc_server->num_hover_regions == 0) return;
+
+    void **hits = NULL;
+    size_t n = 0;
+    struct RegionGrid *grid = window_id ? click_region_grid(ipc_server, window_id) : NULL;
+    if (grid) {
+        n = click_region_hits(grid, x, y, &hits);
+    }
+
+    /* Mark what is under the pointer now, then diff against the hovered list */
+    uint32_t serial = ++ipc_server->hover_serial;
+    for (size_t i = 0; i < n; i++) {
+        struct ClickRegion *region = hits[i];
+        region->hover_serial = serial;
+    }
+
     struct ClickRegion *region, *tmp;
-    wl_list_for_each_safe(region, tmp, &ipc_server->click_regions, link) {
-        if (region->window_id == window_id &&
-            x >= region->x && x < region->x + (int32_t)region->width &&
-            y >= region->y && y < region->y + (int32_t)region->height) {
-            struct icm_msg_click_region_event event = {
-                .region_id = region->region_id,
-                .button = button,
-                .state = state
-            };
-            if (send_event_to_client(region->client, ICM_MSG_CLICK_REGION_EVENT, &event, sizeof(event)) < 0) {
-                /* Client disconnected, it will be cleaned up elsewhere */
-            }
+    wl_list_for_each_safe(region, tmp, &ipc_server->hovered_regions, hover_link) {
+        if (region->hover_serial == serial) continue;
+        region->hovered = 0;
+        wl_list_remove(&region->hover_link);
+        wl_list_init(&region->hover_link);
+        send_region_hover(region, 0, x, y);
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        region = hits[i];
+        if (!(region->flags & ICM_CLICK_REGION_HOVER) || region->hovered) continue;
+        region->hovered = 1;
+        wl_list_insert(&ipc_server->hovered_regions, &region->hover_link);
+        send_region_hover(region, 1, x, y);
+    }
+}
+
+/* Input subscriptions. Pointer and keyboard subscribers of a window hang off
+ * its registry slot, keyboard subscribers are also kept per client, and the
+ * global listeners have their own lists, so fan-out only visits interested
+ * clients. */
+static struct WindowSubscribers *window_subscribers(struct IPCServer *ipc_server,
+                                                    uint32_t window_id) {
+    struct WindowSlot *slot = window_registry_find(&ipc_server->windows, window_id);
+    return slot ? slot->subscribers : NULL;
+}
+
+static void window_subscribers_release(struct IPCServer *ipc_server, uint32_t window_id) {
+    struct WindowSlot *slot = window_registry_find(&ipc_server->windows, window_id);
+    if (!slot || !slot->subscribers) return;
+    if (!wl_list_empty(&slot->subscribers->pointer) || !wl_list_empty(&slot->subscribers->keyboard)) {
+        return;
+    }
+    free(slot->subscribers);
+    slot->subscribers = NULL;
+    window_registry_release(&ipc_server->windows, slot);
+}
+
+static struct wl_list *subscriber_list(struct WindowSubscribers *subs, uint32_t type) {
+    return type == ICM_INPUT_EVENT_KEYBOARD ? &subs->keyboard : &subs->pointer;
+}
+
+static int input_subscribe(struct IPCServer *ipc_server, struct IPCClient *client,
+                           uint32_t window_id, uint32_t type) {
+    struct WindowSlot *slot = window_registry_insert(&ipc_server->windows, window_id);
+    if (!slot) return -1;
+    if (!slot->subscribers) {
+        slot->subscribers = calloc(1, sizeof(*slot->subscribers));
+        if (!slot->subscribers) {
+            window_registry_release(&ipc_server->windows, slot);
+            return -1;
+        }
+        wl_list_init(&slot->subscribers->pointer);
+        wl_list_init(&slot->subscribers->keyboard);
+    }
+
+    /* Registering again only makes the window the client's latest */
+    struct InputSubscription *sub;
+    wl_list_for_each(sub, subscriber_list(slot->subscribers, type), window_link) {
+        if (sub->client == client) {
+            wl_list_remove(&sub->client_link);
+            wl_list_insert(&client->input_subscriptions, &sub->client_link);
+            return 0;
         }
     }
+
+    sub = calloc(1, sizeof(*sub));
+    if (!sub) {
+        window_subscribers_release(ipc_server, window_id);
+        return -1;
+    }
+    sub->client = client;
+    sub->window_id = window_id;
+    sub->type = type;
+    wl_list_insert(subscriber_list(slot->subscribers, type), &sub->window_link);
+    wl_list_insert(&client->input_subscriptions, &sub->client_link);
+
+    if (type == ICM_INPUT_EVENT_KEYBOARD && client->num_keyboard_windows++ == 0) {
+        wl_list_insert(&ipc_server->keyboard_clients, &client->keyboard_link);
+    }
+    return 0;
 }
 
-/* Unregister a window from all IPC clients that were listening for events on it */
-void ipc_window_unmap(struct IPCServer *ipc_server, uint32_t window_id) {
+/* Does not release the window's subscriber lists; callers do that once done */
+static void input_subscription_remove(struct InputSubscription *sub) {
+    struct IPCClient *client = sub->client;
+    if (sub->type == ICM_INPUT_EVENT_KEYBOARD && --client->num_keyboard_windows == 0) {
+        wl_list_remove(&client->keyboard_link);
+        wl_list_init(&client->keyboard_link);
+    }
+    wl_list_remove(&sub->window_link);
+    wl_list_remove(&sub->client_link);
+    free(sub);
+}
+
+static void input_unsubscribe(struct IPCServer *ipc_server, struct IPCClient *client,
+                              uint32_t window_id, uint32_t type) {
+    struct WindowSubscribers *subs = window_subscribers(ipc_server, window_id);
+    if (!subs) return;
+
+    struct InputSubscription *sub, *tmp;
+    wl_list_for_each_safe(sub, tmp, subscriber_list(subs, type), window_link) {
+        if (sub->client == client) {
+            input_subscription_remove(sub);
+            break;
+        }
+    }
+    window_subscribers_release(ipc_server, window_id);
+}
+
+static void input_unsubscribe_all(struct IPCServer *ipc_server, struct IPCClient *client,
+                                  uint32_t types) {
+    struct InputSubscription *sub, *tmp;
+    wl_list_for_each_safe(sub, tmp, &client->input_subscriptions, client_link) {
+        if (!(sub->type & types)) continue;
+        uint32_t window_id = sub->window_id;
+        input_subscription_remove(sub);
+        window_subscribers_release(ipc_server, window_id);
+    }
+}
+
+static void ipc_client_drop_subscriptions(struct IPCServer *ipc_server, struct IPCClient *client) {
+    input_unsubscribe_all(ipc_server, client, ICM_INPUT_EVENT_POINTER | ICM_INPUT_EVENT_KEYBOARD);
+    wl_list_remove(&client->global_pointer_link);
+    wl_list_init(&client->global_pointer_link);
+    wl_list_remove(&client->global_keyboard_link);
+    wl_list_init(&client->global_keyboard_link);
+}
+
+/* Disconnecting tears down subscription lists, so clients whose send failed
+ * during a fan-out loop are only dropped once the loop is done */
+static void disconnect_failed_clients(struct IPCServer *ipc_server) {
     struct IPCClient *client, *tmp;
     wl_list_for_each_safe(client, tmp, &ipc_server->clients, link) {
-        /* If this client was listening for events on this window, unregister it */
-        if (client->event_window_id == window_id) {
-            client->registered_pointer = 0;
-            client->registered_keyboard = 0;
-            client->event_window_id = 0;
-            wlr_log(WLR_DEBUG, "Unregistered window %u from IPC client", window_id);
+        if (client->input_send_failed) {
+            ipc_client_disconnect(client);
+        }
+    }
+}
+
+static void send_input_event(struct IPCClient *client, uint16_t type, const void *event,
+                             size_t size, bool *failed, const char *what) {
+    if (client->input_send_failed) return;
+    if (send_event_to_client(client, type, event, size) < 0) {
+        fprintf(stderr, "Failed to send %s, disconnecting client\n", what);
+        client->input_send_failed = 1;
+        *failed = true;
+    }
+}
+
+void ipc_send_pointer_event(struct IPCServer *ipc_server, const struct icm_msg_pointer_event *event) {
+    struct WindowSubscribers *subs = window_subscribers(ipc_server, event->window_id);
+    if (!subs) return;
+
+    bool failed = false;
+    struct InputSubscription *sub;
+    wl_list_for_each(sub, &subs->pointer, window_link) {
+        send_input_event(sub->client, ICM_MSG_POINTER_EVENT, event, sizeof(*event),
+                         &failed, "pointer event");
+    }
+    if (failed) disconnect_failed_clients(ipc_server);
+}
+
+void ipc_send_global_pointer_event(struct IPCServer *ipc_server, const struct icm_msg_pointer_event *event) {
+    bool failed = false;
+    struct IPCClient *client;
+    wl_list_for_each(client, &ipc_server->global_pointer_clients, global_pointer_link) {
+        send_input_event(client, ICM_MSG_POINTER_EVENT, event, sizeof(*event),
+                         &failed, "global pointer event");
+    }
+    if (failed) disconnect_failed_clients(ipc_server);
+}
+
+/* The focused window if the client took its keys, else its latest keyboard window */
+static uint32_t keyboard_event_window(struct IPCClient *client, uint32_t focused_window_id) {
+    uint32_t latest = 0;
+    struct InputSubscription *sub;
+    wl_list_for_each(sub, &client->input_subscriptions, client_link) {
+        if (sub->type != ICM_INPUT_EVENT_KEYBOARD) continue;
+        if (sub->window_id == focused_window_id) return focused_window_id;
+        if (!latest) latest = sub->window_id;
+    }
+    return latest;
+}
+
+void ipc_send_keyboard_event(struct IPCServer *ipc_server, uint32_t time, uint32_t keycode,
+                             uint32_t state, uint32_t modifiers) {
+    struct Server *server = wl_container_of(ipc_server, server, ipc_server);
+    struct icm_msg_keyboard_event kevent = {
+        .time = time,
+        .keycode = keycode,
+        .state = state,
+        .modifiers = modifiers
+    };
+
+    bool failed = false;
+    struct IPCClient *client;
+    wl_list_for_each(client, &ipc_server->keyboard_clients, keyboard_link) {
+        kevent.window_id = keyboard_event_window(client, server->focused_window_id);
+        send_input_event(client, ICM_MSG_KEYBOARD_EVENT, &kevent, sizeof(kevent),
+                         &failed, "keyboard event");
+    }
+
+    kevent.window_id = 0;  /* 0 indicates global scope */
+    wl_list_for_each(client, &ipc_server->global_keyboard_clients, global_keyboard_link) {
+        send_input_event(client, ICM_MSG_KEYBOARD_EVENT, &kevent, sizeof(kevent),
+                         &failed, "global keyboard event");
+    }
+    if (failed) disconnect_failed_clients(ipc_server);
+}
+
+/* Unregister a window from all IPC clients that were listening for events on it */
+void ipc_window_unmap(struct IPCServer *ipc_server, uint32_t window_id) {
+    struct WindowSubscribers *subs = window_subscribers(ipc_server, window_id);
+    if (subs) {
+        struct InputSubscription *sub, *tmp;
+        wl_list_for_each_safe(sub, tmp, &subs->pointer, window_link) {
+            input_subscription_remove(sub);
         }
+        wl_list_for_each_safe(sub, tmp, &subs->keyboard, window_link) {
+            input_subscription_remove(sub);
+        }
+        window_subscribers_release(ipc_server, window_id);
+        wlr_log(WLR_DEBUG, "Unregistered window %u from IPC clients", window_id);
     }
     
     /* Clean up click regions for this window */
     struct ClickRegion *region, *region_tmp;
     wl_list_for_each_safe(region, region_tmp, &ipc_server->click_regions, link) {
         if (region->window_id == window_id) {
-            wl_list_remove(&region->link);
-            free(region);
+            click_region_remove(ipc_server, region);
         }
     }
 }
@@ -873,9 +1285,78 @@ static ssize_t recv_with_fds(int socket_fd, void *data, size_t size,
 }
 
 /* Buffer management */
-struct BufferEntry *ipc_buffer_create(struct IPCServer *ipc_server, uint32_t buffer_id,
-                                       int32_t width, int32_t height, uint32_t format) {
-    struct BufferEntry *entry = calloc(1, sizeof(*entry));
+
+static void swapchain_handle_release(struct wl_listener *listener, void *data) {
+    struct IPCPixelBuffer *slot = wl_container_of(listener, slot, release);
+    slot->busy = false;
+}
+
+/*
+ * Pixels in a memfd for the client to map read-write. Seals keep the client
+ * from shrinking the file under our mapping, which would fault on the next
+ * access.
+ */
+static struct IPCPixelBuffer *shared_pixel_buffer_create(int32_t width, int32_t height) {
+    size_t size = (size_t)width * height * 4;
+    int fd = memfd_create("icm-window", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        wlr_log(WLR_ERROR, "Failed to create window memfd: %s", strerror(errno));
+        return NULL;
+    }
+    if (ftruncate(fd, size) < 0) {
+        wlr_log(WLR_ERROR, "Failed to size window memfd: %s", strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    /* Unsealed, a client could shrink the file and fault our mapping */
+    if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0) {
+        wlr_log(WLR_ERROR, "Failed to seal window memfd: %s", strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        wlr_log(WLR_ERROR, "Failed to map window memfd: %s", strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    struct IPCPixelBuffer *buffer = ipc_pixel_buffer_wrap(data, fd, width, height, 0x34325241); // ARGB
+    if (!buffer) {
+        munmap(data, size);
+        close(fd);
+    }
+    return buffer;
+}
+
+/* A new slot is entirely stale: it is filled in when first made the back */
+static struct IPCPixelBuffer *swapchain_add(struct BufferSwapchain *chain,
+                                            int32_t width, int32_t height) {
+    if (chain->count == IPC_SWAPCHAIN_MAX || (chain->shared && chain->count > 0)) return NULL;
+    struct IPCPixelBuffer *slot = chain->shared
+        ? shared_pixel_buffer_create(width, height)
+        : ipc_pixel_buffer_create(width, height, 0x34325241); // ARGB
+    if (!slot) return NULL;
+    slot->release.notify = swapchain_handle_release;
+    wl_signal_add(&slot->base.events.release, &slot->release);
+    pixman_region32_union_rect(&slot->stale, &slot->stale, 0, 0, width, height);
+    chain->slots[chain->count++] = slot;
+    return slot;
+}
+
+/* Slots still locked by a texture are freed when it lets go */
+static void swapchain_finish(struct BufferSwapchain *chain) {
+    for (uint32_t i = 0; i < chain->count; i++) {
+        wlr_buffer_drop(&chain->slots[i]->base);
+    }
+    memset(chain, 0, sizeof(*chain));
+}
+
+/* Without pixels the entry has no CPU storage; the caller attaches a DMABUF */
+static struct BufferEntry *buffer_entry_create(struct IPCServer *ipc_server, uint32_t buffer_id,
+                                               int32_t width, int32_t height, uint32_t format,
+                                               bool pixels) {
+    struct BufferEntry *entry = slab_alloc(&ipc_server->buffers);
     if (!entry) return NULL;
 
     entry->buffer_id = buffer_id;
@@ -884,63 +1365,345 @@ struct BufferEntry *ipc_buffer_create(struct IPCServer *ipc_server, uint32_t buf
     entry->width = width;
     entry->height = height;
     entry->format = format;
-    entry->dmabuf_fd = -1;
     entry->visible = 1;
     entry->dirty = 0;
     entry->opacity = 1.0f;
     entry->blur_radius = 0.0f;
     entry->blur_enabled = 0;
-    entry->effect_enabled = 0;
-    entry->effect_dirty = 0;
-    entry->use_effect_buffer = 0;
-    entry->effect_equation[0] = '\0';
-    entry->effect_data = NULL;
-    entry->effect_data_size = 0;
-    entry->has_transform_matrix = 0;
     entry->scale_x = 1.0f;
     entry->scale_y = 1.0f;
     entry->rotation = 0.0f;
-    entry->num_planes = 0;
 
-    /* Allocate CPU-accessible buffer */
-    uint32_t stride = width * 4;  /* Assume RGBA */
-    entry->size = stride * height;
-    entry->data = malloc(entry->size);
-    if (!entry->data) {
-        free(entry);
+    /* Allocate CPU-accessible buffer; the swapchain grows on present */
+    if (pixels) {
+        uint32_t stride = width * 4;  /* Assume RGBA */
+        entry->size = stride * height;
+        struct IPCPixelBuffer *back = swapchain_add(&entry->swapchain, width, height);
+        if (!back) {
+            slab_free(&ipc_server->buffers, entry);
+            return NULL;
+        }
+        pixman_region32_clear(&back->stale);
+        memset(back->data, 0, entry->size);    /* pooled pages hold old pixels */
+        entry->swapchain.back = back;
+        entry->data = back->data;
+    }
+    pixman_region32_init(&entry->damage);
+
+    struct WindowSlot *slot = window_registry_insert(&ipc_server->windows, buffer_id);
+    if (!slot) {
+        pixman_region32_fini(&entry->damage);
+        swapchain_finish(&entry->swapchain);
+        slab_free(&ipc_server->buffers, entry);
         return NULL;
     }
-
-    wl_list_insert(&ipc_server->buffers, &entry->link);
+    slot->buffer = entry;
+    slot->buffer_count++;
     return entry;
 }
 
+struct BufferEntry *ipc_buffer_create(struct IPCServer *ipc_server, uint32_t buffer_id,
+                                       int32_t width, int32_t height, uint32_t format) {
+    return buffer_entry_create(ipc_server, buffer_id, width, height, format, true);
+}
+
+/* Release the texture made from the pixels; the next frame makes a new one
+ * from the whole buffer */
+void ipc_buffer_drop_textures(struct BufferEntry *buffer) {
+    if (buffer->texture_buffer) {
+        wlr_buffer_unlock(&buffer->texture_buffer->base);
+        buffer->texture_buffer = NULL;
+    }
+}
+
+/*
+ * Make the back buffer the front for the renderer to read, with
+ * buffer->damage as what changed since the previous front. Call
+ * ipc_buffer_swap once the renderer holds it.
+ */
+struct wlr_buffer *ipc_buffer_present(struct BufferEntry *buffer) {
+    struct BufferSwapchain *chain = &buffer->swapchain;
+    chain->front = chain->back;
+    for (uint32_t i = 0; i < chain->count; i++) {
+        struct IPCPixelBuffer *slot = chain->slots[i];
+        if (slot != chain->front)
+            pixman_region32_union(&slot->stale, &slot->stale, &buffer->damage);
+    }
+    return &chain->front->base;
+}
+
+/*
+ * Pick a back buffer the renderer is done with, adding one if all are in
+ * use, and copy forward only its stale pixels. If every slot is still
+ * locked, draws keep going to the front until one is released.
+ */
+void ipc_buffer_swap(struct BufferEntry *buffer) {
+    struct BufferSwapchain *chain = &buffer->swapchain;
+    struct IPCPixelBuffer *front = chain->front;
+    if (!front || chain->shared) return;
+    front->busy = front->base.n_locks > 0;
+
+    struct IPCPixelBuffer *back = NULL;
+    for (uint32_t i = 0; i < chain->count && !back; i++) {
+        struct IPCPixelBuffer *slot = chain->slots[i];
+        if (slot != front && !slot->busy) back = slot;
+    }
+    if (!back) back = swapchain_add(chain, front->width, front->height);
+    if (!back) return;
+
+    struct RasterImage dst = {back->data, back->width, back->height, back->width};
+    struct RasterImage src = {front->data, front->width, front->height, front->width};
+    int n;
+    pixman_box32_t *rects = pixman_region32_rectangles(&back->stale, &n);
+    for (int i = 0; i < n; i++) {
+        raster_copy_rect(&dst, rects[i].x1, rects[i].y1, &src, rects[i].x1, rects[i].y1,
+                         rects[i].x2 - rects[i].x1, rects[i].y2 - rects[i].y1);
+    }
+    pixman_region32_clear(&back->stale);
+
+    chain->back = back;
+    buffer->data = back->data;
+}
+
+/*
+ * Move the pixels into a new buffer of the given size, dropping the old
+ * swapchain. The scene node stays; the next frame gives it a texture made
+ * from the whole new buffer.
+ */
+int ipc_buffer_resize(struct BufferEntry *buffer, uint32_t width, uint32_t height, uint32_t mode) {
+    struct IPCPixelBuffer *old = buffer->swapchain.back;
+    if (!old) return -1;    /* DMABUFs keep the size they were imported with */
+    struct BufferSwapchain chain = {.shared = buffer->swapchain.shared};
+    struct IPCPixelBuffer *back = swapchain_add(&chain, width, height);
+    if (!back) return -1;
+    pixman_region32_clear(&back->stale);
+
+    struct RasterImage dst = {back->data, width, height, width};
+    struct RasterImage src = {old->data, old->width, old->height, old->width};
+    if (mode == ICM_RESIZE_SCALE) {
+        /* Passed as opaque so pixels replace the new buffer's instead of
+         * blending onto them; translucent edges may pick up a little color
+         * from transparent neighbours until the client redraws */
+        enum RasterFilter filter = width <= (uint32_t)old->width && height <= (uint32_t)old->height
+            ? RASTER_FILTER_BOX : RASTER_FILTER_BILINEAR;
+        if (raster_scale_image(&dst, 0, 0, width, height, &src, 0, 0, old->width, old->height,
+                               filter, 255, true) < 0) {
+            swapchain_finish(&chain);
+            return -1;
+        }
+    } else {
+        uint32_t keep_w = 0, keep_h = 0;
+        if (mode == ICM_RESIZE_KEEP) {
+            keep_w = width < (uint32_t)old->width ? width : (uint32_t)old->width;
+            keep_h = height < (uint32_t)old->height ? height : (uint32_t)old->height;
+        }
+        raster_copy_rect(&dst, 0, 0, &src, 0, 0, keep_w, keep_h);
+        raster_fill_rect(&dst, keep_w, 0, width - keep_w, keep_h, 0);
+        raster_fill_rect(&dst, 0, keep_h, width, height - keep_h, 0);
+    }
+
+    swapchain_finish(&buffer->swapchain);
+    chain.back = back;
+    buffer->swapchain = chain;
+    buffer->data = back->data;
+    buffer->width = width;
+    buffer->height = height;
+    buffer->size = back->size;
+    ipc_buffer_drop_textures(buffer);
+    pixman_region32_clear(&buffer->damage);
+    buffer->dirty = 1;
+    return 0;
+}
+
+/*
+ * Move the pixels into a memfd the client can map, replacing the swapchain.
+ * From then on the client draws into the mapping and reports what it changed
+ * with COMMIT_BUFFER; compositor-side draws land in the same memory.
+ */
+int ipc_buffer_share(struct BufferEntry *buffer) {
+    if (buffer->swapchain.shared) return 0;
+
+    struct IPCPixelBuffer *old = buffer->swapchain.back;
+    struct BufferSwapchain chain = {.shared = true};
+    struct IPCPixelBuffer *back = swapchain_add(&chain, old->width, old->height);
+    if (!back) return -1;
+    memcpy(back->data, old->data, old->size);
+    pixman_region32_clear(&back->stale);
+
+    swapchain_finish(&buffer->swapchain);
+    chain.back = back;
+    buffer->swapchain = chain;
+    buffer->data = back->data;
+    return 0;
+}
+
+/* Retained rects hang off a scene tree created with the first one */
+static struct BufferRects *buffer_rects(struct BufferEntry *buffer) {
+    if (buffer->rects) return buffer->rects;
+
+    struct BufferRects *rects = calloc(1, sizeof(*rects));
+    if (!rects) return NULL;
+    struct wlr_scene_tree *parent = buffer->scene_buffer
+        ? buffer->scene_buffer->node.parent : layers[LyrNormal];
+    rects->tree = wlr_scene_tree_create(parent);
+    if (!rects->tree) {
+        free(rects);
+        return NULL;
+    }
+    /* Shown by ipc_buffer_sync_rects once it sits next to the buffer */
+    wlr_scene_node_set_enabled(&rects->tree->node, false);
+    rects->scale_x = buffer->scale_x;
+    rects->scale_y = buffer->scale_y;
+    rects->opacity = buffer->opacity;
+    buffer->rects = rects;
+    return rects;
+}
+
+static void buffer_rects_destroy(struct BufferEntry *buffer) {
+    struct BufferRects *rects = buffer->rects;
+    if (!rects) return;
+    wlr_scene_node_destroy(&rects->tree->node);
+    free(rects->entries);
+    free(rects->images);
+    free(rects);
+    buffer->rects = NULL;
+}
+
+static void retained_image_remove(struct BufferRects *rects, struct RetainedImage *image) {
+    wlr_scene_node_destroy(&image->node->node);
+    *image = rects->images[--rects->num_images];
+}
+
+/* Point every window's image of buffer_id at dmabuf again, which repaints
+ * them with its new contents, or remove them if dmabuf is NULL */
+static void retained_images_update(struct IPCServer *ipc_server, uint32_t buffer_id,
+                                   struct BufferDmabuf *dmabuf) {
+    struct BufferEntry *buffer;
+    slab_for_each(buffer, &ipc_server->buffers) {
+        struct BufferRects *rects = buffer->rects;
+        for (uint32_t i = 0; rects && i < rects->num_images;) {
+            struct RetainedImage *image = &rects->images[i];
+            if (image->buffer_id != buffer_id) {
+                i++;
+            } else if (!dmabuf) {
+                retained_image_remove(rects, image);
+            } else {
+                wlr_scene_buffer_set_buffer(image->node, &dmabuf->base);
+                i++;
+            }
+        }
+    }
+}
+
 void ipc_buffer_destroy(struct IPCServer *ipc_server, uint32_t buffer_id) {
-    struct BufferEntry *entry, *tmp;
-    wl_list_for_each_safe(entry, tmp, &ipc_server->buffers, link) {
-        if (entry->buffer_id == buffer_id) {
-            wl_list_remove(&entry->link);
-            if (entry->data) free(entry->data);
-            if (entry->effect_data) free(entry->effect_data);
-            if (entry->dmabuf_fd >= 0) close(entry->dmabuf_fd);
-            if (entry->wlr_buffer) {
-                wlr_buffer_drop(entry->wlr_buffer);
-                entry->wlr_buffer = NULL;
+    struct WindowSlot *slot = window_registry_find(&ipc_server->windows, buffer_id);
+    if (!slot || !slot->buffer) return;
+
+    struct BufferEntry *entry = slot->buffer;
+    if (entry->effect) {
+        if (entry->effect->pixels) wlr_buffer_drop(&entry->effect->pixels->base);
+        free(entry->effect);
+    }
+    if (entry->dmabuf) {
+        retained_images_update(ipc_server, buffer_id, NULL);
+        wlr_buffer_drop(&entry->dmabuf->base);
+    }
+    free(entry->anim);
+    free(entry->transform_matrix);
+    buffer_rects_destroy(entry);
+    if (entry->scene_buffer) {
+        wlr_scene_node_destroy(&entry->scene_buffer->node);
+        entry->scene_buffer = NULL;
+    }
+    ipc_buffer_drop_textures(entry);
+    swapchain_finish(&entry->swapchain);
+    pixman_region32_fini(&entry->damage);
+    slab_free(&ipc_server->buffers, entry);
+
+    /* A reused id falls back to the newest older buffer; the slab keeps
+     * allocation order, so that is the last match */
+    slot->buffer = NULL;
+    if (--slot->buffer_count > 0) {
+        for (uint32_t i = ipc_server->buffers.count; i-- > 0;) {
+            struct BufferEntry *other = ipc_server->buffers.dense[i];
+            if (other->buffer_id == buffer_id) {
+                slot->buffer = other;
+                break;
             }
-            free(entry);
-            return;
         }
     }
+    window_registry_release(&ipc_server->windows, slot);
 }
 
 struct BufferEntry *ipc_buffer_get(struct IPCServer *ipc_server, uint32_t buffer_id) {
-    struct BufferEntry *entry;
-    wl_list_for_each(entry, &ipc_server->buffers, link) {
-        if (entry->buffer_id == buffer_id) {
-            return entry;
-        }
+    struct WindowSlot *slot = window_registry_find(&ipc_server->windows, buffer_id);
+    return slot ? slot->buffer : NULL;
+}
+
+/* For references that may outlive the buffer; stale handles return NULL */
+struct BufferEntry *ipc_buffer_from_handle(struct IPCServer *ipc_server, uint32_t handle) {
+    return slab_get(&ipc_server->buffers, handle);
+}
+
+/* Side structs are allocated on first use and live until the buffer dies */
+static struct BufferEffect *buffer_effect(struct BufferEntry *buffer) {
+    if (!buffer->effect) buffer->effect = calloc(1, sizeof(*buffer->effect));
+    return buffer->effect;
+}
+
+static struct BufferAnimation *buffer_animation(struct BufferEntry *buffer) {
+    if (!buffer->anim) buffer->anim = calloc(1, sizeof(*buffer->anim));
+    return buffer->anim;
+}
+
+static float *buffer_transform_matrix(struct BufferEntry *buffer) {
+    if (!buffer->transform_matrix) {
+        buffer->transform_matrix = calloc(16, sizeof(*buffer->transform_matrix));
     }
-    return NULL;
+    return buffer->transform_matrix;
+}
+
+/* Views and layer surfaces are registered for their whole lifetime by main.c */
+void ipc_window_register_view(struct IPCServer *ipc_server, struct View *view) {
+    struct WindowSlot *slot = window_registry_insert(&ipc_server->windows, view->window_id);
+    if (!slot) {
+        wlr_log(WLR_ERROR, "Failed to register window %u", view->window_id);
+        return;
+    }
+    slot->view = view;
+}
+
+void ipc_window_unregister_view(struct IPCServer *ipc_server, struct View *view) {
+    struct WindowSlot *slot = window_registry_find(&ipc_server->windows, view->window_id);
+    if (!slot || slot->view != view) return;
+    slot->view = NULL;
+    window_registry_release(&ipc_server->windows, slot);
+}
+
+void ipc_window_register_layer_surface(struct IPCServer *ipc_server, struct LayerSurface *layer_surf) {
+    struct WindowSlot *slot = window_registry_insert(&ipc_server->windows, layer_surf->window_id);
+    if (!slot) {
+        wlr_log(WLR_ERROR, "Failed to register window %u", layer_surf->window_id);
+        return;
+    }
+    slot->layer_surf = layer_surf;
+}
+
+void ipc_window_unregister_layer_surface(struct IPCServer *ipc_server, struct LayerSurface *layer_surf) {
+    struct WindowSlot *slot = window_registry_find(&ipc_server->windows, layer_surf->window_id);
+    if (!slot || slot->layer_surf != layer_surf) return;
+    slot->layer_surf = NULL;
+    window_registry_release(&ipc_server->windows, slot);
+}
+
+struct View *ipc_view_get(struct IPCServer *ipc_server, uint32_t window_id) {
+    struct WindowSlot *slot = window_registry_find(&ipc_server->windows, window_id);
+    return slot ? slot->view : NULL;
+}
+
+struct LayerSurface *ipc_layer_surface_get(struct IPCServer *ipc_server, uint32_t window_id) {
+    struct WindowSlot *slot = window_registry_find(&ipc_server->windows, window_id);
+    return slot ? slot->layer_surf : NULL;
 }
 
 /* Helper: schedule frame redraw on all outputs */
@@ -1008,40 +1771,55 @@ static void apply_scene_matrix_iter(struct wlr_scene_buffer *scene_buffer,
     }
 }
 
-/* Helper: Draw a filled rectangle in RGBA buffer */
-static void draw_rect_in_buffer(uint8_t *pixels, uint32_t width, uint32_t height,
-                                int32_t x, int32_t y, uint32_t rect_width, uint32_t rect_height,
-                                uint32_t color_rgba) {
-    // Clamp rectangle to buffer bounds
-    if (x < 0) x = 0;
-    if (y < 0) y = 0;
-    if (x + rect_width > width) rect_width = width - x;
-    if (y + rect_height > height) rect_height = height - y;
-    
-    uint8_t r = (color_rgba >> 24) & 0xFF;
-    uint8_t g = (color_rgba >> 16) & 0xFF;
-    uint8_t b = (color_rgba >> 8) & 0xFF;
-    uint8_t a = color_rgba & 0xFF;
-    
-    for (uint32_t row = y; row < y + rect_height; row++) {
-        for (uint32_t col = x; col < x + rect_width; col++) {
-            uint32_t idx = (row * width + col) * 4;
-            
-            // Blend with alpha
-            if (a == 255) {
-                pixels[idx] = r;
-                pixels[idx + 1] = g;
-                pixels[idx + 2] = b;
-                pixels[idx + 3] = a;
-            } else if (a > 0) {
-                float alpha = a / 255.0f;
-                pixels[idx] = (uint8_t)(pixels[idx] * (1 - alpha) + r * alpha);
-                pixels[idx + 1] = (uint8_t)(pixels[idx + 1] * (1 - alpha) + g * alpha);
-                pixels[idx + 2] = (uint8_t)(pixels[idx + 2] * (1 - alpha) + b * alpha);
-                pixels[idx + 3] = (a > pixels[idx + 3]) ? a : pixels[idx + 3];
-            }
-        }
+/* Imported DMABUFs have no CPU pixels; only retained nodes can go on them */
+static bool buffer_check_cpu_draw(const struct BufferEntry *buffer) {
+    if (buffer->dmabuf) {
+        fprintf(stderr, "buffer %u is dmabuf-backed\n", buffer->buffer_id);
+        return false;
     }
+    return true;
+}
+
+/* Raster view of a CPU buffer; rows past the end of a short allocation are cut off */
+static struct RasterImage buffer_raster_image(const struct BufferEntry *buffer) {
+    struct RasterImage image = {0};
+    if (!buffer->data || buffer->width <= 0 || buffer->height <= 0) return image;
+
+    size_t rows = buffer->size / ((size_t)buffer->width * 4);
+    image.pixels = buffer->data;
+    image.width = buffer->width;
+    image.height = rows < (size_t)buffer->height ? (int32_t)rows : buffer->height;
+    image.stride = buffer->width;
+    return image;
+}
+
+/* Note a changed rect, clipped to the buffer, for the next texture upload */
+static void buffer_damage(struct BufferEntry *buffer, int64_t x, int64_t y,
+                          int64_t width, int64_t height) {
+    int64_t x1 = x + width, y1 = y + height;
+    if (x < 0) x = 0;
+    if (y < 0) y = 0;
+    if (x1 > buffer->width) x1 = buffer->width;
+    if (y1 > buffer->height) y1 = buffer->height;
+    if (x >= x1 || y >= y1) return;
+
+    pixman_region32_union_rect(&buffer->damage, &buffer->damage, (int)x, (int)y,
+                               (unsigned int)(x1 - x), (unsigned int)(y1 - y));
+    buffer->dirty = 1;
+}
+
+static void buffer_damage_all(struct BufferEntry *buffer) {
+    buffer_damage(buffer, 0, 0, buffer->width, buffer->height);
+}
+
+/* Helper: Blend a filled rectangle of an RGBA (0xRRGGBBAA) color into a buffer */
+static void draw_rect_in_buffer(struct BufferEntry *buffer,
+                                int32_t x, int32_t y, uint32_t rect_width, uint32_t rect_height,
+                                uint32_t color_rgba) {
+    struct RasterImage dst = buffer_raster_image(buffer);
+    /* Buffers hold ARGB words */
+    raster_blend_rect(&dst, x, y, rect_width, rect_height, color_rgba >> 8 | color_rgba << 24);
+    buffer_damage(buffer, x, y, rect_width, rect_height);
 }
 
 /* Helper: Render decorations on a window buffer */
@@ -1060,36 +1838,31 @@ static void render_window_decorations(struct BufferEntry *buffer, struct IPCServ
     
     // Draw title bar
     if (title_height > 0) {
-        draw_rect_in_buffer(buffer->data, buffer->width, buffer->height,
-                          0, 0, buffer->width, title_height, color);
+        draw_rect_in_buffer(buffer, 0, 0, buffer->width, title_height, color);
     }
     
     // Draw borders
     if (border_width > 0) {
         // Top border (already drawn if title_height > 0)
         if (title_height == 0) {
-            draw_rect_in_buffer(buffer->data, buffer->width, buffer->height,
-                              0, 0, buffer->width, border_width, color);
+            draw_rect_in_buffer(buffer, 0, 0, buffer->width, border_width, color);
         }
         
         // Bottom border
-        draw_rect_in_buffer(buffer->data, buffer->width, buffer->height,
-                          0, buffer->height - border_width, buffer->width, border_width, color);
+        draw_rect_in_buffer(buffer, 0, buffer->height - border_width, buffer->width, border_width, color);
         
         // Left border
-        draw_rect_in_buffer(buffer->data, buffer->width, buffer->height,
-                          0, 0, border_width, buffer->height, color);
+        draw_rect_in_buffer(buffer, 0, 0, border_width, buffer->height, color);
         
         // Right border
-        draw_rect_in_buffer(buffer->data, buffer->width, buffer->height,
-                          buffer->width - border_width, 0, border_width, buffer->height, color);
+        draw_rect_in_buffer(buffer, buffer->width - border_width, 0, border_width, buffer->height, color);
     }
 }
 
 struct ImageEntry *ipc_image_create(struct IPCServer *ipc_server, uint32_t image_id,
                                     uint32_t width, uint32_t height, uint32_t format,
                                     const uint8_t *data, size_t data_size) {
-    struct ImageEntry *entry = calloc(1, sizeof(*entry));
+    struct ImageEntry *entry = slab_alloc(&ipc_server->images);
     if (!entry) return NULL;
 
     entry->image_id = image_id;
@@ -1097,32 +1870,43 @@ struct ImageEntry *ipc_image_create(struct IPCServer *ipc_server, uint32_t image
     entry->height = height;
     entry->format = format;
     entry->data_size = data_size;
-    entry->data = malloc(data_size);
+    entry->data = pixel_pool_alloc(data_size);
     if (!entry->data) {
-        free(entry);
+        slab_free(&ipc_server->images, entry);
         return NULL;
     }
     memcpy(entry->data, data, data_size);
 
-    wl_list_insert(&ipc_server->images, &entry->link);
+    /* Store pixels as ARGB words like the buffers they are drawn into, so
+     * blits need no per-pixel conversion */
+    size_t pixels = data_size / 4;
+    if ((uint64_t)width * height < pixels) pixels = (size_t)width * height;
+    if (format == 0) {
+        raster_ops->swizzle((uint32_t *)entry->data, (uint32_t *)entry->data, pixels);
+    }
+    entry->opaque = raster_is_opaque((uint32_t *)entry->data, pixels);
     return entry;
 }
 
-void ipc_image_destroy(struct IPCServer *ipc_server, uint32_t image_id) {
-    struct ImageEntry *entry, *tmp;
-    wl_list_for_each_safe(entry, tmp, &ipc_server->images, link) {
-        if (entry->image_id == image_id) {
-            wl_list_remove(&entry->link);
-            if (entry->data) free(entry->data);
-            free(entry);
-            return;
-        }
+static struct RasterImage image_raster_image(const struct ImageEntry *image) {
+    struct RasterImage raster = {0};
+    if (!image->data || image->width == 0 || image->height == 0 ||
+        image->width > INT32_MAX || image->height > INT32_MAX) {
+        return raster;
     }
+
+    size_t rows = image->data_size / ((size_t)image->width * 4);
+    raster.pixels = (uint32_t *)image->data;
+    raster.width = image->width;
+    raster.height = rows < image->height ? (int32_t)rows : (int32_t)image->height;
+    raster.stride = image->width;
+    return raster;
 }
 
+/* Newest first, matching the old list order when an image id is reused */
 struct ImageEntry *ipc_image_get(struct IPCServer *ipc_server, uint32_t image_id) {
-    struct ImageEntry *entry;
-    wl_list_for_each(entry, &ipc_server->images, link) {
+    for (uint32_t i = ipc_server->images.count; i-- > 0;) {
+        struct ImageEntry *entry = ipc_server->images.dense[i];
         if (entry->image_id == image_id) {
             return entry;
         }
@@ -1130,8 +1914,15 @@ struct ImageEntry *ipc_image_get(struct IPCServer *ipc_server, uint32_t image_id
     return NULL;
 }
 
+void ipc_image_destroy(struct IPCServer *ipc_server, uint32_t image_id) {
+    struct ImageEntry *entry = ipc_image_get(ipc_server, image_id);
+    if (!entry) return;
+    pixel_pool_free(entry->data, entry->data_size);
+    slab_free(&ipc_server->images, entry);
+}
+
 void ipc_client_disconnect(struct IPCClient *client) {
-    if (!client) return;
+    if (!client || client->closing) return;
 
     wl_list_remove(&client->link);
 
@@ -1139,8 +1930,7 @@ void ipc_client_disconnect(struct IPCClient *client) {
     struct KeybindEntry *kb, *kb_tmp;
     wl_list_for_each_safe(kb, kb_tmp, &client->server->ipc_server.keybinds, link) {
         if (kb->client == client) {
-            wl_list_remove(&kb->link);
-            free(kb);
+            keybind_remove(&client->server->ipc_server, kb);
         }
     }
 
@@ -1148,8 +1938,7 @@ void ipc_client_disconnect(struct IPCClient *client) {
     struct ClickRegion *cr, *cr_tmp;
     wl_list_for_each_safe(cr, cr_tmp, &client->server->ipc_server.click_regions, link) {
         if (cr->client == client) {
-            wl_list_remove(&cr->link);
-            free(cr);
+            click_region_remove(&client->server->ipc_server, cr);
         }
     }
 
@@ -1162,6 +1951,15 @@ void ipc_client_disconnect(struct IPCClient *client) {
         }
     }
 
+    ipc_client_drop_subscriptions(&client->server->ipc_server, client);
+    ipc_client_drop_input(client);
+
+    if (client->uring_attached) {
+        /* Freed once the kernel is done with the client's buffers */
+        ipc_uring_release_client(client);
+        return;
+    }
+
     if (client->event_source) {
         wl_event_source_remove(client->event_source);
     }
@@ -1170,161 +1968,338 @@ void ipc_client_disconnect(struct IPCClient *client) {
 }
 
 /* Message handlers */
+static void dmabuf_buffer_destroy(struct wlr_buffer *wlr_buffer) {
+    struct BufferDmabuf *dmabuf = wl_container_of(wlr_buffer, dmabuf, base);
+    wlr_buffer_finish(wlr_buffer);
+    wlr_dmabuf_attributes_finish(&dmabuf->attribs);
+    free(dmabuf);
+}
+
+static bool dmabuf_buffer_get_dmabuf(struct wlr_buffer *wlr_buffer,
+                                     struct wlr_dmabuf_attributes *attribs) {
+    struct BufferDmabuf *dmabuf = wl_container_of(wlr_buffer, dmabuf, base);
+    *attribs = dmabuf->attribs;
+    return true;
+}
+
+static const struct wlr_buffer_impl dmabuf_buffer_impl = {
+    .destroy = dmabuf_buffer_destroy,
+    .get_dmabuf = dmabuf_buffer_get_dmabuf,
+};
+
+/*
+ * The planes become a wlr_buffer the scene shows directly, so the pixels
+ * never leave the GPU. The format and modifier must be one the renderer can
+ * sample; anything else would only fail later, on the first frame.
+ */
 static int handle_import_dmabuf(struct IPCServer *ipc_server, struct IPCClient *client,
                                  const struct icm_msg_import_dmabuf *msg,
                                  const int *fds, int num_fds) {
-    if (num_fds < msg->num_planes) {
-        fprintf(stderr, "Not enough FDs for DMABUF planes\n");
-        return -1;
+    uint32_t num_planes = msg->num_planes;
+    if (num_planes == 0 || num_planes > WLR_DMABUF_MAX_PLANES || num_fds < (int)num_planes ||
+        msg->width <= 0 || msg->height <= 0) {
+        fprintf(stderr, "Invalid DMABUF import for buffer %u\n", msg->buffer_id);
+        goto close_fds;
+    }
+
+    /* wlroots takes one modifier for all planes */
+    uint64_t modifier = msg->planes[0].modifier;
+    for (uint32_t i = 1; i < num_planes; i++) {
+        if (msg->planes[i].modifier != modifier) {
+            fprintf(stderr, "DMABUF planes of buffer %u disagree on the modifier\n", msg->buffer_id);
+            goto close_fds;
+        }
+    }
+    const struct wlr_drm_format_set *formats =
+        wlr_renderer_get_texture_formats(ipc_server->server->renderer, WLR_BUFFER_CAP_DMABUF);
+    if (!formats || !wlr_drm_format_set_has(formats, msg->format, modifier)) {
+        wlr_log(WLR_ERROR, "Renderer cannot import DMABUF format 0x%08x modifier 0x%016llx",
+                msg->format, (unsigned long long)modifier);
+        goto close_fds;
     }
 
-    struct BufferEntry *entry = ipc_buffer_create(ipc_server, msg->buffer_id,
-                                                   msg->width, msg->height, msg->format);
-    if (!entry) {
-        return -1;
+    struct BufferDmabuf *dmabuf = calloc(1, sizeof(*dmabuf));
+    if (!dmabuf) goto close_fds;
+    dmabuf->attribs = (struct wlr_dmabuf_attributes){
+        .width = msg->width,
+        .height = msg->height,
+        .format = msg->format,
+        .modifier = modifier,
+        .n_planes = num_planes,
+    };
+    for (uint32_t i = 0; i < num_planes; i++) {
+        dmabuf->attribs.fd[i] = fds[i];
+        dmabuf->attribs.offset[i] = msg->planes[i].offset;
+        dmabuf->attribs.stride[i] = msg->planes[i].stride;
     }
+    for (int i = num_planes; i < num_fds; i++) close(fds[i]);
+    wlr_buffer_init(&dmabuf->base, &dmabuf_buffer_impl, msg->width, msg->height);
 
-    for (uint32_t i = 0; i < msg->num_planes && i < 4; i++) {
-        entry->planes[i].fd = fds[i];
-        entry->planes[i].offset = msg->planes[i].offset;
-        entry->planes[i].stride = msg->planes[i].stride;
-        entry->planes[i].modifier = msg->planes[i].modifier;
+    struct BufferEntry *entry = buffer_entry_create(ipc_server, msg->buffer_id,
+                                                    msg->width, msg->height, msg->format, false);
+    if (!entry) {
+        wlr_buffer_drop(&dmabuf->base);
+        return -1;
     }
-    entry->num_planes = msg->num_planes;
+    entry->dmabuf = dmabuf;
+    entry->dirty = 1;
 
     fprintf(stderr, "Imported DMABUF buffer %u (%dx%d format=%u)\n",
             msg->buffer_id, msg->width, msg->height, msg->format);
+    schedule_frame_update(ipc_server);
+    return 0;
+
+close_fds:
+    for (int i = 0; i < num_fds; i++) close(fds[i]);
+    return -1;
+}
+
+/* True if a payload of size bytes reaches the end of an optional trailing field */
+#define HAS_FIELD(type, field, size) ((size) >= offsetof(type, field) + sizeof(((type *)0)->field))
+
+static struct RetainedRect *retained_rect_find(struct BufferRects *rects, uint32_t rect_id) {
+    for (uint32_t i = 0; i < rects->count; i++) {
+        if (rects->entries[i].rect_id == rect_id) return &rects->entries[i];
+    }
+    return NULL;
+}
+
+/* Lay a rect out in scene coordinates; scene colors are premultiplied */
+static void retained_rect_apply(const struct BufferRects *rects, struct RetainedRect *rect) {
+    float alpha = (rect->color >> 24) / 255.0f * rects->opacity;
+    const float color[4] = {
+        ((rect->color >> 16) & 0xFF) / 255.0f * alpha,
+        ((rect->color >> 8) & 0xFF) / 255.0f * alpha,
+        (rect->color & 0xFF) / 255.0f * alpha,
+        alpha,
+    };
+    wlr_scene_node_set_position(&rect->node->node, (int)(rect->x * rects->scale_x),
+                                (int)(rect->y * rects->scale_y));
+    wlr_scene_rect_set_size(rect->node, (int)(rect->width * rects->scale_x),
+                            (int)(rect->height * rects->scale_y));
+    wlr_scene_rect_set_color(rect->node, color);
+}
+
+static void retained_image_apply(const struct BufferRects *rects, struct RetainedImage *image) {
+    wlr_scene_node_set_position(&image->node->node, (int)(image->x * rects->scale_x),
+                                (int)(image->y * rects->scale_y));
+    wlr_scene_buffer_set_dest_size(image->node, (int)(image->width * rects->scale_x),
+                                   (int)(image->height * rects->scale_y));
+    wlr_scene_buffer_set_opacity(image->node, image->alpha / 255.0f * rects->opacity);
+}
+
+static int retained_rect_set(struct BufferEntry *buffer, const struct icm_msg_draw_rect *msg) {
+    struct BufferRects *rects = buffer_rects(buffer);
+    if (!rects) return -1;
+
+    struct RetainedRect *rect = retained_rect_find(rects, msg->rect_id);
+    if (msg->width == 0 || msg->height == 0) {
+        if (rect) {
+            wlr_scene_node_destroy(&rect->node->node);
+            *rect = rects->entries[--rects->count];
+        }
+        return 0;
+    }
+
+    if (!rect) {
+        if (rects->count == rects->capacity) {
+            uint32_t capacity = rects->capacity ? rects->capacity * 2 : 8;
+            struct RetainedRect *grown = realloc(rects->entries, capacity * sizeof(*grown));
+            if (!grown) return -1;
+            rects->entries = grown;
+            rects->capacity = capacity;
+        }
+        const float clear[4] = {0};
+        struct wlr_scene_rect *node = wlr_scene_rect_create(rects->tree, 0, 0, clear);
+        if (!node) return -1;
+        rect = &rects->entries[rects->count++];
+        rect->rect_id = msg->rect_id;
+        rect->node = node;
+    }
+
+    rect->x = msg->x;
+    rect->y = msg->y;
+    rect->width = msg->width;
+    rect->height = msg->height;
+    rect->color = msg->color_rgba;
+    retained_rect_apply(rects, rect);
     return 0;
 }
 
+/* Called once per frame after the buffer's scene node is updated */
+void ipc_buffer_sync_rects(struct BufferEntry *buffer) {
+    struct BufferRects *rects = buffer->rects;
+    if (!rects) return;
+
+    struct wlr_scene_node *anchor = buffer->scene_buffer ? &buffer->scene_buffer->node : NULL;
+    bool shown = anchor && anchor->enabled;
+    wlr_scene_node_set_enabled(&rects->tree->node, shown);
+    if (!shown) return;
+
+    if (rects->tree->node.parent != anchor->parent) {
+        wlr_scene_node_reparent(&rects->tree->node, anchor->parent);
+    }
+    wlr_scene_node_place_above(&rects->tree->node, anchor);
+    wlr_scene_node_set_position(&rects->tree->node, anchor->x, anchor->y);
+
+    if (rects->scale_x != buffer->scale_x || rects->scale_y != buffer->scale_y ||
+        rects->opacity != buffer->opacity) {
+        rects->scale_x = buffer->scale_x;
+        rects->scale_y = buffer->scale_y;
+        rects->opacity = buffer->opacity;
+        for (uint32_t i = 0; i < rects->count; i++) {
+            retained_rect_apply(rects, &rects->entries[i]);
+        }
+        for (uint32_t i = 0; i < rects->num_images; i++) {
+            retained_image_apply(rects, &rects->images[i]);
+        }
+    }
+}
+
 static int handle_draw_rect(struct IPCServer *ipc_server, struct IPCClient *client,
-                             const struct icm_msg_draw_rect *msg) {
+                             const struct icm_msg_draw_rect *msg, uint32_t payload_size) {
     struct BufferEntry *buffer = ipc_buffer_get(ipc_server, msg->window_id);
     if (!buffer) {
         fprintf(stderr, "Buffer not found for window %u\n", msg->window_id);
         return -1;
     }
 
-    /* Optimized RGBA rect fill using memset */
-    uint32_t color = msg->color_rgba;
-    uint8_t *ptr = (uint8_t *)buffer->data;
-    uint32_t stride = buffer->width * 4;
-
-    int32_t x1 = msg->x;
-    int32_t y1 = msg->y;
-    int32_t x2 = msg->x + msg->width;
-    int32_t y2 = msg->y + msg->height;
-
-    if (x1 < 0) x1 = 0;
-    if (y1 < 0) y1 = 0;
-    if (x2 > (int32_t)buffer->width) x2 = buffer->width;
-    if (y2 > (int32_t)buffer->height) y2 = buffer->height;
-
-    int32_t width = x2 - x1;
-    if (width <= 0) return 0;
-
-    for (int32_t y = y1; y < y2; y++) {
-        uint8_t *row_start = ptr + y * stride + x1 * 4;
-        uint32_t *pixel_ptr = (uint32_t *)row_start;
-        for (int32_t x = 0; x < width; x++) {
-            pixel_ptr[x] = color;
+    uint32_t flags = HAS_FIELD(struct icm_msg_draw_rect, flags, payload_size) ? msg->flags : 0;
+    if ((flags & ICM_DRAW_RECT_RETAINED) && msg->rect_id != 0) {
+        if (retained_rect_set(buffer, msg) < 0) {
+            fprintf(stderr, "DRAW_RECT: cannot retain rect %u of window %u\n",
+                    msg->rect_id, msg->window_id);
+            return -1;
         }
+        schedule_frame_update(ipc_server);
+        return 0;
+    }
+    if (!buffer_check_cpu_draw(buffer)) {
+        return -1;
     }
 
-    buffer->dirty = 1;
+    /* Plain store of the ARGB color, alpha included */
+    struct RasterImage dst = buffer_raster_image(buffer);
+    raster_fill_rect(&dst, msg->x, msg->y, msg->width, msg->height, msg->color_rgba);
+    buffer_damage(buffer, msg->x, msg->y, msg->width, msg->height);
+
     schedule_frame_update(ipc_server);
     return 0;
 }
 
-static int handle_draw_line(struct IPCServer *ipc_server, struct IPCClient *client,
-                             const struct icm_msg_draw_line *msg) {
+static int handle_clear_rects(struct IPCServer *ipc_server, struct IPCClient *client,
+                              const struct icm_msg_clear_rects *msg) {
     struct BufferEntry *buffer = ipc_buffer_get(ipc_server, msg->window_id);
     if (!buffer) {
         return -1;
     }
+    if (buffer->rects) {
+        buffer_rects_destroy(buffer);
+        schedule_frame_update(ipc_server);
+    }
+    return 0;
+}
 
-    /* Bresenham line drawing */
-    uint32_t color = msg->color_rgba;
-    uint8_t *ptr = (uint8_t *)buffer->data;
-    uint32_t stride = buffer->width * 4;
-
-    int dx = abs(msg->x1 - msg->x0);
-    int dy = abs(msg->y1 - msg->y0);
-    int sx = msg->x0 < msg->x1 ? 1 : -1;
-    int sy = msg->y0 < msg->y1 ? 1 : -1;
-    int err = dx - dy;
+static int handle_draw_line(struct IPCServer *ipc_server, struct IPCClient *client,
+                             const struct icm_msg_draw_line *msg, uint32_t payload_size) {
+    struct BufferEntry *buffer = ipc_buffer_get(ipc_server, msg->window_id);
+    if (!buffer || !buffer_check_cpu_draw(buffer)) {
+        return -1;
+    }
 
-    int x = msg->x0, y = msg->y0;
-    while (1) {
-        if (x >= 0 && x < (int)buffer->width && y >= 0 && y < (int)buffer->height) {
-            uint32_t *pixel = (uint32_t *)(ptr + y * stride + x * 4);
-            *pixel = color;
-        }
+    uint32_t flags = HAS_FIELD(struct icm_msg_draw_line, flags, payload_size) ? msg->flags : 0;
+    float width = msg->thickness ? (float)msg->thickness : 1.0f;
 
-        if (x == msg->x1 && y == msg->y1) break;
-        int e2 = 2 * err;
-        if (e2 > -dy) {
-            err -= dy;
-            x += sx;
-        }
-        if (e2 < dx) {
-            err += dx;
-            y += sy;
-        }
+    /* Endpoints name pixels; stroke between their centers */
+    struct RasterImage dst = buffer_raster_image(buffer);
+    if (raster_stroke_line(&dst, msg->x0 + 0.5f, msg->y0 + 0.5f, msg->x1 + 0.5f, msg->y1 + 0.5f,
+                           width, msg->color_rgba, flags & ICM_DRAW_ANTIALIAS) < 0) {
+        return -1;
     }
+    /* Square caps reach half the width past the endpoint pixels */
+    int64_t reach = msg->thickness / 2 + 1;
+    int64_t x0 = msg->x0 < msg->x1 ? msg->x0 : msg->x1;
+    int64_t y0 = msg->y0 < msg->y1 ? msg->y0 : msg->y1;
+    buffer_damage(buffer, x0 - reach, y0 - reach,
+                  llabs((int64_t)msg->x1 - msg->x0) + 2 * reach + 1,
+                  llabs((int64_t)msg->y1 - msg->y0) + 2 * reach + 1);
 
-    buffer->dirty = 1;
     schedule_frame_update(ipc_server);
     return 0;
 }
 
 static int handle_draw_circle(struct IPCServer *ipc_server, struct IPCClient *client,
-                               const struct icm_msg_draw_circle *msg) {
+                               const struct icm_msg_draw_circle *msg, uint32_t payload_size) {
     struct BufferEntry *buffer = ipc_buffer_get(ipc_server, msg->window_id);
-    if (!buffer) {
+    if (!buffer || !buffer_check_cpu_draw(buffer)) {
         return -1;
     }
 
-    uint32_t color = msg->color_rgba;
-    uint8_t *ptr = (uint8_t *)buffer->data;
-    uint32_t stride = buffer->width * 4;
+    uint32_t flags = 0, thickness = 0, radius_y = 0;
+    if (HAS_FIELD(struct icm_msg_draw_circle, flags, payload_size)) flags = msg->flags;
+    if (HAS_FIELD(struct icm_msg_draw_circle, thickness, payload_size)) thickness = msg->thickness;
+    if (HAS_FIELD(struct icm_msg_draw_circle, radius_y, payload_size)) radius_y = msg->radius_y;
 
-    /* Midpoint circle algorithm */
-    int x = 0;
-    int y = msg->radius;
-    int d = 3 - 2 * msg->radius;
-
-    while (x <= y) {
-        int points[8][2] = {
-            {msg->cx + x, msg->cy + y},
-            {msg->cx - x, msg->cy + y},
-            {msg->cx + x, msg->cy - y},
-            {msg->cx - x, msg->cy - y},
-            {msg->cx + y, msg->cy + x},
-            {msg->cx - y, msg->cy + x},
-            {msg->cx + y, msg->cy - x},
-            {msg->cx - y, msg->cy - x},
-        };
+    float rx = (float)msg->radius;
+    float ry = radius_y ? (float)radius_y : rx;
+    float stroke = thickness ? (float)thickness : 1.0f;
+    if (msg->fill) {
+        /* Out to where a 1 pixel outline would end */
+        rx += 0.5f;
+        ry += 0.5f;
+        stroke = 0.0f;
+    }
 
-        for (int i = 0; i < 8; i++) {
-            int px = points[i][0];
-            int py = points[i][1];
-            if (px >= 0 && px < (int)buffer->width && py >= 0 && py < (int)buffer->height) {
-                uint32_t *pixel = (uint32_t *)(ptr + py * stride + px * 4);
-                *pixel = color;
-            }
-        }
+    struct RasterImage dst = buffer_raster_image(buffer);
+    if (raster_draw_ellipse(&dst, msg->cx + 0.5f, msg->cy + 0.5f, rx, ry, stroke,
+                            msg->color_rgba, flags & ICM_DRAW_ANTIALIAS) < 0) {
+        return -1;
+    }
+    int64_t reach_x = (int64_t)ceilf(rx + stroke * 0.5f) + 1;
+    int64_t reach_y = (int64_t)ceilf(ry + stroke * 0.5f) + 1;
+    buffer_damage(buffer, (int64_t)msg->cx - reach_x, (int64_t)msg->cy - reach_y,
+                  2 * reach_x + 1, 2 * reach_y + 1);
 
-        if (d < 0) {
-            d = d + 4 * x + 6;
-        } else {
-            d = d + 4 * (x - y) + 10;
-            y--;
-        }
-        x++;
+    schedule_frame_update(ipc_server);
+    return 0;
+}
+
+/* Damage the pixels spanned by a point list, corners or centers alike */
+static void damage_points(struct BufferEntry *buffer, const int32_t *points, uint32_t num_points) {
+    int32_t x0 = INT32_MAX, y0 = INT32_MAX, x1 = INT32_MIN, y1 = INT32_MIN;
+    for (uint32_t i = 0; i < num_points; i++) {
+        int32_t x = points[i * 2], y = points[i * 2 + 1];
+        if (x < x0) x0 = x;
+        if (x > x1) x1 = x;
+        if (y < y0) y0 = y;
+        if (y > y1) y1 = y;
+    }
+    buffer_damage(buffer, x0, y0, (int64_t)x1 - x0 + 1, (int64_t)y1 - y0 + 1);
+}
+
+static int fill_polygon_in_buffer(struct IPCServer *ipc_server, struct BufferEntry *buffer,
+                                  const int32_t *points, uint32_t num_points,
+                                  enum RasterFillRule rule, uint32_t color) {
+    static struct RasterPoint *path;
+    static uint32_t path_capacity;
+
+    if (num_points > path_capacity) {
+        struct RasterPoint *grown = realloc(path, num_points * sizeof(*grown));
+        if (!grown) return -1;
+        path = grown;
+        path_capacity = num_points;
+    }
+    for (uint32_t i = 0; i < num_points; i++) {
+        path[i].x = (float)points[i * 2];
+        path[i].y = (float)points[i * 2 + 1];
     }
 
-    buffer->dirty = 1;
+    struct RasterImage dst = buffer_raster_image(buffer);
+    if (raster_fill_path(&dst, path, &num_points, 1, rule, color, true) < 0) {
+        return -1;
+    }
+    damage_points(buffer, points, num_points);
+
     schedule_frame_update(ipc_server);
     return 0;
 }
@@ -1337,21 +2312,33 @@ static int handle_draw_polygon(struct IPCServer *ipc_server, struct IPCClient *c
 
     struct icm_msg_draw_polygon *msg = (struct icm_msg_draw_polygon *)payload;
     struct BufferEntry *buffer = ipc_buffer_get(ipc_server, msg->window_id);
-    if (!buffer) {
+    if (!buffer || !buffer_check_cpu_draw(buffer)) {
         return -1;
     }
 
     uint32_t num_points = msg->num_points;
-    if (num_points < 2) {
+    if (num_points < 2 ||
+        num_points > (payload_size - sizeof(*msg)) / (2 * sizeof(int32_t))) {
         return -1;
     }
 
     /* Points are stored right after the message structure */
     int32_t *points = (int32_t *)(payload + sizeof(struct icm_msg_draw_polygon));
 
+    if (msg->fill != ICM_POLYGON_OUTLINE) {
+        if (msg->fill != ICM_POLYGON_FILL_NONZERO && msg->fill != ICM_POLYGON_FILL_EVENODD) {
+            return -1;
+        }
+        return fill_polygon_in_buffer(ipc_server, buffer, points, num_points,
+                                      msg->fill == ICM_POLYGON_FILL_EVENODD
+                                          ? RASTER_FILL_EVENODD : RASTER_FILL_NONZERO,
+                                      msg->color_rgba);
+    }
+
     uint32_t color = msg->color_rgba;
     uint8_t *ptr = (uint8_t *)buffer->data;
     uint32_t stride = buffer->width * 4;
+    if (!ptr) return -1;
 
     /* Draw lines between consecutive points */
     for (uint32_t i = 0; i < num_points; i++) {
@@ -1386,8 +2373,8 @@ static int handle_draw_polygon(struct IPCServer *ipc_server, struct IPCClient *c
             }
         }
     }
+    damage_points(buffer, points, num_points);
 
-    buffer->dirty = 1;
     schedule_frame_update(ipc_server);
     return 0;
 }
@@ -1408,8 +2395,8 @@ static int handle_create_buffer(struct IPCServer *ipc_server, struct IPCClient *
     
     /* Start fade-in animation */
     if (entry->opacity < 1.0f) {
-        start_buffer_animation(entry, 300); // 300ms fade-in
-        entry->target_opacity = 1.0f;
+        struct BufferAnimation *anim = start_buffer_animation(entry, 300); // 300ms fade-in
+        if (anim) anim->target_opacity = 1.0f;
     }
 
     /* Send window created event to all clients */
@@ -1420,14 +2407,8 @@ static int handle_create_buffer(struct IPCServer *ipc_server, struct IPCClient *
         .decorated = entry->decorated,
         .focused = entry->focused
     };
-    
-    struct IPCClient *c, *tmp;
-    wl_list_for_each_safe(c, tmp, &ipc_server->clients, link) {
-        fprintf(stderr, "Sending WINDOW_CREATED event to client\n");
-        if (send_event_to_client(c, ICM_MSG_WINDOW_CREATED, &event, sizeof(event)) < 0) {
-            /* Client disconnected, will be cleaned up elsewhere */
-        }
-    }
+    ipc_notify_window_created(ipc_server, &event);
+    ipc_notify_window_state(ipc_server, msg->buffer_id);
 
     schedule_frame_update(ipc_server);
     return 0;
@@ -1439,143 +2420,131 @@ void draw_window_decorations(struct BufferEntry *buffer) {
         return;
     }
 
-    uint32_t *pixels = (uint32_t *)buffer->data;
+    struct RasterImage dst = buffer_raster_image(buffer);
     uint32_t border_color = buffer->focused ? 0xFF4285F4 : 0xFFCCCCCC; // Blue when focused, gray when not
     uint32_t titlebar_color = buffer->focused ? 0xFF5C6BC0 : 0xFFE0E0E0;
-    int border_width = 2;
-    int titlebar_height = 24;
+    int32_t border_width = 2;
+    int32_t titlebar_height = 24;
 
     // Draw title bar
-    for (int y = 0; y < titlebar_height && y < buffer->height; y++) {
-        for (int x = 0; x < buffer->width; x++) {
-            int idx = y * buffer->width + x;
-            if (idx < (int)(buffer->size / 4)) {
-                pixels[idx] = titlebar_color;
-            }
-        }
-    }
-
-    // Draw borders
-    for (int y = 0; y < buffer->height; y++) {
-        for (int x = 0; x < buffer->width; x++) {
-            int idx = y * buffer->width + x;
-            if (idx >= (int)(buffer->size / 4)) continue;
-
-            // Left border
-            if (x < border_width) {
-                pixels[idx] = border_color;
-            }
-            // Right border
-            else if (x >= buffer->width - border_width) {
-                pixels[idx] = border_color;
-            }
-            // Bottom border (skip titlebar area)
-            else if (y >= buffer->height - border_width && y >= titlebar_height) {
-                pixels[idx] = border_color;
-            }
-        }
-    }
-
-    buffer->dirty = 1;
+    raster_fill_rect(&dst, 0, 0, dst.width, titlebar_height, titlebar_color);
+
+    // Left and right borders run the full height, the bottom one stays below the title bar
+    raster_fill_rect(&dst, 0, 0, border_width, dst.height, border_color);
+    raster_fill_rect(&dst, dst.width - border_width, 0, border_width, dst.height, border_color);
+    int32_t bottom = dst.height - border_width;
+    if (bottom < titlebar_height) bottom = titlebar_height;
+    raster_fill_rect(&dst, 0, bottom, dst.width, dst.height - bottom, border_color);
+
+    buffer_damage(buffer, 0, 0, dst.width, titlebar_height);
+    buffer_damage(buffer, 0, 0, border_width, dst.height);
+    buffer_damage(buffer, dst.width - border_width, 0, border_width, dst.height);
+    buffer_damage(buffer, 0, bottom, dst.width, dst.height - bottom);
 }
 
 /* Animation system */
-void start_buffer_animation(struct BufferEntry *buffer, uint32_t duration_ms) {
+struct BufferAnimation *start_buffer_animation(struct BufferEntry *buffer, uint32_t duration_ms) {
+    struct BufferAnimation *anim = buffer_animation(buffer);
+    if (!anim) return NULL;
+
     buffer->animating = 1;
-    buffer->animation_start_time = 0; // Will be set on first frame
-    buffer->animation_duration = duration_ms;
+    anim->start_time = 0; // Will be set on first frame
+    anim->duration = duration_ms;
     
     // Store current values as start values
-    buffer->start_opacity = buffer->opacity;
-    buffer->start_scale_x = buffer->scale_x;
-    buffer->start_scale_y = buffer->scale_y;
-    buffer->start_x = buffer->x;
-    buffer->start_y = buffer->y;
+    anim->start_opacity = buffer->opacity;
+    anim->start_scale_x = buffer->scale_x;
+    anim->start_scale_y = buffer->scale_y;
+    anim->start_x = buffer->x;
+    anim->start_y = buffer->y;
     
     // Set target values (these should be set by the caller)
-    buffer->target_opacity = buffer->opacity;
-    buffer->target_scale_x = buffer->scale_x;
-    buffer->target_scale_y = buffer->scale_y;
-    buffer->target_x = buffer->x;
-    buffer->target_y = buffer->y;
+    anim->target_opacity = buffer->opacity;
+    anim->target_scale_x = buffer->scale_x;
+    anim->target_scale_y = buffer->scale_y;
+    anim->target_x = buffer->x;
+    anim->target_y = buffer->y;
+    return anim;
 }
 
 void update_buffer_animation(struct BufferEntry *buffer, uint32_t current_time) {
-    if (!buffer->animating) return;
+    struct BufferAnimation *anim = buffer->anim;
+    if (!buffer->animating || !anim) return;
     
-    if (buffer->animation_start_time == 0) {
-        buffer->animation_start_time = current_time;
+    if (anim->start_time == 0) {
+        anim->start_time = current_time;
         return;
     }
     
-    uint32_t elapsed = current_time - buffer->animation_start_time;
-    float progress = (float)elapsed / buffer->animation_duration;
+    uint32_t elapsed = current_time - anim->start_time;
+    float progress = (float)elapsed / anim->duration;
     
     if (progress >= 1.0f) {
         // Animation complete
-        buffer->opacity = buffer->target_opacity;
-        buffer->scale_x = buffer->target_scale_x;
-        buffer->scale_y = buffer->target_scale_y;
-        buffer->x = buffer->target_x;
-        buffer->y = buffer->target_y;
+        buffer->opacity = anim->target_opacity;
+        buffer->scale_x = anim->target_scale_x;
+        buffer->scale_y = anim->target_scale_y;
+        buffer->x = anim->target_x;
+        buffer->y = anim->target_y;
         // 3D transforms
-        buffer->start_translate_x = buffer->target_translate_x;
-        buffer->start_translate_y = buffer->target_translate_y;
-        buffer->start_translate_z = buffer->target_translate_z;
-        buffer->start_rotate_x = buffer->target_rotate_x;
-        buffer->start_rotate_y = buffer->target_rotate_y;
-        buffer->start_rotate_z = buffer->target_rotate_z;
-        buffer->start_scale_z = buffer->target_scale_z;
-        buffer->current_translate_x = buffer->target_translate_x;
-        buffer->current_translate_y = buffer->target_translate_y;
-        buffer->current_translate_z = buffer->target_translate_z;
-        buffer->current_rotate_x = buffer->target_rotate_x;
-        buffer->current_rotate_y = buffer->target_rotate_y;
-        buffer->current_rotate_z = buffer->target_rotate_z;
-        buffer->current_scale_z = buffer->target_scale_z;
+        anim->start_translate_x = anim->target_translate_x;
+        anim->start_translate_y = anim->target_translate_y;
+        anim->start_translate_z = anim->target_translate_z;
+        anim->start_rotate_x = anim->target_rotate_x;
+        anim->start_rotate_y = anim->target_rotate_y;
+        anim->start_rotate_z = anim->target_rotate_z;
+        anim->start_scale_z = anim->target_scale_z;
+        anim->current_translate_x = anim->target_translate_x;
+        anim->current_translate_y = anim->target_translate_y;
+        anim->current_translate_z = anim->target_translate_z;
+        anim->current_rotate_x = anim->target_rotate_x;
+        anim->current_rotate_y = anim->target_rotate_y;
+        anim->current_rotate_z = anim->target_rotate_z;
+        anim->current_scale_z = anim->target_scale_z;
         
         // Apply final 3D transform
-        build_transform_matrix(buffer->transform_matrix, buffer->target_translate_x, buffer->target_translate_y, buffer->target_translate_z,
-                              buffer->target_rotate_x, buffer->target_rotate_y, buffer->target_rotate_z,
-                              buffer->target_scale_x, buffer->target_scale_y, buffer->target_scale_z);
-        buffer->has_transform_matrix = 1;
-        if (buffer->scene_buffer) {
-            wlr_scene_buffer_set_transform_matrix(buffer->scene_buffer, buffer->transform_matrix);
+        float *matrix = buffer_transform_matrix(buffer);
+        if (matrix) {
+            build_transform_matrix(matrix, anim->target_translate_x, anim->target_translate_y, anim->target_translate_z,
+                                  anim->target_rotate_x, anim->target_rotate_y, anim->target_rotate_z,
+                                  anim->target_scale_x, anim->target_scale_y, anim->target_scale_z);
+            if (buffer->scene_buffer) {
+                wlr_scene_buffer_set_transform_matrix(buffer->scene_buffer, matrix);
+            }
         }
         
         buffer->animating = 0;
-        buffer->dirty = 1;
         return;
     }
     
     // Ease-in-out interpolation
     float t = progress < 0.5f ? 2 * progress * progress : 1 - pow(-2 * progress + 2, 2) / 2;
     
-    buffer->opacity = buffer->start_opacity + t * (buffer->target_opacity - buffer->start_opacity);
-    buffer->scale_x = buffer->start_scale_x + t * (buffer->target_scale_x - buffer->start_scale_x);
-    buffer->scale_y = buffer->start_scale_y + t * (buffer->target_scale_y - buffer->start_scale_y);
-    buffer->x = buffer->start_x + t * (buffer->target_x - buffer->start_x);
-    buffer->y = buffer->start_y + t * (buffer->target_y - buffer->start_y);
+    buffer->opacity = anim->start_opacity + t * (anim->target_opacity - anim->start_opacity);
+    buffer->scale_x = anim->start_scale_x + t * (anim->target_scale_x - anim->start_scale_x);
+    buffer->scale_y = anim->start_scale_y + t * (anim->target_scale_y - anim->start_scale_y);
+    buffer->x = anim->start_x + t * (anim->target_x - anim->start_x);
+    buffer->y = anim->start_y + t * (anim->target_y - anim->start_y);
     
     // 3D interpolation
-    buffer->current_translate_x = buffer->start_translate_x + t * (buffer->target_translate_x - buffer->start_translate_x);
-    buffer->current_translate_y = buffer->start_translate_y + t * (buffer->target_translate_y - buffer->start_translate_y);
-    buffer->current_translate_z = buffer->start_translate_z + t * (buffer->target_translate_z - buffer->start_translate_z);
-    buffer->current_rotate_x = buffer->start_rotate_x + t * (buffer->target_rotate_x - buffer->start_rotate_x);
-    buffer->current_rotate_y = buffer->start_rotate_y + t * (buffer->target_rotate_y - buffer->start_rotate_y);
-    buffer->current_rotate_z = buffer->start_rotate_z + t * (buffer->target_rotate_z - buffer->start_rotate_z);
-    buffer->current_scale_z = buffer->start_scale_z + t * (buffer->target_scale_z - buffer->start_scale_z);
+    anim->current_translate_x = anim->start_translate_x + t * (anim->target_translate_x - anim->start_translate_x);
+    anim->current_translate_y = anim->start_translate_y + t * (anim->target_translate_y - anim->start_translate_y);
+    anim->current_translate_z = anim->start_translate_z + t * (anim->target_translate_z - anim->start_translate_z);
+    anim->current_rotate_x = anim->start_rotate_x + t * (anim->target_rotate_x - anim->start_rotate_x);
+    anim->current_rotate_y = anim->start_rotate_y + t * (anim->target_rotate_y - anim->start_rotate_y);
+    anim->current_rotate_z = anim->start_rotate_z + t * (anim->target_rotate_z - anim->start_rotate_z);
+    anim->current_scale_z = anim->start_scale_z + t * (anim->target_scale_z - anim->start_scale_z);
     
     // Build and apply 3D transform matrix
-    build_transform_matrix(buffer->transform_matrix, buffer->current_translate_x, buffer->current_translate_y, buffer->current_translate_z,
-                          buffer->current_rotate_x, buffer->current_rotate_y, buffer->current_rotate_z,
-                          buffer->scale_x, buffer->scale_y, buffer->current_scale_z);
-    buffer->has_transform_matrix = 1;
-    if (buffer->scene_buffer) {
-        wlr_scene_buffer_set_transform_matrix(buffer->scene_buffer, buffer->transform_matrix);
+    float *matrix = buffer_transform_matrix(buffer);
+    if (matrix) {
+        build_transform_matrix(matrix, anim->current_translate_x, anim->current_translate_y, anim->current_translate_z,
+                              anim->current_rotate_x, anim->current_rotate_y, anim->current_rotate_z,
+                              buffer->scale_x, buffer->scale_y, anim->current_scale_z);
+        if (buffer->scene_buffer) {
+            wlr_scene_buffer_set_transform_matrix(buffer->scene_buffer, matrix);
+        }
     }
-    
-    buffer->dirty = 1;
 }
 
 /* Update all active animations */
@@ -1584,8 +2553,8 @@ void update_animations(struct IPCServer *ipc_server) {
     clock_gettime(CLOCK_MONOTONIC, &now);
     uint32_t current_time = now.tv_sec * 1000 + now.tv_nsec / 1000000;
     
-    struct BufferEntry *buffer, *tmp;
-    wl_list_for_each_safe(buffer, tmp, &ipc_server->buffers, link) {
+    struct BufferEntry *buffer;
+    slab_for_each(buffer, &ipc_server->buffers) {
         if (buffer->animating) {
             update_buffer_animation(buffer, current_time);
         }
@@ -1598,14 +2567,57 @@ static int handle_destroy_buffer(struct IPCServer *ipc_server, struct IPCClient
     fprintf(stderr, "Destroyed buffer %u\n", msg->buffer_id);
 
     /* Send window destroyed event to all clients */
-    struct icm_msg_window_destroyed event = {
-        .window_id = msg->buffer_id
+    ipc_notify_window_destroyed(ipc_server, msg->buffer_id);
+
+    schedule_frame_update(ipc_server);
+    return 0;
+}
+
+static int handle_query_buffer_info(struct IPCServer *ipc_server, struct IPCClient *client,
+                                    const struct icm_msg_query_buffer_info *msg) {
+    struct BufferEntry *buffer = ipc_buffer_get(ipc_server, msg->buffer_id);
+    if (!buffer || buffer->dmabuf) {
+        fprintf(stderr, "No shareable buffer %u\n", msg->buffer_id);
+        return -1;
+    }
+    if (ipc_buffer_share(buffer) < 0) {
+        wlr_log(WLR_ERROR, "Failed to share buffer %u", msg->buffer_id);
+        return -1;
+    }
+
+    struct IPCPixelBuffer *pixels = buffer->swapchain.back;
+    struct icm_msg_query_buffer_info_reply reply = {
+        .buffer_id = msg->buffer_id,
+        .width = pixels->width,
+        .height = pixels->height,
+        .format = pixels->format,
+        .size = pixels->size,
+        .stride = pixels->width * 4,
+        .mmap_fd = 0,
     };
-    struct IPCClient *c, *tmp;
-    wl_list_for_each_safe(c, tmp, &ipc_server->clients, link) {
-        if (send_event_to_client(c, ICM_MSG_WINDOW_DESTROYED, &event, sizeof(event)) < 0) {
-            /* Client disconnected, will be cleaned up elsewhere */
-        }
+    return send_event_to_client_with_fds(client, ICM_MSG_BUFFER_INFO_DATA, &reply, sizeof(reply),
+                                         &pixels->fd, 1);
+}
+
+static int handle_commit_buffer(struct IPCServer *ipc_server, struct IPCClient *client,
+                                const struct icm_msg_commit_buffer *msg, uint32_t payload_size) {
+    if (payload_size < sizeof(*msg) ||
+        msg->num_rects > (payload_size - sizeof(*msg)) / sizeof(struct icm_damage_rect)) {
+        return -1;
+    }
+    struct BufferEntry *buffer = ipc_buffer_get(ipc_server, msg->buffer_id);
+    if (!buffer) {
+        fprintf(stderr, "Buffer not found for window %u\n", msg->buffer_id);
+        return -1;
+    }
+
+    const struct icm_damage_rect *rects = (const struct icm_damage_rect *)(msg + 1);
+    if (msg->num_rects == 0) buffer_damage_all(buffer);
+    for (uint32_t i = 0; i < msg->num_rects; i++) {
+        buffer_damage(buffer, rects[i].x, rects[i].y, rects[i].width, rects[i].height);
+    }
+    if (buffer->dmabuf) {
+        retained_images_update(ipc_server, msg->buffer_id, buffer->dmabuf);
     }
 
     schedule_frame_update(ipc_server);
@@ -1616,7 +2628,7 @@ struct ExportedSurface {
     struct wl_list link;
     uint32_t surface_id;             /* Unique surface identifier */
     uint32_t window_id;             /* Source window in this compositor */
-    struct BufferEntry *buffer;     /* Rendering target buffer */
+    uint32_t buffer_handle;         /* Rendering target buffer */
     struct View *view;              /* Associated view (optional) */
     uint8_t active;
 };
@@ -1634,11 +2646,12 @@ static int handle_export_surface(struct IPCServer *ipc_server, struct IPCClient
     exported->active = 1;
 
     /* Create a buffer to render into */
-    exported->buffer = ipc_buffer_create(ipc_server, msg->surface_id, 1280, 720, 0x34325241); /* ARGB */
-    if (!exported->buffer) {
+    struct BufferEntry *buffer = ipc_buffer_create(ipc_server, msg->surface_id, 1280, 720, 0x34325241); /* ARGB */
+    if (!buffer) {
         free(exported);
         return -1;
     }
+    exported->buffer_handle = slab_handle(buffer);
 
     wl_list_insert(&ipc_server->surfaces, &exported->link);
     fprintf(stderr, "Exported surface %u from window %u\n", msg->surface_id, msg->window_id);
@@ -1655,20 +2668,77 @@ static int handle_import_surface(struct IPCServer *ipc_server, struct IPCClient
 
 static int handle_register_pointer_event(struct IPCServer *ipc_server, struct IPCClient *client,
                                          const struct icm_msg_register_pointer_event *msg) {
-    client->registered_pointer = 1;
-    client->event_window_id = msg->window_id;
+    if (input_subscribe(ipc_server, client, msg->window_id, ICM_INPUT_EVENT_POINTER) < 0) {
+        return -1;
+    }
     fprintf(stderr, "Client registered for pointer events on window %u\n", msg->window_id);
     return 0;
 }
 
 static int handle_register_keyboard_event(struct IPCServer *ipc_server, struct IPCClient *client,
                                           const struct icm_msg_register_keyboard_event *msg) {
-    client->registered_keyboard = 1;
-    client->event_window_id = msg->window_id;
+    if (input_subscribe(ipc_server, client, msg->window_id, ICM_INPUT_EVENT_KEYBOARD) < 0) {
+        return -1;
+    }
     fprintf(stderr, "Client registered for keyboard events on window %u\n", msg->window_id);
     return 0;
 }
 
+static int handle_register_input_events(struct IPCServer *ipc_server, struct IPCClient *client,
+                                        const struct icm_msg_register_input_events *msg,
+                                        uint32_t payload_size) {
+    if (payload_size < sizeof(*msg) ||
+        msg->num_windows > (payload_size - sizeof(*msg)) / sizeof(uint32_t)) {
+        fprintf(stderr, "REGISTER_INPUT_EVENTS: truncated window list\n");
+        return -1;
+    }
+
+    const uint8_t *ids = (const uint8_t *)(msg + 1);
+    for (uint32_t i = 0; i < msg->num_windows; i++) {
+        uint32_t window_id;
+        memcpy(&window_id, ids + i * sizeof(window_id), sizeof(window_id));
+        if ((msg->types & ICM_INPUT_EVENT_POINTER) &&
+            input_subscribe(ipc_server, client, window_id, ICM_INPUT_EVENT_POINTER) < 0) {
+            return -1;
+        }
+        if ((msg->types & ICM_INPUT_EVENT_KEYBOARD) &&
+            input_subscribe(ipc_server, client, window_id, ICM_INPUT_EVENT_KEYBOARD) < 0) {
+            return -1;
+        }
+    }
+    fprintf(stderr, "Client registered input events (types=%u) on %u windows\n",
+            msg->types, msg->num_windows);
+    return 0;
+}
+
+static int handle_unregister_input_events(struct IPCServer *ipc_server, struct IPCClient *client,
+                                          const struct icm_msg_unregister_input_events *msg,
+                                          uint32_t payload_size) {
+    if (payload_size < sizeof(*msg) ||
+        msg->num_windows > (payload_size - sizeof(*msg)) / sizeof(uint32_t)) {
+        fprintf(stderr, "UNREGISTER_INPUT_EVENTS: truncated window list\n");
+        return -1;
+    }
+
+    if (msg->num_windows == 0) {
+        input_unsubscribe_all(ipc_server, client, msg->types);
+        return 0;
+    }
+
+    const uint8_t *ids = (const uint8_t *)(msg + 1);
+    for (uint32_t i = 0; i < msg->num_windows; i++) {
+        uint32_t window_id;
+        memcpy(&window_id, ids + i * sizeof(window_id), sizeof(window_id));
+        if (msg->types & ICM_INPUT_EVENT_POINTER) {
+            input_unsubscribe(ipc_server, client, window_id, ICM_INPUT_EVENT_POINTER);
+        }
+        if (msg->types & ICM_INPUT_EVENT_KEYBOARD) {
+            input_unsubscribe(ipc_server, client, window_id, ICM_INPUT_EVENT_KEYBOARD);
+        }
+    }
+    return 0;
+}
+
 static int handle_query_capture_mouse(struct IPCServer *ipc_server, struct IPCClient *client,
                                       const struct icm_msg_query_capture_mouse *msg) {
     /* For now, assume capture is granted */
@@ -1691,91 +2761,416 @@ static int handle_upload_image(struct IPCServer *ipc_server, struct IPCClient *c
         return -1;
     }
 
-    uint32_t image_id = ipc_server->next_image_id++;
-    struct ImageEntry *entry = ipc_image_create(ipc_server, image_id,
-                                                msg->width, msg->height, msg->format,
-                                                msg->data, msg->data_size);
-    if (!entry) {
-        return -1;
-    }
+    uint32_t image_id = ipc_server->next_image_id++;
+    struct ImageEntry *entry = ipc_image_create(ipc_server, image_id,
+                                                msg->width, msg->height, msg->format,
+                                                msg->data, msg->data_size);
+    if (!entry) {
+        return -1;
+    }
+
+    fprintf(stderr, "Uploaded image %u (%dx%d format=%u size=%zu)\n",
+            image_id, msg->width, msg->height, msg->format, msg->data_size);
+    return 0;
+}
+
+static int handle_destroy_image(struct IPCServer *ipc_server, struct IPCClient *client,
+                                const struct icm_msg_destroy_image *msg) {
+    ipc_image_destroy(ipc_server, msg->image_id);
+    fprintf(stderr, "Destroyed image %u\n", msg->image_id);
+    return 0;
+}
+
+/* Source extent along one axis; see icm_msg_draw_uploaded_image */
+static uint32_t image_source_extent(uint32_t src_size, uint32_t dst_size, uint32_t offset, uint32_t image_size) {
+    if (src_size) return src_size;
+    if (dst_size) return dst_size;
+    return offset < image_size ? image_size - offset : 0;
+}
+
+static enum RasterFilter image_filter(uint32_t filter, uint32_t src_width, uint32_t src_height,
+                                      uint32_t width, uint32_t height) {
+    switch (filter) {
+    case ICM_IMAGE_FILTER_NEAREST:
+        return RASTER_FILTER_NEAREST;
+    case ICM_IMAGE_FILTER_BILINEAR:
+        return RASTER_FILTER_BILINEAR;
+    case ICM_IMAGE_FILTER_BOX:
+        return RASTER_FILTER_BOX;
+    default:
+        /* Bilinear only looks at 2x2 pixels, so it aliases once shrinking by 2x */
+        if ((uint64_t)width * 2 <= src_width || (uint64_t)height * 2 <= src_height) {
+            return RASTER_FILTER_BOX;
+        }
+        return RASTER_FILTER_BILINEAR;
+    }
+}
+
+static int handle_draw_uploaded_image(struct IPCServer *ipc_server, struct IPCClient *client,
+                                      const struct icm_msg_draw_uploaded_image *msg,
+                                      uint32_t payload_size) {
+    struct BufferEntry *buffer = ipc_buffer_get(ipc_server, msg->window_id);
+    if (!buffer) {
+        fprintf(stderr, "Buffer not found for window %u\n", msg->window_id);
+        return -1;
+    }
+    if (!buffer_check_cpu_draw(buffer)) {
+        return -1;
+    }
+
+    struct ImageEntry *image = ipc_image_get(ipc_server, msg->image_id);
+    if (!image) {
+        fprintf(stderr, "Image not found %u\n", msg->image_id);
+        return -1;
+    }
+
+    uint32_t filter = ICM_IMAGE_FILTER_AUTO;
+    if (HAS_FIELD(struct icm_msg_draw_uploaded_image, filter, payload_size)) {
+        filter = msg->filter;
+    }
+
+    uint32_t src_width = image_source_extent(msg->src_width, msg->width, msg->src_x, image->width);
+    uint32_t src_height = image_source_extent(msg->src_height, msg->height, msg->src_y, image->height);
+    uint32_t width = msg->width ? msg->width : src_width;
+    uint32_t height = msg->height ? msg->height : src_height;
+
+    struct RasterImage dst = buffer_raster_image(buffer);
+    struct RasterImage src = image_raster_image(image);
+    if (width == src_width && height == src_height) {
+        if (image->opaque && msg->alpha == 255) {
+            raster_copy_rect(&dst, msg->x, msg->y, &src, msg->src_x, msg->src_y, width, height);
+        } else {
+            raster_blend_image(&dst, msg->x, msg->y, &src, msg->src_x, msg->src_y,
+                               width, height, msg->alpha);
+        }
+    } else if (raster_scale_image(&dst, msg->x, msg->y, width, height,
+                                  &src, msg->src_x, msg->src_y, src_width, src_height,
+                                  image_filter(filter, src_width, src_height, width, height),
+                                  msg->alpha, image->opaque) < 0) {
+        fprintf(stderr, "DRAW_UPLOADED_IMAGE: out of memory scaling image %u\n", image->image_id);
+        return -1;
+    }
+
+    buffer_damage(buffer, msg->x, msg->y, width, height);
+    return 0;
+}
+
+static int retained_image_set(struct BufferEntry *buffer, struct BufferDmabuf *dmabuf,
+                              const struct icm_msg_draw_image *msg, const struct wlr_fbox *src,
+                              uint32_t width, uint32_t height) {
+    struct BufferRects *rects = buffer_rects(buffer);
+    if (!rects) return -1;
+
+    struct RetainedImage *image = NULL;
+    for (uint32_t i = 0; i < rects->num_images && !image; i++) {
+        if (rects->images[i].buffer_id == msg->buffer_id) image = &rects->images[i];
+    }
+    if (msg->alpha == 0) {
+        if (image) retained_image_remove(rects, image);
+        return 0;
+    }
+
+    if (!image) {
+        if (rects->num_images == rects->images_capacity) {
+            uint32_t capacity = rects->images_capacity ? rects->images_capacity * 2 : 4;
+            struct RetainedImage *grown = realloc(rects->images, capacity * sizeof(*grown));
+            if (!grown) return -1;
+            rects->images = grown;
+            rects->images_capacity = capacity;
+        }
+        struct wlr_scene_buffer *node = wlr_scene_buffer_create(rects->tree, &dmabuf->base);
+        if (!node) return -1;
+        image = &rects->images[rects->num_images++];
+        image->buffer_id = msg->buffer_id;
+        image->node = node;
+    } else if (image->node->buffer != &dmabuf->base) {
+        wlr_scene_buffer_set_buffer(image->node, &dmabuf->base);    /* id was reused */
+    }
+
+    wlr_scene_buffer_set_source_box(image->node, src);
+    image->x = msg->x;
+    image->y = msg->y;
+    image->width = width;
+    image->height = height;
+    image->alpha = msg->alpha;
+    retained_image_apply(rects, image);
+    return 0;
+}
+
+/*
+ * A DMABUF source stays on the GPU: it is shown as a scene node above the
+ * window instead of being read back, and a later DRAW_IMAGE of the same
+ * source moves it. Other IPC windows are drawn into the pixels like
+ * uploaded images.
+ */
+static int handle_draw_image(struct IPCServer *ipc_server, struct IPCClient *client,
+                             const struct icm_msg_draw_image *msg) {
+    struct BufferEntry *buffer = ipc_buffer_get(ipc_server, msg->window_id);
+    struct BufferEntry *source = ipc_buffer_get(ipc_server, msg->buffer_id);
+    if (!buffer || !source || buffer == source) {
+        fprintf(stderr, "DRAW_IMAGE: no buffer %u to draw into window %u\n",
+                msg->buffer_id, msg->window_id);
+        return -1;
+    }
+
+    uint32_t src_width = image_source_extent(msg->src_width, msg->width, msg->src_x, source->width);
+    uint32_t src_height = image_source_extent(msg->src_height, msg->height, msg->src_y, source->height);
+    uint32_t width = msg->width ? msg->width : src_width;
+    uint32_t height = msg->height ? msg->height : src_height;
+
+    if (source->dmabuf) {
+        /* The scene rejects source boxes reaching past the buffer */
+        if (src_width == 0 || src_height == 0 ||
+            (uint64_t)msg->src_x + src_width > (uint64_t)source->width ||
+            (uint64_t)msg->src_y + src_height > (uint64_t)source->height) {
+            return -1;
+        }
+        const struct wlr_fbox src = {msg->src_x, msg->src_y, src_width, src_height};
+        if (retained_image_set(buffer, source->dmabuf, msg, &src, width, height) < 0) {
+            fprintf(stderr, "DRAW_IMAGE: cannot show buffer %u in window %u\n",
+                    msg->buffer_id, msg->window_id);
+            return -1;
+        }
+        schedule_frame_update(ipc_server);
+        return 0;
+    }
+    if (!buffer_check_cpu_draw(buffer)) {
+        return -1;
+    }
+
+    struct RasterImage dst = buffer_raster_image(buffer);
+    struct RasterImage src = buffer_raster_image(source);
+    if (width == src_width && height == src_height) {
+        raster_blend_image(&dst, msg->x, msg->y, &src, msg->src_x, msg->src_y,
+                           width, height, msg->alpha);
+    } else if (raster_scale_image(&dst, msg->x, msg->y, width, height,
+                                  &src, msg->src_x, msg->src_y, src_width, src_height,
+                                  image_filter(ICM_IMAGE_FILTER_AUTO, src_width, src_height, width, height),
+                                  msg->alpha, false) < 0) {
+        fprintf(stderr, "DRAW_IMAGE: out of memory scaling buffer %u\n", msg->buffer_id);
+        return -1;
+    }
+
+    buffer_damage(buffer, msg->x, msg->y, width, height);
+    schedule_frame_update(ipc_server);
+    return 0;
+}
+
+/* Instanced draws walk the buffer in horizontal bands small enough to stay in
+ * cache, drawing every record that reaches a band in message order, so
+ * overlaps come out as if the records were sent one by one */
+#define DRAW_BAND_BYTES (256 * 1024)
+
+static int32_t draw_band_rows(const struct RasterImage *dst) {
+    size_t row_bytes = (size_t)dst->stride * 4;
+    size_t rows = row_bytes ? DRAW_BAND_BYTES / row_bytes : 0;
+    return rows < 16 ? 16 : rows > INT32_MAX ? INT32_MAX : (int32_t)rows;
+}
+
+static struct RasterImage draw_band(const struct RasterImage *dst, int32_t top, int32_t rows) {
+    struct RasterImage band = *dst;
+    band.pixels += (size_t)top * dst->stride;
+    band.height = rows < dst->height - top ? rows : dst->height - top;
+    return band;
+}
+
+static bool band_reaches(int32_t top, int32_t rows, int64_t y0, int64_t y1) {
+    return y0 < (int64_t)top + rows && y1 > top;
+}
+
+/* Bounding box of what one band drew, in buffer coordinates */
+struct BandDamage {
+    int64_t x0, y0, x1, y1;
+};
+
+static void band_damage_reset(struct BandDamage *damage) {
+    damage->x0 = damage->y0 = INT64_MAX;
+    damage->x1 = damage->y1 = INT64_MIN;
+}
 
-    fprintf(stderr, "Uploaded image %u (%dx%d format=%u size=%zu)\n",
-            image_id, msg->width, msg->height, msg->format, msg->data_size);
-    return 0;
+static void band_damage_add(struct BandDamage *damage, int64_t x, int64_t y,
+                            int64_t width, int64_t height) {
+    if (x < damage->x0) damage->x0 = x;
+    if (y < damage->y0) damage->y0 = y;
+    if (x + width > damage->x1) damage->x1 = x + width;
+    if (y + height > damage->y1) damage->y1 = y + height;
 }
 
-static int handle_destroy_image(struct IPCServer *ipc_server, struct IPCClient *client,
-                                const struct icm_msg_destroy_image *msg) {
-    ipc_image_destroy(ipc_server, msg->image_id);
-    fprintf(stderr, "Destroyed image %u\n", msg->image_id);
-    return 0;
+/* One damage rect per band keeps the region small however many records */
+static void band_damage_flush(struct BufferEntry *buffer, const struct BandDamage *damage,
+                              int32_t top, int32_t rows) {
+    int64_t y0 = damage->y0 > top ? damage->y0 : top;
+    int64_t y1 = damage->y1 < (int64_t)top + rows ? damage->y1 : (int64_t)top + rows;
+    if (damage->x0 >= damage->x1 || y0 >= y1) return;
+    buffer_damage(buffer, damage->x0, y0, damage->x1 - damage->x0, y1 - y0);
 }
 
-static int handle_draw_uploaded_image(struct IPCServer *ipc_server, struct IPCClient *client,
-                                      const struct icm_msg_draw_uploaded_image *msg) {
+static struct BufferEntry *instanced_buffer(struct IPCServer *ipc_server,
+                                            const struct icm_msg_draw_instanced *msg,
+                                            uint32_t payload_size, size_t record_size,
+                                            const char *name) {
+    if (payload_size < sizeof(*msg)) {
+        return NULL;
+    }
+    if (msg->num_records > (payload_size - sizeof(*msg)) / record_size) {
+        fprintf(stderr, "%s: %u records do not fit in %u bytes\n",
+                name, msg->num_records, payload_size);
+        return NULL;
+    }
     struct BufferEntry *buffer = ipc_buffer_get(ipc_server, msg->window_id);
     if (!buffer) {
         fprintf(stderr, "Buffer not found for window %u\n", msg->window_id);
-        return -1;
+        return NULL;
     }
+    return buffer_check_cpu_draw(buffer) ? buffer : NULL;
+}
 
-    struct ImageEntry *image = ipc_image_get(ipc_server, msg->image_id);
-    if (!image) {
-        fprintf(stderr, "Image not found %u\n", msg->image_id);
+static int handle_draw_rects(struct IPCServer *ipc_server, struct IPCClient *client,
+                             const struct icm_msg_draw_instanced *msg, uint32_t payload_size) {
+    struct BufferEntry *buffer = instanced_buffer(ipc_server, msg, payload_size,
+                                                  sizeof(struct icm_rect_record), "DRAW_RECTS");
+    if (!buffer) {
         return -1;
     }
 
-    /* Simple blit, assuming RGBA */
-    uint8_t *dst_ptr = (uint8_t *)buffer->data;
-    uint32_t dst_stride = buffer->width * 4;
-    uint8_t *src_ptr = image->data;
-    uint32_t src_stride = image->width * 4;
+    const struct icm_rect_record *records = (const struct icm_rect_record *)(msg + 1);
+    bool blend = msg->flags & ICM_DRAW_INSTANCED_BLEND;
+    struct RasterImage dst = buffer_raster_image(buffer);
+    int32_t rows = draw_band_rows(&dst);
+
+    for (int32_t top = 0; top < dst.height; top += rows) {
+        struct RasterImage band = draw_band(&dst, top, rows);
+        struct BandDamage damage;
+        band_damage_reset(&damage);
+        for (uint32_t i = 0; i < msg->num_records; i++) {
+            const struct icm_rect_record *rec = &records[i];
+            if (!band_reaches(top, band.height, rec->y, rec->y + rec->height)) continue;
+            if (blend) {
+                raster_blend_rect(&band, rec->x, rec->y - top, rec->width, rec->height, rec->color_rgba);
+            } else {
+                raster_fill_rect(&band, rec->x, rec->y - top, rec->width, rec->height, rec->color_rgba);
+            }
+            band_damage_add(&damage, rec->x, rec->y, rec->width, rec->height);
+        }
+        band_damage_flush(buffer, &damage, top, band.height);
+    }
 
-    int32_t dst_x = msg->x;
-    int32_t dst_y = msg->y;
-    uint32_t width = msg->width;
-    uint32_t height = msg->height;
-    uint32_t src_x = msg->src_x;
-    uint32_t src_y = msg->src_y;
-    uint32_t src_width = msg->src_width;
-    uint32_t src_height = msg->src_height;
-    uint8_t alpha = msg->alpha;
+    schedule_frame_update(ipc_server);
+    return 0;
+}
 
-    if (dst_x < 0) { src_x -= dst_x; width += dst_x; dst_x = 0; }
-    if (dst_y < 0) { src_y -= dst_y; height += dst_y; dst_y = 0; }
-    if (dst_x + width > buffer->width) width = buffer->width - dst_x;
-    if (dst_y + height > buffer->height) height = buffer->height - dst_y;
-    if (src_x + width > image->width) width = image->width - src_x;
-    if (src_y + height > image->height) height = image->height - src_y;
+static int handle_draw_lines(struct IPCServer *ipc_server, struct IPCClient *client,
+                             const struct icm_msg_draw_instanced *msg, uint32_t payload_size) {
+    struct BufferEntry *buffer = instanced_buffer(ipc_server, msg, payload_size,
+                                                  sizeof(struct icm_line_record), "DRAW_LINES");
+    if (!buffer) {
+        return -1;
+    }
 
-    for (uint32_t y = 0; y < height; y++) {
-        for (uint32_t x = 0; x < width; x++) {
-            uint32_t *dst_pixel = (uint32_t *)(dst_ptr + (dst_y + y) * dst_stride + (dst_x + x) * 4);
-            uint32_t *src_pixel = (uint32_t *)(src_ptr + (src_y + y) * src_stride + (src_x + x) * 4);
-            uint32_t src_color = *src_pixel;
-            uint32_t dst_color = *dst_pixel;
+    const struct icm_line_record *records = (const struct icm_line_record *)(msg + 1);
+    bool antialias = msg->flags & ICM_DRAW_INSTANCED_ANTIALIAS;
+    struct RasterImage dst = buffer_raster_image(buffer);
+    int32_t rows = draw_band_rows(&dst);
+
+    for (int32_t top = 0; top < dst.height; top += rows) {
+        struct RasterImage band = draw_band(&dst, top, rows);
+        struct BandDamage damage;
+        band_damage_reset(&damage);
+        for (uint32_t i = 0; i < msg->num_records; i++) {
+            const struct icm_line_record *rec = &records[i];
+            /* Square caps and the pixel center offset reach width / 2 + 1 out */
+            int32_t reach = rec->thickness / 2 + 1;
+            int32_t y0 = rec->y0 < rec->y1 ? rec->y0 : rec->y1;
+            int32_t y1 = rec->y0 < rec->y1 ? rec->y1 : rec->y0;
+            if (!band_reaches(top, band.height, y0 - reach, y1 + reach + 1)) continue;
+
+            float width = rec->thickness ? (float)rec->thickness : 1.0f;
+            if (raster_stroke_line(&band, rec->x0 + 0.5f, rec->y0 - top + 0.5f,
+                                   rec->x1 + 0.5f, rec->y1 - top + 0.5f,
+                                   width, rec->color_rgba, antialias) < 0) {
+                fprintf(stderr, "DRAW_LINES: out of memory\n");
+                band_damage_flush(buffer, &damage, top, band.height);
+                return -1;
+            }
+            int32_t x0 = rec->x0 < rec->x1 ? rec->x0 : rec->x1;
+            int32_t x1 = rec->x0 < rec->x1 ? rec->x1 : rec->x0;
+            band_damage_add(&damage, x0 - reach, y0 - reach,
+                            x1 - x0 + 2 * reach + 1, y1 - y0 + 2 * reach + 1);
+        }
+        band_damage_flush(buffer, &damage, top, band.height);
+    }
 
-            // Simple alpha blend
-            uint8_t sa = (src_color >> 24) & 0xFF;
-            uint8_t sr = (src_color >> 16) & 0xFF;
-            uint8_t sg = (src_color >> 8) & 0xFF;
-            uint8_t sb = src_color & 0xFF;
+    schedule_frame_update(ipc_server);
+    return 0;
+}
 
-            uint8_t da = (dst_color >> 24) & 0xFF;
-            uint8_t dr = (dst_color >> 16) & 0xFF;
-            uint8_t dg = (dst_color >> 8) & 0xFF;
-            uint8_t db = dst_color & 0xFF;
+static int handle_draw_sprites(struct IPCServer *ipc_server, struct IPCClient *client,
+                               const struct icm_msg_draw_instanced *msg, uint32_t payload_size) {
+    static struct ImageEntry **images;
+    static uint32_t images_capacity;
 
-            uint8_t a = (sa * alpha) / 255;
-            uint8_t r = (sr * a + dr * (255 - a)) / 255;
-            uint8_t g = (sg * a + dg * (255 - a)) / 255;
-            uint8_t b = (sb * a + db * (255 - a)) / 255;
+    struct BufferEntry *buffer = instanced_buffer(ipc_server, msg, payload_size,
+                                                  sizeof(struct icm_sprite_record), "DRAW_SPRITES");
+    if (!buffer) {
+        return -1;
+    }
+    if (msg->num_records > images_capacity) {
+        struct ImageEntry **grown = realloc(images, msg->num_records * sizeof(*grown));
+        if (!grown) {
+            return -1;
+        }
+        images = grown;
+        images_capacity = msg->num_records;
+    }
 
-            *dst_pixel = (a << 24) | (r << 16) | (g << 8) | b;
+    /* Resolve every image once up front; sprites mostly share an atlas */
+    const struct icm_sprite_record *records = (const struct icm_sprite_record *)(msg + 1);
+    struct ImageEntry *last = NULL;
+    uint32_t missing = 0;
+    for (uint32_t i = 0; i < msg->num_records; i++) {
+        if (!last || last->image_id != records[i].image_id) {
+            last = ipc_image_get(ipc_server, records[i].image_id);
+        }
+        images[i] = last;
+        if (!last) missing++;
+    }
+
+    struct RasterImage dst = buffer_raster_image(buffer);
+    int32_t rows = draw_band_rows(&dst);
+
+    for (int32_t top = 0; top < dst.height; top += rows) {
+        struct RasterImage band = draw_band(&dst, top, rows);
+        struct BandDamage damage;
+        band_damage_reset(&damage);
+        for (uint32_t i = 0; i < msg->num_records; i++) {
+            const struct icm_sprite_record *rec = &records[i];
+            const struct ImageEntry *image = images[i];
+            if (!image) continue;
+
+            /* Nothing past the window's extent can show, and the clamp keeps
+             * the extents in int32 range for the rect helpers */
+            uint32_t width = image_source_extent(rec->width, 0, rec->src_x, image->width);
+            uint32_t height = image_source_extent(rec->height, 0, rec->src_y, image->height);
+            if (width > (uint32_t)dst.width) width = dst.width;
+            if (height > (uint32_t)dst.height) height = dst.height;
+            if (!band_reaches(top, band.height, rec->y, (int64_t)rec->y + height)) continue;
+
+            struct RasterImage src = image_raster_image(image);
+            if (image->opaque && rec->alpha == 255) {
+                raster_copy_rect(&band, rec->x, rec->y - top, &src, rec->src_x, rec->src_y, width, height);
+            } else {
+                raster_blend_image(&band, rec->x, rec->y - top, &src, rec->src_x, rec->src_y,
+                                   width, height, rec->alpha);
+            }
+            band_damage_add(&damage, rec->x, rec->y, width, height);
         }
+        band_damage_flush(buffer, &damage, top, band.height);
     }
 
-    buffer->dirty = 1;
+    if (missing > 0) {
+        wlr_log(WLR_DEBUG, "DRAW_SPRITES: %u of %u images not found", missing, msg->num_records);
+    }
+    schedule_frame_update(ipc_server);
     return 0;
 }
 
@@ -1786,6 +3181,9 @@ static int handle_draw_text(struct IPCServer *ipc_server, struct IPCClient *clie
         fprintf(stderr, "Buffer not found for window %u\n", msg->window_id);
         return -1;
     }
+    if (!buffer_check_cpu_draw(buffer)) {
+        return -1;
+    }
 
     size_t text_len = payload_size - sizeof(*msg);
     if (text_len == 0) return 0;
@@ -1843,6 +3241,11 @@ static int handle_draw_text(struct IPCServer *ipc_server, struct IPCClient *clie
         cairo_move_to(cr, msg->x, msg->y);
         pango_cairo_show_layout(cr, layout);
 
+        PangoRectangle ink;
+        pango_layout_get_pixel_extents(layout, &ink, NULL);
+        buffer_damage(buffer, (int64_t)msg->x + ink.x - 1, (int64_t)msg->y + ink.y - 1,
+                      ink.width + 2, ink.height + 2);
+
         // Clean up
         g_object_unref(layout);
         cairo_destroy(cr);
@@ -1855,7 +3258,6 @@ static int handle_draw_text(struct IPCServer *ipc_server, struct IPCClient *clie
         fprintf(stderr, "Cannot draw text on window %u: unsupported format or no buffer data\n", msg->window_id);
     }
 
-    buffer->dirty = 1;
     schedule_frame_update(ipc_server);
     return 0;
 }
@@ -1870,23 +3272,29 @@ static int handle_set_window_visible(struct IPCServer *ipc_server, struct IPCCli
 
     buffer->visible = msg->visible;
     fprintf(stderr, "Set window %u visible: %d\n", msg->window_id, msg->visible);
+    ipc_notify_window_state(ipc_server, msg->window_id);
     schedule_frame_update(ipc_server);
 
     return 0;
 }
 
 static int handle_register_keybind(struct IPCServer *ipc_server, struct IPCClient *client,
-                                   const struct icm_msg_register_keybind *msg) {
+                                   const struct icm_msg_register_keybind *msg, size_t payload_size) {
     struct KeybindEntry *entry = calloc(1, sizeof(*entry));
     if (!entry) return -1;
 
     entry->keybind_id = msg->keybind_id;
     entry->modifiers = msg->modifiers;
     entry->keycode = msg->keycode;
+    entry->flags = payload_size >= sizeof(*msg) ? msg->flags : 0;
     entry->client = client;
 
-    wl_list_insert(&ipc_server->keybinds, &entry->link);
-    fprintf(stderr, "Registered keybind %u (mod=%u key=%u)\n", msg->keybind_id, msg->modifiers, msg->keycode);
+    if (keybind_add(ipc_server, entry) < 0) {
+        free(entry);
+        return -1;
+    }
+    fprintf(stderr, "Registered keybind %u (mod=%u key=%u flags=%u)\n",
+            msg->keybind_id, msg->modifiers, msg->keycode, entry->flags);
     return 0;
 }
 
@@ -1895,8 +3303,7 @@ static int handle_unregister_keybind(struct IPCServer *ipc_server, struct IPCCli
     struct KeybindEntry *entry, *tmp;
     wl_list_for_each_safe(entry, tmp, &ipc_server->keybinds, link) {
         if (entry->keybind_id == msg->keybind_id && entry->client == client) {
-            wl_list_remove(&entry->link);
-            free(entry);
+            keybind_remove(ipc_server, entry);
             fprintf(stderr, "Unregistered keybind %u\n", msg->keybind_id);
             return 0;
         }
@@ -1905,7 +3312,8 @@ static int handle_unregister_keybind(struct IPCServer *ipc_server, struct IPCCli
 }
 
 static int handle_register_click_region(struct IPCServer *ipc_server, struct IPCClient *client,
-                                        const struct icm_msg_register_click_region *msg) {
+                                        const struct icm_msg_register_click_region *msg,
+                                        size_t payload_size) {
     struct ClickRegion *region = calloc(1, sizeof(*region));
     if (!region) return -1;
 
@@ -1915,9 +3323,13 @@ static int handle_register_click_region(struct IPCServer *ipc_server, struct IPC
     region->y = msg->y;
     region->width = msg->width;
     region->height = msg->height;
+    region->flags = payload_size >= sizeof(*msg) ? msg->flags : 0;
     region->client = client;
 
-    wl_list_insert(&ipc_server->click_regions, &region->link);
+    if (click_region_add(ipc_server, region) < 0) {
+        free(region);
+        return -1;
+    }
     fprintf(stderr, "Registered click region %u on window %u\n", msg->region_id, msg->window_id);
     return 0;
 }
@@ -1927,8 +3339,7 @@ static int handle_unregister_click_region(struct IPCServer *ipc_server, struct I
     struct ClickRegion *region, *tmp;
     wl_list_for_each_safe(region, tmp, &ipc_server->click_regions, link) {
         if (region->region_id == msg->region_id && region->client == client) {
-            wl_list_remove(&region->link);
-            free(region);
+            click_region_remove(ipc_server, region);
             fprintf(stderr, "Unregistered click region %u\n", msg->region_id);
             return 0;
         }
@@ -1954,12 +3365,18 @@ static int handle_request_screen_copy(struct IPCServer *ipc_server, struct IPCCl
 }
 
 static int handle_register_global_pointer_event(struct IPCServer *ipc_server, struct IPCClient *client) {
+    if (!client->registered_global_pointer) {
+        wl_list_insert(&ipc_server->global_pointer_clients, &client->global_pointer_link);
+    }
     client->registered_global_pointer = 1;
     fprintf(stderr, "Client registered for global pointer events\n");
     return 0;
 }
 
 static int handle_register_global_keyboard_event(struct IPCServer *ipc_server, struct IPCClient *client) {
+    if (!client->registered_global_keyboard) {
+        wl_list_insert(&ipc_server->global_keyboard_clients, &client->global_keyboard_link);
+    }
     client->registered_global_keyboard = 1;
     fprintf(stderr, "Client registered for global keyboard events\n");
     return 0;
@@ -2016,32 +3433,27 @@ static int handle_set_window_layer(struct IPCServer *ipc_server, struct IPCClien
     }
 
     /* Try View (XDG toplevel) */
-    struct Server *server = wl_container_of(ipc_server, server, ipc_server);
-    struct View *view;
-    wl_list_for_each(view, &server->views, link) {
-        if (view->window_id == msg->window_id) {
-            if (view->scene_tree) {
-                wlr_scene_node_reparent(&view->scene_tree->node, layers[scene_layer]);
-            }
-            schedule_frame_update(ipc_server);
-            fprintf(stderr, "Set View %u layer to %d (scene layer %d)\n",
-                    msg->window_id, msg->layer, scene_layer);
-            return 0;
+    struct View *view = ipc_view_get(ipc_server, msg->window_id);
+    if (view) {
+        if (view->scene_tree) {
+            wlr_scene_node_reparent(&view->scene_tree->node, layers[scene_layer]);
         }
+        schedule_frame_update(ipc_server);
+        fprintf(stderr, "Set View %u layer to %d (scene layer %d)\n",
+                msg->window_id, msg->layer, scene_layer);
+        return 0;
     }
 
     /* Try LayerSurface */
-    struct LayerSurface *layer_surf;
-    wl_list_for_each(layer_surf, &server->layer_surfaces, link) {
-        if (layer_surf->window_id == msg->window_id) {
-            if (layer_surf->scene_layer) {
-                wlr_scene_node_reparent(&layer_surf->scene_layer->tree->node, layers[scene_layer]);
-            }
-            schedule_frame_update(ipc_server);
-            fprintf(stderr, "Set LayerSurface %u layer to %d (scene layer %d)\n",
-                    msg->window_id, msg->layer, scene_layer);
-            return 0;
+    struct LayerSurface *layer_surf = ipc_layer_surface_get(ipc_server, msg->window_id);
+    if (layer_surf) {
+        if (layer_surf->scene_layer) {
+            wlr_scene_node_reparent(&layer_surf->scene_layer->tree->node, layers[scene_layer]);
         }
+        schedule_frame_update(ipc_server);
+        fprintf(stderr, "Set LayerSurface %u layer to %d (scene layer %d)\n",
+                msg->window_id, msg->layer, scene_layer);
+        return 0;
     }
 
     fprintf(stderr, "Window %u not found for layer change\n", msg->window_id);
@@ -2058,15 +3470,12 @@ static int handle_raise_window(struct IPCServer *ipc_server, struct IPCClient *c
         return 0;
     }
 
-    struct Server *server = wl_container_of(ipc_server, server, ipc_server);
-    struct View *view;
-    wl_list_for_each(view, &server->views, link) {
-        if (view->window_id == msg->window_id && view->scene_tree) {
-            wlr_scene_node_raise_to_top(&view->scene_tree->node);
-            schedule_frame_update(ipc_server);
-            fprintf(stderr, "Raised View %u\n", msg->window_id);
-            return 0;
-        }
+    struct View *view = ipc_view_get(ipc_server, msg->window_id);
+    if (view && view->scene_tree) {
+        wlr_scene_node_raise_to_top(&view->scene_tree->node);
+        schedule_frame_update(ipc_server);
+        fprintf(stderr, "Raised View %u\n", msg->window_id);
+        return 0;
     }
 
     fprintf(stderr, "Window %u not found for raise\n", msg->window_id);
@@ -2083,15 +3492,12 @@ static int handle_lower_window(struct IPCServer *ipc_server, struct IPCClient *c
         return 0;
     }
 
-    struct Server *server = wl_container_of(ipc_server, server, ipc_server);
-    struct View *view;
-    wl_list_for_each(view, &server->views, link) {
-        if (view->window_id == msg->window_id && view->scene_tree) {
-            wlr_scene_node_lower_to_bottom(&view->scene_tree->node);
-            schedule_frame_update(ipc_server);
-            fprintf(stderr, "Lowered View %u\n", msg->window_id);
-            return 0;
-        }
+    struct View *view = ipc_view_get(ipc_server, msg->window_id);
+    if (view && view->scene_tree) {
+        wlr_scene_node_lower_to_bottom(&view->scene_tree->node);
+        schedule_frame_update(ipc_server);
+        fprintf(stderr, "Lowered View %u\n", msg->window_id);
+        return 0;
     }
 
     fprintf(stderr, "Window %u not found for lower\n", msg->window_id);
@@ -2179,30 +3585,28 @@ static int handle_set_window_matrix(struct IPCServer *ipc_server, struct IPCClie
                                     const struct icm_msg_set_window_matrix *msg) {
     struct BufferEntry *buffer = ipc_buffer_get(ipc_server, msg->window_id);
     if (buffer) {
-        memcpy(buffer->transform_matrix, msg->matrix, sizeof(buffer->transform_matrix));
-        buffer->has_transform_matrix = 1;
+        float *matrix = buffer_transform_matrix(buffer);
+        if (!matrix) return -1;
+        memcpy(matrix, msg->matrix, 16 * sizeof(*matrix));
         if (buffer->scene_buffer) {
-            wlr_scene_buffer_set_transform_matrix(buffer->scene_buffer, buffer->transform_matrix);
+            wlr_scene_buffer_set_transform_matrix(buffer->scene_buffer, matrix);
         }
         schedule_frame_update(ipc_server);
         fprintf(stderr, "Set IPC buffer %u transformation matrix\n", msg->window_id);
         return 0;
     }
 
-    struct Server *server = wl_container_of(ipc_server, server, ipc_server);
-    struct View *view;
-    wl_list_for_each(view, &server->views, link) {
-        if (view->window_id == msg->window_id && view->scene_tree) {
-            memcpy(view->transform_matrix, msg->matrix, sizeof(view->transform_matrix));
-            view->has_transform_matrix = 1;
-            struct SceneMatrixData state = { .has_matrix = 1 };
-            memcpy(state.matrix, msg->matrix, sizeof(state.matrix));
-            wlr_scene_node_for_each_buffer(&view->scene_tree->node,
-                apply_scene_matrix_iter, &state);
-            schedule_frame_update(ipc_server);
-            fprintf(stderr, "Set view %u transformation matrix\n", msg->window_id);
-            return 0;
-        }
+    struct View *view = ipc_view_get(ipc_server, msg->window_id);
+    if (view && view->scene_tree) {
+        memcpy(view->transform_matrix, msg->matrix, sizeof(view->transform_matrix));
+        view->has_transform_matrix = 1;
+        struct SceneMatrixData state = { .has_matrix = 1 };
+        memcpy(state.matrix, msg->matrix, sizeof(state.matrix));
+        wlr_scene_node_for_each_buffer(&view->scene_tree->node,
+            apply_scene_matrix_iter, &state);
+        schedule_frame_update(ipc_server);
+        fprintf(stderr, "Set view %u transformation matrix\n", msg->window_id);
+        return 0;
     }
 
     fprintf(stderr, "Window %u not found for matrix transform\n", msg->window_id);
@@ -2228,32 +3632,29 @@ static int handle_set_window_mesh_transform(struct IPCServer *ipc_server, struct
         (const struct icm_msg_mesh_vertex *)(payload_data + header_size);
     
     // Find the view/buffer
-    struct Server *server = wl_container_of(ipc_server, server, ipc_server);
-    struct View *view;
-    wl_list_for_each(view, &server->views, link) {
-        if (view->window_id == msg->window_id) {
-            // Free old mesh if exists
-            if (view->mesh_transform.vertices) {
-                free(view->mesh_transform.vertices);
-            }
-            
-            // Allocate and copy new mesh
-            view->mesh_transform.vertices = malloc(expected_vertices_size);
-            if (!view->mesh_transform.vertices) {
-                fprintf(stderr, "Failed to allocate mesh vertices\n");
-                return -1;
-            }
-            
-            memcpy(view->mesh_transform.vertices, vertices, expected_vertices_size);
-            view->mesh_transform.mesh_width = msg->mesh_width;
-            view->mesh_transform.mesh_height = msg->mesh_height;
-            view->mesh_transform.enabled = 1;
-            
-            schedule_frame_update(ipc_server);
-            fprintf(stderr, "Set mesh transform for window %u: %ux%u grid (%zu vertices)\n",
-                    msg->window_id, msg->mesh_width, msg->mesh_height, vertex_count);
-            return 0;
+    struct View *view = ipc_view_get(ipc_server, msg->window_id);
+    if (view) {
+        // Free old mesh if exists
+        if (view->mesh_transform.vertices) {
+            free(view->mesh_transform.vertices);
+        }
+        
+        // Allocate and copy new mesh
+        view->mesh_transform.vertices = malloc(expected_vertices_size);
+        if (!view->mesh_transform.vertices) {
+            fprintf(stderr, "Failed to allocate mesh vertices\n");
+            return -1;
         }
+        
+        memcpy(view->mesh_transform.vertices, vertices, expected_vertices_size);
+        view->mesh_transform.mesh_width = msg->mesh_width;
+        view->mesh_transform.mesh_height = msg->mesh_height;
+        view->mesh_transform.enabled = 1;
+        
+        schedule_frame_update(ipc_server);
+        fprintf(stderr, "Set mesh transform for window %u: %ux%u grid (%zu vertices)\n",
+                msg->window_id, msg->mesh_width, msg->mesh_height, vertex_count);
+        return 0;
     }
     
     fprintf(stderr, "Window %u not found for mesh transform\n", msg->window_id);
@@ -2262,22 +3663,19 @@ static int handle_set_window_mesh_transform(struct IPCServer *ipc_server, struct
 
 static int handle_clear_window_mesh_transform(struct IPCServer *ipc_server, struct IPCClient *client,
                                                const struct icm_msg_clear_window_mesh_transform *msg) {
-    struct Server *server = wl_container_of(ipc_server, server, ipc_server);
-    struct View *view;
-    wl_list_for_each(view, &server->views, link) {
-        if (view->window_id == msg->window_id) {
-            if (view->mesh_transform.vertices) {
-                free(view->mesh_transform.vertices);
-                view->mesh_transform.vertices = NULL;
-            }
-            view->mesh_transform.mesh_width = 0;
-            view->mesh_transform.mesh_height = 0;
-            view->mesh_transform.enabled = 0;
-            
-            schedule_frame_update(ipc_server);
-            fprintf(stderr, "Cleared mesh transform for window %u\n", msg->window_id);
-            return 0;
+    struct View *view = ipc_view_get(ipc_server, msg->window_id);
+    if (view) {
+        if (view->mesh_transform.vertices) {
+            free(view->mesh_transform.vertices);
+            view->mesh_transform.vertices = NULL;
         }
+        view->mesh_transform.mesh_width = 0;
+        view->mesh_transform.mesh_height = 0;
+        view->mesh_transform.enabled = 0;
+        
+        schedule_frame_update(ipc_server);
+        fprintf(stderr, "Cleared mesh transform for window %u\n", msg->window_id);
+        return 0;
     }
     
     fprintf(stderr, "Window %u not found for clearing mesh transform\n", msg->window_id);
@@ -2298,25 +3696,22 @@ static int handle_update_window_mesh_vertices(struct IPCServer *ipc_server, stru
     const struct icm_msg_mesh_vertex *new_vertices = 
         (const struct icm_msg_mesh_vertex *)(payload_data + header_size);
     
-    struct Server *server = wl_container_of(ipc_server, server, ipc_server);
-    struct View *view;
-    wl_list_for_each(view, &server->views, link) {
-        if (view->window_id == msg->window_id && view->mesh_transform.enabled) {
-            size_t total_vertices = view->mesh_transform.mesh_width * view->mesh_transform.mesh_height;
-            
-            if (msg->start_index + msg->num_vertices > total_vertices) {
-                fprintf(stderr, "Mesh update out of bounds\n");
-                return -1;
-            }
-            
-            // Update the specified vertices
-            memcpy(&view->mesh_transform.vertices[msg->start_index], new_vertices, expected_vertices_size);
-            
-            schedule_frame_update(ipc_server);
-            fprintf(stderr, "Updated %u mesh vertices for window %u starting at index %u\n",
-                    msg->num_vertices, msg->window_id, msg->start_index);
-            return 0;
+    struct View *view = ipc_view_get(ipc_server, msg->window_id);
+    if (view && view->mesh_transform.enabled) {
+        size_t total_vertices = view->mesh_transform.mesh_width * view->mesh_transform.mesh_height;
+        
+        if (msg->start_index + msg->num_vertices > total_vertices) {
+            fprintf(stderr, "Mesh update out of bounds\n");
+            return -1;
         }
+        
+        // Update the specified vertices
+        memcpy(&view->mesh_transform.vertices[msg->start_index], new_vertices, expected_vertices_size);
+        
+        schedule_frame_update(ipc_server);
+        fprintf(stderr, "Updated %u mesh vertices for window %u starting at index %u\n",
+                msg->num_vertices, msg->window_id, msg->start_index);
+        return 0;
     }
     
     fprintf(stderr, "Window %u not found or mesh not enabled for vertex update\n", msg->window_id);
@@ -2347,47 +3742,43 @@ static int handle_set_window_state(struct IPCServer *ipc_server, struct IPCClien
         schedule_frame_update(ipc_server);
         fprintf(stderr, "Set BufferEntry %u state: minimized=%d maximized=%d fullscreen=%d decorated=%d\n",
                 msg->window_id, buffer->minimized, buffer->maximized, buffer->fullscreen, buffer->decorated);
+        ipc_notify_window_state(ipc_server, msg->window_id);
         return 0;
     }
     
     // Also check for Views (xdg_toplevel windows like Qt)
-    struct Server *server = wl_container_of(ipc_server, server, ipc_server);
-    struct View *view;
-    wl_list_for_each(view, &server->views, link) {
-        if (view->window_id == msg->window_id) {
-            // For xdg_toplevel windows, send appropriate state changes
-            if (!view->is_xwayland && view->xdg_surface && view->xdg_surface->toplevel) {
-                // Set window state using wlroots API
-                if (msg->state & 2) {  // maximized
-                    wlr_xdg_toplevel_set_maximized(view->xdg_surface->toplevel, true);
-                } else {
-                    wlr_xdg_toplevel_set_maximized(view->xdg_surface->toplevel, false);
-                }
-                
-                if (msg->state & 4) {  // fullscreen
-                    wlr_xdg_toplevel_set_fullscreen(view->xdg_surface->toplevel, true);
-                } else {
-                    wlr_xdg_toplevel_set_fullscreen(view->xdg_surface->toplevel, false);
-                }
-                
-                fprintf(stderr, "Set View %u state: minimized=%d maximized=%d fullscreen=%d\n",
-                        msg->window_id, (msg->state & 1) ? 1 : 0, (msg->state & 2) ? 1 : 0, (msg->state & 4) ? 1 : 0);
+    struct View *view = ipc_view_get(ipc_server, msg->window_id);
+    if (view) {
+        // For xdg_toplevel windows, send appropriate state changes
+        if (!view->is_xwayland && view->xdg_surface && view->xdg_surface->toplevel) {
+            // Set window state using wlroots API
+            if (msg->state & 2) {  // maximized
+                wlr_xdg_toplevel_set_maximized(view->xdg_surface->toplevel, true);
+            } else {
+                wlr_xdg_toplevel_set_maximized(view->xdg_surface->toplevel, false);
             }
             
-            schedule_frame_update(ipc_server);
-            return 0;
+            if (msg->state & 4) {  // fullscreen
+                wlr_xdg_toplevel_set_fullscreen(view->xdg_surface->toplevel, true);
+            } else {
+                wlr_xdg_toplevel_set_fullscreen(view->xdg_surface->toplevel, false);
+            }
+            
+            fprintf(stderr, "Set View %u state: minimized=%d maximized=%d fullscreen=%d\n",
+                    msg->window_id, (msg->state & 1) ? 1 : 0, (msg->state & 2) ? 1 : 0, (msg->state & 4) ? 1 : 0);
         }
+        
+        schedule_frame_update(ipc_server);
+        return 0;
     }
     
     // Check layer surfaces
-    struct LayerSurface *layer_surf;
-    wl_list_for_each(layer_surf, &server->layer_surfaces, link) {
-        if (layer_surf->window_id == msg->window_id) {
-            // Layer surfaces handle their own state; we can note decoration preference
-            fprintf(stderr, "Set LayerSurface %u state: decorated=%d (layer surfaces manage own state)\n",
-                    msg->window_id, (msg->state & 8) ? 1 : 0);
-            return 0;
-        }
+    struct LayerSurface *layer_surf = ipc_layer_surface_get(ipc_server, msg->window_id);
+    if (layer_surf) {
+        // Layer surfaces handle their own state; we can note decoration preference
+        fprintf(stderr, "Set LayerSurface %u state: decorated=%d (layer surfaces manage own state)\n",
+                msg->window_id, (msg->state & 8) ? 1 : 0);
+        return 0;
     }
     
     fprintf(stderr, "Window %u not found for state change\n", msg->window_id);
@@ -2403,20 +3794,12 @@ static int handle_focus_window(struct IPCServer *ipc_server, struct IPCClient *c
     server->focused_window_id = msg->window_id;
     
     // Find the view to focus
-    struct View *view_to_focus = NULL;
-    struct View *old_focused_view = NULL;
+    struct View *view_to_focus = ipc_view_get(ipc_server, msg->window_id);
+    struct View *old_focused_view = ipc_view_get(ipc_server, old_focused_id);
     struct wlr_surface *target_surface = NULL;
-    
-    // First, find the views
-    struct View *v;
-    wl_list_for_each(v, &server->views, link) {
-        if (v->window_id == msg->window_id) {
-            view_to_focus = v;
-            target_surface = v->is_xwayland ? v->xwayland_surface->surface : v->xdg_surface->surface;
-        }
-        if (v->window_id == old_focused_id) {
-            old_focused_view = v;
-        }
+    if (view_to_focus) {
+        target_surface = view_to_focus->is_xwayland ? view_to_focus->xwayland_surface->surface :
+                                                      view_to_focus->xdg_surface->surface;
     }
     
     // Check if the view is mapped before trying to focus
@@ -2438,22 +3821,24 @@ static int handle_focus_window(struct IPCServer *ipc_server, struct IPCClient *c
             }
             
             fprintf(stderr, "Focused BufferEntry window %u (cleared Wayland surface focus, keyboard via IPC)\n", msg->window_id);
+            ipc_notify_window_state(ipc_server, old_focused_id);
+            ipc_notify_window_state(ipc_server, msg->window_id);
             schedule_frame_update(ipc_server);
             return 0;
         }
         
-        struct LayerSurface *layer_surf;
-        wl_list_for_each(layer_surf, &server->layer_surfaces, link) {
-            if (layer_surf->window_id == msg->window_id) {
-                // Set keyboard focus to the layer surface (fixes launcher input)
-                struct wlr_keyboard *keyboard = wlr_seat_get_keyboard(server->seat);
-                if (keyboard && layer_surf->layer_surface && layer_surf->layer_surface->surface) {
-                    wlr_seat_keyboard_notify_enter(server->seat, layer_surf->layer_surface->surface,
-                        keyboard->keycodes, keyboard->num_keycodes, &keyboard->modifiers);
-                }
-                fprintf(stderr, "Focused LayerSurface window %u (set keyboard focus)\n", msg->window_id);
-                return 0;
+        struct LayerSurface *layer_surf = ipc_layer_surface_get(ipc_server, msg->window_id);
+        if (layer_surf) {
+            // Set keyboard focus to the layer surface (fixes launcher input)
+            struct wlr_keyboard *keyboard = wlr_seat_get_keyboard(server->seat);
+            if (keyboard && layer_surf->layer_surface && layer_surf->layer_surface->surface) {
+                wlr_seat_keyboard_notify_enter(server->seat, layer_surf->layer_surface->surface,
+                    keyboard->keycodes, keyboard->num_keycodes, &keyboard->modifiers);
             }
+            fprintf(stderr, "Focused LayerSurface window %u (set keyboard focus)\n", msg->window_id);
+            ipc_notify_window_state(ipc_server, old_focused_id);
+            ipc_notify_window_state(ipc_server, msg->window_id);
+            return 0;
         }
         
         fprintf(stderr, "Window %u to focus not found\n", msg->window_id);
@@ -2508,6 +3893,8 @@ static int handle_focus_window(struct IPCServer *ipc_server, struct IPCClient *c
     }
     
     fprintf(stderr, "Focused and raised window %u\n", msg->window_id);
+    ipc_notify_window_state(ipc_server, old_focused_id);
+    ipc_notify_window_state(ipc_server, msg->window_id);
     schedule_frame_update(ipc_server);
     return 0;
 }
@@ -2517,18 +3904,16 @@ static int handle_blur_window(struct IPCServer *ipc_server, struct IPCClient *cl
     // Blur (unfocus) the specified window
     
     struct Server *server = wl_container_of(ipc_server, server, ipc_server);
+    if (server->focused_window_id == msg->window_id) {
+        server->focused_window_id = 0;
+    }
     
     // Find the view to blur
-    struct View *view_to_blur = NULL;
+    struct View *view_to_blur = ipc_view_get(ipc_server, msg->window_id);
     struct wlr_surface *old_surface = NULL;
-    
-    struct View *v;
-    wl_list_for_each(v, &server->views, link) {
-        if (v->window_id == msg->window_id) {
-            view_to_blur = v;
-            old_surface = v->is_xwayland ? v->xwayland_surface->surface : v->xdg_surface->surface;
-            break;
-        }
+    if (view_to_blur) {
+        old_surface = view_to_blur->is_xwayland ? view_to_blur->xwayland_surface->surface :
+                                                  view_to_blur->xdg_surface->surface;
     }
     
     if (!view_to_blur) {
@@ -2537,21 +3922,20 @@ static int handle_blur_window(struct IPCServer *ipc_server, struct IPCClient *cl
         if (buffer) {
             buffer->focused = 0;
             fprintf(stderr, "Blurred BufferEntry window %u\n", msg->window_id);
+            ipc_notify_window_state(ipc_server, msg->window_id);
             schedule_frame_update(ipc_server);
             return 0;
         }
         
-        struct LayerSurface *layer_surf;
-        wl_list_for_each(layer_surf, &server->layer_surfaces, link) {
-            if (layer_surf->window_id == msg->window_id) {
-                // Clear keyboard focus from the layer surface
-                struct wlr_keyboard *keyboard = wlr_seat_get_keyboard(server->seat);
-                if (keyboard && server->seat->keyboard_state.focused_surface == layer_surf->layer_surface->surface) {
-                    wlr_seat_keyboard_clear_focus(server->seat);
-                }
-                fprintf(stderr, "Blurred LayerSurface window %u\n", msg->window_id);
-                return 0;
+        struct LayerSurface *layer_surf = ipc_layer_surface_get(ipc_server, msg->window_id);
+        if (layer_surf) {
+            // Clear keyboard focus from the layer surface
+            struct wlr_keyboard *keyboard = wlr_seat_get_keyboard(server->seat);
+            if (keyboard && server->seat->keyboard_state.focused_surface == layer_surf->layer_surface->surface) {
+                wlr_seat_keyboard_clear_focus(server->seat);
             }
+            fprintf(stderr, "Blurred LayerSurface window %u\n", msg->window_id);
+            return 0;
         }
         
         fprintf(stderr, "Window %u to blur not found\n", msg->window_id);
@@ -2581,6 +3965,7 @@ static int handle_blur_window(struct IPCServer *ipc_server, struct IPCClient *cl
     }
     
     fprintf(stderr, "Blurred window %u\n", msg->window_id);
+    ipc_notify_window_state(ipc_server, msg->window_id);
     schedule_frame_update(ipc_server);
     return 0;
 }
@@ -2593,188 +3978,307 @@ static int handle_animate_window(struct IPCServer *ipc_server, struct IPCClient
         return -1;
     }
     
+    struct BufferAnimation *anim = buffer_animation(buffer);
+    if (!anim) return -1;
+
     /* Set up animation */
     buffer->animating = 1;
-    buffer->animation_start_time = 0; // Will be set on first update
-    buffer->animation_duration = msg->duration_ms;
+    anim->start_time = 0; // Will be set on first update
+    anim->duration = msg->duration_ms;
     
     /* Store current values as start values */
-    buffer->start_x = buffer->x;
-    buffer->start_y = buffer->y;
-    buffer->start_scale_x = buffer->scale_x;
-    buffer->start_scale_y = buffer->scale_y;
-    buffer->start_opacity = buffer->opacity;
+    anim->start_x = buffer->x;
+    anim->start_y = buffer->y;
+    anim->start_scale_x = buffer->scale_x;
+    anim->start_scale_y = buffer->scale_y;
+    anim->start_opacity = buffer->opacity;
     
     // 3D transforms - assume current transform is identity if not set
-    buffer->start_translate_x = 0.0f;
-    buffer->start_translate_y = 0.0f;
-    buffer->start_translate_z = 0.0f;
-    buffer->start_rotate_x = 0.0f;
-    buffer->start_rotate_y = 0.0f;
-    buffer->start_rotate_z = 0.0f;
-    buffer->start_scale_z = 1.0f;
+    anim->start_translate_x = 0.0f;
+    anim->start_translate_y = 0.0f;
+    anim->start_translate_z = 0.0f;
+    anim->start_rotate_x = 0.0f;
+    anim->start_rotate_y = 0.0f;
+    anim->start_rotate_z = 0.0f;
+    anim->start_scale_z = 1.0f;
     
     // Initialize current values
-    buffer->current_translate_x = buffer->start_translate_x;
-    buffer->current_translate_y = buffer->start_translate_y;
-    buffer->current_translate_z = buffer->start_translate_z;
-    buffer->current_rotate_x = buffer->start_rotate_x;
-    buffer->current_rotate_y = buffer->start_rotate_y;
-    buffer->current_rotate_z = buffer->start_rotate_z;
-    buffer->current_scale_z = buffer->start_scale_z;
+    anim->current_translate_x = anim->start_translate_x;
+    anim->current_translate_y = anim->start_translate_y;
+    anim->current_translate_z = anim->start_translate_z;
+    anim->current_rotate_x = anim->start_rotate_x;
+    anim->current_rotate_y = anim->start_rotate_y;
+    anim->current_rotate_z = anim->start_rotate_z;
+    anim->current_scale_z = anim->start_scale_z;
     
     /* Set target values based on flags */
     if (msg->flags & 1) { // animate position
-        buffer->target_x = msg->target_x;
-        buffer->target_y = msg->target_y;
+        anim->target_x = msg->target_x;
+        anim->target_y = msg->target_y;
     } else {
-        buffer->target_x = buffer->x;
-        buffer->target_y = buffer->y;
+        anim->target_x = buffer->x;
+        anim->target_y = buffer->y;
     }
     
     if (msg->flags & 2) { // animate scale
-        buffer->target_scale_x = msg->target_scale_x;
-        buffer->target_scale_y = msg->target_scale_y;
+        anim->target_scale_x = msg->target_scale_x;
+        anim->target_scale_y = msg->target_scale_y;
     } else {
-        buffer->target_scale_x = buffer->scale_x;
-        buffer->target_scale_y = buffer->scale_y;
+        anim->target_scale_x = buffer->scale_x;
+        anim->target_scale_y = buffer->scale_y;
     }
     
     if (msg->flags & 4) { // animate opacity
-        buffer->target_opacity = msg->target_opacity;
+        anim->target_opacity = msg->target_opacity;
     } else {
-        buffer->target_opacity = buffer->opacity;
+        anim->target_opacity = buffer->opacity;
     }
     
     if (msg->flags & 8) { // animate 3d translate
-        buffer->target_translate_x = msg->target_translate_x;
-        buffer->target_translate_y = msg->target_translate_y;
-        buffer->target_translate_z = msg->target_translate_z;
+        anim->target_translate_x = msg->target_translate_x;
+        anim->target_translate_y = msg->target_translate_y;
+        anim->target_translate_z = msg->target_translate_z;
     } else {
-        buffer->target_translate_x = buffer->start_translate_x;
-        buffer->target_translate_y = buffer->start_translate_y;
-        buffer->target_translate_z = buffer->start_translate_z;
+        anim->target_translate_x = anim->start_translate_x;
+        anim->target_translate_y = anim->start_translate_y;
+        anim->target_translate_z = anim->start_translate_z;
+    }
+    
+    if (msg->flags & 16) { // animate 3d rotate
+        anim->target_rotate_x = msg->target_rotate_x;
+        anim->target_rotate_y = msg->target_rotate_y;
+        anim->target_rotate_z = msg->target_rotate_z;
+    } else {
+        anim->target_rotate_x = anim->start_rotate_x;
+        anim->target_rotate_y = anim->start_rotate_y;
+        anim->target_rotate_z = anim->start_rotate_z;
+    }
+    
+    if (msg->flags & 32) { // animate 3d scale
+        anim->target_scale_z = msg->target_scale_z;
+    } else {
+        anim->target_scale_z = anim->start_scale_z;
+    }
+    
+    fprintf(stderr, "Started animation for window %u: duration=%ums flags=%u\n",
+            msg->window_id, msg->duration_ms, msg->flags);
+    
+    schedule_frame_update(ipc_server);
+    return 0;
+}
+
+static int handle_stop_animation(struct IPCServer *ipc_server, struct IPCClient *client,
+                                const struct icm_msg_stop_animation *msg) {
+    struct BufferEntry *buffer = ipc_buffer_get(ipc_server, msg->window_id);
+    if (!buffer) {
+        fprintf(stderr, "Buffer not found for stop animation %u\n", msg->window_id);
+        return -1;
+    }
+    
+    buffer->animating = 0;
+    fprintf(stderr, "Stopped animation for window %u\n", msg->window_id);
+    
+    schedule_frame_update(ipc_server);
+    return 0;
+}
+
+/* A window id resolved to whichever object carries it. Lookup order matches
+ * the single-window handlers: IPC buffers, then views, then layer surfaces. */
+struct WindowTarget {
+    struct BufferEntry *buffer;
+    struct View *view;
+    struct LayerSurface *layer_surf;
+};
+
+static int resolve_window(struct IPCServer *ipc_server, uint32_t window_id,
+                          struct WindowTarget *target) {
+    memset(target, 0, sizeof(*target));
+
+    struct WindowSlot *slot = window_registry_find(&ipc_server->windows, window_id);
+    if (!slot) return -1;
+
+    if (slot->buffer) {
+        target->buffer = slot->buffer;
+    } else if (slot->view) {
+        target->view = slot->view;
+    } else if (slot->layer_surf) {
+        target->layer_surf = slot->layer_surf;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+static enum wl_output_transform rotation_to_output_transform(float rotation) {
+    if (fabsf(rotation) >= 45.0f && fabsf(rotation) < 135.0f) {
+        return WL_OUTPUT_TRANSFORM_90;
+    } else if (fabsf(rotation) >= 135.0f && fabsf(rotation) < 225.0f) {
+        return WL_OUTPUT_TRANSFORM_180;
+    } else if (fabsf(rotation) >= 225.0f) {
+        return WL_OUTPUT_TRANSFORM_270;
+    }
+    return WL_OUTPUT_TRANSFORM_NORMAL;
+}
+
+/* Property setters shared by the single-window handlers and
+ * SET_WINDOWS_PROPERTIES. They update state and scene nodes only; callers
+ * schedule the frame. Return -1 if the target does not support the property. */
+static int apply_window_position(struct WindowTarget *target, int32_t x, int32_t y) {
+    if (target->buffer) {
+        target->buffer->x = x;
+        target->buffer->y = y;
+        if (target->buffer->scene_buffer) {
+            wlr_scene_node_set_position(&target->buffer->scene_buffer->node, x, y);
+        }
+        return 0;
+    }
+    if (target->view) {
+        struct View *view = target->view;
+        view->x = x;
+        view->y = y;
+        view->position_set_by_ipc = true;  /* Mark as IPC-positioned */
+        if (view->scene_tree) {
+            wlr_scene_node_set_position(&view->scene_tree->node, view->x, view->y);
+        }
+        return 0;
+    }
+    if (target->layer_surf) {
+        /* Layer surfaces positioning is handled differently */
+        if (target->layer_surf->scene_layer) {
+            wlr_scene_node_set_position(&target->layer_surf->scene_layer->tree->node, x, y);
+        }
+        return 0;
+    }
+    return -1;
+}
+
+static int apply_window_opacity(struct WindowTarget *target, float opacity) {
+    if (target->buffer) {
+        target->buffer->opacity = opacity;
+        if (target->buffer->scene_buffer) {
+            wlr_scene_buffer_set_opacity(target->buffer->scene_buffer, opacity);
+        }
+        return 0;
+    }
+    if (target->view && target->view->scene_tree) {
+        struct View *view = target->view;
+        view->opacity = opacity;
+        struct SceneOpacityData state = {
+            .opacity = view->opacity,
+            .blur_radius = view->blur_radius,
+            .blur_enabled = view->blur_enabled,
+        };
+        wlr_scene_node_for_each_buffer(&view->scene_tree->node,
+            apply_scene_opacity_iter, &state);
+        return 0;
     }
-    
-    if (msg->flags & 16) { // animate 3d rotate
-        buffer->target_rotate_x = msg->target_rotate_x;
-        buffer->target_rotate_y = msg->target_rotate_y;
-        buffer->target_rotate_z = msg->target_rotate_z;
-    } else {
-        buffer->target_rotate_x = buffer->start_rotate_x;
-        buffer->target_rotate_y = buffer->start_rotate_y;
-        buffer->target_rotate_z = buffer->start_rotate_z;
+    if (target->layer_surf && target->layer_surf->scene_layer) {
+        struct SceneOpacityData state = {
+            .opacity = opacity,
+            .blur_radius = 0.0f,
+            .blur_enabled = 0,
+        };
+        wlr_scene_node_for_each_buffer(&target->layer_surf->scene_layer->tree->node,
+            apply_scene_opacity_iter, &state);
+        return 0;
     }
-    
-    if (msg->flags & 32) { // animate 3d scale
-        buffer->target_scale_z = msg->target_scale_z;
-    } else {
-        buffer->target_scale_z = buffer->start_scale_z;
+    return -1;
+}
+
+static int apply_window_transform(struct WindowTarget *target, float scale_x, float scale_y,
+                                  float rotation) {
+    if (target->buffer) {
+        struct BufferEntry *buffer = target->buffer;
+        buffer->scale_x = scale_x;
+        buffer->scale_y = scale_y;
+        buffer->rotation = rotation;
+        if (buffer->scene_buffer) {
+            wlr_scene_buffer_set_dest_size(buffer->scene_buffer,
+                buffer->width * buffer->scale_x, buffer->height * buffer->scale_y);
+        }
+        return 0;
     }
-    
-    fprintf(stderr, "Started animation for window %u: duration=%ums flags=%u\n",
-            msg->window_id, msg->duration_ms, msg->flags);
-    
-    schedule_frame_update(ipc_server);
-    return 0;
+    if (target->view && target->view->scene_tree) {
+        struct View *view = target->view;
+        view->scale_x = scale_x;
+        view->scale_y = scale_y;
+        view->rotation = rotation;
+
+        struct SceneTransformData state = {
+            .scale_x = view->scale_x,
+            .scale_y = view->scale_y,
+            .transform = rotation_to_output_transform(rotation),
+        };
+        wlr_scene_node_for_each_buffer(&view->scene_tree->node,
+            apply_scene_transform_iter, &state);
+        return 0;
+    }
+    return -1;
 }
 
-static int handle_stop_animation(struct IPCServer *ipc_server, struct IPCClient *client,
-                                const struct icm_msg_stop_animation *msg) {
-    struct BufferEntry *buffer = ipc_buffer_get(ipc_server, msg->window_id);
-    if (!buffer) {
-        fprintf(stderr, "Buffer not found for stop animation %u\n", msg->window_id);
+static int handle_set_window_position(struct IPCServer *ipc_server, struct IPCClient *client,
+                                      const struct icm_msg_set_window_position *msg) {
+    struct WindowTarget target;
+    if (resolve_window(ipc_server, msg->window_id, &target) < 0) {
+        fprintf(stderr, "Window %u not found for positioning\n", msg->window_id);
         return -1;
     }
-    
-    buffer->animating = 0;
-    fprintf(stderr, "Stopped animation for window %u\n", msg->window_id);
-    
-    schedule_frame_update(ipc_server);
+
+    apply_window_position(&target, msg->x, msg->y);
+
+    if (target.view) {
+        fprintf(stderr, "Set view window %u position to (%d, %d) via IPC\n", msg->window_id, msg->x, msg->y);
+    } else if (target.layer_surf) {
+        schedule_frame_update(ipc_server);
+        fprintf(stderr, "Set LayerSurface window %u position to (%d, %d) via IPC\n", msg->window_id, msg->x, msg->y);
+    }
     return 0;
 }
 
-static int handle_set_window_position(struct IPCServer *ipc_server, struct IPCClient *client,
-                                      const struct icm_msg_set_window_position *msg) {
-    struct Server *server = wl_container_of(ipc_server, server, ipc_server);
-    
+static int handle_set_window_size(struct IPCServer *ipc_server, struct IPCClient *client,
+                                  const struct icm_msg_set_window_size *msg, size_t payload_size) {
     // First try to find as a BufferEntry (IPC-created window)
     struct BufferEntry *buffer = ipc_buffer_get(ipc_server, msg->window_id);
     if (buffer) {
-        buffer->x = msg->x;
-        buffer->y = msg->y;
-        
-        // Update scene node immediately if it exists
-        if (buffer->scene_buffer) {
-            wlr_scene_node_set_position(&buffer->scene_buffer->node, buffer->x, buffer->y);
+        if (msg->width == 0 || msg->height == 0 ||
+            (uint64_t)msg->width * msg->height > INT32_MAX / 4) {
+            return -1;
         }
-        return 0;
-    }
-    
-    // Try to find as a View (application window)
-    struct View *view;
-    wl_list_for_each(view, &server->views, link) {
-        if (view->window_id == msg->window_id) {
-            view->x = msg->x;
-            view->y = msg->y;
-            view->position_set_by_ipc = true;  /* Mark as IPC-positioned */
-            if (view->scene_tree) {
-                wlr_scene_node_set_position(&view->scene_tree->node, view->x, view->y);
-            }
-            fprintf(stderr, "Set view window %u position to (%d, %d) via IPC\n", msg->window_id, msg->x, msg->y);
+        if (msg->width == (uint32_t)buffer->width && msg->height == (uint32_t)buffer->height) {
             return 0;
         }
-    }
-        
-    // Also check layer surfaces
-    struct LayerSurface *layer_surf;
-    wl_list_for_each(layer_surf, &server->layer_surfaces, link) {
-        if (layer_surf->window_id == msg->window_id) {
-            // Layer surfaces positioning is handled differently
-            if (layer_surf->scene_layer) {
-                wlr_scene_node_set_position(&layer_surf->scene_layer->tree->node, msg->x, msg->y);
-            }
-            schedule_frame_update(ipc_server);
-            fprintf(stderr, "Set LayerSurface window %u position to (%d, %d) via IPC\n", msg->window_id, msg->x, msg->y);
-            return 0;
+
+        uint8_t mode = HAS_FIELD(struct icm_msg_set_window_size, resize_mode, payload_size)
+            ? msg->resize_mode : ICM_RESIZE_KEEP;
+        if (mode > ICM_RESIZE_SCALE) return -1;
+        if (ipc_buffer_resize(buffer, msg->width, msg->height, mode) < 0) {
+            wlr_log(WLR_ERROR, "Failed to resize buffer %u to %ux%u",
+                    msg->window_id, msg->width, msg->height);
+            return -1;
         }
-    }
-    
-    fprintf(stderr, "Window %u not found for positioning\n", msg->window_id);
-    return -1;
-}
+        draw_window_decorations(buffer);
 
-static int handle_set_window_size(struct IPCServer *ipc_server, struct IPCClient *client,
-                                  const struct icm_msg_set_window_size *msg) {
-    // First try to find as a BufferEntry (IPC-created window)
-    struct BufferEntry *buffer = ipc_buffer_get(ipc_server, msg->window_id);
-    if (buffer) {
-        // Note: This doesn't resize the buffer data, just updates the logical size
-        buffer->width = msg->width;
-        buffer->height = msg->height;
-        
         // Update scene buffer destination size immediately if it exists
         if (buffer->scene_buffer) {
             wlr_scene_buffer_set_dest_size(buffer->scene_buffer, 
                 buffer->width * buffer->scale_x, buffer->height * buffer->scale_y);
         }
-        
+        ipc_notify_window_state(ipc_server, msg->window_id);
+        schedule_frame_update(ipc_server);
+
         fprintf(stderr, "Set IPC window %u size to %ux%u\n", msg->window_id, msg->width, msg->height);
         return 0;
     }
     
     // If not found as BufferEntry, try to find as a View (xdg_toplevel window like Qt)
-    struct Server *server = wl_container_of(ipc_server, server, ipc_server);
-    struct View *view;
-    wl_list_for_each(view, &server->views, link) {
-        if (view->window_id == msg->window_id) {
-            // For xdg_toplevel windows, we need to send a configure event
-            if (!view->is_xwayland && view->xdg_surface && view->xdg_surface->toplevel) {
-                wlr_xdg_toplevel_set_size(view->xdg_surface->toplevel, msg->width, msg->height);
-                fprintf(stderr, "Set View window %u size to %ux%u (xdg_toplevel)\n", msg->window_id, msg->width, msg->height);
-            }
-            return 0;
+    struct View *view = ipc_view_get(ipc_server, msg->window_id);
+    if (view) {
+        // For xdg_toplevel windows, we need to send a configure event
+        if (!view->is_xwayland && view->xdg_surface && view->xdg_surface->toplevel) {
+            wlr_xdg_toplevel_set_size(view->xdg_surface->toplevel, msg->width, msg->height);
+            fprintf(stderr, "Set View window %u size to %ux%u (xdg_toplevel)\n", msg->window_id, msg->width, msg->height);
         }
+        return 0;
     }
     
     // Layer surfaces don't support arbitrary resizing
@@ -2784,53 +4288,13 @@ static int handle_set_window_size(struct IPCServer *ipc_server, struct IPCClient
 
 static int handle_set_window_opacity(struct IPCServer *ipc_server, struct IPCClient *client,
                                      const struct icm_msg_set_window_opacity *msg) {
-    struct BufferEntry *buffer = ipc_buffer_get(ipc_server, msg->window_id);
-    if (!buffer) {
-        struct Server *server = wl_container_of(ipc_server, server, ipc_server);
-        struct View *view;
-        wl_list_for_each(view, &server->views, link) {
-            if (view->window_id == msg->window_id && view->scene_tree) {
-                view->opacity = msg->opacity;
-                struct SceneOpacityData state = {
-                    .opacity = view->opacity,
-                    .blur_radius = view->blur_radius,
-                    .blur_enabled = view->blur_enabled,
-                };
-                wlr_scene_node_for_each_buffer(&view->scene_tree->node,
-                    apply_scene_opacity_iter, &state);
-                schedule_frame_update(ipc_server);
-                fprintf(stderr, "Set view %u opacity to %f\n", msg->window_id, msg->opacity);
-                return 0;
-            }
-        }
-
-        struct LayerSurface *layer_surf;
-        wl_list_for_each(layer_surf, &server->layer_surfaces, link) {
-            if (layer_surf->window_id == msg->window_id && layer_surf->scene_layer) {
-                struct SceneOpacityData state = {
-                    .opacity = msg->opacity,
-                    .blur_radius = 0.0f,
-                    .blur_enabled = 0,
-                };
-                wlr_scene_node_for_each_buffer(&layer_surf->scene_layer->tree->node,
-                    apply_scene_opacity_iter, &state);
-                schedule_frame_update(ipc_server);
-                fprintf(stderr, "Set layer surface %u opacity to %f\n", msg->window_id, msg->opacity);
-                return 0;
-            }
-        }
-
+    struct WindowTarget target;
+    if (resolve_window(ipc_server, msg->window_id, &target) < 0 ||
+        apply_window_opacity(&target, msg->opacity) < 0) {
         fprintf(stderr, "Window %u not found for opacity change\n", msg->window_id);
         return -1;
     }
 
-    buffer->opacity = msg->opacity;
-    
-    // Update scene buffer opacity immediately if it exists
-    if (buffer->scene_buffer) {
-        wlr_scene_buffer_set_opacity(buffer->scene_buffer, buffer->opacity);
-    }
-    
     schedule_frame_update(ipc_server);
     fprintf(stderr, "Set window %u opacity to %f\n", msg->window_id, msg->opacity);
     return 0;
@@ -2840,24 +4304,21 @@ static int handle_set_window_blur(struct IPCServer *ipc_server, struct IPCClient
                                    const struct icm_msg_set_window_blur *msg) {
     struct BufferEntry *buffer = ipc_buffer_get(ipc_server, msg->window_id);
     if (!buffer) {
-        struct Server *server = wl_container_of(ipc_server, server, ipc_server);
-        struct View *view;
-        wl_list_for_each(view, &server->views, link) {
-            if (view->window_id == msg->window_id && view->scene_tree) {
-                view->blur_radius = msg->blur_radius;
-                view->blur_enabled = msg->enabled;
-                struct SceneOpacityData state = {
-                    .opacity = view->opacity,
-                    .blur_radius = view->blur_radius,
-                    .blur_enabled = view->blur_enabled,
-                };
-                wlr_scene_node_for_each_buffer(&view->scene_tree->node,
-                    apply_scene_opacity_iter, &state);
-                schedule_frame_update(ipc_server);
-                fprintf(stderr, "Set view %u blur: radius=%f enabled=%d\n",
-                        msg->window_id, msg->blur_radius, msg->enabled);
-                return 0;
-            }
+        struct View *view = ipc_view_get(ipc_server, msg->window_id);
+        if (view && view->scene_tree) {
+            view->blur_radius = msg->blur_radius;
+            view->blur_enabled = msg->enabled;
+            struct SceneOpacityData state = {
+                .opacity = view->opacity,
+                .blur_radius = view->blur_radius,
+                .blur_enabled = view->blur_enabled,
+            };
+            wlr_scene_node_for_each_buffer(&view->scene_tree->node,
+                apply_scene_opacity_iter, &state);
+            schedule_frame_update(ipc_server);
+            fprintf(stderr, "Set view %u blur: radius=%f enabled=%d\n",
+                    msg->window_id, msg->blur_radius, msg->enabled);
+            return 0;
         }
 
         fprintf(stderr, "Window %u not found for blur change\n", msg->window_id);
@@ -2906,10 +4367,13 @@ static int handle_set_window_effect(struct IPCServer *ipc_server, struct IPCClie
         return -1;
     }
 
-    strncpy(buffer->effect_equation, msg->equation, sizeof(buffer->effect_equation) - 1);
-    buffer->effect_equation[sizeof(buffer->effect_equation) - 1] = '\0';
-    buffer->effect_enabled = msg->enabled;
-    buffer->effect_dirty = 1;
+    struct BufferEffect *effect = buffer_effect(buffer);
+    if (!effect) return -1;
+
+    strncpy(effect->equation, msg->equation, sizeof(effect->equation) - 1);
+    effect->equation[sizeof(effect->equation) - 1] = '\0';
+    effect->enabled = msg->enabled;
+    effect->dirty = 1;
 
     schedule_frame_update(ipc_server);
     fprintf(stderr, "Set window %u effect: equation='%s' enabled=%d\n",
@@ -2919,57 +4383,16 @@ static int handle_set_window_effect(struct IPCServer *ipc_server, struct IPCClie
 
 static int handle_set_window_transform(struct IPCServer *ipc_server, struct IPCClient *client,
                                        const struct icm_msg_set_window_transform *msg) {
-    struct BufferEntry *buffer = ipc_buffer_get(ipc_server, msg->window_id);
-    if (!buffer) {
-        struct Server *server = wl_container_of(ipc_server, server, ipc_server);
-        struct View *view;
-        wl_list_for_each(view, &server->views, link) {
-            if (view->window_id == msg->window_id && view->scene_tree) {
-                view->scale_x = msg->scale_x;
-                view->scale_y = msg->scale_y;
-                view->rotation = msg->rotation;
-
-                enum wl_output_transform transform = WL_OUTPUT_TRANSFORM_NORMAL;
-                if (fabsf(msg->rotation) >= 45.0f && fabsf(msg->rotation) < 135.0f) {
-                    transform = WL_OUTPUT_TRANSFORM_90;
-                } else if (fabsf(msg->rotation) >= 135.0f && fabsf(msg->rotation) < 225.0f) {
-                    transform = WL_OUTPUT_TRANSFORM_180;
-                } else if (fabsf(msg->rotation) >= 225.0f) {
-                    transform = WL_OUTPUT_TRANSFORM_270;
-                }
-
-                struct SceneTransformData state = {
-                    .scale_x = view->scale_x,
-                    .scale_y = view->scale_y,
-                    .transform = transform,
-                };
-                wlr_scene_node_for_each_buffer(&view->scene_tree->node,
-                    apply_scene_transform_iter, &state);
-
-                schedule_frame_update(ipc_server);
-                fprintf(stderr, "Set view %u transform: scale %fx%f, rotation %f\n",
-                        msg->window_id, msg->scale_x, msg->scale_y, msg->rotation);
-                return 0;
-            }
-        }
-
+    struct WindowTarget target;
+    if (resolve_window(ipc_server, msg->window_id, &target) < 0 ||
+        apply_window_transform(&target, msg->scale_x, msg->scale_y, msg->rotation) < 0) {
         fprintf(stderr, "Window %u not found for transform\n", msg->window_id);
         return -1;
     }
 
-    buffer->scale_x = msg->scale_x;
-    buffer->scale_y = msg->scale_y;
-    buffer->rotation = msg->rotation;
-    
     schedule_frame_update(ipc_server);
-    
-    // Update scene buffer destination size immediately if it exists
-    if (buffer->scene_buffer) {
-        wlr_scene_buffer_set_dest_size(buffer->scene_buffer, 
-            buffer->width * buffer->scale_x, buffer->height * buffer->scale_y);
-    }
-    
-    fprintf(stderr, "Set window %u transform: scale %fx%f, rotation %f\n", msg->window_id, msg->scale_x, msg->scale_y, msg->rotation);
+    fprintf(stderr, "Set window %u transform: scale %fx%f, rotation %f\n",
+            msg->window_id, msg->scale_x, msg->scale_y, msg->rotation);
     return 0;
 }
 
@@ -3274,40 +4697,38 @@ static int handle_query_window_info(struct IPCServer *ipc_server, struct IPCClie
 
     // Try to find as a View (xdg_toplevel window like Qt)
     struct Server *server = wl_container_of(ipc_server, server, ipc_server);
-    struct View *view;
-    wl_list_for_each(view, &server->views, link) {
-        if (view->window_id == msg->window_id) {
-            struct icm_msg_window_info_data response = {
-                .window_id = msg->window_id,
-                .x = view->x,
-                .y = view->y,
-                .width = view->xdg_surface->geometry.width > 0 ? view->xdg_surface->geometry.width : 400,
-                .height = view->xdg_surface->geometry.height > 0 ? view->xdg_surface->geometry.height : 300,
-                .visible = view->mapped,
-                .opacity = view->opacity,
-                .scale_x = view->scale_x,
-                .scale_y = view->scale_y,
-                .rotation = view->rotation,
-                .layer = 2, // NORMAL layer
-                .parent_id = 0,
-                .state = 0,
-                .focused = view->mapped && server->grabbed_view == view,
-                .pid = 0,
-            };
-            
-            // Copy title from xdg_toplevel
-            if (view->xdg_surface && view->xdg_surface->toplevel && view->xdg_surface->toplevel->title) {
-                strncpy(response.process_name, view->xdg_surface->toplevel->title, sizeof(response.process_name) - 1);
-            } else {
-                strncpy(response.process_name, "Untitled", sizeof(response.process_name) - 1);
-            }
-            response.process_name[sizeof(response.process_name) - 1] = '\0';
-            
-            send_event_to_client(client, ICM_MSG_WINDOW_INFO_DATA, &response, sizeof(response));
-            fprintf(stderr, "Query window %u info: title='%s', pos=(%d,%d), size=%ux%u\n", 
-                    msg->window_id, response.process_name, response.x, response.y, response.width, response.height);
-            return 0;
+    struct View *view = ipc_view_get(ipc_server, msg->window_id);
+    if (view) {
+        struct icm_msg_window_info_data response = {
+            .window_id = msg->window_id,
+            .x = view->x,
+            .y = view->y,
+            .width = view->xdg_surface->geometry.width > 0 ? view->xdg_surface->geometry.width : 400,
+            .height = view->xdg_surface->geometry.height > 0 ? view->xdg_surface->geometry.height : 300,
+            .visible = view->mapped,
+            .opacity = view->opacity,
+            .scale_x = view->scale_x,
+            .scale_y = view->scale_y,
+            .rotation = view->rotation,
+            .layer = 2, // NORMAL layer
+            .parent_id = 0,
+            .state = 0,
+            .focused = view->mapped && server->grabbed_view == view,
+            .pid = 0,
+        };
+        
+        // Copy title from xdg_toplevel
+        if (view->xdg_surface && view->xdg_surface->toplevel && view->xdg_surface->toplevel->title) {
+            strncpy(response.process_name, view->xdg_surface->toplevel->title, sizeof(response.process_name) - 1);
+        } else {
+            strncpy(response.process_name, "Untitled", sizeof(response.process_name) - 1);
         }
+        response.process_name[sizeof(response.process_name) - 1] = '\0';
+        
+        send_event_to_client(client, ICM_MSG_WINDOW_INFO_DATA, &response, sizeof(response));
+        fprintf(stderr, "Query window %u info: title='%s', pos=(%d,%d), size=%ux%u\n", 
+                msg->window_id, response.process_name, response.x, response.y, response.width, response.height);
+        return 0;
     }
 
     // Return error if window not found
@@ -3374,18 +4795,469 @@ static int handle_query_toplevel_windows(struct IPCServer *ipc_server, struct IP
             idx++;
         }
     }
-    
-    send_event_to_client(client, ICM_MSG_TOPLEVEL_WINDOWS_DATA, response_buf, response_size);
-    free(response_buf);
-    
-    fprintf(stderr, "Query toplevel windows: found %u windows\n", count);
-    return 0;
+    
+    send_event_to_client(client, ICM_MSG_TOPLEVEL_WINDOWS_DATA, response_buf, response_size);
+    free(response_buf);
+    
+    fprintf(stderr, "Query toplevel windows: found %u windows\n", count);
+    return 0;
+}
+
+/* Batched window queries */
+
+#define WINDOWS_BATCH_REPLY_MAX (65536 - sizeof(struct icm_ipc_header))
+/* The fields batch_append_record knows how to write */
+#define WINDOWS_BATCH_FIELDS (ICM_WINDOW_FIELD_GEOMETRY | ICM_WINDOW_FIELD_STATE | \
+                              ICM_WINDOW_FIELD_APPEARANCE | ICM_WINDOW_FIELD_TITLE | \
+                              ICM_WINDOW_FIELD_APP_ID)
+#define WINDOWS_BATCH_STRING_MAX 1024
+
+/* Everything a batch record can carry; strings point at compositor-owned
+ * storage and are copied once, straight into the reply */
+struct WindowSnapshot {
+    uint32_t window_id;
+    uint8_t kind;
+    int32_t x, y;
+    uint32_t width, height;
+    uint32_t state;
+    uint8_t visible, focused;
+    float opacity, scale_x, scale_y, rotation;
+    const char *title;
+    const char *app_id;
+};
+
+static void snapshot_buffer(struct BufferEntry *buffer, struct WindowSnapshot *snap) {
+    *snap = (struct WindowSnapshot){
+        .window_id = buffer->buffer_id,
+        .kind = ICM_WINDOW_KIND_IPC,
+        .x = buffer->x,
+        .y = buffer->y,
+        .width = buffer->width,
+        .height = buffer->height,
+        .state = (buffer->minimized ? 1 : 0) | (buffer->maximized ? 2 : 0) |
+                 (buffer->fullscreen ? 4 : 0) | (buffer->decorated ? 8 : 0),
+        .visible = buffer->visible,
+        .focused = buffer->focused,
+        .opacity = buffer->opacity,
+        .scale_x = buffer->scale_x,
+        .scale_y = buffer->scale_y,
+        .rotation = buffer->rotation,
+        .title = "",
+        .app_id = "",
+    };
+}
+
+static void snapshot_view(struct Server *server, struct View *view, struct WindowSnapshot *snap) {
+    *snap = (struct WindowSnapshot){
+        .window_id = view->window_id,
+        .kind = ICM_WINDOW_KIND_TOPLEVEL,
+        .x = view->x,
+        .y = view->y,
+        .visible = view->mapped,
+        .opacity = view->opacity,
+        .scale_x = view->scale_x,
+        .scale_y = view->scale_y,
+        .rotation = view->rotation,
+        .title = "",
+        .app_id = "",
+    };
+
+    struct wlr_surface *surface = NULL;
+    if (view->is_xwayland) {
+        struct wlr_xwayland_surface *xsurface = view->xwayland_surface;
+        if (xsurface) {
+            surface = xsurface->surface;
+            snap->width = xsurface->width;
+            snap->height = xsurface->height;
+            snap->state = (xsurface->minimized ? 1 : 0) |
+                          (xsurface->maximized_vert && xsurface->maximized_horz ? 2 : 0) |
+                          (xsurface->fullscreen ? 4 : 0);
+            if (xsurface->title) snap->title = xsurface->title;
+            if (xsurface->class) snap->app_id = xsurface->class;
+        }
+    } else if (view->xdg_surface) {
+        surface = view->xdg_surface->surface;
+        snap->width = view->xdg_surface->geometry.width > 0 ? view->xdg_surface->geometry.width : 400;
+        snap->height = view->xdg_surface->geometry.height > 0 ? view->xdg_surface->geometry.height : 300;
+        struct wlr_xdg_toplevel *toplevel = view->xdg_surface->role == WLR_XDG_SURFACE_ROLE_TOPLEVEL ?
+            view->xdg_surface->toplevel : NULL;
+        if (toplevel) {
+            snap->state = (toplevel->current.maximized ? 2 : 0) |
+                          (toplevel->current.fullscreen ? 4 : 0);
+            if (toplevel->title) snap->title = toplevel->title;
+            if (toplevel->app_id) snap->app_id = toplevel->app_id;
+        }
+    }
+
+    snap->focused = view->window_id == server->focused_window_id ||
+                    (surface && server->seat->keyboard_state.focused_surface == surface);
+}
+
+static void snapshot_layer_surface(struct LayerSurface *layer_surf, struct WindowSnapshot *snap) {
+    struct wlr_layer_surface_v1 *layer_surface = layer_surf->layer_surface;
+    *snap = (struct WindowSnapshot){
+        .window_id = layer_surf->window_id,
+        .kind = ICM_WINDOW_KIND_LAYER,
+        .width = layer_surface->current.actual_width,
+        .height = layer_surface->current.actual_height,
+        .visible = layer_surface->surface && layer_surface->surface->mapped,
+        .opacity = 1.0f,
+        .scale_x = 1.0f,
+        .scale_y = 1.0f,
+        .title = layer_surface->namespace ? layer_surface->namespace : "",
+        .app_id = "",
+    };
+    if (layer_surf->scene_layer) {
+        snap->x = layer_surf->scene_layer->tree->node.x;
+        snap->y = layer_surf->scene_layer->tree->node.y;
+    }
+}
+
+/* Clamp to the string limit without splitting a UTF-8 sequence */
+static size_t batch_string_length(const char *str) {
+    size_t len = strnlen(str, WINDOWS_BATCH_STRING_MAX + 1);
+    if (len <= WINDOWS_BATCH_STRING_MAX) return len;
+    len = WINDOWS_BATCH_STRING_MAX;
+    while (len > 0 && ((uint8_t)str[len] & 0xC0) == 0x80) len--;
+    return len;
+}
+
+/* Append one record; returns 0 if it did not fit */
+static int batch_append_record(uint8_t *reply, size_t *pos, uint32_t fields,
+                               const struct WindowSnapshot *snap) {
+    size_t title_len = (fields & ICM_WINDOW_FIELD_TITLE) ? batch_string_length(snap->title) : 0;
+    size_t app_id_len = (fields & ICM_WINDOW_FIELD_APP_ID) ? batch_string_length(snap->app_id) : 0;
+
+    size_t size = 8;
+    if (fields & ICM_WINDOW_FIELD_GEOMETRY) size += 16;
+    if (fields & ICM_WINDOW_FIELD_STATE) size += 8;
+    if (fields & ICM_WINDOW_FIELD_APPEARANCE) size += 16;
+    if (fields & ICM_WINDOW_FIELD_TITLE) size += 2 + title_len;
+    if (fields & ICM_WINDOW_FIELD_APP_ID) size += 2 + app_id_len;
+    size = (size + 3) & ~(size_t)3;
+
+    if (*pos + size > WINDOWS_BATCH_REPLY_MAX) return 0;
+
+    uint8_t *p = reply + *pos;
+    memset(p, 0, size);
+    memcpy(p, &snap->window_id, 4);
+    p[4] = snap->kind;
+    p += 8;
+
+    if (fields & ICM_WINDOW_FIELD_GEOMETRY) {
+        memcpy(p, &snap->x, 4);
+        memcpy(p + 4, &snap->y, 4);
+        memcpy(p + 8, &snap->width, 4);
+        memcpy(p + 12, &snap->height, 4);
+        p += 16;
+    }
+    if (fields & ICM_WINDOW_FIELD_STATE) {
+        memcpy(p, &snap->state, 4);
+        p[4] = snap->visible;
+        p[5] = snap->focused;
+        p += 8;
+    }
+    if (fields & ICM_WINDOW_FIELD_APPEARANCE) {
+        memcpy(p, &snap->opacity, 4);
+        memcpy(p + 4, &snap->scale_x, 4);
+        memcpy(p + 8, &snap->scale_y, 4);
+        memcpy(p + 12, &snap->rotation, 4);
+        p += 16;
+    }
+    if (fields & ICM_WINDOW_FIELD_TITLE) {
+        uint16_t len = title_len;
+        memcpy(p, &len, 2);
+        memcpy(p + 2, snap->title, title_len);
+        p += 2 + title_len;
+    }
+    if (fields & ICM_WINDOW_FIELD_APP_ID) {
+        uint16_t len = app_id_len;
+        memcpy(p, &len, 2);
+        memcpy(p + 2, snap->app_id, app_id_len);
+    }
+
+    *pos += size;
+    return 1;
+}
+
+static int handle_query_windows_batch(struct IPCServer *ipc_server, struct IPCClient *client,
+                                      const struct icm_msg_query_windows_batch *msg,
+                                      uint32_t payload_size) {
+    struct Server *server = wl_container_of(ipc_server, server, ipc_server);
+
+    if (payload_size < sizeof(*msg)) {
+        return -1;
+    }
+    if (msg->filter == ICM_WINDOW_FILTER_IDS &&
+        msg->num_ids > (payload_size - sizeof(*msg)) / sizeof(uint32_t)) {
+        fprintf(stderr, "QUERY_WINDOWS_BATCH: %u ids do not fit in %u bytes\n",
+                msg->num_ids, payload_size);
+        return -1;
+    }
+
+    uint8_t *reply = malloc(WINDOWS_BATCH_REPLY_MAX);
+    if (!reply) {
+        return -1;
+    }
+
+    /* Unknown bits would claim fields no record carries */
+    uint32_t fields = msg->fields & WINDOWS_BATCH_FIELDS;
+    struct icm_msg_windows_batch_data *head = (struct icm_msg_windows_batch_data *)reply;
+    head->fields = fields;
+    head->num_windows = 0;
+    head->flags = 0;
+    size_t pos = sizeof(*head);
+    int visible_only = msg->flags & ICM_WINDOW_QUERY_VISIBLE_ONLY;
+    struct WindowSnapshot snap;
+
+#define BATCH_EMIT() \
+    do { \
+        if (visible_only && !snap.visible) break; \
+        if (!batch_append_record(reply, &pos, fields, &snap)) { \
+            head->flags |= ICM_WINDOWS_BATCH_TRUNCATED; \
+            goto send; \
+        } \
+        head->num_windows++; \
+    } while (0)
+
+    if (msg->filter == ICM_WINDOW_FILTER_IDS) {
+        const uint32_t *ids = (const uint32_t *)(msg + 1);
+        for (uint32_t i = 0; i < msg->num_ids; i++) {
+            struct WindowTarget target;
+            if (resolve_window(ipc_server, ids[i], &target) < 0) {
+                continue;
+            }
+            if (target.buffer) {
+                snapshot_buffer(target.buffer, &snap);
+            } else if (target.view) {
+                snapshot_view(server, target.view, &snap);
+            } else {
+                snapshot_layer_surface(target.layer_surf, &snap);
+            }
+            BATCH_EMIT();
+        }
+    } else if (msg->filter == ICM_WINDOW_FILTER_ALL || msg->filter == ICM_WINDOW_FILTER_TOPLEVELS) {
+        int all = msg->filter == ICM_WINDOW_FILTER_ALL;
+        if (all) {
+            struct BufferEntry *buffer;
+            slab_for_each(buffer, &ipc_server->buffers) {
+                if (slab_handle(buffer) == ipc_server->screen_effect_handle) continue;
+                snapshot_buffer(buffer, &snap);
+                BATCH_EMIT();
+            }
+        }
+        struct View *view;
+        wl_list_for_each(view, &server->views, link) {
+            snapshot_view(server, view, &snap);
+            BATCH_EMIT();
+        }
+        if (all) {
+            struct LayerSurface *layer_surf;
+            wl_list_for_each(layer_surf, &server->layer_surfaces, link) {
+                snapshot_layer_surface(layer_surf, &snap);
+                BATCH_EMIT();
+            }
+        }
+    } else {
+        free(reply);
+        return -1;
+    }
+
+#undef BATCH_EMIT
+
+send:
+    send_event_to_client(client, ICM_MSG_WINDOWS_BATCH_DATA, reply, pos);
+    free(reply);
+    return 0;
+}
+
+/* Window event stream */
+
+/* Send to every client holding a bit of mask, or to all clients if mask is 0 */
+static void broadcast_window_event(struct IPCServer *ipc_server, uint32_t mask, uint16_t type,
+                                   const void *payload, size_t payload_size) {
+    struct IPCClient *c, *tmp;
+    wl_list_for_each_safe(c, tmp, &ipc_server->clients, link) {
+        if (mask && !(c->window_event_mask & mask)) continue;
+        if (send_event_to_client(c, type, payload, payload_size) < 0) {
+            /* Client disconnected, will be cleaned up elsewhere */
+        }
+    }
+}
+
+/* Title and app_id events share one layout: id, length, then the bytes */
+static size_t encode_window_string_event(uint8_t *buf, uint32_t window_id, const char *str) {
+    struct icm_msg_window_title_changed *event = (struct icm_msg_window_title_changed *)buf;
+    size_t len = str ? batch_string_length(str) : 0;
+    event->window_id = window_id;
+    event->title_len = len;
+    event->reserved = 0;
+    if (len) memcpy(event + 1, str, len);
+    return sizeof(*event) + len;
+}
+
+static void snapshot_window_state(const struct WindowSnapshot *snap,
+                                  struct icm_msg_window_state_changed *event) {
+    *event = (struct icm_msg_window_state_changed){
+        .window_id = snap->window_id,
+        .state = snap->state,
+        .visible = snap->visible,
+        .focused = snap->focused,
+    };
+}
+
+/* Push a state event if the window differs from what subscribers last saw */
+static void report_window_state(struct IPCServer *ipc_server, const struct WindowSnapshot *snap,
+                                struct WindowEventState *reported) {
+    if (snap->width != reported->width || snap->height != reported->height) {
+        reported->width = snap->width;
+        reported->height = snap->height;
+        struct icm_msg_window_size_changed event = {
+            .window_id = snap->window_id,
+            .width = snap->width,
+            .height = snap->height,
+        };
+        broadcast_window_event(ipc_server, ICM_WINDOW_EVENT_SIZE, ICM_MSG_WINDOW_SIZE_CHANGED,
+                               &event, sizeof(event));
+    }
+
+    uint32_t mask = 0;
+    if (snap->state != reported->state || snap->visible != reported->visible) {
+        mask |= ICM_WINDOW_EVENT_STATE;
+    }
+    if (snap->focused != reported->focused) {
+        mask |= ICM_WINDOW_EVENT_FOCUS;
+    }
+    if (!mask) return;
+
+    reported->state = snap->state;
+    reported->visible = snap->visible;
+    reported->focused = snap->focused;
+
+    struct icm_msg_window_state_changed event;
+    snapshot_window_state(snap, &event);
+    broadcast_window_event(ipc_server, mask, ICM_MSG_WINDOW_STATE_CHANGED, &event, sizeof(event));
+}
+
+void ipc_notify_window_created(struct IPCServer *ipc_server, const struct icm_msg_window_created *event) {
+    broadcast_window_event(ipc_server, 0, ICM_MSG_WINDOW_CREATED, event, sizeof(*event));
+}
+
+void ipc_notify_window_destroyed(struct IPCServer *ipc_server, uint32_t window_id) {
+    struct icm_msg_window_destroyed event = {
+        .window_id = window_id
+    };
+    broadcast_window_event(ipc_server, 0, ICM_MSG_WINDOW_DESTROYED, &event, sizeof(event));
+}
+
+void ipc_notify_window_title(struct IPCServer *ipc_server, uint32_t window_id, const char *title) {
+    uint8_t buf[sizeof(struct icm_msg_window_title_changed) + WINDOWS_BATCH_STRING_MAX];
+    size_t size = encode_window_string_event(buf, window_id, title);
+    broadcast_window_event(ipc_server, ICM_WINDOW_EVENT_TITLE, ICM_MSG_WINDOW_TITLE_CHANGED, buf, size);
+}
+
+void ipc_notify_window_app_id(struct IPCServer *ipc_server, uint32_t window_id, const char *app_id) {
+    uint8_t buf[sizeof(struct icm_msg_window_app_id_changed) + WINDOWS_BATCH_STRING_MAX];
+    size_t size = encode_window_string_event(buf, window_id, app_id);
+    broadcast_window_event(ipc_server, ICM_WINDOW_EVENT_APP_ID, ICM_MSG_WINDOW_APP_ID_CHANGED, buf, size);
+}
+
+void ipc_notify_view_state(struct IPCServer *ipc_server, struct View *view) {
+    struct Server *server = wl_container_of(ipc_server, server, ipc_server);
+    struct WindowSnapshot snap;
+    snapshot_view(server, view, &snap);
+    report_window_state(ipc_server, &snap, &view->reported);
+}
+
+void ipc_notify_window_state(struct IPCServer *ipc_server, uint32_t window_id) {
+    struct WindowTarget target;
+    if (window_id == 0 || resolve_window(ipc_server, window_id, &target) < 0) {
+        return;
+    }
+
+    struct WindowSnapshot snap;
+    if (target.buffer) {
+        snapshot_buffer(target.buffer, &snap);
+        report_window_state(ipc_server, &snap, &target.buffer->reported);
+    } else if (target.view) {
+        ipc_notify_view_state(ipc_server, target.view);
+    } else {
+        snapshot_layer_surface(target.layer_surf, &snap);
+        report_window_state(ipc_server, &snap, &target.layer_surf->reported);
+    }
+}
+
+/* Replay the current state of one window for the newly subscribed bits */
+static void send_window_snapshot(struct IPCClient *client, uint32_t mask,
+                                 const struct WindowSnapshot *snap) {
+    if (mask & ICM_WINDOW_EVENT_CREATED) {
+        struct icm_msg_window_created event = {
+            .window_id = snap->window_id,
+            .width = snap->width,
+            .height = snap->height,
+            .decorated = (snap->state & 8) ? 1 : 0,
+            .focused = snap->focused
+        };
+        send_event_to_client(client, ICM_MSG_WINDOW_CREATED, &event, sizeof(event));
+    }
+
+    uint8_t buf[sizeof(struct icm_msg_window_title_changed) + WINDOWS_BATCH_STRING_MAX];
+    if ((mask & ICM_WINDOW_EVENT_TITLE) && snap->title[0]) {
+        size_t size = encode_window_string_event(buf, snap->window_id, snap->title);
+        send_event_to_client(client, ICM_MSG_WINDOW_TITLE_CHANGED, buf, size);
+    }
+    if ((mask & ICM_WINDOW_EVENT_APP_ID) && snap->app_id[0]) {
+        size_t size = encode_window_string_event(buf, snap->window_id, snap->app_id);
+        send_event_to_client(client, ICM_MSG_WINDOW_APP_ID_CHANGED, buf, size);
+    }
+
+    if (mask & (ICM_WINDOW_EVENT_STATE | ICM_WINDOW_EVENT_FOCUS)) {
+        struct icm_msg_window_state_changed event;
+        snapshot_window_state(snap, &event);
+        send_event_to_client(client, ICM_MSG_WINDOW_STATE_CHANGED, &event, sizeof(event));
+    }
+
+    if (mask & ICM_WINDOW_EVENT_SIZE) {
+        struct icm_msg_window_size_changed event = {
+            .window_id = snap->window_id,
+            .width = snap->width,
+            .height = snap->height,
+        };
+        send_event_to_client(client, ICM_MSG_WINDOW_SIZE_CHANGED, &event, sizeof(event));
+    }
+}
+
+static void send_window_snapshots(struct IPCServer *ipc_server, struct IPCClient *client, uint32_t mask) {
+    struct Server *server = wl_container_of(ipc_server, server, ipc_server);
+    struct WindowSnapshot snap;
+
+    struct BufferEntry *buffer;
+    slab_for_each(buffer, &ipc_server->buffers) {
+        if (slab_handle(buffer) == ipc_server->screen_effect_handle) continue;
+        snapshot_buffer(buffer, &snap);
+        send_window_snapshot(client, mask, &snap);
+    }
+    struct View *view;
+    wl_list_for_each(view, &server->views, link) {
+        snapshot_view(server, view, &snap);
+        send_window_snapshot(client, mask, &snap);
+    }
+    struct LayerSurface *layer_surf;
+    wl_list_for_each(layer_surf, &server->layer_surfaces, link) {
+        snapshot_layer_surface(layer_surf, &snap);
+        send_window_snapshot(client, mask, &snap);
+    }
 }
 
 static int handle_subscribe_window_events(struct IPCServer *ipc_server, struct IPCClient *client,
                                           const struct icm_msg_subscribe_window_events *msg) {
+    uint32_t added = msg->event_mask & ~client->window_event_mask;
     client->window_event_mask |= msg->event_mask;
     fprintf(stderr, "Client subscribed to window events: mask=0x%x\n", client->window_event_mask);
+
+    if (added & ~ICM_WINDOW_EVENT_DESTROYED) {
+        send_window_snapshots(ipc_server, client, added);
+    }
     return 0;
 }
 
@@ -3396,6 +5268,187 @@ static int handle_unsubscribe_window_events(struct IPCServer *ipc_server, struct
     return 0;
 }
 
+/* Shared state page */
+
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE 0x0010
+#endif
+
+#define STATE_PAGE_SIZE ((sizeof(struct icm_state_page) + 4095) & ~(size_t)4095)
+#define STATE_PAGE_BODY offsetof(struct icm_state_page, cursor_x)
+
+struct IPCStatePage {
+    int fd;
+    struct icm_state_page *page;    /* the only writable mapping */
+    struct icm_state_page next;     /* scratch for the next update */
+};
+
+static struct IPCStatePage *state_page_create(void) {
+    struct IPCStatePage *sp = calloc(1, sizeof(*sp));
+    if (!sp) return NULL;
+
+    sp->fd = memfd_create("icm-state-page", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (sp->fd < 0) {
+        wlr_log(WLR_ERROR, "Failed to create state page memfd: %s", strerror(errno));
+        free(sp);
+        return NULL;
+    }
+    if (ftruncate(sp->fd, STATE_PAGE_SIZE) < 0) {
+        wlr_log(WLR_ERROR, "Failed to size state page: %s", strerror(errno));
+        goto fail;
+    }
+    sp->page = mmap(NULL, STATE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, sp->fd, 0);
+    if (sp->page == MAP_FAILED) {
+        wlr_log(WLR_ERROR, "Failed to map state page: %s", strerror(errno));
+        goto fail;
+    }
+
+    /* Our mapping stays writable; clients can only ever map it read-only */
+    if (fcntl(sp->fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_FUTURE_WRITE) < 0) {
+        wlr_log(WLR_INFO, "State page: F_SEAL_FUTURE_WRITE unsupported, clients could write to it");
+        fcntl(sp->fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW);
+    }
+    fcntl(sp->fd, F_ADD_SEALS, F_SEAL_SEAL);
+
+    sp->page->magic = ICM_STATE_PAGE_MAGIC;
+    sp->page->version = ICM_STATE_PAGE_VERSION;
+    sp->page->size = sizeof(struct icm_state_page);
+    return sp;
+
+fail:
+    close(sp->fd);
+    free(sp);
+    return NULL;
+}
+
+static void state_page_destroy(struct IPCStatePage *sp) {
+    if (!sp) return;
+    munmap(sp->page, STATE_PAGE_SIZE);
+    close(sp->fd);
+    free(sp);
+}
+
+/* Readers retry while the sequence is odd or has moved under them */
+static void state_page_begin_write(struct icm_state_page *page) {
+    __atomic_store_n(&page->sequence, page->sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void state_page_end_write(struct icm_state_page *page) {
+    __atomic_store_n(&page->sequence, page->sequence + 1, __ATOMIC_RELEASE);
+}
+
+static void state_page_add_window(struct icm_state_page *next, const struct WindowSnapshot *snap) {
+    if (next->num_windows == ICM_STATE_PAGE_MAX_WINDOWS) {
+        next->flags |= ICM_STATE_PAGE_WINDOWS_TRUNCATED;
+        return;
+    }
+    next->windows[next->num_windows++] = (struct icm_state_page_window){
+        .window_id = snap->window_id,
+        .kind = snap->kind,
+        .visible = snap->visible,
+        .focused = snap->focused,
+        .x = snap->x,
+        .y = snap->y,
+        .width = snap->width,
+        .height = snap->height,
+        .state = snap->state,
+    };
+}
+
+static void state_page_build(struct IPCServer *ipc_server, struct icm_state_page *next) {
+    struct Server *server = ipc_server->server;
+    memset(next, 0, sizeof(*next));
+
+    next->cursor_x = server->cursor->x;
+    next->cursor_y = server->cursor->y;
+    next->focused_window_id = server->focused_window_id;
+
+    struct wlr_output_layout_output *lo;
+    wl_list_for_each(lo, &server->output_layout->outputs, link) {
+        if (next->num_outputs == ICM_STATE_PAGE_MAX_OUTPUTS) break;
+        struct icm_state_page_output *out = &next->outputs[next->num_outputs++];
+        int width = 0, height = 0;
+        wlr_output_effective_resolution(lo->output, &width, &height);
+        out->x = lo->x;
+        out->y = lo->y;
+        out->width = width;
+        out->height = height;
+        out->scale = lo->output->scale;
+        out->enabled = lo->output->enabled;
+    }
+
+    struct WindowSnapshot snap;
+    struct BufferEntry *buffer;
+    slab_for_each(buffer, &ipc_server->buffers) {
+        if (slab_handle(buffer) == ipc_server->screen_effect_handle) continue;
+        snapshot_buffer(buffer, &snap);
+        state_page_add_window(next, &snap);
+    }
+    struct View *view;
+    wl_list_for_each(view, &server->views, link) {
+        snapshot_view(server, view, &snap);
+        state_page_add_window(next, &snap);
+    }
+    struct LayerSurface *layer_surf;
+    wl_list_for_each(layer_surf, &server->layer_surfaces, link) {
+        snapshot_layer_surface(layer_surf, &snap);
+        state_page_add_window(next, &snap);
+    }
+}
+
+void ipc_state_page_update(struct IPCServer *ipc_server) {
+    struct IPCStatePage *sp = ipc_server->state_page;
+    if (!sp) return;
+
+    struct icm_state_page *page = sp->page;
+    struct icm_state_page *next = &sp->next;
+    state_page_build(ipc_server, next);
+
+    size_t table_size = next->num_windows * sizeof(struct icm_state_page_window);
+    int table_changed = next->num_windows != page->num_windows ||
+                        memcmp(next->windows, page->windows, table_size) != 0;
+    next->window_generation = page->window_generation + (table_changed ? 1 : 0);
+
+    /* Most frames change nothing; leave the sequence alone so readers
+     * never retry for them */
+    if (memcmp((uint8_t *)next + STATE_PAGE_BODY, (uint8_t *)page + STATE_PAGE_BODY,
+               sizeof(*next) - STATE_PAGE_BODY) == 0) {
+        return;
+    }
+
+    state_page_begin_write(page);
+    memcpy((uint8_t *)page + STATE_PAGE_BODY, (uint8_t *)next + STATE_PAGE_BODY,
+           sizeof(*next) - STATE_PAGE_BODY);
+    state_page_end_write(page);
+}
+
+void ipc_state_page_set_cursor(struct IPCServer *ipc_server, double x, double y) {
+    struct IPCStatePage *sp = ipc_server->state_page;
+    if (!sp || (sp->page->cursor_x == x && sp->page->cursor_y == y)) return;
+
+    /* Hardware cursors move without a frame, so motion writes through */
+    state_page_begin_write(sp->page);
+    sp->page->cursor_x = x;
+    sp->page->cursor_y = y;
+    state_page_end_write(sp->page);
+}
+
+static int handle_get_state_page(struct IPCServer *ipc_server, struct IPCClient *client) {
+    if (!ipc_server->state_page) {
+        ipc_server->state_page = state_page_create();
+        if (!ipc_server->state_page) return -1;
+        ipc_state_page_update(ipc_server);
+    }
+
+    struct icm_msg_state_page reply = {
+        .size = STATE_PAGE_SIZE,
+        .version = ICM_STATE_PAGE_VERSION,
+    };
+    int fd = ipc_server->state_page->fd;
+    return send_event_to_client_with_fds(client, ICM_MSG_STATE_PAGE, &reply, sizeof(reply), &fd, 1);
+}
+
 static int handle_set_window_decorations(struct IPCServer *ipc_server, struct IPCClient *client,
                                          const struct icm_msg_set_window_decorations *msg) {
     if (msg->server_side) {
@@ -3456,6 +5509,62 @@ static int handle_launch_app(struct IPCServer *ipc_server, struct IPCClient *cli
     return 0;
 }
 
+static int handle_set_windows_properties(struct IPCServer *ipc_server, struct IPCClient *client,
+                                         const struct icm_msg_set_windows_properties *msg,
+                                         uint32_t payload_size) {
+    if (payload_size < sizeof(*msg)) {
+        return -1;
+    }
+    uint32_t max_records = (payload_size - sizeof(*msg)) / sizeof(struct icm_window_properties_record);
+    if (msg->num_records > max_records) {
+        fprintf(stderr, "SET_WINDOWS_PROPERTIES: %u records do not fit in %u bytes\n",
+                msg->num_records, payload_size);
+        return -1;
+    }
+
+    const struct icm_window_properties_record *records =
+        (const struct icm_window_properties_record *)(msg + 1);
+    uint32_t applied = 0;
+    uint32_t missing = 0;
+
+    for (uint32_t i = 0; i < msg->num_records; i++) {
+        const struct icm_window_properties_record *rec = &records[i];
+        struct WindowTarget target;
+        if (resolve_window(ipc_server, rec->window_id, &target) < 0) {
+            missing++;
+            continue;
+        }
+        if (rec->mask & ICM_WINDOW_PROP_POSITION) {
+            apply_window_position(&target, rec->x, rec->y);
+        }
+        if (rec->mask & ICM_WINDOW_PROP_OPACITY) {
+            apply_window_opacity(&target, rec->opacity);
+        }
+        if (rec->mask & ICM_WINDOW_PROP_TRANSFORM) {
+            apply_window_transform(&target, rec->scale_x, rec->scale_y, rec->rotation);
+        }
+        applied++;
+    }
+
+    if (applied > 0) {
+        schedule_frame_update(ipc_server);
+    }
+    if (missing > 0) {
+        wlr_log(WLR_DEBUG, "SET_WINDOWS_PROPERTIES: %u of %u windows not found",
+                missing, msg->num_records);
+    }
+    return missing == msg->num_records && missing > 0 ? -1 : 0;
+}
+
+static int handle_set_client_priority(struct IPCServer *ipc_server, struct IPCClient *client,
+                                      const struct icm_msg_set_client_priority *msg) {
+    if (msg->priority > ICM_CLIENT_PRIORITY_HIGH) {
+        return -1;
+    }
+    client->priority = msg->priority;
+    return 0;
+}
+
 /* Main message dispatcher */
 static int process_message(struct IPCServer *ipc_server, struct IPCClient *client,
                            struct icm_ipc_header *header, uint8_t *payload,
@@ -3473,6 +5582,16 @@ static int process_message(struct IPCServer *ipc_server, struct IPCClient *clien
         ret = handle_destroy_buffer(ipc_server, client, msg);
         break;
     }
+    case ICM_MSG_QUERY_BUFFER_INFO: {
+        struct icm_msg_query_buffer_info *msg = (struct icm_msg_query_buffer_info *)payload;
+        ret = handle_query_buffer_info(ipc_server, client, msg);
+        break;
+    }
+    case ICM_MSG_COMMIT_BUFFER: {
+        struct icm_msg_commit_buffer *msg = (struct icm_msg_commit_buffer *)payload;
+        ret = handle_commit_buffer(ipc_server, client, msg, header->length - sizeof(struct icm_ipc_header));
+        break;
+    }
     case ICM_MSG_IMPORT_DMABUF: {
         struct icm_msg_import_dmabuf *msg = (struct icm_msg_import_dmabuf *)payload;
         ret = handle_import_dmabuf(ipc_server, client, msg, fds, num_fds);
@@ -3480,23 +5599,48 @@ static int process_message(struct IPCServer *ipc_server, struct IPCClient *clien
     }
     case ICM_MSG_DRAW_RECT: {
         struct icm_msg_draw_rect *msg = (struct icm_msg_draw_rect *)payload;
-        ret = handle_draw_rect(ipc_server, client, msg);
+        ret = handle_draw_rect(ipc_server, client, msg, header->length - sizeof(struct icm_ipc_header));
+        break;
+    }
+    case ICM_MSG_CLEAR_RECTS: {
+        struct icm_msg_clear_rects *msg = (struct icm_msg_clear_rects *)payload;
+        ret = handle_clear_rects(ipc_server, client, msg);
         break;
     }
     case ICM_MSG_DRAW_LINE: {
         struct icm_msg_draw_line *msg = (struct icm_msg_draw_line *)payload;
-        ret = handle_draw_line(ipc_server, client, msg);
+        ret = handle_draw_line(ipc_server, client, msg, header->length - sizeof(struct icm_ipc_header));
         break;
     }
     case ICM_MSG_DRAW_CIRCLE: {
         struct icm_msg_draw_circle *msg = (struct icm_msg_draw_circle *)payload;
-        ret = handle_draw_circle(ipc_server, client, msg);
+        ret = handle_draw_circle(ipc_server, client, msg, header->length - sizeof(struct icm_ipc_header));
         break;
     }
     case ICM_MSG_DRAW_POLYGON: {
         ret = handle_draw_polygon(ipc_server, client, payload, header->length - sizeof(struct icm_ipc_header));
         break;
     }
+    case ICM_MSG_DRAW_IMAGE: {
+        struct icm_msg_draw_image *msg = (struct icm_msg_draw_image *)payload;
+        ret = handle_draw_image(ipc_server, client, msg);
+        break;
+    }
+    case ICM_MSG_DRAW_RECTS: {
+        struct icm_msg_draw_instanced *msg = (struct icm_msg_draw_instanced *)payload;
+        ret = handle_draw_rects(ipc_server, client, msg, header->length - sizeof(struct icm_ipc_header));
+        break;
+    }
+    case ICM_MSG_DRAW_LINES: {
+        struct icm_msg_draw_instanced *msg = (struct icm_msg_draw_instanced *)payload;
+        ret = handle_draw_lines(ipc_server, client, msg, header->length - sizeof(struct icm_ipc_header));
+        break;
+    }
+    case ICM_MSG_DRAW_SPRITES: {
+        struct icm_msg_draw_instanced *msg = (struct icm_msg_draw_instanced *)payload;
+        ret = handle_draw_sprites(ipc_server, client, msg, header->length - sizeof(struct icm_ipc_header));
+        break;
+    }
     case ICM_MSG_BATCH_BEGIN: {
         struct icm_msg_batch_begin *msg = (struct icm_msg_batch_begin *)payload;
         client->batch_id = msg->batch_id;
@@ -3552,7 +5696,8 @@ static int process_message(struct IPCServer *ipc_server, struct IPCClient *clien
     }
     case ICM_MSG_DRAW_UPLOADED_IMAGE: {
         struct icm_msg_draw_uploaded_image *msg = (struct icm_msg_draw_uploaded_image *)payload;
-        ret = handle_draw_uploaded_image(ipc_server, client, msg);
+        ret = handle_draw_uploaded_image(ipc_server, client, msg,
+                                         header->length - sizeof(struct icm_ipc_header));
         break;
     }
     case ICM_MSG_DRAW_TEXT: {
@@ -3567,7 +5712,8 @@ static int process_message(struct IPCServer *ipc_server, struct IPCClient *clien
     }
     case ICM_MSG_REGISTER_KEYBIND: {
         struct icm_msg_register_keybind *msg = (struct icm_msg_register_keybind *)payload;
-        ret = handle_register_keybind(ipc_server, client, msg);
+        ret = handle_register_keybind(ipc_server, client, msg,
+                                      header->length - sizeof(struct icm_ipc_header));
         break;
     }
     case ICM_MSG_UNREGISTER_KEYBIND: {
@@ -3577,7 +5723,8 @@ static int process_message(struct IPCServer *ipc_server, struct IPCClient *clien
     }
     case ICM_MSG_REGISTER_CLICK_REGION: {
         struct icm_msg_register_click_region *msg = (struct icm_msg_register_click_region *)payload;
-        ret = handle_register_click_region(ipc_server, client, msg);
+        ret = handle_register_click_region(ipc_server, client, msg,
+                                           header->length - sizeof(struct icm_ipc_header));
         break;
     }
     case ICM_MSG_UNREGISTER_CLICK_REGION: {
@@ -3621,7 +5768,7 @@ static int process_message(struct IPCServer *ipc_server, struct IPCClient *clien
     }
     case ICM_MSG_SET_WINDOW_SIZE: {
         struct icm_msg_set_window_size *msg = (struct icm_msg_set_window_size *)payload;
-        ret = handle_set_window_size(ipc_server, client, msg);
+        ret = handle_set_window_size(ipc_server, client, msg, header->length - sizeof(struct icm_ipc_header));
         break;
     }
     case ICM_MSG_SET_WINDOW_OPACITY: {
@@ -3790,6 +5937,38 @@ static int process_message(struct IPCServer *ipc_server, struct IPCClient *clien
         ret = handle_launch_app(ipc_server, client, msg);
         break;
     }
+    case ICM_MSG_SET_WINDOWS_PROPERTIES: {
+        struct icm_msg_set_windows_properties *msg = (struct icm_msg_set_windows_properties *)payload;
+        ret = handle_set_windows_properties(ipc_server, client, msg,
+                                            header->length - sizeof(struct icm_ipc_header));
+        break;
+    }
+    case ICM_MSG_GET_STATE_PAGE:
+        ret = handle_get_state_page(ipc_server, client);
+        break;
+    case ICM_MSG_QUERY_WINDOWS_BATCH: {
+        struct icm_msg_query_windows_batch *msg = (struct icm_msg_query_windows_batch *)payload;
+        ret = handle_query_windows_batch(ipc_server, client, msg,
+                                         header->length - sizeof(struct icm_ipc_header));
+        break;
+    }
+    case ICM_MSG_SET_CLIENT_PRIORITY: {
+        struct icm_msg_set_client_priority *msg = (struct icm_msg_set_client_priority *)payload;
+        ret = handle_set_client_priority(ipc_server, client, msg);
+        break;
+    }
+    case ICM_MSG_REGISTER_INPUT_EVENTS: {
+        struct icm_msg_register_input_events *msg = (struct icm_msg_register_input_events *)payload;
+        ret = handle_register_input_events(ipc_server, client, msg,
+                                           header->length - sizeof(struct icm_ipc_header));
+        break;
+    }
+    case ICM_MSG_UNREGISTER_INPUT_EVENTS: {
+        struct icm_msg_unregister_input_events *msg = (struct icm_msg_unregister_input_events *)payload;
+        ret = handle_unregister_input_events(ipc_server, client, msg,
+                                             header->length - sizeof(struct icm_ipc_header));
+        break;
+    }
     default:
         if (header->type == 0) {
             fprintf(stderr, "Warning: Received null message type (possibly buffer sync issue)\n");
@@ -3802,11 +5981,315 @@ static int process_message(struct IPCServer *ipc_server, struct IPCClient *clien
     return ret;
 }
 
+/* Fair scheduling
+ *
+ * A client gets one slice of work (budget_msgs messages or budget_us
+ * microseconds, scaled by its priority) each time it is served. If messages
+ * remain when the slice runs out, the client goes onto pending_clients, its
+ * socket stops being read so the kernel pushes back on the sender, and
+ * sched_fd is kicked. Each kick serves every pending client once, so a
+ * flooding client can delay the others by at most one slice per turn, and
+ * frame callbacks and input handled by the loop run in between turns.
+ *
+ * Messages that affect input routing are exempt from the budget: a slice
+ * never ends in front of one. In-stream order is always preserved. */
+
+static uint64_t monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int message_affects_input(uint16_t type) {
+    switch (type) {
+    case ICM_MSG_FOCUS_WINDOW:
+    case ICM_MSG_REGISTER_KEYBIND:
+    case ICM_MSG_UNREGISTER_KEYBIND:
+    case ICM_MSG_REGISTER_POINTER_EVENT:
+    case ICM_MSG_REGISTER_KEYBOARD_EVENT:
+    case ICM_MSG_REGISTER_GLOBAL_POINTER_EVENT:
+    case ICM_MSG_REGISTER_GLOBAL_KEYBOARD_EVENT:
+    case ICM_MSG_REGISTER_GLOBAL_CAPTURE_MOUSE:
+    case ICM_MSG_REGISTER_GLOBAL_CAPTURE_KEYBOARD:
+    case ICM_MSG_UNREGISTER_GLOBAL_CAPTURE_KEYBOARD:
+    case ICM_MSG_UNREGISTER_GLOBAL_CAPTURE_MOUSE:
+    case ICM_MSG_REGISTER_CLICK_REGION:
+    case ICM_MSG_UNREGISTER_CLICK_REGION:
+    case ICM_MSG_SET_CLIENT_PRIORITY:
+    case ICM_MSG_REGISTER_INPUT_EVENTS:
+    case ICM_MSG_UNREGISTER_INPUT_EVENTS:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static uint32_t scale_budget(uint32_t budget, uint32_t priority) {
+    if (budget == 0) return 0;
+    switch (priority) {
+    case ICM_CLIENT_PRIORITY_HIGH:
+        return budget * 4;
+    case ICM_CLIENT_PRIORITY_LOW:
+        return budget / 4 ? budget / 4 : 1;
+    default:
+        return budget;
+    }
+}
+
+/* Take ownership of fds received alongside stream data. Messages claim them
+ * in order according to the num_fds field of their header. */
+void ipc_client_queue_fds(struct IPCClient *client, const int *fds, int num_fds) {
+    for (int i = 0; i < num_fds; i++) {
+        if (client->rx_num_fds < ICM_IPC_RX_FDS_MAX) {
+            client->rx_fds[client->rx_num_fds++] = fds[i];
+        } else {
+            wlr_log(WLR_ERROR, "IPC client fd %d: too many unclaimed fds, closing %d",
+                    client->socket_fd, fds[i]);
+            close(fds[i]);
+        }
+    }
+}
+
+static int claim_fds(struct IPCClient *client, int wanted, int *fds) {
+    int n = wanted;
+    if (n > ICM_MAX_FDS_PER_MSG) n = ICM_MAX_FDS_PER_MSG;
+    if (n > client->rx_num_fds) n = client->rx_num_fds;
+    if (n <= 0) return 0;
+
+    memcpy(fds, client->rx_fds, n * sizeof(int));
+    client->rx_num_fds -= n;
+    memmove(client->rx_fds, client->rx_fds + n, client->rx_num_fds * sizeof(int));
+    return n;
+}
+
+/* Move backlogged bytes into read_buffer as space allows */
+static void refill_read_buffer(struct IPCClient *client) {
+    size_t avail = client->rx_backlog_len - client->rx_backlog_off;
+    if (avail == 0) return;
+
+    size_t space = sizeof(client->read_buffer) - client->read_pos;
+    size_t n = avail < space ? avail : space;
+    memcpy(client->read_buffer + client->read_pos, client->rx_backlog + client->rx_backlog_off, n);
+    client->read_pos += n;
+    client->rx_backlog_off += n;
+    if (client->rx_backlog_off == client->rx_backlog_len) {
+        client->rx_backlog_off = 0;
+        client->rx_backlog_len = 0;
+    }
+}
+
+/* Append stream bytes received outside recv_with_fds (the io_uring backend
+ * cannot stop the kernel from delivering while a client is backlogged) */
+void ipc_client_receive(struct IPCClient *client, const uint8_t *data, size_t size) {
+    if (client->rx_backlog_len == 0) {
+        size_t space = sizeof(client->read_buffer) - client->read_pos;
+        size_t n = size < space ? size : space;
+        memcpy(client->read_buffer + client->read_pos, data, n);
+        client->read_pos += n;
+        data += n;
+        size -= n;
+    }
+    if (size == 0) return;
+
+    if (client->rx_backlog_off > 0 && client->rx_backlog_len + size > client->rx_backlog_cap) {
+        memmove(client->rx_backlog, client->rx_backlog + client->rx_backlog_off,
+                client->rx_backlog_len - client->rx_backlog_off);
+        client->rx_backlog_len -= client->rx_backlog_off;
+        client->rx_backlog_off = 0;
+    }
+    if (client->rx_backlog_len + size > client->rx_backlog_cap) {
+        size_t cap = client->rx_backlog_cap ? client->rx_backlog_cap : 65536;
+        while (cap < client->rx_backlog_len + size) cap *= 2;
+        uint8_t *backlog = realloc(client->rx_backlog, cap);
+        if (!backlog) {
+            wlr_log(WLR_ERROR, "IPC client fd %d: out of memory queueing input", client->socket_fd);
+            return;
+        }
+        client->rx_backlog = backlog;
+        client->rx_backlog_cap = cap;
+    }
+    memcpy(client->rx_backlog + client->rx_backlog_len, data, size);
+    client->rx_backlog_len += size;
+}
+
+/* Parse and dispatch complete messages until the slice budget runs out.
+ * Returns 1 if the client still has buffered input. */
+static int ipc_client_run_slice(struct IPCClient *client) {
+    struct IPCServer *ipc_server = &client->server->ipc_server;
+    uint32_t budget_msgs = scale_budget(ipc_server->budget_msgs, client->priority);
+    uint32_t budget_us = scale_budget(ipc_server->budget_us, client->priority);
+    uint64_t start_us = budget_us ? monotonic_us() : 0;
+    uint32_t processed = 0;
+
+    refill_read_buffer(client);
+
+    /* Process complete messages */
+    while (client->read_pos >= sizeof(struct icm_ipc_header) && !client->closing) {
+        /* Read header in little-endian format */
+        uint8_t *buf = client->read_buffer;
+        uint32_t msg_length = buf[0] | (buf[1] << 8) | (buf[2] << 16) | (buf[3] << 24);
+        uint16_t msg_type = buf[4] | (buf[5] << 8);
+        uint16_t msg_flags = buf[6] | (buf[7] << 8);
+        uint32_t msg_sequence = buf[8] | (buf[9] << 8) | (buf[10] << 16) | (buf[11] << 24);
+        int32_t msg_num_fds = buf[12] | (buf[13] << 8) | (buf[14] << 16) | (buf[15] << 24);
+
+        wlr_log(WLR_DEBUG, "Received message type %u, length %u", msg_type, msg_length);
+
+        /* Validate header length */
+        if (msg_length < sizeof(struct icm_ipc_header) || msg_length > 65536) {
+            fprintf(stderr, "Invalid message length: %u (expected 16-%u)\n", 
+                    msg_length, 65536);
+            /* Skip this byte and try to resync */
+            memmove(client->read_buffer, client->read_buffer + 1, client->read_pos - 1);
+            client->read_pos--;
+            refill_read_buffer(client);
+            continue;
+        }
+
+        if (client->read_pos < msg_length) {
+            break;  /* Incomplete message */
+        }
+
+        /* Out of budget: yield unless the next message affects input routing */
+        if (processed > 0 && !message_affects_input(msg_type)) {
+            if (budget_msgs && processed >= budget_msgs) return 1;
+            if (budget_us && monotonic_us() - start_us >= budget_us) return 1;
+        }
+
+        int fds[ICM_MAX_FDS_PER_MSG];
+        int num_fds = claim_fds(client, msg_num_fds, fds);
+
+        /* Validate message type */
+        if (msg_type < 1 || msg_type > ICM_MSG_TYPE_MAX) {
+            fprintf(stderr, "Invalid message type: %u\n", msg_type);
+            for (int i = 0; i < num_fds; i++) close(fds[i]);
+            /* Skip this message and continue */
+            memmove(client->read_buffer,
+                   client->read_buffer + msg_length,
+                   client->read_pos - msg_length);
+            client->read_pos -= msg_length;
+            refill_read_buffer(client);
+            continue;
+        }
+
+        uint8_t *payload = client->read_buffer + sizeof(struct icm_ipc_header);
+
+        /* Create a temporary header struct for the handler */
+        struct icm_ipc_header header = {
+            .length = msg_length,
+            .type = msg_type,
+            .flags = msg_flags,
+            .sequence = msg_sequence,
+            .num_fds = msg_num_fds
+        };
+
+        process_message(ipc_server, client, &header, payload, fds, num_fds);
+        processed++;
+
+        /* Move remaining data to front */
+        memmove(client->read_buffer,
+               client->read_buffer + msg_length,
+               client->read_pos - msg_length);
+        client->read_pos -= msg_length;
+        refill_read_buffer(client);
+    }
+
+    return 0;
+}
+
+static void ipc_client_pause_input(struct IPCClient *client) {
+    if (client->uring_attached) return;  /* ipc_uring.c pauses on backlog size */
+    if (client->event_source) {
+        wl_event_source_fd_update(client->event_source, 0);
+    }
+}
+
+static void ipc_client_resume_input(struct IPCClient *client) {
+    if (client->uring_attached) {
+        ipc_uring_resume_client(client);
+    } else if (client->event_source) {
+        wl_event_source_fd_update(client->event_source, WL_EVENT_READABLE);
+    }
+}
+
+static void ipc_sched_kick(struct IPCServer *ipc_server) {
+    if (ipc_server->sched_kicked || ipc_server->sched_fd < 0) return;
+    uint64_t one = 1;
+    if (write(ipc_server->sched_fd, &one, sizeof(one)) == sizeof(one)) {
+        ipc_server->sched_kicked = 1;
+    }
+}
+
+/* Serve every backlogged client one slice, then give the loop back */
+static int ipc_sched_handle(int fd, uint32_t mask, void *data) {
+    struct IPCServer *ipc_server = data;
+    uint64_t count;
+    if (read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        wlr_log(WLR_ERROR, "IPC scheduler: read failed: %s", strerror(errno));
+    }
+    ipc_server->sched_kicked = 0;
+
+    int turns = wl_list_length(&ipc_server->pending_clients);
+    while (turns-- > 0 && !wl_list_empty(&ipc_server->pending_clients)) {
+        struct IPCClient *client = wl_container_of(ipc_server->pending_clients.next,
+                                                   client, pending_link);
+        wl_list_remove(&client->pending_link);
+        wl_list_init(&client->pending_link);
+
+        if (ipc_client_run_slice(client) && !client->closing) {
+            wl_list_insert(ipc_server->pending_clients.prev, &client->pending_link);
+            continue;
+        }
+
+        client->backlogged = 0;
+        if (!client->closing) {
+            ipc_client_resume_input(client);
+        }
+    }
+
+    if (!wl_list_empty(&ipc_server->pending_clients)) {
+        ipc_sched_kick(ipc_server);
+    }
+    return 0;
+}
+
+/* Entry point for both socket backends once new input has been buffered */
+void ipc_client_process_messages(struct IPCClient *client) {
+    /* Already queued: the new bytes are handled on its next turn */
+    if (client->backlogged || client->closing) return;
+
+    if (!ipc_client_run_slice(client) || client->closing) return;
+
+    struct IPCServer *ipc_server = &client->server->ipc_server;
+    client->backlogged = 1;
+    if (client->priority == ICM_CLIENT_PRIORITY_HIGH) {
+        wl_list_insert(&ipc_server->pending_clients, &client->pending_link);
+    } else {
+        wl_list_insert(ipc_server->pending_clients.prev, &client->pending_link);
+    }
+    ipc_client_pause_input(client);
+    ipc_sched_kick(ipc_server);
+}
+
+/* Release scheduler state and unclaimed input of a departing client */
+static void ipc_client_drop_input(struct IPCClient *client) {
+    if (client->backlogged) {
+        wl_list_remove(&client->pending_link);
+        wl_list_init(&client->pending_link);
+        client->backlogged = 0;
+    }
+    for (int i = 0; i < client->rx_num_fds; i++) {
+        close(client->rx_fds[i]);
+    }
+    client->rx_num_fds = 0;
+    free(client->rx_backlog);
+    client->rx_backlog = NULL;
+    client->rx_backlog_len = client->rx_backlog_off = client->rx_backlog_cap = 0;
+}
+
 /* Client I/O handler */
 int ipc_server_handle_client(int fd, uint32_t mask, void *data) {
     struct IPCClient *client = (struct IPCClient *)data;
-    struct Server *server = client->server;
-    struct IPCServer *ipc_server = &server->ipc_server;
 
     if (mask & WL_EVENT_READABLE) {
         int fds[ICM_MAX_FDS_PER_MSG];
@@ -3817,104 +6300,18 @@ int ipc_server_handle_client(int fd, uint32_t mask, void *data) {
                                    sizeof(client->read_buffer) - client->read_pos,
                                    fds, &num_fds, ICM_MAX_FDS_PER_MSG);
 
+        if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+            return 0;
+        }
         if (n <= 0) {
             /* Client disconnected or error */
-            wl_list_remove(&client->link);
-
-            /* Clean up keybinds */
-            struct KeybindEntry *kb, *kb_tmp;
-            wl_list_for_each_safe(kb, kb_tmp, &ipc_server->keybinds, link) {
-                if (kb->client == client) {
-                    wl_list_remove(&kb->link);
-                    free(kb);
-                }
-            }
-
-            /* Clean up click regions */
-            struct ClickRegion *cr, *cr_tmp;
-            wl_list_for_each_safe(cr, cr_tmp, &ipc_server->click_regions, link) {
-                if (cr->client == client) {
-                    wl_list_remove(&cr->link);
-                    free(cr);
-                }
-            }
-
-            /* Clean up screen copy requests */
-            struct ScreenCopyRequest *scr, *scr_tmp;
-            wl_list_for_each_safe(scr, scr_tmp, &ipc_server->screen_copy_requests, link) {
-                if (scr->client == client) {
-                    wl_list_remove(&scr->link);
-                    free(scr);
-                }
-            }
-
-            if (client->event_source) {
-                wl_event_source_remove(client->event_source);
-            }
-            close(client->socket_fd);
-            free(client);
+            ipc_client_disconnect(client);
             return 0;
         }
 
         client->read_pos += n;
-
-        /* Process complete messages */
-        while (client->read_pos >= sizeof(struct icm_ipc_header)) {
-            /* Read header in little-endian format */
-            uint8_t *buf = client->read_buffer;
-            uint32_t msg_length = buf[0] | (buf[1] << 8) | (buf[2] << 16) | (buf[3] << 24);
-            uint16_t msg_type = buf[4] | (buf[5] << 8);
-            uint16_t msg_flags = buf[6] | (buf[7] << 8);
-            uint32_t msg_sequence = buf[8] | (buf[9] << 8) | (buf[10] << 16) | (buf[11] << 24);
-            int32_t msg_num_fds = buf[12] | (buf[13] << 8) | (buf[14] << 16) | (buf[15] << 24);
-
-            fprintf(stderr, "Received message type %u, length %u\n", msg_type, msg_length);
-
-            /* Validate header length */
-            if (msg_length < sizeof(struct icm_ipc_header) || msg_length > 65536) {
-                fprintf(stderr, "Invalid message length: %u (expected 16-%u)\n", 
-                        msg_length, 65536);
-                /* Skip this byte and try to resync */
-                memmove(client->read_buffer, client->read_buffer + 1, client->read_pos - 1);
-                client->read_pos--;
-                continue;
-            }
-
-            if (client->read_pos < msg_length) {
-                break;  /* Incomplete message */
-            }
-
-            /* Validate message type */
-            if (msg_type < 1 || msg_type > 100) {
-                fprintf(stderr, "Invalid message type: %u\n", msg_type);
-                /* Skip this message and continue */
-                memmove(client->read_buffer,
-                       client->read_buffer + msg_length,
-                       client->read_pos - msg_length);
-                client->read_pos -= msg_length;
-                continue;
-            }
-
-            uint8_t *payload = client->read_buffer + sizeof(struct icm_ipc_header);
-            uint32_t payload_size = msg_length - sizeof(struct icm_ipc_header);
-
-            /* Create a temporary header struct for the handler */
-            struct icm_ipc_header header = {
-                .length = msg_length,
-                .type = msg_type,
-                .flags = msg_flags,
-                .sequence = msg_sequence,
-                .num_fds = msg_num_fds
-            };
-
-            process_message(ipc_server, client, &header, payload, fds, num_fds);
-
-            /* Move remaining data to front */
-            memmove(client->read_buffer,
-                   client->read_buffer + msg_length,
-                   client->read_pos - msg_length);
-            client->read_pos -= msg_length;
-        }
+        ipc_client_queue_fds(client, fds, num_fds);
+        ipc_client_process_messages(client);
     }
 
     return 0;
@@ -3942,13 +6339,20 @@ static int ipc_handle_new_connection(int fd, uint32_t mask, void *data) {
     client->server = ipc_server->server;
     client->read_pos = 0;
     client->batching = 0;
-    client->registered_pointer = 0;
-    client->registered_keyboard = 0;
-    client->event_window_id = 0;
+    wl_list_init(&client->input_subscriptions);
+    client->num_keyboard_windows = 0;
+    wl_list_init(&client->keyboard_link);
+    wl_list_init(&client->global_pointer_link);
+    wl_list_init(&client->global_keyboard_link);
+    client->priority = ICM_CLIENT_PRIORITY_NORMAL;
+    wl_list_init(&client->pending_link);
+    wl_list_init(&client->uring_send_link);
 
-    client->event_source = wl_event_loop_add_fd(
-        wl_display_get_event_loop(ipc_server->server->wl_display),
-        client_fd, WL_EVENT_READABLE, ipc_server_handle_client, client);
+    if (ipc_uring_add_client(ipc_server, client) < 0) {
+        client->event_source = wl_event_loop_add_fd(
+            wl_display_get_event_loop(ipc_server->server->wl_display),
+            client_fd, WL_EVENT_READABLE, ipc_server_handle_client, client);
+    }
 
     wl_list_insert(&ipc_server->clients, &client->link);
 
@@ -3965,9 +6369,10 @@ int ipc_server_init(struct IPCServer *ipc_server, struct Server *server,
     ipc_server->next_keybind_id = 1;
     ipc_server->next_region_id = 1;
     ipc_server->next_window_id = 1;
+    window_registry_init(&ipc_server->windows);
     ipc_server->screen_effect_equation[0] = '\0';
     ipc_server->screen_effect_enabled = 0;
-    ipc_server->screen_effect_buffer = NULL;
+    ipc_server->screen_effect_handle = 0;
     ipc_server->screen_effect_dirty = 0;
     
     /* Initialize decoration defaults */
@@ -3978,12 +6383,41 @@ int ipc_server_init(struct IPCServer *ipc_server, struct Server *server,
     ipc_server->decoration_enabled = 1;              /* Enable decorations by default */
     
     wl_list_init(&ipc_server->clients);
-    wl_list_init(&ipc_server->buffers);
+    wl_list_init(&ipc_server->keyboard_clients);
+    wl_list_init(&ipc_server->global_pointer_clients);
+    wl_list_init(&ipc_server->global_keyboard_clients);
+    slab_init(&ipc_server->buffers, sizeof(struct BufferEntry));
     wl_list_init(&ipc_server->surfaces);
-    wl_list_init(&ipc_server->images);
+    slab_init(&ipc_server->images, sizeof(struct ImageEntry));
     wl_list_init(&ipc_server->keybinds);
+    ipc_server->keybind_buckets = NULL;
+    ipc_server->keybind_bucket_count = 0;
+    ipc_server->keybind_count = 0;
     wl_list_init(&ipc_server->click_regions);
+    wl_list_init(&ipc_server->hovered_regions);
+    ipc_server->num_hover_regions = 0;
+    ipc_server->hover_serial = 0;
     wl_list_init(&ipc_server->screen_copy_requests);
+    wl_list_init(&ipc_server->pending_clients);
+
+    /* Per-client work budget for one scheduling turn */
+    const char *budget_env = getenv("ICM_IPC_BUDGET_MSGS");
+    ipc_server->budget_msgs = budget_env ? strtoul(budget_env, NULL, 10) : 64;
+    budget_env = getenv("ICM_IPC_BUDGET_US");
+    ipc_server->budget_us = budget_env ? strtoul(budget_env, NULL, 10) : 2000;
+    ipc_server->sched_kicked = 0;
+    ipc_server->sched_source = NULL;
+    ipc_server->sched_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ipc_server->sched_fd >= 0) {
+        ipc_server->sched_source = wl_event_loop_add_fd(
+            wl_display_get_event_loop(server->wl_display),
+            ipc_server->sched_fd, WL_EVENT_READABLE, ipc_sched_handle, ipc_server);
+    } else {
+        /* Without a way to come back later, process everything immediately */
+        fprintf(stderr, "eventfd failed: %s, IPC budget disabled\n", strerror(errno));
+        ipc_server->budget_msgs = 0;
+        ipc_server->budget_us = 0;
+    }
 
     /* Create Unix domain socket */
     ipc_server->socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
@@ -4018,41 +6452,83 @@ int ipc_server_init(struct IPCServer *ipc_server, struct Server *server,
         ipc_server->socket_fd, WL_EVENT_READABLE,
         ipc_handle_new_connection, ipc_server);
 
+    /* Optional; falls back to per-client fd sources */
+    ipc_server->uring = NULL;
+    ipc_uring_init(ipc_server);
+
     fprintf(stderr, "IPC server listening on %s\n", socket_path);
     return 0;
 }
 
 /* Destroy IPC server */
 void ipc_server_destroy(struct IPCServer *ipc_server) {
+    /* Flush queued events and retire in-flight ring operations */
+    ipc_uring_destroy(ipc_server);
+
     /* Close all client connections */
     struct IPCClient *client, *tmp_client;
     wl_list_for_each_safe(client, tmp_client, &ipc_server->clients, link) {
         wl_list_remove(&client->link);
+        ipc_client_drop_subscriptions(ipc_server, client);
+        ipc_client_drop_input(client);
+        if (client->event_source) {
+            wl_event_source_remove(client->event_source);
+        }
         close(client->socket_fd);
+        free(client->send_queue);
+        free(client->send_inflight);
         free(client);
     }
 
-    /* Cleanup buffers */
-    struct BufferEntry *buffer, *tmp_buffer;
-    wl_list_for_each_safe(buffer, tmp_buffer, &ipc_server->buffers, link) {
-        ipc_buffer_destroy(ipc_server, buffer->buffer_id);
+    state_page_destroy(ipc_server->state_page);
+    ipc_server->state_page = NULL;
+
+    /* Cleanup keybinds */
+    struct KeybindEntry *kb, *tmp_kb;
+    wl_list_for_each_safe(kb, tmp_kb, &ipc_server->keybinds, link) {
+        keybind_remove(ipc_server, kb);
+    }
+    free(ipc_server->keybind_buckets);
+    ipc_server->keybind_buckets = NULL;
+    ipc_server->keybind_bucket_count = 0;
+
+    /* Cleanup click regions */
+    struct ClickRegion *cr, *tmp_cr;
+    wl_list_for_each_safe(cr, tmp_cr, &ipc_server->click_regions, link) {
+        click_region_remove(ipc_server, cr);
     }
 
-    /* Cleanup exported surfaces */
+    /* Cleanup exported surfaces; their buffers go with the rest below */
     struct ExportedSurface *surface, *tmp_surface;
     wl_list_for_each_safe(surface, tmp_surface, &ipc_server->surfaces, link) {
         wl_list_remove(&surface->link);
-        if (surface->buffer) {
-            ipc_buffer_destroy(ipc_server, surface->buffer->buffer_id);
-        }
         free(surface);
     }
 
+    /* Cleanup buffers, newest first so each id resolves to the one being freed */
+    while (ipc_server->buffers.count > 0) {
+        struct BufferEntry *buffer = ipc_server->buffers.dense[ipc_server->buffers.count - 1];
+        ipc_buffer_destroy(ipc_server, buffer->buffer_id);
+    }
+    ipc_server->screen_effect_handle = 0;
+    slab_finish(&ipc_server->buffers);
+
     /* Cleanup images */
-    struct ImageEntry *image, *tmp_image;
-    wl_list_for_each_safe(image, tmp_image, &ipc_server->images, link) {
+    while (ipc_server->images.count > 0) {
+        struct ImageEntry *image = ipc_server->images.dense[ipc_server->images.count - 1];
         ipc_image_destroy(ipc_server, image->image_id);
     }
+    slab_finish(&ipc_server->images);
+    pixel_pool_release();
+
+    window_registry_finish(&ipc_server->windows);
+
+    if (ipc_server->sched_source) {
+        wl_event_source_remove(ipc_server->sched_source);
+    }
+    if (ipc_server->sched_fd >= 0) {
+        close(ipc_server->sched_fd);
+    }
 
     /* Close socket */
     if (ipc_server->event_source) {
@@ -8,6 +8,7 @@
 #include <wlr/types/wlr_layer_shell_v1.h>
 #include <wlr/types/wlr_output.h>
 #include <wlr/types/wlr_output_layout.h>
+#include <wlr/render/dmabuf.h>
 #include <wlr/render/wlr_renderer.h>
 #include <wlr/render/wlr_texture.h>
 #include <wlr/types/wlr_scene.h>
@@ -21,7 +22,13 @@
 #include <wlr/types/wlr_input_device.h>
 #include <wayland-server-protocol.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #include <wayland-server.h>
+#include "pixel_pool.h"
+#include "region_grid.h"
+#include "slab.h"
+#include "window_registry.h"
 
 /* Forward declarations */
 struct Server;
@@ -36,83 +43,194 @@ enum CursorMode {
 
 
 struct LayerSurface;
+struct View;
+struct icm_msg_window_created;
+struct icm_msg_pointer_event;
+
+/* Kept in the data field of the scene node a window owns, so a hit node can be
+ * mapped back to its window by walking up to the first node with data set. */
+enum SceneOwnerType {
+    SCENE_OWNER_VIEW = 1,
+    SCENE_OWNER_LAYER_SURFACE,
+};
 
-struct BufferEntry
+struct SceneOwner {
+    enum SceneOwnerType type;
+    uint32_t window_id;
+};
+
+/* Last window state pushed to event subscribers; changes are detected against it */
+struct WindowEventState {
+    uint32_t state;
+    uint8_t visible;
+    uint8_t focused;
+    uint32_t width, height;
+};
+
+/* Animation state, allocated on a buffer's first animation */
+struct BufferAnimation
+{
+    uint32_t start_time;
+    uint32_t duration;
+    float start_opacity, target_opacity;
+    float start_scale_x, start_scale_y, target_scale_x, target_scale_y;
+    float start_x, start_y, target_x, target_y;
+    float start_translate_x, start_translate_y, start_translate_z;
+    float target_translate_x, target_translate_y, target_translate_z;
+    float start_rotate_x, start_rotate_y, start_rotate_z;
+    float target_rotate_x, target_rotate_y, target_rotate_z;
+    float start_scale_z, target_scale_z;
+    /* Current interpolated values during animation */
+    float current_translate_x, current_translate_y, current_translate_z;
+    float current_rotate_x, current_rotate_y, current_rotate_z;
+    float current_scale_z;
+};
+
+/* Per-window pixel effect, allocated by SET_WINDOW_EFFECT */
+struct BufferEffect
+{
+    uint8_t enabled;
+    uint8_t dirty;
+    uint8_t active;             /* scene currently shows pixels instead of the client's */
+    char equation[256];
+    struct IPCPixelBuffer *pixels;
+};
+
+/* An imported DMABUF. The scene shows it as is and the renderer imports it
+ * without CPU access; attribs owns the plane fds. */
+struct BufferDmabuf
+{
+    struct wlr_buffer base;
+    struct wlr_dmabuf_attributes attribs;
+};
+
+/* A rect kept as a scene node and updated in place by its rect_id */
+struct RetainedRect
+{
+    uint32_t rect_id;
+    int32_t x, y;
+    uint32_t width, height;
+    uint32_t color;             /* ARGB, as DRAW_RECT */
+    struct wlr_scene_rect *node;
+};
+
+/* A DMABUF drawn into a window with DRAW_IMAGE, kept as a scene node keyed
+ * by its source buffer */
+struct RetainedImage
 {
-    struct wl_list link;
     uint32_t buffer_id;
     int32_t x, y;
+    uint32_t width, height;
+    uint8_t alpha;
+    struct wlr_scene_buffer *node;
+};
+
+/* Retained rects and images, allocated by the first retained DRAW_RECT or
+ * DMABUF DRAW_IMAGE */
+struct BufferRects
+{
+    struct wlr_scene_tree *tree;    /* kept just above the buffer's scene node */
+    struct RetainedRect *entries;
+    uint32_t count, capacity;
+    struct RetainedImage *images;
+    uint32_t num_images, images_capacity;
+    float scale_x, scale_y, opacity;    /* as last applied to the nodes */
+};
+
+#define IPC_SWAPCHAIN_MAX 3
+
+/*
+ * Draws go into back while the renderer reads front, so a draw never touches
+ * pixels a texture is being made from. Presenting swaps in a buffer the
+ * renderer has released, brought up to date by copying only the pixels that
+ * changed since it was last shown.
+ *
+ * A shared chain is a single memfd buffer the client maps and draws into
+ * itself (see QUERY_BUFFER_INFO); front and back are the same and never swap.
+ */
+struct BufferSwapchain
+{
+    struct IPCPixelBuffer *slots[IPC_SWAPCHAIN_MAX];
+    uint32_t count;
+    bool shared;
+    struct IPCPixelBuffer *front;   /* NULL until the first present */
+    struct IPCPixelBuffer *back;    /* BufferEntry.data points at its pixels */
+};
+
+/*
+ * Fields read by the per-frame loops (render_ipc_buffers, update_animations)
+ * come first so walking the buffer slab touches as little memory per entry as
+ * possible. Bulky state that most buffers never use hangs off side structs
+ * that stay NULL until needed.
+ */
+struct BufferEntry
+{
+    struct wlr_scene_buffer *scene_buffer;
+    struct wlr_client_buffer *texture_buffer;   /* what the scene shows; see render_ipc_buffers */
+    void *data;                 /* back buffer of swapchain, where draws go */
+    struct BufferEffect *effect;
+    struct BufferAnimation *anim;
+    float *transform_matrix;    /* 16 floats, NULL until a transform is set */
+    int32_t x, y;
     int32_t width;
     int32_t height;
+    float scale_x, scale_y;
+    float opacity;
+    uint8_t visible;
+    uint8_t dirty;  // Flag to indicate buffer content has changed; see damage
+    uint8_t animating;
+
+    uint32_t buffer_id;
     uint32_t format;
-    void *data;
     size_t size;
-    struct wlr_buffer *wlr_buffer;
-    struct wlr_scene_buffer *scene_buffer;
-    int dmabuf_fd;
-    uint8_t visible;
-    uint8_t dirty;  // Flag to indicate buffer content has changed
-    float opacity;
+    float rotation;
     float blur_radius;
     uint8_t blur_enabled;
-    uint8_t effect_enabled;
-    uint8_t effect_dirty;
-    uint8_t use_effect_buffer;
-    char effect_equation[256];
-    uint8_t *effect_data;
-    size_t effect_data_size;
-    float transform_matrix[16];
-    uint8_t has_transform_matrix;
-    float scale_x, scale_y;
-    float rotation;
     uint8_t minimized;
     uint8_t maximized;
     uint8_t fullscreen;
     uint8_t decorated;
     uint8_t focused;
+    struct WindowEventState reported;
     int32_t layer;
     uint32_t parent_id;
-    
-    /* Animation state */
-    uint8_t animating;
-    uint32_t animation_start_time;
-    uint32_t animation_duration;
-    float start_opacity, target_opacity;
-    float start_scale_x, start_scale_y, target_scale_x, target_scale_y;
-    float start_x, start_y, target_x, target_y;
-    float start_translate_x, start_translate_y, start_translate_z;
-    float target_translate_x, target_translate_y, target_translate_z;
-    float start_rotate_x, start_rotate_y, start_rotate_z;
-    float target_rotate_x, target_rotate_y, target_rotate_z;
-    float start_scale_z, target_scale_z;
-    /* Current interpolated values during animation */
-    float current_translate_x, current_translate_y, current_translate_z;
-    float current_rotate_x, current_rotate_y, current_rotate_z;
-    float current_scale_z;
-    
-    struct
-    {
-        int fd;
-        uint32_t offset;
-        uint32_t stride;
-        uint64_t modifier;
-    } planes[4];
-    uint32_t num_planes;
+    struct BufferDmabuf *dmabuf;
+    struct BufferRects *rects;
+    /* Pixels changed since the last upload, in buffer coordinates. Dirty
+     * with no damage means the whole buffer. */
+    pixman_region32_t damage;
+    struct BufferSwapchain swapchain;
 };
 
-/* Custom buffer implementation for IPC pixel data */
+/*
+ * A wlr_buffer over CPU pixels. Each one owns its pixels; the renderer may
+ * keep reading them (the pixman renderer samples straight from them) until it
+ * drops its locks and the buffer sends release.
+ */
 struct IPCPixelBuffer {
     struct wlr_buffer base;
     void *data;
     size_t size;
     int width, height;
     uint32_t format;
+    int fd;                     /* memfd data is mapped from, -1 for pooled pixels */
+    /* Swapchain bookkeeping, see ipc_buffer_present */
+    struct wl_listener release;
+    bool busy;                  /* locked by the renderer since it was presented */
+    pixman_region32_t stale;    /* pixels older than the newest frame */
 };
 
 static void ipc_pixel_buffer_destroy(struct wlr_buffer *wlr_buffer) {
     struct IPCPixelBuffer *buffer = wl_container_of(wlr_buffer, buffer, base);
     wlr_buffer_finish(wlr_buffer);
-    // Don't free data here - it's managed by BufferEntry
+    wl_list_remove(&buffer->release.link);
+    pixman_region32_fini(&buffer->stale);
+    if (buffer->fd >= 0) {
+        munmap(buffer->data, buffer->size);
+        close(buffer->fd);
+    } else {
+        pixel_pool_free(buffer->data, buffer->size);
+    }
     free(buffer);
 }
 
@@ -140,36 +258,54 @@ static const struct wlr_buffer_impl ipc_pixel_buffer_impl = {
     .end_data_ptr_access = ipc_pixel_buffer_end_data_ptr_access
 };
 
-static struct wlr_buffer *ipc_buffer_create_wlr_buffer(void *data, int width, int height, uint32_t format) {
+/* Takes over data: pooled pixels if fd is -1, otherwise a mapping of fd.
+ * Free with wlr_buffer_drop. */
+static struct IPCPixelBuffer *ipc_pixel_buffer_wrap(void *data, int fd, int width, int height,
+                                                    uint32_t format) {
     struct IPCPixelBuffer *buffer = calloc(1, sizeof(*buffer));
     if (!buffer) return NULL;
 
     wlr_buffer_init(&buffer->base, &ipc_pixel_buffer_impl, width, height);
-
     buffer->data = data;
-    buffer->size = width * height * 4; // Assume RGBA
+    buffer->size = (size_t)width * height * 4; // Assume RGBA
     buffer->width = width;
     buffer->height = height;
     buffer->format = format;
+    buffer->fd = fd;
+    wl_list_init(&buffer->release.link);
+    pixman_region32_init(&buffer->stale);
+
+    return buffer;
+}
 
-    return &buffer->base;
+/* Allocates uninitialized pooled pixels */
+static struct IPCPixelBuffer *ipc_pixel_buffer_create(int width, int height, uint32_t format) {
+    size_t size = (size_t)width * height * 4;
+    void *data = pixel_pool_alloc(size);
+    if (!data) return NULL;
+
+    struct IPCPixelBuffer *buffer = ipc_pixel_buffer_wrap(data, -1, width, height, format);
+    if (!buffer) pixel_pool_free(data, size);
+    return buffer;
 }
 
 struct ImageEntry {
-    struct wl_list link;
     uint32_t image_id;
     uint32_t width;
     uint32_t height;
     uint32_t format;
-    uint8_t *data;
+    uint8_t *data;              /* ARGB words; format 0 (RGBA) is swizzled on upload */
     size_t data_size;
+    uint8_t opaque;             /* every pixel has alpha 255, blits can copy */
 };
 
 struct KeybindEntry {
-    struct wl_list link;
+    struct wl_list link;            /* IPCServer.keybinds, for per-client cleanup */
+    struct KeybindEntry *next;      /* next binding in the same hash bucket */
     uint32_t keybind_id;
     uint32_t modifiers;
     uint32_t keycode;
+    uint32_t flags;                 /* ICM_KEYBIND_* */
     struct IPCClient *client;
 };
 
@@ -179,7 +315,11 @@ struct ClickRegion {
     uint32_t window_id;
     int32_t x, y;
     uint32_t width, height;
+    uint32_t flags;                 /* ICM_CLICK_REGION_* */
     struct IPCClient *client;
+    struct wl_list hover_link;      /* IPCServer.hovered_regions while hovered */
+    uint8_t hovered;
+    uint32_t hover_serial;
 };
 
 struct ScreenCopyRequest {
@@ -189,6 +329,23 @@ struct ScreenCopyRequest {
     struct IPCClient *client;
 };
 
+/* One client's interest in pointer or keyboard events of one window */
+struct InputSubscription {
+    struct wl_list window_link;     /* WindowSubscribers.pointer / .keyboard */
+    struct wl_list client_link;     /* IPCClient.input_subscriptions */
+    struct IPCClient *client;
+    uint32_t window_id;
+    uint32_t type;                  /* ICM_INPUT_EVENT_POINTER or _KEYBOARD */
+};
+
+struct WindowSubscribers {
+    struct wl_list pointer;
+    struct wl_list keyboard;
+};
+
+#define ICM_IPC_RX_FDS_MAX 32
+#define ICM_IPC_TX_FDS_MAX 32
+
 struct IPCClient
 {
     struct wl_list link;
@@ -202,31 +359,88 @@ struct IPCClient
     int batching;
 
     /* Event registration */
-    int registered_pointer;
-    int registered_keyboard;
-    uint32_t event_window_id;
+    struct wl_list input_subscriptions; /* InputSubscription.client_link, newest first */
+    uint32_t num_keyboard_windows;
+    struct wl_list keyboard_link;       /* IPCServer.keyboard_clients while num_keyboard_windows > 0 */
+    uint8_t input_send_failed;          /* disconnect once the current fan-out is done */
 
     /* Global event registration */
     int registered_global_pointer;
     int registered_global_keyboard;
+    struct wl_list global_pointer_link;     /* IPCServer.global_pointer_clients */
+    struct wl_list global_keyboard_link;    /* IPCServer.global_keyboard_clients */
     int registered_global_capture_mouse;
     int registered_global_capture_keyboard;
 
     /* Window events subscription */
     uint32_t window_event_mask;  /* bitfield: 1=created, 2=destroyed, 4=title, 8=state, 16=focus */
+
+    /* Fair scheduling (see ipc_client_process_messages) */
+    uint32_t priority;           /* enum icm_client_priority */
+    uint8_t backlogged;          /* on IPCServer.pending_clients, input paused */
+    struct wl_list pending_link;
+    int rx_fds[ICM_IPC_RX_FDS_MAX];  /* received fds not yet claimed by a message */
+    int rx_num_fds;
+    uint8_t *rx_backlog;         /* received bytes that did not fit in read_buffer */
+    size_t rx_backlog_len;
+    size_t rx_backlog_off;
+    size_t rx_backlog_cap;
+
+    /* io_uring backend state (ipc_uring.c); unused on the poll path */
+    uint8_t uring_attached;      /* socket I/O is owned by the ring */
+    uint8_t uring_recv_armed;    /* a multishot recvmsg is outstanding */
+    uint8_t uring_recv_paused;   /* recv cancelled until the backlog drains */
+    uint8_t closing;             /* disconnected, waiting for in-flight ops */
+    int uring_ops;               /* submitted operations not yet completed */
+    struct wl_list uring_send_link;
+    uint8_t *send_queue;         /* encoded events waiting for the next send */
+    size_t send_queue_len;
+    size_t send_queue_cap;
+    uint8_t *send_inflight;      /* owned by the kernel until the send completes */
+    size_t send_inflight_len;
+    size_t send_inflight_off;
+    size_t send_inflight_cap;
+    int send_queue_fds[ICM_IPC_TX_FDS_MAX];     /* duplicates, sent with the next send */
+    int send_queue_num_fds;
+    int send_inflight_fds[ICM_IPC_TX_FDS_MAX];
+    int send_inflight_num_fds;
+    struct IPCUringSendMsg *send_msg;           /* msghdr for sends carrying fds */
 };
 
+struct IPCUring;
+
 struct IPCServer
 {
     struct Server *server;
     int socket_fd;
     struct wl_event_source *event_source;
+    struct IPCUring *uring;  /* NULL when client sockets use the poll path */
+    struct IPCStatePage *state_page;  /* created on the first GET_STATE_PAGE */
+    /* Clients with unprocessed messages, served round-robin one slice per
+     * turn; sched_fd is kicked to come back after the loop's other sources */
+    struct wl_list pending_clients;
+    int sched_fd;
+    struct wl_event_source *sched_source;
+    uint8_t sched_kicked;
+    uint32_t budget_msgs;    /* messages per client slice, 0 = unlimited */
+    uint32_t budget_us;      /* microseconds per client slice, 0 = unlimited */
     struct wl_list clients;
-    struct wl_list buffers;
+    /* Input fan-out lists; per-window pointer subscribers hang off the registry */
+    struct wl_list keyboard_clients;        /* IPCClient.keyboard_link */
+    struct wl_list global_pointer_clients;  /* IPCClient.global_pointer_link */
+    struct wl_list global_keyboard_clients; /* IPCClient.global_keyboard_link */
+    struct Slab buffers;            /* BufferEntry */
     struct wl_list surfaces;
-    struct wl_list images;
+    struct Slab images;             /* ImageEntry */
     struct wl_list keybinds;
+    /* (modifiers, keycode) -> chain of KeybindEntry, one per registration */
+    struct KeybindEntry **keybind_buckets;
+    uint32_t keybind_bucket_count;  /* power of two, 0 until the first bind */
+    uint32_t keybind_count;
     struct wl_list click_regions;
+    struct wl_list hovered_regions;     /* ClickRegion.hover_link */
+    uint32_t num_hover_regions;         /* registered with ICM_CLICK_REGION_HOVER */
+    uint32_t hover_serial;
     struct wl_list screen_copy_requests;
     uint32_t next_buffer_id;
     uint32_t next_surface_id;
@@ -234,10 +448,11 @@ struct IPCServer
     uint32_t next_keybind_id;
     uint32_t next_region_id;
     uint32_t next_window_id;
+    struct WindowRegistry windows;  /* window id -> buffer / view / layer surface */
     char screen_effect_equation[256];
     uint8_t screen_effect_enabled;
     /* Background effect buffer for screen-wide effects */
-    struct BufferEntry *screen_effect_buffer;
+    uint32_t screen_effect_handle;
     uint8_t screen_effect_dirty;
     /* Decoration configuration */
     uint32_t decoration_border_width;   /* Width of decoration borders in pixels */
@@ -285,6 +500,7 @@ struct Server {
     struct wl_listener cursor_frame;
     struct wl_listener request_cursor;
     struct wl_listener request_set_selection;
+    struct wl_listener keyboard_focus_change;
     struct IPCServer ipc_server;
     int cursor_theme_loaded;
     uint32_t focused_window_id;  /* ID of currently focused window (0 = none) */
@@ -295,11 +511,29 @@ int ipc_server_init(struct IPCServer *ipc_server, struct Server *server, const c
 void ipc_server_destroy(struct IPCServer *ipc_server);
 
 int ipc_server_handle_client(int fd, uint32_t mask, void *data);
+void ipc_client_queue_fds(struct IPCClient *client, const int *fds, int num_fds);
+void ipc_client_receive(struct IPCClient *client, const uint8_t *data, size_t size);
+void ipc_client_process_messages(struct IPCClient *client);
 
 struct BufferEntry *ipc_buffer_create(struct IPCServer *ipc_server, uint32_t buffer_id,
                                       int32_t width, int32_t height, uint32_t format);
 void ipc_buffer_destroy(struct IPCServer *ipc_server, uint32_t buffer_id);
 struct BufferEntry *ipc_buffer_get(struct IPCServer *ipc_server, uint32_t buffer_id);
+struct BufferEntry *ipc_buffer_from_handle(struct IPCServer *ipc_server, uint32_t handle);
+void ipc_buffer_sync_rects(struct BufferEntry *buffer);
+void ipc_buffer_drop_textures(struct BufferEntry *buffer);
+struct wlr_buffer *ipc_buffer_present(struct BufferEntry *buffer);
+void ipc_buffer_swap(struct BufferEntry *buffer);
+int ipc_buffer_resize(struct BufferEntry *buffer, uint32_t width, uint32_t height,
+                      uint32_t mode /* enum icm_resize_mode */);
+int ipc_buffer_share(struct BufferEntry *buffer);
+
+void ipc_window_register_view(struct IPCServer *ipc_server, struct View *view);
+void ipc_window_unregister_view(struct IPCServer *ipc_server, struct View *view);
+void ipc_window_register_layer_surface(struct IPCServer *ipc_server, struct LayerSurface *layer_surf);
+void ipc_window_unregister_layer_surface(struct IPCServer *ipc_server, struct LayerSurface *layer_surf);
+struct View *ipc_view_get(struct IPCServer *ipc_server, uint32_t window_id);
+struct LayerSurface *ipc_layer_surface_get(struct IPCServer *ipc_server, uint32_t window_id);
 
 struct ImageEntry *ipc_image_create(struct IPCServer *ipc_server, uint32_t image_id,
                                     uint32_t width, uint32_t height, uint32_t format,
@@ -308,16 +542,36 @@ void ipc_image_destroy(struct IPCServer *ipc_server, uint32_t image_id);
 struct ImageEntry *ipc_image_get(struct IPCServer *ipc_server, uint32_t image_id);
 
 int send_event_to_client(struct IPCClient *client, uint16_t type, const void *payload, size_t payload_size);
+int send_event_to_client_with_fds(struct IPCClient *client, uint16_t type, const void *payload,
+                                  size_t payload_size, const int *fds, int num_fds);
 void ipc_client_disconnect(struct IPCClient *client);
 
 void ipc_server_broadcast_shutdown(struct IPCServer *ipc_server);
 
-void ipc_check_keybind(struct IPCServer *ipc_server, uint32_t modifiers, uint32_t keycode);
+/* Fires every binding for the combination; true if one of them consumes the key */
+bool ipc_check_keybind(struct IPCServer *ipc_server, uint32_t modifiers, uint32_t keycode);
 void ipc_check_click_region(struct IPCServer *ipc_server, uint32_t window_id, int32_t x, int32_t y, uint32_t button, uint32_t state);
+void ipc_send_pointer_event(struct IPCServer *ipc_server, const struct icm_msg_pointer_event *event);
+/* event->window_id is kept; x/y should be layout coordinates */
+void ipc_send_global_pointer_event(struct IPCServer *ipc_server, const struct icm_msg_pointer_event *event);
+void ipc_send_keyboard_event(struct IPCServer *ipc_server, uint32_t time, uint32_t keycode,
+                             uint32_t state, uint32_t modifiers);
+/* Sends hover enter/leave for the pointer at (x, y) in window_id; 0 = over no window */
+void ipc_update_region_hover(struct IPCServer *ipc_server, uint32_t window_id, int32_t x, int32_t y);
 void ipc_window_unmap(struct IPCServer *ipc_server, uint32_t window_id);
 
+void ipc_notify_window_created(struct IPCServer *ipc_server, const struct icm_msg_window_created *event);
+void ipc_notify_window_destroyed(struct IPCServer *ipc_server, uint32_t window_id);
+void ipc_notify_window_title(struct IPCServer *ipc_server, uint32_t window_id, const char *title);
+void ipc_notify_window_app_id(struct IPCServer *ipc_server, uint32_t window_id, const char *app_id);
+void ipc_notify_window_state(struct IPCServer *ipc_server, uint32_t window_id);
+void ipc_notify_view_state(struct IPCServer *ipc_server, struct View *view);
+
 void update_animations(struct IPCServer *ipc_server);
 
+void ipc_state_page_update(struct IPCServer *ipc_server);
+void ipc_state_page_set_cursor(struct IPCServer *ipc_server, double x, double y);
+
 void apply_pixel_effect(uint8_t *pixels, size_t width, size_t height,
     const char *equation, double time_seconds);
 
@@ -334,4 +588,6 @@ struct LayerSurface
     struct wl_listener output_destroy;
     struct wl_listener new_popup;
     uint32_t window_id;
+    struct WindowEventState reported;
+    struct SceneOwner owner;
 };
\ No newline at end of file
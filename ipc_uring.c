@@ -0,0 +1,722 @@
+#include "ipc_uring.h"
+#include "ipc_server.h"
+#include "ipc_protocol.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <wayland-server-core.h>
+#include <wlr/util/log.h>
+
+#ifdef ICM_HAVE_IO_URING
+
+#include <fcntl.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <liburing.h>
+
+#define IPC_URING_ENTRIES       256
+#define IPC_URING_BUF_GROUP     0
+#define IPC_URING_BUF_COUNT     64      /* must be a power of two */
+#define IPC_URING_BUF_SIZE      16384
+#define IPC_URING_SEND_MAX      (4 * 1024 * 1024)  /* per-client backlog limit */
+#define IPC_URING_DRAIN_MS      200
+#define IPC_URING_RX_PAUSE      (256 * 1024)      /* backlog that pauses recv */
+
+/* user_data carries the client pointer with the operation in the low bits */
+enum IPCUringOp {
+    IPC_URING_OP_RECV   = 1,
+    IPC_URING_OP_SEND   = 2,
+    IPC_URING_OP_CANCEL = 3,
+};
+#define IPC_URING_OP_MASK 0x7ULL
+
+/* Per-client sendmsg header; lives until the send that uses it completes */
+struct IPCUringSendMsg {
+    struct msghdr msg;
+    struct iovec iov;
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(ICM_IPC_TX_FDS_MAX * sizeof(int))];
+    } control;
+};
+
+struct IPCUring {
+    struct IPCServer *ipc_server;
+    struct io_uring ring;
+    struct io_uring_buf_ring *buf_ring;
+    uint8_t *buf_base;
+    int buf_mask;
+    /* Template for multishot recvmsg; only the control length matters */
+    struct msghdr recv_msg;
+    int event_fd;
+    struct wl_event_source *event_source;
+    struct wl_event_source *flush_idle;
+    struct wl_list send_pending;     /* IPCClient.uring_send_link */
+    struct wl_list closing_clients;  /* IPCClient.link, waiting for ops to drain */
+};
+
+static struct IPCUring *client_uring(struct IPCClient *client) {
+    return client->server->ipc_server.uring;
+}
+
+static uint64_t pack_user_data(struct IPCClient *client, enum IPCUringOp op) {
+    return (uint64_t)(uintptr_t)client | op;
+}
+
+static struct io_uring_sqe *get_sqe(struct IPCUring *u) {
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&u->ring);
+    if (!sqe) {
+        /* Submission queue is full: push what we have and retry */
+        io_uring_submit(&u->ring);
+        sqe = io_uring_get_sqe(&u->ring);
+    }
+    return sqe;
+}
+
+static void recycle_buffer(struct IPCUring *u, uint16_t bid) {
+    io_uring_buf_ring_add(u->buf_ring, u->buf_base + (size_t)bid * IPC_URING_BUF_SIZE,
+                          IPC_URING_BUF_SIZE, bid, u->buf_mask, 0);
+    io_uring_buf_ring_advance(u->buf_ring, 1);
+}
+
+static void flush_idle(void *data);
+
+static void schedule_flush(struct IPCUring *u) {
+    if (u->flush_idle) return;
+    struct wl_event_loop *loop = wl_display_get_event_loop(u->ipc_server->server->wl_display);
+    u->flush_idle = wl_event_loop_add_idle(loop, flush_idle, u);
+}
+
+static int arm_recv(struct IPCUring *u, struct IPCClient *client) {
+    struct io_uring_sqe *sqe = get_sqe(u);
+    if (!sqe) return -1;
+
+    io_uring_prep_recvmsg_multishot(sqe, client->socket_fd, &u->recv_msg, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = IPC_URING_BUF_GROUP;
+    io_uring_sqe_set_data64(sqe, pack_user_data(client, IPC_URING_OP_RECV));
+
+    client->uring_ops++;
+    client->uring_recv_armed = 1;
+    schedule_flush(u);
+    return 0;
+}
+
+static void close_fds(int *fds, int *num_fds) {
+    for (int i = 0; i < *num_fds; i++) close(fds[i]);
+    *num_fds = 0;
+}
+
+/* Sends carrying descriptors use sendmsg; they are attached to the first
+ * submission and released once any of its bytes have gone out */
+static void prep_send_with_fds(struct io_uring_sqe *sqe, struct IPCClient *client) {
+    struct IPCUringSendMsg *sm = client->send_msg;
+    size_t fds_size = client->send_inflight_num_fds * sizeof(int);
+
+    memset(sm, 0, sizeof(*sm));
+    sm->iov.iov_base = client->send_inflight + client->send_inflight_off;
+    sm->iov.iov_len = client->send_inflight_len - client->send_inflight_off;
+    sm->msg.msg_iov = &sm->iov;
+    sm->msg.msg_iovlen = 1;
+    sm->msg.msg_control = sm->control.buf;
+    sm->msg.msg_controllen = CMSG_SPACE(fds_size);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&sm->msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(fds_size);
+    memcpy(CMSG_DATA(cmsg), client->send_inflight_fds, fds_size);
+
+    io_uring_prep_sendmsg(sqe, client->socket_fd, &sm->msg, MSG_NOSIGNAL);
+}
+
+static int submit_send(struct IPCUring *u, struct IPCClient *client) {
+    struct io_uring_sqe *sqe = get_sqe(u);
+    if (!sqe) return -1;
+
+    if (client->send_inflight_num_fds) {
+        prep_send_with_fds(sqe, client);
+    } else {
+        io_uring_prep_send(sqe, client->socket_fd,
+                           client->send_inflight + client->send_inflight_off,
+                           client->send_inflight_len - client->send_inflight_off,
+                           MSG_NOSIGNAL);
+    }
+    io_uring_sqe_set_data64(sqe, pack_user_data(client, IPC_URING_OP_SEND));
+
+    client->uring_ops++;
+    schedule_flush(u);
+    return 0;
+}
+
+/* Move everything queued since the last send into the in-flight buffer. The
+ * kernel reads from send_inflight until the completion arrives, so appends
+ * always go to send_queue and the two buffers are swapped here. */
+static void start_send(struct IPCUring *u, struct IPCClient *client) {
+    if (client->send_inflight_len || client->send_queue_len == 0) return;
+
+    uint8_t *buf = client->send_inflight;
+    size_t cap = client->send_inflight_cap;
+    client->send_inflight = client->send_queue;
+    client->send_inflight_cap = client->send_queue_cap;
+    client->send_inflight_len = client->send_queue_len;
+    client->send_inflight_off = 0;
+    client->send_queue = buf;
+    client->send_queue_cap = cap;
+    client->send_queue_len = 0;
+
+    memcpy(client->send_inflight_fds, client->send_queue_fds,
+           client->send_queue_num_fds * sizeof(int));
+    client->send_inflight_num_fds = client->send_queue_num_fds;
+    client->send_queue_num_fds = 0;
+
+    if (submit_send(u, client) < 0) {
+        wlr_log(WLR_ERROR, "IPC: no submission slot for send (fd=%d)", client->socket_fd);
+    }
+}
+
+static void flush_pending_sends(struct IPCUring *u) {
+    struct IPCClient *client, *tmp;
+    wl_list_for_each_safe(client, tmp, &u->send_pending, uring_send_link) {
+        wl_list_remove(&client->uring_send_link);
+        wl_list_init(&client->uring_send_link);
+        start_send(u, client);
+    }
+}
+
+static void flush_idle(void *data) {
+    struct IPCUring *u = data;
+    u->flush_idle = NULL;
+
+    /* One send per client carrying every event queued during this dispatch,
+     * and one io_uring_enter for all of them */
+    flush_pending_sends(u);
+    io_uring_submit(&u->ring);
+}
+
+static void drop_send_fds(struct IPCClient *client) {
+    close_fds(client->send_queue_fds, &client->send_queue_num_fds);
+    close_fds(client->send_inflight_fds, &client->send_inflight_num_fds);
+    free(client->send_msg);
+    client->send_msg = NULL;
+}
+
+static void free_client(struct IPCClient *client) {
+    wl_list_remove(&client->link);
+    close(client->socket_fd);
+    drop_send_fds(client);
+    free(client->send_queue);
+    free(client->send_inflight);
+    free(client);
+}
+
+static void maybe_free_client(struct IPCClient *client) {
+    if (client->closing && client->uring_ops == 0) {
+        free_client(client);
+    }
+}
+
+static void pause_recv(struct IPCUring *u, struct IPCClient *client) {
+    struct io_uring_sqe *sqe = get_sqe(u);
+    if (!sqe) return;
+
+    io_uring_prep_cancel64(sqe, pack_user_data(client, IPC_URING_OP_RECV), 0);
+    io_uring_sqe_set_data64(sqe, pack_user_data(client, IPC_URING_OP_CANCEL));
+    client->uring_ops++;
+    client->uring_recv_paused = 1;
+    schedule_flush(u);
+}
+
+/* Feed one completed recvmsg buffer into the client's stream.
+ * Returns -1 on EOF or a malformed completion. */
+static int consume_recv_buffer(struct IPCUring *u, struct IPCClient *client,
+                               uint8_t *buf, int len) {
+    struct io_uring_recvmsg_out *out = io_uring_recvmsg_validate(buf, len, &u->recv_msg);
+    if (!out) {
+        wlr_log(WLR_ERROR, "IPC: malformed recvmsg completion (fd=%d)", client->socket_fd);
+        return -1;
+    }
+    if (out->flags & MSG_CTRUNC) {
+        wlr_log(WLR_ERROR, "IPC: ancillary data truncated, file descriptors lost (fd=%d)",
+                client->socket_fd);
+    }
+
+    int fds[ICM_MAX_FDS_PER_MSG];
+    int num_fds = 0;
+    struct cmsghdr *cmsg;
+    for (cmsg = io_uring_recvmsg_cmsg_firsthdr(out, &u->recv_msg); cmsg;
+         cmsg = io_uring_recvmsg_cmsg_nexthdr(out, &u->recv_msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            int n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            if (n > ICM_MAX_FDS_PER_MSG) n = ICM_MAX_FDS_PER_MSG;
+            memcpy(fds, CMSG_DATA(cmsg), n * sizeof(int));
+            num_fds = n;
+            break;
+        }
+    }
+
+    uint8_t *payload = io_uring_recvmsg_payload(out, &u->recv_msg);
+    size_t payload_len = io_uring_recvmsg_payload_length(out, len, &u->recv_msg);
+    if (payload_len == 0) {
+        return -1;  /* Peer closed the connection */
+    }
+
+    ipc_client_queue_fds(client, fds, num_fds);
+    ipc_client_receive(client, payload, payload_len);
+    ipc_client_process_messages(client);
+
+    /* The scheduler has put this client on hold; stop pulling more data
+     * once its backlog is large so the socket buffer pushes back */
+    if (client->backlogged && !client->closing && client->uring_recv_armed &&
+        !client->uring_recv_paused && client->rx_backlog_len > IPC_URING_RX_PAUSE) {
+        pause_recv(u, client);
+    }
+    return 0;
+}
+
+static void handle_recv_completion(struct IPCUring *u, struct IPCClient *client,
+                                   int res, uint32_t flags) {
+    int eof = res == 0;
+
+    if (flags & IORING_CQE_F_BUFFER) {
+        uint16_t bid = flags >> IORING_CQE_BUFFER_SHIFT;
+        uint8_t *buf = u->buf_base + (size_t)bid * IPC_URING_BUF_SIZE;
+        if (res > 0 && !client->closing && consume_recv_buffer(u, client, buf, res) < 0) {
+            eof = 1;
+        }
+        recycle_buffer(u, bid);
+    }
+
+    if (!(flags & IORING_CQE_F_MORE)) {
+        client->uring_recv_armed = 0;
+        client->uring_ops--;
+    }
+
+    if (client->closing) {
+        maybe_free_client(client);
+        return;
+    }
+
+    /* -ECANCELED comes from pause_recv(); ENOBUFS means the ring ran dry */
+    if (eof || (res < 0 && res != -ENOBUFS && res != -EINTR && res != -ECANCELED)) {
+        if (res < 0) {
+            wlr_log(WLR_DEBUG, "IPC: recv failed on fd %d: %s", client->socket_fd, strerror(-res));
+        }
+        ipc_client_disconnect(client);
+        return;
+    }
+
+    /* Multishot ends when the buffer ring runs dry; buffers are recycled as
+     * soon as they are consumed, so re-arming straight away is enough */
+    if (!client->uring_recv_armed && !client->uring_recv_paused && arm_recv(u, client) < 0) {
+        ipc_client_disconnect(client);
+    }
+}
+
+static void handle_send_completion(struct IPCUring *u, struct IPCClient *client, int res) {
+    client->uring_ops--;
+
+    if (client->closing) {
+        maybe_free_client(client);
+        return;
+    }
+
+    if (res == -EAGAIN || res == -EINTR) {
+        submit_send(u, client);
+        return;
+    }
+    if (res < 0) {
+        wlr_log(WLR_ERROR, "Failed to send event to client: %s", strerror(-res));
+        ipc_client_disconnect(client);
+        return;
+    }
+
+    /* The descriptors went out with the first bytes of this send */
+    close_fds(client->send_inflight_fds, &client->send_inflight_num_fds);
+
+    client->send_inflight_off += res;
+    if (client->send_inflight_off < client->send_inflight_len) {
+        submit_send(u, client);
+        return;
+    }
+
+    client->send_inflight_len = 0;
+    client->send_inflight_off = 0;
+    if (client->send_queue_len && wl_list_empty(&client->uring_send_link)) {
+        wl_list_insert(u->send_pending.prev, &client->uring_send_link);
+        schedule_flush(u);
+    }
+}
+
+static void process_completions(struct IPCUring *u) {
+    struct io_uring_cqe *cqe;
+    while (io_uring_peek_cqe(&u->ring, &cqe) == 0) {
+        uint64_t user_data = io_uring_cqe_get_data64(cqe);
+        int res = cqe->res;
+        uint32_t flags = cqe->flags;
+        io_uring_cqe_seen(&u->ring, cqe);
+
+        struct IPCClient *client = (struct IPCClient *)(uintptr_t)(user_data & ~IPC_URING_OP_MASK);
+        switch (user_data & IPC_URING_OP_MASK) {
+        case IPC_URING_OP_RECV:
+            handle_recv_completion(u, client, res, flags);
+            break;
+        case IPC_URING_OP_SEND:
+            handle_send_completion(u, client, res);
+            break;
+        case IPC_URING_OP_CANCEL:
+            if (client) {
+                client->uring_ops--;
+                maybe_free_client(client);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+static int handle_ring_event(int fd, uint32_t mask, void *data) {
+    struct IPCUring *u = data;
+    eventfd_t value;
+    eventfd_read(fd, &value);
+
+    process_completions(u);
+
+    /* Re-arms and follow-up sends queued above go out with the idle flush */
+    return 0;
+}
+
+/* Check that multishot recvmsg with provided buffers works on this kernel
+ * (6.0+) before committing clients to the ring */
+static int probe_multishot_recvmsg(struct IPCUring *u) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) return -1;
+
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&u->ring);
+    io_uring_prep_recvmsg_multishot(sqe, sv[0], &u->recv_msg, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = IPC_URING_BUF_GROUP;
+    io_uring_sqe_set_data64(sqe, 0);
+    io_uring_submit(&u->ring);
+
+    if (write(sv[1], "p", 1) != 1) {
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+    shutdown(sv[1], SHUT_WR);
+
+    /* Expect the byte, then EOF terminating the multishot */
+    int ok = 0;
+    int finished = 0;
+    while (!finished) {
+        struct io_uring_cqe *cqe;
+        struct __kernel_timespec ts = { .tv_sec = 0, .tv_nsec = 100 * 1000000 };
+        if (io_uring_wait_cqe_timeout(&u->ring, &cqe, &ts) < 0) break;
+
+        if (cqe->res > 0) ok = 1;
+        if (cqe->flags & IORING_CQE_F_BUFFER) {
+            recycle_buffer(u, cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        }
+        finished = !(cqe->flags & IORING_CQE_F_MORE);
+        io_uring_cqe_seen(&u->ring, cqe);
+    }
+
+    close(sv[0]);
+    close(sv[1]);
+    return ok && finished ? 0 : -1;
+}
+
+static void free_uring(struct IPCUring *u) {
+    if (u->event_source) wl_event_source_remove(u->event_source);
+    if (u->flush_idle) wl_event_source_remove(u->flush_idle);
+    if (u->buf_ring) {
+        io_uring_free_buf_ring(&u->ring, u->buf_ring, IPC_URING_BUF_COUNT, IPC_URING_BUF_GROUP);
+    }
+    io_uring_queue_exit(&u->ring);
+    if (u->event_fd >= 0) close(u->event_fd);
+    free(u->buf_base);
+    free(u);
+}
+
+int ipc_uring_init(struct IPCServer *ipc_server) {
+    const char *env = getenv("ICM_IPC_URING");
+    if (env && strcmp(env, "0") == 0) {
+        wlr_log(WLR_INFO, "IPC: io_uring disabled by ICM_IPC_URING=0");
+        return -1;
+    }
+
+    struct IPCUring *u = calloc(1, sizeof(*u));
+    if (!u) return -1;
+    u->ipc_server = ipc_server;
+    u->event_fd = -1;
+    wl_list_init(&u->send_pending);
+    wl_list_init(&u->closing_clients);
+
+    struct io_uring_params params = {0};
+    params.flags = IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+    int ret = io_uring_queue_init_params(IPC_URING_ENTRIES, &u->ring, &params);
+    if (ret == -EINVAL) {
+        /* Older kernel without the setup flags */
+        memset(&params, 0, sizeof(params));
+        ret = io_uring_queue_init_params(IPC_URING_ENTRIES, &u->ring, &params);
+    }
+    if (ret < 0) {
+        wlr_log(WLR_INFO, "IPC: io_uring unavailable (%s), using poll", strerror(-ret));
+        free(u);
+        return -1;
+    }
+
+    if (posix_memalign((void **)&u->buf_base, 4096,
+                       (size_t)IPC_URING_BUF_COUNT * IPC_URING_BUF_SIZE) != 0) {
+        u->buf_base = NULL;
+        goto fail;
+    }
+    u->buf_ring = io_uring_setup_buf_ring(&u->ring, IPC_URING_BUF_COUNT,
+                                          IPC_URING_BUF_GROUP, 0, &ret);
+    if (!u->buf_ring) {
+        wlr_log(WLR_INFO, "IPC: provided buffer rings unsupported (%s), using poll", strerror(-ret));
+        goto fail;
+    }
+    u->buf_mask = io_uring_buf_ring_mask(IPC_URING_BUF_COUNT);
+    for (int i = 0; i < IPC_URING_BUF_COUNT; i++) {
+        io_uring_buf_ring_add(u->buf_ring, u->buf_base + (size_t)i * IPC_URING_BUF_SIZE,
+                              IPC_URING_BUF_SIZE, i, u->buf_mask, i);
+    }
+    io_uring_buf_ring_advance(u->buf_ring, IPC_URING_BUF_COUNT);
+
+    /* Each buffer carries io_uring_recvmsg_out + control + payload */
+    u->recv_msg.msg_controllen = CMSG_SPACE(ICM_MAX_FDS_PER_MSG * sizeof(int));
+
+    if (probe_multishot_recvmsg(u) < 0) {
+        wlr_log(WLR_INFO, "IPC: multishot recvmsg unsupported, using poll");
+        goto fail;
+    }
+
+    u->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (u->event_fd < 0 || io_uring_register_eventfd(&u->ring, u->event_fd) < 0) {
+        goto fail;
+    }
+    u->event_source = wl_event_loop_add_fd(
+        wl_display_get_event_loop(ipc_server->server->wl_display),
+        u->event_fd, WL_EVENT_READABLE, handle_ring_event, u);
+    if (!u->event_source) goto fail;
+
+    ipc_server->uring = u;
+    wlr_log(WLR_INFO, "IPC: using io_uring backend (%d x %d byte receive buffers)",
+            IPC_URING_BUF_COUNT, IPC_URING_BUF_SIZE);
+    return 0;
+
+fail:
+    free_uring(u);
+    return -1;
+}
+
+int ipc_uring_add_client(struct IPCServer *ipc_server, struct IPCClient *client) {
+    struct IPCUring *u = ipc_server->uring;
+    if (!u) return -1;
+
+    wl_list_init(&client->uring_send_link);
+    if (arm_recv(u, client) < 0) return -1;
+
+    /* The ring waits for readiness itself; a non-blocking socket would only
+     * turn that into -EAGAIN completions */
+    int flags = fcntl(client->socket_fd, F_GETFL);
+    if (flags >= 0) fcntl(client->socket_fd, F_SETFL, flags & ~O_NONBLOCK);
+
+    client->uring_attached = 1;
+    return 0;
+}
+
+int ipc_uring_queue_send(struct IPCClient *client, const struct iovec *iov, int iovcnt,
+                         const int *fds, int num_fds) {
+    struct IPCUring *u = client_uring(client);
+    if (client->closing) return -1;
+
+    size_t size = 0;
+    for (int i = 0; i < iovcnt; i++) size += iov[i].iov_len;
+    size_t needed = client->send_queue_len + size;
+    if (needed > IPC_URING_SEND_MAX) {
+        wlr_log(WLR_ERROR, "IPC: client fd %d is not reading, dropping %zu queued bytes",
+                client->socket_fd, client->send_queue_len);
+        return -1;
+    }
+    if (client->send_queue_num_fds + num_fds > ICM_IPC_TX_FDS_MAX) {
+        wlr_log(WLR_ERROR, "IPC: too many file descriptors queued for fd %d", client->socket_fd);
+        return -1;
+    }
+    if (num_fds && !client->send_msg) {
+        client->send_msg = calloc(1, sizeof(*client->send_msg));
+        if (!client->send_msg) return -1;
+    }
+    if (needed > client->send_queue_cap) {
+        size_t cap = client->send_queue_cap ? client->send_queue_cap : 4096;
+        while (cap < needed) cap *= 2;
+        uint8_t *queue = realloc(client->send_queue, cap);
+        if (!queue) return -1;
+        client->send_queue = queue;
+        client->send_queue_cap = cap;
+    }
+
+    int *queued = client->send_queue_fds + client->send_queue_num_fds;
+    for (int i = 0; i < num_fds; i++) {
+        queued[i] = fcntl(fds[i], F_DUPFD_CLOEXEC, 0);
+        if (queued[i] < 0) {
+            wlr_log(WLR_ERROR, "IPC: failed to duplicate fd for send: %s", strerror(errno));
+            close_fds(queued, &i);
+            return -1;
+        }
+    }
+    client->send_queue_num_fds += num_fds;
+
+    for (int i = 0; i < iovcnt; i++) {
+        memcpy(client->send_queue + client->send_queue_len, iov[i].iov_base, iov[i].iov_len);
+        client->send_queue_len += iov[i].iov_len;
+    }
+
+    if (wl_list_empty(&client->uring_send_link)) {
+        wl_list_insert(u->send_pending.prev, &client->uring_send_link);
+        schedule_flush(u);
+    }
+    return 0;
+}
+
+void ipc_uring_resume_client(struct IPCClient *client) {
+    struct IPCUring *u = client_uring(client);
+    if (!client->uring_recv_paused || client->closing) return;
+
+    client->uring_recv_paused = 0;
+    if (!client->uring_recv_armed && arm_recv(u, client) < 0) {
+        ipc_client_disconnect(client);
+    }
+}
+
+void ipc_uring_release_client(struct IPCClient *client) {
+    struct IPCUring *u = client_uring(client);
+
+    client->closing = 1;
+    wl_list_remove(&client->uring_send_link);
+    wl_list_init(&client->uring_send_link);
+    wl_list_insert(&u->closing_clients, &client->link);
+
+    if (client->uring_ops > 0) {
+        /* Cancel the armed recv and any send; shutdown covers ops the cancel
+         * races with. Each completion drops uring_ops until the last frees */
+        struct io_uring_sqe *sqe = get_sqe(u);
+        if (sqe) {
+            io_uring_prep_cancel_fd(sqe, client->socket_fd, IORING_ASYNC_CANCEL_ALL);
+            io_uring_sqe_set_data64(sqe, pack_user_data(client, IPC_URING_OP_CANCEL));
+            client->uring_ops++;
+            schedule_flush(u);
+        }
+        shutdown(client->socket_fd, SHUT_RDWR);
+    }
+
+    maybe_free_client(client);
+}
+
+static int clients_busy(struct IPCUring *u, int sends_only) {
+    struct IPCClient *client;
+    wl_list_for_each(client, &u->ipc_server->clients, link) {
+        if (!client->uring_attached) continue;
+        if (sends_only ? (client->send_inflight_len || client->send_queue_len)
+                       : client->uring_ops > 0) {
+            return 1;
+        }
+    }
+    return !sends_only && !wl_list_empty(&u->closing_clients);
+}
+
+/* Run the completion loop synchronously; used at shutdown when the Wayland
+ * loop no longer dispatches */
+static void drain(struct IPCUring *u, int sends_only) {
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while (clients_busy(u, sends_only)) {
+        if (sends_only) flush_pending_sends(u);
+        io_uring_submit(&u->ring);
+
+        struct io_uring_cqe *cqe;
+        struct __kernel_timespec ts = { .tv_sec = 0, .tv_nsec = 10 * 1000000 };
+        io_uring_wait_cqe_timeout(&u->ring, &cqe, &ts);
+        process_completions(u);
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long elapsed_ms = (now.tv_sec - start.tv_sec) * 1000 +
+                          (now.tv_nsec - start.tv_nsec) / 1000000;
+        if (elapsed_ms > IPC_URING_DRAIN_MS) {
+            wlr_log(WLR_ERROR, "IPC: timed out draining io_uring operations");
+            break;
+        }
+    }
+}
+
+void ipc_uring_destroy(struct IPCServer *ipc_server) {
+    struct IPCUring *u = ipc_server->uring;
+    if (!u) return;
+
+    /* Deliver whatever is queued (e.g. COMPOSITOR_SHUTDOWN) first */
+    drain(u, 1);
+
+    struct io_uring_sqe *sqe = get_sqe(u);
+    if (sqe) {
+        io_uring_prep_cancel64(sqe, 0, IORING_ASYNC_CANCEL_ANY);
+        io_uring_sqe_set_data64(sqe, pack_user_data(NULL, IPC_URING_OP_CANCEL));
+    }
+    drain(u, 0);
+
+    struct IPCClient *client, *tmp;
+    wl_list_for_each_safe(client, tmp, &u->closing_clients, link) {
+        free_client(client);
+    }
+    wl_list_for_each(client, &ipc_server->clients, link) {
+        drop_send_fds(client);
+        client->uring_attached = 0;
+    }
+
+    ipc_server->uring = NULL;
+    free_uring(u);
+}
+
+#else /* !ICM_HAVE_IO_URING */
+
+int ipc_uring_init(struct IPCServer *ipc_server) {
+    (void)ipc_server;
+    wlr_log(WLR_INFO, "IPC: built without io_uring support, using poll");
+    return -1;
+}
+
+void ipc_uring_destroy(struct IPCServer *ipc_server) {
+    (void)ipc_server;
+}
+
+int ipc_uring_add_client(struct IPCServer *ipc_server, struct IPCClient *client) {
+    (void)ipc_server;
+    (void)client;
+    return -1;
+}
+
+int ipc_uring_queue_send(struct IPCClient *client, const struct iovec *iov, int iovcnt,
+                         const int *fds, int num_fds) {
+    (void)client;
+    (void)iov;
+    (void)iovcnt;
+    (void)fds;
+    (void)num_fds;
+    return -1;
+}
+
+void ipc_uring_resume_client(struct IPCClient *client) {
+    (void)client;
+}
+
+void ipc_uring_release_client(struct IPCClient *client) {
+    (void)client;
+}
+
+#endif /* ICM_HAVE_IO_URING */
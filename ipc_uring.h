@@ -0,0 +1,73 @@
+#ifndef ICM_IPC_URING_H
+#define ICM_IPC_URING_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+/**
+ * io_uring socket backend for the IPC server.
+ *
+ * When available, every client socket keeps a multishot recvmsg armed that
+ * draws from a shared provided-buffer ring, and outbound events are queued per
+ * client and flushed as one send per client from an idle callback, so a burst
+ * of events across many clients costs a single io_uring_enter. Completions are
+ * delivered to the Wayland event loop through an eventfd registered with the
+ * ring.
+ *
+ * The poll-based path in ipc_server.c remains the fallback: it is used when
+ * icm is built without liburing, when the kernel lacks multishot recvmsg or
+ * provided buffer rings, or when ICM_IPC_URING=0 is set in the environment.
+ */
+
+struct IPCServer;
+struct IPCClient;
+
+/**
+ * Set up the ring and attach it to the IPC server.
+ *
+ * @param ipc_server The IPC server, with its Server pointer already set
+ * @return 0 if the io_uring backend is active, -1 to use the poll path
+ */
+int ipc_uring_init(struct IPCServer *ipc_server);
+
+/**
+ * Flush queued sends, cancel outstanding operations and tear the ring down.
+ * Clients that were waiting on in-flight operations are freed.
+ */
+void ipc_uring_destroy(struct IPCServer *ipc_server);
+
+/**
+ * Hand a freshly accepted client socket to the ring.
+ *
+ * @return 0 if the ring now owns the socket's I/O, -1 if the caller should
+ *         register the socket with the event loop instead
+ */
+int ipc_uring_add_client(struct IPCServer *ipc_server, struct IPCClient *client);
+
+/**
+ * Append an encoded message, gathered from iov, to the client's send queue.
+ * The data is copied and the file descriptors are duplicated; the caller
+ * keeps its own.
+ *
+ * Descriptors are attached to the next send, so they can reach the client
+ * with bytes that precede the message claiming them, never after.
+ *
+ * @return 0 on success, -1 if the client is closing or its queue overflowed
+ */
+int ipc_uring_queue_send(struct IPCClient *client, const struct iovec *iov, int iovcnt,
+                         const int *fds, int num_fds);
+
+/**
+ * Re-arm receives for a client whose recv was paused while its backlog was
+ * worked off by the IPC scheduler.
+ */
+void ipc_uring_resume_client(struct IPCClient *client);
+
+/**
+ * Release a client whose bookkeeping has already been unlinked by
+ * ipc_client_disconnect(). The socket is shut down and the client is freed
+ * once the kernel has finished with every operation that references it.
+ */
+void ipc_uring_release_client(struct IPCClient *client);
+
+#endif /* ICM_IPC_URING_H */
@@ -51,6 +51,8 @@
 #include "transform_matrix.h"
 #include "gl_shaders.h"
 #include "main.h"
+#include "pixel_pool.h"
+#include "raster.h"
 #include "signal.h"
 #include <bits/sigaction.h>
 #include <wayland-util.h>
@@ -77,22 +79,38 @@ struct Keyboard {
     struct wl_listener modifiers;
     struct wl_listener key;
     struct wl_listener destroy;
+    /* Pressed keys whose press a keybind consumed; their release is dropped too */
+    uint32_t consumed_keys[WLR_KEYBOARD_KEYS_CAP];
+    size_t num_consumed_keys;
 };
 
-struct LayerSurface
+/* Tag the scene node a window owns so hit tests can find the window */
+static void scene_owner_attach(struct SceneOwner *owner, struct wlr_scene_node *node,
+                               enum SceneOwnerType type, uint32_t window_id)
 {
-    struct wl_list link;
-    struct Server *server;
-    struct wlr_layer_surface_v1 *layer_surface;
-    struct wlr_scene_layer_surface_v1 *scene_layer;
-    struct wl_listener destroy;
-    struct wl_listener map;
-    struct wl_listener unmap;
-    struct wl_listener surface_commit;
-    struct wl_listener output_destroy;
-    struct wl_listener new_popup;
-    uint32_t window_id;
-};
+    owner->type = type;
+    owner->window_id = window_id;
+    node->data = owner;
+}
+
+/* First owner on the way up from node, NULL if no window owns it */
+static struct SceneOwner *scene_node_owner(struct wlr_scene_node *node)
+{
+    while (node) {
+        if (node->data) return node->data;
+        node = node->parent ? &node->parent->node : NULL;
+    }
+    return NULL;
+}
+
+/* Mapped View owning node, if any */
+static struct View *scene_node_view(struct wlr_scene_node *node)
+{
+    struct SceneOwner *owner = scene_node_owner(node);
+    if (!owner || owner->type != SCENE_OWNER_VIEW) return NULL;
+    struct View *view = wl_container_of(owner, view, owner);
+    return view->mapped ? view : NULL;
+}
 
 /* Check if a surface belongs to a layer shell surface */
 static struct LayerSurface *layer_surface_at(struct Server *server, double lx, double ly)
@@ -196,6 +214,8 @@ static void focus_view(struct View *view, struct wlr_surface *surface) {
         wlr_xdg_toplevel_set_activated(view->xdg_surface->toplevel, true);
     }
 
+    server->focused_window_id = view->window_id;
+
     /* Notify the Wayland seat of the keyboard focus change */
     wlr_seat_keyboard_notify_enter(server->seat, surface,
         keyboard->keycodes, keyboard->num_keycodes, &keyboard->modifiers);
@@ -221,15 +241,33 @@ static void keyboard_handle_modifiers(struct wl_listener *listener, void *data)
     }
 }
 
+static void keyboard_mark_consumed(struct Keyboard *keyboard, uint32_t keycode)
+{
+    if (keyboard->num_consumed_keys < WLR_KEYBOARD_KEYS_CAP) {
+        keyboard->consumed_keys[keyboard->num_consumed_keys++] = keycode;
+    }
+}
+
+static bool keyboard_take_consumed(struct Keyboard *keyboard, uint32_t keycode)
+{
+    for (size_t i = 0; i < keyboard->num_consumed_keys; i++) {
+        if (keyboard->consumed_keys[i] == keycode) {
+            keyboard->consumed_keys[i] = keyboard->consumed_keys[--keyboard->num_consumed_keys];
+            return true;
+        }
+    }
+    return false;
+}
+
 /**
  * Handle keyboard key events (press and release)
  * 
  * Processes both Wayland seat notifications and IPC client registrations.
  * Routes keyboard events to:
- * - Wayland seat (for standard input routing)
+ * - Keybinding system (for dynamic keybind dispatch), before anything else
+ * - Wayland seat (for standard input routing), unless a keybind consumed the key
  * - Window-specific IPC clients (registered for specific windows)
  * - Global IPC clients (registered for all keyboard events)
- * - Keybinding system (for dynamic keybind dispatch)
  * 
  * Also handles F1 as a default window focus key when no focus exists.
  */
@@ -246,50 +284,29 @@ static void keyboard_handle_key(struct wl_listener *listener, void *data) {
         }
     }
 
-    /* Notify the Wayland seat of the keyboard event */
-    wlr_seat_keyboard_notify_key(server->seat, event->time_msec, event->keycode, event->state);
-
     /* Get current keyboard modifiers (Shift, Ctrl, Alt, etc.) */
     struct wlr_keyboard *wlr_kb = wlr_keyboard_from_input_device(keyboard->device);
     uint32_t mods = wlr_keyboard_get_modifiers(wlr_kb);
 
-    /* Distribute keyboard event to window-specific IPC clients */
-    struct IPCClient *client, *tmp;
-    wl_list_for_each_safe(client, tmp, &server->ipc_server.clients, link) {
-        if (client->registered_keyboard) {
-            struct icm_msg_keyboard_event kevent = {
-                .window_id = client->event_window_id,
-                .time = event->time_msec,
-                .keycode = event->keycode,
-                .state = event->state,
-                .modifiers = mods
-            };
-            if (send_event_to_client(client, ICM_MSG_KEYBOARD_EVENT, &kevent, sizeof(kevent)) < 0) {
-                fprintf(stderr, "Failed to send keyboard event, disconnecting client\n");
-                ipc_client_disconnect(client);
-            }
-        }
-        /* Also distribute to global keyboard listeners */
-        if (client->registered_global_keyboard) {
-            struct icm_msg_keyboard_event kevent = {
-                .window_id = 0,  /* 0 indicates global scope */
-                .time = event->time_msec,
-                .keycode = event->keycode,
-                .state = event->state,
-                .modifiers = mods
-            };
-            if (send_event_to_client(client, ICM_MSG_KEYBOARD_EVENT, &kevent, sizeof(kevent)) < 0) {
-                fprintf(stderr, "Failed to send global keyboard event, disconnecting client\n");
-                ipc_client_disconnect(client);
-            }
-        }
+    /* Keybinds fire before the focused client sees the key */
+    bool consumed;
+    if (event->state == WL_KEYBOARD_KEY_STATE_PRESSED) {
+        consumed = ipc_check_keybind(&server->ipc_server, mods, event->keycode);
+        if (consumed) keyboard_mark_consumed(keyboard, event->keycode);
+    } else {
+        consumed = keyboard_take_consumed(keyboard, event->keycode);
     }
 
-    /* On key press: check for registered keybindings and handle special keys */
-    if (event->state == WL_KEYBOARD_KEY_STATE_PRESSED) {
-        /* Check if this key combination matches any registered keybinds */
-        ipc_check_keybind(&server->ipc_server, mods, event->keycode);
+    /* Notify the Wayland seat of the keyboard event */
+    if (!consumed) {
+        wlr_seat_keyboard_notify_key(server->seat, event->time_msec, event->keycode, event->state);
+    }
+
+    /* Distribute keyboard event to subscribed and global IPC clients */
+    ipc_send_keyboard_event(&server->ipc_server, event->time_msec, event->keycode, event->state, mods);
 
+    /* On key press: handle special keys */
+    if (event->state == WL_KEYBOARD_KEY_STATE_PRESSED) {
         /* Handle special keys (F1 = focus topmost window) */
         if (wlr_kb && wlr_kb->xkb_state) {
             uint32_t keycode = event->keycode + 8;  /* XKB uses keycode + 8 convention */
@@ -423,6 +440,7 @@ static void on_map(struct wl_listener *listener, void *data)
 
     wlr_xdg_toplevel_set_size(view->xdg_surface->toplevel, window_width, window_height);
     focus_view(view, view->xdg_surface->surface);
+    ipc_notify_view_state(&server->ipc_server, view);
 }
 
 /**
@@ -441,6 +459,7 @@ static void on_unmap(struct wl_listener *listener, void *data)
     if (view->window_id > 0) {
         ipc_window_unmap(&view->server->ipc_server, view->window_id);
     }
+    ipc_notify_view_state(&view->server->ipc_server, view);
 }
 
 /**
@@ -448,17 +467,20 @@ static void on_unmap(struct wl_listener *listener, void *data)
  * 
  * Called when the window's surface state is committed (buffer attached, damage, etc.)
  * On initial commit, sends a configure event to let the client choose its size.
+ * Acked maximize/fullscreen changes land here, so window state events are
+ * reported from the commit rather than from the request.
  * 
  * Note: wlr_scene handles geometry offsets internally, so we don't manually adjust.
  */
 static void on_commit(struct wl_listener *listener, void *data)
 {
     struct View *view = wl_container_of(listener, view, commit);
-    if (view->xdg_surface->initial_commit)
+    if (!view->is_xwayland && view->xdg_surface->initial_commit)
     {
         /* Send initial configure without forcing a size - let client choose */
         wlr_xdg_toplevel_set_size(view->xdg_surface->toplevel, 0, 0);
     }
+    ipc_notify_view_state(&view->server->ipc_server, view);
 }
 
 /**
@@ -485,10 +507,36 @@ static void on_destroy(struct wl_listener *listener, void *data)
     wl_list_remove(&view->destroy.link);
     wl_list_remove(&view->request_move.link);
     wl_list_remove(&view->request_resize.link);
+    wl_list_remove(&view->set_title.link);
+    wl_list_remove(&view->set_app_id.link);
     wl_list_remove(&view->link);
+    ipc_window_unregister_view(&view->server->ipc_server, view);
+    ipc_notify_window_destroyed(&view->server->ipc_server, view->window_id);
     free(view);
 }
 
+/**
+ * Handle window title and app_id changes
+ * 
+ * Forwards the new string to IPC clients subscribed to title or app_id
+ * events. Xwayland windows report their WM_CLASS as the app_id.
+ */
+static void on_set_title(struct wl_listener *listener, void *data)
+{
+    struct View *view = wl_container_of(listener, view, set_title);
+    const char *title = view->is_xwayland ? view->xwayland_surface->title :
+                                            view->xdg_surface->toplevel->title;
+    ipc_notify_window_title(&view->server->ipc_server, view->window_id, title);
+}
+
+static void on_set_app_id(struct wl_listener *listener, void *data)
+{
+    struct View *view = wl_container_of(listener, view, set_app_id);
+    const char *app_id = view->is_xwayland ? view->xwayland_surface->class :
+                                             view->xdg_surface->toplevel->app_id;
+    ipc_notify_window_app_id(&view->server->ipc_server, view->window_id, app_id);
+}
+
 /**
  * Handle window move request
  * 
@@ -587,6 +635,7 @@ static void layer_surface_map(struct wl_listener *listener, void *data)
     struct LayerSurface *layer_surf = wl_container_of(listener, layer_surf, map);
     layer_surf->layer_surface->surface->mapped = true;
     arrange_layers(layer_surf->server);
+    ipc_notify_window_state(&layer_surf->server->ipc_server, layer_surf->window_id);
 }
 
 static void layer_surface_unmap(struct wl_listener *listener, void *data)
@@ -598,6 +647,7 @@ static void layer_surface_unmap(struct wl_listener *listener, void *data)
     if (layer_surf->window_id > 0) {
         ipc_window_unmap(&layer_surf->server->ipc_server, layer_surf->window_id);
     }
+    ipc_notify_window_state(&layer_surf->server->ipc_server, layer_surf->window_id);
 }
 
 static void layer_surface_destroy(struct wl_listener *listener, void *data)
@@ -615,6 +665,8 @@ static void layer_surface_destroy(struct wl_listener *listener, void *data)
     wl_list_remove(&layer_surf->surface_commit.link);
     wl_list_remove(&layer_surf->new_popup.link);
     wl_list_remove(&layer_surf->link);
+    ipc_window_unregister_layer_surface(&layer_surf->server->ipc_server, layer_surf);
+    ipc_notify_window_destroyed(&layer_surf->server->ipc_server, layer_surf->window_id);
     free(layer_surf);
 }
 
@@ -664,6 +716,7 @@ static void server_new_xdg_surface(struct wl_listener *listener, void *data)
     view->window_id = server->ipc_server.next_window_id++;
 
     view->scene_tree = wlr_scene_xdg_surface_create(layers[LyrNormal], xdg_surface);
+    scene_owner_attach(&view->owner, &view->scene_tree->node, SCENE_OWNER_VIEW, view->window_id);
     view->x = 0;
     view->y = 0;
     view->opacity = 1.0f;
@@ -684,6 +737,10 @@ static void server_new_xdg_surface(struct wl_listener *listener, void *data)
     view->destroy.notify = on_destroy;
     wl_signal_add(&xdg_surface->events.destroy, &view->destroy);
 
+    wl_list_init(&view->request_move.link);
+    wl_list_init(&view->request_resize.link);
+    wl_list_init(&view->set_title.link);
+    wl_list_init(&view->set_app_id.link);
     if (xdg_surface->role == WLR_XDG_SURFACE_ROLE_TOPLEVEL && xdg_surface->toplevel)
     {
         struct wlr_xdg_toplevel *toplevel = xdg_surface->toplevel;
@@ -691,9 +748,14 @@ static void server_new_xdg_surface(struct wl_listener *listener, void *data)
         wl_signal_add(&toplevel->events.request_move, &view->request_move);
         view->request_resize.notify = on_request_resize;
         wl_signal_add(&toplevel->events.request_resize, &view->request_resize);
+        view->set_title.notify = on_set_title;
+        wl_signal_add(&toplevel->events.set_title, &view->set_title);
+        view->set_app_id.notify = on_set_app_id;
+        wl_signal_add(&toplevel->events.set_app_id, &view->set_app_id);
     }
 
     wl_list_insert(&server->views, &view->link);
+    ipc_window_register_view(&server->ipc_server, view);
     
     /* Initialize position tracking state */
     view->position_set_by_ipc = false;
@@ -703,15 +765,7 @@ static void server_new_xdg_surface(struct wl_listener *listener, void *data)
         .window_id = view->window_id,
         .width = 400, // Default size, will be updated when configured
         .height = 300};
-
-    struct IPCClient *c, *tmp;
-    wl_list_for_each_safe(c, tmp, &server->ipc_server.clients, link)
-    {
-        if (send_event_to_client(c, ICM_MSG_WINDOW_CREATED, &event, sizeof(event)) < 0)
-        {
-            /* Client disconnected, will be cleaned up elsewhere */
-        }
-    }
+    ipc_notify_window_created(&server->ipc_server, &event);
 }
 
 static void server_new_layer_surface(struct wl_listener *listener, void *data)
@@ -746,6 +800,8 @@ static void server_new_layer_surface(struct wl_listener *listener, void *data)
         free(layer_surf);
         return;
     }
+    scene_owner_attach(&layer_surf->owner, &layer_surf->scene_layer->tree->node,
+                       SCENE_OWNER_LAYER_SURFACE, layer_surf->window_id);
 
     layer_surf->map.notify = layer_surface_map;
     wl_signal_add(&layer_surface->surface->events.map, &layer_surf->map);
@@ -763,21 +819,14 @@ static void server_new_layer_surface(struct wl_listener *listener, void *data)
     wl_signal_add(&layer_surface->events.new_popup, &layer_surf->new_popup);
 
     wl_list_insert(&server->layer_surfaces, &layer_surf->link);
+    ipc_window_register_layer_surface(&server->ipc_server, layer_surf);
 
     // Send window created event
     struct icm_msg_window_created event = {
         .window_id = layer_surf->window_id,
         .width = layer_surface->current.desired_width,
         .height = layer_surface->current.desired_height};
-
-    struct IPCClient *c, *tmp;
-    wl_list_for_each_safe(c, tmp, &server->ipc_server.clients, link)
-    {
-        if (send_event_to_client(c, ICM_MSG_WINDOW_CREATED, &event, sizeof(event)) < 0)
-        {
-            /* Client disconnected, will be cleaned up elsewhere */
-        }
-    }
+    ipc_notify_window_created(&server->ipc_server, &event);
 }
 
 static void server_new_xwayland_surface(struct wl_listener *listener, void *data)
@@ -803,6 +852,7 @@ static void server_new_xwayland_surface(struct wl_listener *listener, void *data
         free(view);
         return;
     }
+    scene_owner_attach(&view->owner, &view->scene_tree->node, SCENE_OWNER_VIEW, view->window_id);
     view->x = 0;
     view->y = 0;
     view->opacity = 1.0f;
@@ -822,8 +872,15 @@ static void server_new_xwayland_surface(struct wl_listener *listener, void *data
     wl_signal_add(&xwayland_surface->surface->events.commit, &view->commit);
     view->destroy.notify = on_destroy;
     wl_signal_add(&xwayland_surface->events.destroy, &view->destroy);
+    wl_list_init(&view->request_move.link);
+    wl_list_init(&view->request_resize.link);
+    view->set_title.notify = on_set_title;
+    wl_signal_add(&xwayland_surface->events.set_title, &view->set_title);
+    view->set_app_id.notify = on_set_app_id;
+    wl_signal_add(&xwayland_surface->events.set_class, &view->set_app_id);
 
     wl_list_insert(&server->views, &view->link);
+    ipc_window_register_view(&server->ipc_server, view);
     
     /* Initialize position tracking state */
     view->position_set_by_ipc = false;
@@ -833,15 +890,7 @@ static void server_new_xwayland_surface(struct wl_listener *listener, void *data
         .window_id = view->window_id,
         .width = xwayland_surface->width,
         .height = xwayland_surface->height};
-
-    struct IPCClient *c, *tmp;
-    wl_list_for_each_safe(c, tmp, &server->ipc_server.clients, link)
-    {
-        if (send_event_to_client(c, ICM_MSG_WINDOW_CREATED, &event, sizeof(event)) < 0)
-        {
-            /* Client disconnected, will be cleaned up elsewhere */
-        }
-    }
+    ipc_notify_window_created(&server->ipc_server, &event);
 }
 
 void process_screen_copy_requests(struct IPCServer *ipc_server)
@@ -853,9 +902,19 @@ void process_screen_copy_requests(struct IPCServer *ipc_server)
         uint32_t width = req->width;
         uint32_t height = req->height;
         size_t data_size = width * height * 4;
-        uint8_t *data = malloc(data_size);
-        if (!data)
+        struct icm_msg_screen_copy_data msg = {
+            .request_id = req->request_id,
+            .width = width,
+            .height = height,
+            .format = 0, // RGBA
+            .data_size = data_size};
+        /* Build the pixels in place behind the reply header */
+        size_t buf_size = sizeof(msg) + data_size;
+        uint8_t *buf = pixel_pool_alloc(buf_size);
+        if (!buf)
             continue;
+        memcpy(buf, &msg, sizeof(msg));
+        uint8_t *data = buf + sizeof(msg);
         for (size_t i = 0; i < data_size; i += 4)
         {
             data[i] = 255;     // R
@@ -873,125 +932,177 @@ void process_screen_copy_requests(struct IPCServer *ipc_server)
                 time_seconds);
         }
         
-        struct icm_msg_screen_copy_data msg = {
-            .request_id = req->request_id,
-            .width = width,
-            .height = height,
-            .format = 0, // RGBA
-            .data_size = data_size};
-        // Send header + data
-        uint8_t *buf = malloc(sizeof(msg) + data_size);
-        if (!buf)
-        {
-            free(data);
-            continue;
-        }
-        memcpy(buf, &msg, sizeof(msg));
-        memcpy(buf + sizeof(msg), data, data_size);
-        send_event_to_client(req->client, ICM_MSG_SCREEN_COPY_DATA, buf, sizeof(msg) + data_size);
-        free(data);
-        free(buf);
+        send_event_to_client(req->client, ICM_MSG_SCREEN_COPY_DATA, buf, buf_size);
+        pixel_pool_free(buf, buf_size);
         wl_list_remove(&req->link);
         free(req);
     }
 }
 
-static void render_ipc_buffers(struct Output *output)
+/*
+ * The scene shows a texture-backed wlr_client_buffer for each IPC buffer.
+ * Draws only copy their damage into that texture, so a blinking cursor
+ * uploads a few hundred bytes instead of the whole window. The first upload,
+ * and any renderer that cannot update a texture in place, imports the whole
+ * source instead. The source is the swapchain front, or the effect output.
+ */
+static bool ipc_buffer_upload(struct Server *server, struct BufferEntry *buffer,
+                              struct wlr_buffer *source)
 {
-    struct Server *server = output->server;
-    struct IPCServer *ipc_server = &server->ipc_server;
+    if (buffer->texture_buffer &&
+        wlr_texture_update_from_buffer(buffer->texture_buffer->texture, source, &buffer->damage))
+        return true;
+
+    if (buffer->texture_buffer)
+        wlr_buffer_unlock(&buffer->texture_buffer->base);
+    buffer->texture_buffer = wlr_client_buffer_create(source, server->renderer);
+    pixman_region32_union_rect(&buffer->damage, &buffer->damage, 0, 0, buffer->width, buffer->height);
+    return buffer->texture_buffer != NULL;
+}
 
-    struct BufferEntry *buffer, *tmp;
-    wl_list_for_each_safe(buffer, tmp, &ipc_server->buffers, link)
-    {
-        if (!buffer->visible)
-        {
-            // Remove from scene if it exists
-            if (buffer->scene_buffer)
-            {
-                wlr_scene_node_destroy(&buffer->scene_buffer->node);
-                buffer->scene_buffer = NULL;
-            }
-            if (buffer->wlr_buffer)
-            {
-                wlr_buffer_drop(buffer->wlr_buffer);
-                buffer->wlr_buffer = NULL;
-            }
-            continue;
+/*
+ * Bring the scene node of a CPU-drawn buffer up to date: run its effect,
+ * upload what changed and hand the back buffer to the renderer.
+ */
+static bool ipc_buffer_show_pixels(struct Server *server, struct BufferEntry *buffer)
+{
+    if (!buffer->data)
+        return false;
+
+    /* The effect output matches the swapchain, so either can update the
+     * same texture */
+    struct IPCPixelBuffer *back = buffer->swapchain.back;
+    struct BufferEffect *effect = buffer->effect;
+    bool wants_effect = effect && effect->enabled && effect->equation[0] != '\0';
+    if (wants_effect) {
+        struct IPCPixelBuffer *pixels = effect->pixels;
+        if (!pixels || pixels->width != back->width || pixels->height != back->height) {
+            if (pixels)
+                wlr_buffer_drop(&pixels->base);
+            effect->pixels = ipc_pixel_buffer_create(back->width, back->height, 0x34325241); // ARGB
+            effect->dirty = 1;
         }
+        wants_effect = effect->pixels != NULL;
+    }
 
-        if (!buffer->data)
-            continue;
+    bool effect_active = effect && effect->active;
+    if (effect_active != wants_effect) {
+        /* The texture holds the other source's pixels */
+        effect->active = wants_effect;
+        pixman_region32_clear(&buffer->damage);
+        buffer->dirty = 1;
+    }
+    effect_active = wants_effect;
 
-        bool wants_effect = buffer->effect_enabled && buffer->effect_equation[0] != '\0';
-        if (wants_effect) {
-            size_t needed = buffer->width * buffer->height * 4;
-            if (!buffer->effect_data || buffer->effect_data_size != needed) {
-                free(buffer->effect_data);
-                buffer->effect_data = malloc(needed);
-                buffer->effect_data_size = needed;
-                buffer->effect_dirty = 1;
-            }
-        }
+    if (wants_effect && (buffer->dirty || effect->dirty)) {
+        memcpy(effect->pixels->data, back->data, back->size);
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double time_seconds = now.tv_sec + now.tv_nsec / 1000000000.0;
+        apply_pixel_effect(effect->pixels->data, back->width, back->height,
+            effect->equation, time_seconds);
+        effect->dirty = 0;
+        buffer->dirty = 1;
+    }
 
-        if (wants_effect && (buffer->dirty || buffer->effect_dirty)) {
-            memcpy(buffer->effect_data, buffer->data, buffer->size);
-            struct timespec now;
-            clock_gettime(CLOCK_MONOTONIC, &now);
-            double time_seconds = now.tv_sec + now.tv_nsec / 1000000000.0;
-            apply_pixel_effect(buffer->effect_data, buffer->width, buffer->height,
-                buffer->effect_equation, time_seconds);
-            buffer->effect_dirty = 0;
+    /* Effects rewrite every pixel; otherwise upload only the damage */
+    bool uploaded = false;
+    if (buffer->dirty || !buffer->texture_buffer)
+    {
+        if (effect_active || !pixman_region32_not_empty(&buffer->damage))
+            pixman_region32_union_rect(&buffer->damage, &buffer->damage,
+                                       0, 0, buffer->width, buffer->height);
+        struct wlr_buffer *source = effect_active ? &effect->pixels->base
+                                                  : ipc_buffer_present(buffer);
+        if (!ipc_buffer_upload(server, buffer, source))
+        {
+            fprintf(stderr, "Failed to upload texture for buffer %u\n", buffer->buffer_id);
+            return false;
         }
+        uploaded = true;
+    }
 
-        if (buffer->use_effect_buffer != wants_effect) {
-            buffer->use_effect_buffer = wants_effect;
-            if (buffer->scene_buffer) {
-                wlr_scene_node_destroy(&buffer->scene_buffer->node);
-                buffer->scene_buffer = NULL;
-            }
-            if (buffer->wlr_buffer) {
-                wlr_buffer_drop(buffer->wlr_buffer);
-                buffer->wlr_buffer = NULL;
-            }
+    // Create scene buffer if not exists
+    if (!buffer->scene_buffer)
+    {
+        /* Place IPC buffers in the normal layer by default;
+         * handle_set_window_layer can reparent them later */
+        buffer->scene_buffer = wlr_scene_buffer_create(layers[LyrNormal], &buffer->texture_buffer->base);
+        if (!buffer->scene_buffer)
+        {
+            fprintf(stderr, "Failed to create scene buffer for buffer %u\n", buffer->buffer_id);
+            ipc_buffer_drop_textures(buffer);
+            return false;
         }
+        fprintf(stderr, "Created scene_buffer for buffer %u\n", buffer->buffer_id);
+    }
+    else if (uploaded)
+    {
+        /* Only the damaged part of the node is repainted on outputs */
+        wlr_scene_buffer_set_buffer_with_damage(buffer->scene_buffer,
+                                                &buffer->texture_buffer->base, &buffer->damage);
+    }
+    if (uploaded)
+    {
+        pixman_region32_clear(&buffer->damage);
+        buffer->dirty = 0;
+        /* Draws while an effect shows stay in the back buffer */
+        if (!effect_active)
+            ipc_buffer_swap(buffer);
+    }
+    return true;
+}
 
-        // Create wlr_buffer if not exists
-        if (!buffer->wlr_buffer)
+/* Imported DMABUFs go to the scene as they are; the renderer samples them
+ * on the GPU. COMMIT_BUFFER marks new contents. */
+static bool ipc_buffer_show_dmabuf(struct BufferEntry *buffer)
+{
+    struct wlr_buffer *dmabuf = &buffer->dmabuf->base;
+    if (!buffer->scene_buffer)
+    {
+        buffer->scene_buffer = wlr_scene_buffer_create(layers[LyrNormal], dmabuf);
+        if (!buffer->scene_buffer)
         {
-            uint8_t *render_data = buffer->use_effect_buffer ? buffer->effect_data : buffer->data;
-            buffer->wlr_buffer = ipc_buffer_create_wlr_buffer(render_data, buffer->width, buffer->height, 0x34325241); // ARGB
-            if (!buffer->wlr_buffer)
-            {
-                fprintf(stderr, "Failed to create wlr_buffer for buffer %u\n", buffer->buffer_id);
-                continue;
-            }
-            fprintf(stderr, "Created wlr_buffer for buffer %u (%dx%d)\n", buffer->buffer_id, buffer->width, buffer->height);
+            fprintf(stderr, "Failed to create scene buffer for buffer %u\n", buffer->buffer_id);
+            return false;
         }
+    }
+    else if (buffer->dirty)
+    {
+        wlr_scene_buffer_set_buffer_with_damage(buffer->scene_buffer, dmabuf,
+                                                pixman_region32_not_empty(&buffer->damage)
+                                                    ? &buffer->damage : NULL);
+    }
+    pixman_region32_clear(&buffer->damage);
+    buffer->dirty = 0;
+    return true;
+}
 
-        // Create scene buffer if not exists
-        if (!buffer->scene_buffer)
+static void render_ipc_buffers(struct Output *output)
+{
+    struct Server *server = output->server;
+    struct IPCServer *ipc_server = &server->ipc_server;
+
+    struct BufferEntry *buffer;
+    slab_for_each(buffer, &ipc_server->buffers)
+    {
+        if (!buffer->visible)
         {
-            /* Place IPC buffers in the normal layer by default;
-             * handle_set_window_layer can reparent them later */
-            buffer->scene_buffer = wlr_scene_buffer_create(layers[LyrNormal], buffer->wlr_buffer);
-            if (!buffer->scene_buffer)
+            // Remove from scene if it exists
+            if (buffer->scene_buffer)
             {
-                fprintf(stderr, "Failed to create scene buffer for buffer %u\n", buffer->buffer_id);
-                wlr_buffer_drop(buffer->wlr_buffer);
-                buffer->wlr_buffer = NULL;
-                continue;
+                wlr_scene_node_destroy(&buffer->scene_buffer->node);
+                buffer->scene_buffer = NULL;
             }
-            fprintf(stderr, "Created scene_buffer for buffer %u\n", buffer->buffer_id);
+            ipc_buffer_drop_textures(buffer);
+            ipc_buffer_sync_rects(buffer);
+            continue;
         }
 
-        // If buffer was modified, update the scene
-        if (buffer->dirty)
-        {
-            // Re-set the buffer to signal changes
-            wlr_scene_buffer_set_buffer(buffer->scene_buffer, buffer->wlr_buffer);
-            buffer->dirty = 0;
-        }
+        bool shown = buffer->dmabuf ? ipc_buffer_show_dmabuf(buffer)
+                                    : ipc_buffer_show_pixels(server, buffer);
+        if (!shown)
+            continue;
 
         // Apply transformations
         wlr_scene_node_set_position(&buffer->scene_buffer->node, buffer->x, buffer->y);
@@ -1003,11 +1114,13 @@ static void render_ipc_buffers(struct Output *output)
         // For opacity
         wlr_scene_buffer_set_opacity(buffer->scene_buffer, buffer->opacity);
 
-        if (buffer->has_transform_matrix) {
+        if (buffer->transform_matrix) {
             wlr_scene_buffer_set_transform_matrix(buffer->scene_buffer, buffer->transform_matrix);
         } else {
             wlr_scene_buffer_clear_transform_matrix(buffer->scene_buffer);
         }
+
+        ipc_buffer_sync_rects(buffer);
     }
 }
 
@@ -1016,12 +1129,14 @@ static void render_screen_effect(struct Output *output)
     struct Server *server = output->server;
     struct IPCServer *ipc_server = &server->ipc_server;
 
+    struct BufferEntry *buffer = ipc_buffer_from_handle(ipc_server, ipc_server->screen_effect_handle);
+
     if (!ipc_server->screen_effect_enabled || ipc_server->screen_effect_equation[0] == '\0') {
         /* Clean up screen effect buffer if effect is disabled */
-        if (ipc_server->screen_effect_buffer) {
-            ipc_buffer_destroy(ipc_server, ipc_server->screen_effect_buffer->buffer_id);
-            ipc_server->screen_effect_buffer = NULL;
+        if (buffer) {
+            ipc_buffer_destroy(ipc_server, buffer->buffer_id);
         }
+        ipc_server->screen_effect_handle = 0;
         return;
     }
 
@@ -1030,34 +1145,34 @@ static void render_screen_effect(struct Output *output)
     int width = wlr_output->width;
     int height = wlr_output->height;
 
-    /* Create or recreate buffer if dimensions changed */
-    if (!ipc_server->screen_effect_buffer ||
-        ipc_server->screen_effect_buffer->width != width ||
-        ipc_server->screen_effect_buffer->height != height) {
-        
-        if (ipc_server->screen_effect_buffer) {
-            ipc_buffer_destroy(ipc_server, ipc_server->screen_effect_buffer->buffer_id);
-        }
+    /* The effect rewrites every pixel, so a mode change only needs new storage */
+    if (buffer && (buffer->width != width || buffer->height != height) &&
+        ipc_buffer_resize(buffer, width, height, ICM_RESIZE_CLEAR) < 0) {
+        ipc_buffer_destroy(ipc_server, buffer->buffer_id);
+        buffer = NULL;
+    }
+
+    /* Create buffer on first use */
+    if (!buffer) {
+        ipc_server->screen_effect_handle = 0;
         
         uint32_t effect_buffer_id = ipc_server->next_buffer_id++;
-        ipc_server->screen_effect_buffer = ipc_buffer_create(ipc_server, effect_buffer_id, 
-                                                              width, height, 0x34325241);
-        if (!ipc_server->screen_effect_buffer) {
+        buffer = ipc_buffer_create(ipc_server, effect_buffer_id, width, height, 0x34325241);
+        if (!buffer) {
             fprintf(stderr, "Failed to create screen effect buffer\n");
             return;
         }
+        ipc_server->screen_effect_handle = slab_handle(buffer);
         
         /* Initialize buffer with a base color (e.g., black) */
-        memset(ipc_server->screen_effect_buffer->data, 0, ipc_server->screen_effect_buffer->size);
-        ipc_server->screen_effect_buffer->visible = 1;
-        ipc_server->screen_effect_buffer->layer = 0; /* Background layer */
-        ipc_server->screen_effect_buffer->opacity = 1.0f;
+        memset(buffer->data, 0, buffer->size);
+        buffer->visible = 1;
+        buffer->layer = 0; /* Background layer */
+        buffer->opacity = 1.0f;
         ipc_server->screen_effect_dirty = 1;
         
         fprintf(stderr, "Created screen effect buffer %ux%u\n", width, height);
     }
-
-    struct BufferEntry *buffer = ipc_server->screen_effect_buffer;
     
     /* Apply effect if dirty */
     if (ipc_server->screen_effect_dirty) {
@@ -1073,33 +1188,16 @@ static void render_screen_effect(struct Output *output)
         ipc_server->screen_effect_dirty = 0;
     }
     
-    /* Create/update wlr_buffer if needed */
-    if (!buffer->wlr_buffer || buffer->dirty) {
-        if (buffer->wlr_buffer) {
-            wlr_buffer_drop(buffer->wlr_buffer);
-        }
-        buffer->wlr_buffer = ipc_buffer_create_wlr_buffer(buffer->data, buffer->width, 
-                                                           buffer->height, 0x34325241);
-        if (!buffer->wlr_buffer) {
-            fprintf(stderr, "Failed to create wlr_buffer for screen effect\n");
-            return;
-        }
-    }
-    
-    /* Create/update scene buffer if needed */
+    /* Create the scene buffer in the background layer; render_ipc_buffers
+     * uploads the pixels along with the other IPC buffers */
     if (!buffer->scene_buffer) {
-        buffer->scene_buffer = wlr_scene_buffer_create(layers[LyrBg], buffer->wlr_buffer);
+        buffer->scene_buffer = wlr_scene_buffer_create(layers[LyrBg], NULL);
         if (!buffer->scene_buffer) {
             fprintf(stderr, "Failed to create scene buffer for screen effect\n");
             return;
         }
     }
     
-    if (buffer->dirty) {
-        wlr_scene_buffer_set_buffer(buffer->scene_buffer, buffer->wlr_buffer);
-        buffer->dirty = 0;
-    }
-    
     /* Position at origin (fullscreen) */
     wlr_scene_node_set_position(&buffer->scene_buffer->node, 0, 0);
     wlr_scene_buffer_set_opacity(buffer->scene_buffer, buffer->opacity);
@@ -1123,9 +1221,15 @@ static void output_frame(struct wl_listener *listener, void *data)
 
     wlr_scene_output_commit(output->scene_output, NULL);
 
+    // Return pixel memory idle since earlier frames
+    pixel_pool_trim();
+
     // Process screen copy requests after rendering
     process_screen_copy_requests(&output->server->ipc_server);
 
+    // Publish this frame's state to clients sharing the state page
+    ipc_state_page_update(&output->server->ipc_server);
+
     // Load cursor theme after first frame if not loaded and not nested
     if (!output->server->cursor_theme_loaded && !wlr_backend_is_wl(output->server->backend))
     {
@@ -1242,6 +1346,8 @@ static struct CursorSurfaceInfo process_cursor_motion(struct Server *server, uin
     struct wlr_surface *surface = NULL;
     struct wlr_scene_node *node = NULL;
 
+    ipc_state_page_set_cursor(&server->ipc_server, server->cursor->x, server->cursor->y);
+
     /* Search layers top-to-bottom for the first surface under the cursor */
     for (int layer = NUM_LAYERS - 1; layer >= 0; layer--) {
         node = wlr_scene_node_at(&layers[layer]->node,
@@ -1264,64 +1370,35 @@ static struct CursorSurfaceInfo process_cursor_motion(struct Server *server, uin
         if (server->cursor_mgr && server->cursor_theme_loaded)
             wlr_cursor_set_xcursor(server->cursor, server->cursor_mgr, "default");
         wlr_seat_pointer_notify_clear_focus(server->seat);
+        ipc_update_region_hover(&server->ipc_server, 0, 0, 0);
         info.surface = NULL;
         return info;
     }
 
     info.surface = surface;
 
-    /* Identify which window this surface belongs to (IPC buffer, View, or LayerSurface) */
-    struct wlr_surface *root_surface = wlr_surface_get_root_surface(surface);
-    
-    /* Check if it's an IPC-controlled buffer */
-    struct BufferEntry *buffer = NULL;
-    struct Server *server_ptr = wl_container_of(&server->ipc_server, server_ptr, ipc_server);
-    wl_list_for_each(buffer, &server->ipc_server.buffers, link) {
-        if (buffer->scene_buffer) {
-            struct wlr_scene_node *buf_node = &buffer->scene_buffer->node;
-            struct wlr_scene_node *check_node = node;
-            while (check_node) {
-                if (check_node == buf_node) {
-                    info.window_id = buffer->buffer_id;
-                    break;
-                }
-                struct wl_list c = check_node->parent->children;
-                check_node = wl_container_of(c.next, check_node, link);
-            }
-            if (info.window_id) break;
-        }
-    }
-
-    /* Check if it's a regular XDG/Wayland application window */
-    if (!info.window_id) {
-        struct View *v;
-        wl_list_for_each(v, &server->views, link) {
-            struct wlr_surface *vs = v->is_xwayland ?
-                v->xwayland_surface->surface : v->xdg_surface->surface;
-            if (vs == root_surface && v->mapped) {
-                info.view = v;
-                info.window_id = v->window_id;
-                break;
-            }
-        }
-    }
-
-    /* Check if it's a layer shell surface (panels, notifications, etc.) */
-    if (!info.window_id) {
-        struct LayerSurface *layer_surf;
-        wl_list_for_each(layer_surf, &server->layer_surfaces, link) {
-            if (layer_surf->layer_surface->surface == root_surface) {
-                info.layer_surf = layer_surf;
-                info.window_id = layer_surf->window_id;
-                break;
-            }
+    /* Identify the View or LayerSurface this surface belongs to from the owner
+     * its scene subtree was tagged with. IPC buffers are plain scene buffers
+     * with no surfaces, so a surface hit never belongs to one. */
+    struct SceneOwner *owner = scene_node_owner(node);
+    if (owner && owner->type == SCENE_OWNER_VIEW) {
+        struct View *view = wl_container_of(owner, view, owner);
+        if (view->mapped) {
+            info.view = view;
+            info.window_id = owner->window_id;
         }
+    } else if (owner && owner->type == SCENE_OWNER_LAYER_SURFACE) {
+        struct LayerSurface *layer_surf = wl_container_of(owner, layer_surf, owner);
+        info.layer_surf = layer_surf;
+        info.window_id = owner->window_id;
     }
 
     /* Update Wayland seat pointer focus: enter first, then motion */
     wlr_seat_pointer_notify_enter(server->seat, surface, sx, sy);
     wlr_seat_pointer_notify_motion(server->seat, time, sx, sy);
 
+    ipc_update_region_hover(&server->ipc_server, info.window_id, (int32_t)info.sx, (int32_t)info.sy);
+
     return info;
 }
 
@@ -1345,44 +1422,22 @@ static void cursor_motion(struct wl_listener *listener, void *data)
     struct CursorSurfaceInfo surface_info = process_cursor_motion(server, event->time_msec);
 
     /* Send pointer motion to window-specific IPC clients */
+    struct icm_msg_pointer_event pevent = {
+        .window_id = surface_info.window_id,
+        .time = event->time_msec,
+        .button = 0,
+        .state = 0,
+        .x = (int32_t)surface_info.sx,  /* Surface-relative coordinates */
+        .y = (int32_t)surface_info.sy
+    };
     if (surface_info.surface && surface_info.window_id > 0) {
-        struct IPCClient *client, *tmp;
-        wl_list_for_each_safe(client, tmp, &server->ipc_server.clients, link) {
-            if (client->registered_pointer && client->event_window_id == surface_info.window_id) {
-                struct icm_msg_pointer_event pevent = {
-                    .window_id = surface_info.window_id,
-                    .time = event->time_msec,
-                    .button = 0,
-                    .state = 0,
-                    .x = (int32_t)surface_info.sx,  /* Surface-relative coordinates */
-                    .y = (int32_t)surface_info.sy
-                };
-                if (send_event_to_client(client, ICM_MSG_POINTER_EVENT, &pevent, sizeof(pevent)) < 0) {
-                    fprintf(stderr, "Failed to send pointer motion event, disconnecting client\n");
-                    ipc_client_disconnect(client);
-                }
-            }
-        }
+        ipc_send_pointer_event(&server->ipc_server, &pevent);
     }
 
     /* Send global pointer motion to clients listening for all pointers */
-    struct IPCClient *client, *tmp;
-    wl_list_for_each_safe(client, tmp, &server->ipc_server.clients, link) {
-        if (client->registered_global_pointer) {
-            struct icm_msg_pointer_event pevent = {
-                .window_id = surface_info.window_id,
-                .time = event->time_msec,
-                .button = 0,
-                .state = 0,
-                .x = (int32_t)server->cursor->x,  /* Global coordinates */
-                .y = (int32_t)server->cursor->y
-            };
-            if (send_event_to_client(client, ICM_MSG_POINTER_EVENT, &pevent, sizeof(pevent)) < 0) {
-                fprintf(stderr, "Failed to send global pointer motion event, disconnecting client\n");
-                ipc_client_disconnect(client);
-            }
-        }
-    }
+    pevent.x = (int32_t)server->cursor->x;  /* Global coordinates */
+    pevent.y = (int32_t)server->cursor->y;
+    ipc_send_global_pointer_event(&server->ipc_server, &pevent);
 
     /* Handle window move operation: cursor has grabbed a window to drag it */
     if (server->cursor_mode == CURSOR_MOVE && server->grabbed_view)
@@ -1453,44 +1508,22 @@ static void cursor_motion_absolute(struct wl_listener *listener, void *data)
     struct CursorSurfaceInfo surface_info = process_cursor_motion(server, event->time_msec);
 
     /* Send pointer motion to window-specific IPC clients */
+    struct icm_msg_pointer_event pevent = {
+        .window_id = surface_info.window_id,
+        .time = event->time_msec,
+        .button = 0,
+        .state = 0,
+        .x = (int32_t)surface_info.sx,  /* Surface-relative coordinates */
+        .y = (int32_t)surface_info.sy
+    };
     if (surface_info.surface && surface_info.window_id > 0) {
-        struct IPCClient *client, *tmp;
-        wl_list_for_each_safe(client, tmp, &server->ipc_server.clients, link) {
-            if (client->registered_pointer && client->event_window_id == surface_info.window_id) {
-                struct icm_msg_pointer_event pevent = {
-                    .window_id = surface_info.window_id,
-                    .time = event->time_msec,
-                    .button = 0,
-                    .state = 0,
-                    .x = (int32_t)surface_info.sx,  /* Surface-relative coordinates */
-                    .y = (int32_t)surface_info.sy
-                };
-                if (send_event_to_client(client, ICM_MSG_POINTER_EVENT, &pevent, sizeof(pevent)) < 0) {
-                    fprintf(stderr, "Failed to send pointer motion event, disconnecting client\n");
-                    ipc_client_disconnect(client);
-                }
-            }
-        }
+        ipc_send_pointer_event(&server->ipc_server, &pevent);
     }
 
     /* Send global pointer motion to clients listening for all pointers */
-    struct IPCClient *client, *tmp;
-    wl_list_for_each_safe(client, tmp, &server->ipc_server.clients, link) {
-        if (client->registered_global_pointer) {
-            struct icm_msg_pointer_event pevent = {
-                .window_id = surface_info.window_id,
-                .time = event->time_msec,
-                .button = 0,
-                .state = 0,
-                .x = (int32_t)server->cursor->x,  /* Global coordinates */
-                .y = (int32_t)server->cursor->y
-            };
-            if (send_event_to_client(client, ICM_MSG_POINTER_EVENT, &pevent, sizeof(pevent)) < 0) {
-                fprintf(stderr, "Failed to send global pointer motion event, disconnecting client\n");
-                ipc_client_disconnect(client);
-            }
-        }
-    }
+    pevent.x = (int32_t)server->cursor->x;  /* Global coordinates */
+    pevent.y = (int32_t)server->cursor->y;
+    ipc_send_global_pointer_event(&server->ipc_server, &pevent);
 
     /* Handle window move operation: cursor has grabbed a window to drag it */
     if (server->cursor_mode == CURSOR_MOVE && server->grabbed_view)
@@ -1562,22 +1595,12 @@ static void cursor_button(struct wl_listener *listener, void *data)
                 wlr_scene_surface_try_from_buffer(scene_buffer);
             if (scene_surface) {
                 surface = scene_surface->surface;
+                /* Check if this is a regular application window */
+                view = scene_node_view(node);
             }
         }
 
         if (surface) {
-            struct wlr_surface *root_surface = wlr_surface_get_root_surface(surface);
-            
-            /* Check if this is a regular application window */
-            struct View *v;
-            wl_list_for_each(v, &server->views, link) {
-                struct wlr_surface *vs = v->is_xwayland ?
-                    v->xwayland_surface->surface : v->xdg_surface->surface;
-                if (vs == root_surface && v->mapped) {
-                    view = v;
-                    break;
-                }
-            }
 
             /* Focus the window if it's a regular application */
             if (view) {
@@ -1606,31 +1629,22 @@ static void cursor_button(struct wl_listener *listener, void *data)
     struct CursorSurfaceInfo surface_info = process_cursor_motion(server, event->time_msec);
     
     /* Route button events to window-specific IPC clients */
-    struct IPCClient *client, *tmp;
-    wl_list_for_each_safe(client, tmp, &server->ipc_server.clients, link)
-    {
-        if (client->registered_pointer && surface_info.window_id > 0 && 
-            client->event_window_id == surface_info.window_id)
-        {
-            struct icm_msg_pointer_event pevent = {
-                .window_id = surface_info.window_id,
-                .time = event->time_msec,
-                .button = event->button,
-                .state = event->state,
-                /* Send surface-relative coordinates for window-specific events */
-                .x = (int32_t)surface_info.sx,
-                .y = (int32_t)surface_info.sy
-            };
-            if (send_event_to_client(client, ICM_MSG_POINTER_EVENT, &pevent, sizeof(pevent)) < 0)
-            {
-                fprintf(stderr, "Failed to send pointer event, disconnecting client\n");
-                ipc_client_disconnect(client);
-            }
-            else {
-                /* Check click regions for this client's window */
-                ipc_check_click_region(&server->ipc_server, surface_info.window_id, (int32_t)surface_info.sx, (int32_t)surface_info.sy, event->button, event->state);
-            }
-        }
+    if (surface_info.window_id > 0) {
+        struct icm_msg_pointer_event pevent = {
+            .window_id = surface_info.window_id,
+            .time = event->time_msec,
+            .button = event->button,
+            .state = event->state,
+            /* Send surface-relative coordinates for window-specific events */
+            .x = (int32_t)surface_info.sx,
+            .y = (int32_t)surface_info.sy
+        };
+        ipc_send_pointer_event(&server->ipc_server, &pevent);
+    }
+
+    /* Click regions are indexed per window and fire once per button event */
+    if (surface_info.window_id > 0) {
+        ipc_check_click_region(&server->ipc_server, surface_info.window_id, (int32_t)surface_info.sx, (int32_t)surface_info.sy, event->button, event->state);
     }
 }
 
@@ -1702,9 +1716,44 @@ static void seat_request_set_selection(struct wl_listener *listener, void *data)
     wlr_seat_set_selection(server->seat, event->source, event->serial);
 }
 
+static uint32_t window_id_for_surface(struct Server *server, struct wlr_surface *surface)
+{
+    if (!surface) return 0;
+
+    struct View *view;
+    wl_list_for_each(view, &server->views, link) {
+        if ((view->is_xwayland ? view->xwayland_surface->surface : view->xdg_surface->surface) == surface) {
+            return view->window_id;
+        }
+    }
+    struct LayerSurface *layer_surf;
+    wl_list_for_each(layer_surf, &server->layer_surfaces, link) {
+        if (layer_surf->layer_surface->surface == surface) {
+            return layer_surf->window_id;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Report keyboard focus moves to IPC window event subscribers
+ * 
+ * Every focus path (click, IPC focus/blur, layer surfaces, surface
+ * destruction) ends in the seat, so both sides of the change are reported
+ * from here.
+ */
+static void seat_keyboard_focus_change(struct wl_listener *listener, void *data)
+{
+    struct Server *server = wl_container_of(listener, server, keyboard_focus_change);
+    struct wlr_seat_keyboard_focus_change_event *event = data;
+    ipc_notify_window_state(&server->ipc_server, window_id_for_surface(server, event->old_surface));
+    ipc_notify_window_state(&server->ipc_server, window_id_for_surface(server, event->new_surface));
+}
+
 int main(int argc, char **argv)
 {
     wlr_log_init(WLR_DEBUG, NULL);
+    raster_init();
 
     // Work around Mesa EGL device query allocation issue
     setenv("MESA_EGL_DISABLE_QUERY_DEVICE_EXT", "1", 1);
@@ -1846,6 +1895,8 @@ int main(int argc, char **argv)
 
     server.request_set_selection.notify = seat_request_set_selection;
     wl_signal_add(&server.seat->events.request_set_selection, &server.request_set_selection);
+    server.keyboard_focus_change.notify = seat_keyboard_focus_change;
+    wl_signal_add(&server.seat->keyboard_state.events.focus_change, &server.keyboard_focus_change);
 
     const char *socket = wl_display_add_socket_auto(server.wl_display);
     if (!socket)
@@ -38,6 +38,8 @@ struct View {
     float rotation;
     float transform_matrix[16];
     uint8_t has_transform_matrix;
+    struct WindowEventState reported;
+    struct SceneOwner owner;
 
     // Mesh transformation support
     struct {
@@ -54,6 +56,8 @@ struct View {
     struct wl_listener destroy;
     struct wl_listener request_move;
     struct wl_listener request_resize;
+    struct wl_listener set_title;
+    struct wl_listener set_app_id;   /* set_class for Xwayland */
 };
 
 #endif
@@ -0,0 +1,125 @@
+#define _GNU_SOURCE
+#include "pixel_pool.h"
+#include <stdint.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include <wlr/util/log.h>
+
+/* Classes 0-2 are 1-3 pages; above that four steps per power of two */
+#define POOL_CLASSES 256
+#define POOL_HUGEPAGE_SIZE (2u << 20)
+#define POOL_TRIM_INTERVAL_MSEC 1000
+
+/* Kept in the first bytes of a cached block */
+struct PoolBlock {
+    struct PoolBlock *next;         /* older blocks follow */
+    uint64_t freed_msec;
+};
+
+static struct {
+    size_t page_size;
+    struct PoolBlock *free[POOL_CLASSES];
+    size_t cached;                  /* bytes on the free lists */
+    uint64_t next_trim_msec;
+} pool;
+
+static uint64_t now_msec(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static size_t size_class(size_t size) {
+    if (!pool.page_size) pool.page_size = sysconf(_SC_PAGESIZE);
+    size_t pages = size / pool.page_size + (size % pool.page_size != 0);
+    if (pages < 4) return pages ? pages - 1 : 0;
+
+    /* Keep the top three bits of the page count, rounding up */
+    unsigned shift = 63 - __builtin_clzll(pages) - 2;
+    size_t mant = (pages + ((size_t)1 << shift) - 1) >> shift;
+    if (mant == 8) {
+        shift++;
+        mant = 4;
+    }
+    return 3 + shift * 4 + (mant - 4);
+}
+
+static size_t class_bytes(size_t cls) {
+    if (cls < 3) return (cls + 1) * pool.page_size;
+    size_t step = cls - 3;
+    return ((4 + step % 4) << (step / 4)) * pool.page_size;
+}
+
+void *pixel_pool_alloc(size_t size) {
+    if (size > SIZE_MAX / 2) return NULL;
+    size_t cls = size_class(size);
+    size_t bytes = class_bytes(cls);
+
+    struct PoolBlock *block = pool.free[cls];
+    if (block) {
+        pool.free[cls] = block->next;
+        pool.cached -= bytes;
+        return block;
+    }
+
+    void *pixels = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pixels == MAP_FAILED) {
+        wlr_log(WLR_ERROR, "pixel pool: failed to map %zu bytes", bytes);
+        return NULL;
+    }
+#ifdef MADV_HUGEPAGE
+    if (bytes >= POOL_HUGEPAGE_SIZE) madvise(pixels, bytes, MADV_HUGEPAGE);
+#endif
+    return pixels;
+}
+
+void pixel_pool_free(void *pixels, size_t size) {
+    if (!pixels) return;
+    size_t cls = size_class(size);
+    size_t bytes = class_bytes(cls);
+
+    if (pool.cached + bytes > PIXEL_POOL_CACHE_LIMIT) {
+        munmap(pixels, bytes);
+        return;
+    }
+    struct PoolBlock *block = pixels;
+    block->next = pool.free[cls];
+    block->freed_msec = now_msec();
+    pool.free[cls] = block;
+    pool.cached += bytes;
+}
+
+/* Unmap block and everything after it on its list */
+static void unmap_list(struct PoolBlock *block, size_t bytes) {
+    while (block) {
+        struct PoolBlock *next = block->next;
+        munmap(block, bytes);
+        pool.cached -= bytes;
+        block = next;
+    }
+}
+
+void pixel_pool_trim(void) {
+    if (pool.cached == 0) return;
+    uint64_t now = now_msec();
+    if (now < pool.next_trim_msec) return;
+    pool.next_trim_msec = now + POOL_TRIM_INTERVAL_MSEC;
+
+    for (size_t cls = 0; cls < POOL_CLASSES; cls++) {
+        /* Lists run newest first, so the idle blocks are a tail */
+        struct PoolBlock **link = &pool.free[cls];
+        while (*link && now - (*link)->freed_msec < PIXEL_POOL_IDLE_MSEC) {
+            link = &(*link)->next;
+        }
+        unmap_list(*link, class_bytes(cls));
+        *link = NULL;
+    }
+}
+
+void pixel_pool_release(void) {
+    for (size_t cls = 0; cls < POOL_CLASSES; cls++) {
+        unmap_list(pool.free[cls], class_bytes(cls));
+        pool.free[cls] = NULL;
+    }
+}
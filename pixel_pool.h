@@ -0,0 +1,40 @@
+#ifndef ICM_PIXEL_POOL_H
+#define ICM_PIXEL_POOL_H
+
+#include <stddef.h>
+
+/**
+ * Page-aligned pixel storage for IPC buffers, images and screen copies.
+ *
+ * Sizes are rounded up to a size class, four per power of two so at most a
+ * quarter of a block is slack, and blocks come straight from mmap. Freed
+ * blocks are cached per class and handed out again, so popups and tooltips
+ * that come and go every few frames reuse the same pages instead of churning
+ * the heap. Blocks of 2 MiB and up are advised as transparent hugepages.
+ *
+ * The cache holds at most PIXEL_POOL_CACHE_LIMIT bytes; blocks freed past
+ * that are unmapped at once, and pixel_pool_trim unmaps blocks that sat
+ * unused for PIXEL_POOL_IDLE_MSEC.
+ *
+ * Recycled blocks keep their old contents. Callers that show pixels they
+ * have not written must clear them first.
+ */
+
+#define PIXEL_POOL_CACHE_LIMIT (64u << 20)
+#define PIXEL_POOL_IDLE_MSEC 3000
+
+/**
+ * @return size usable bytes, or NULL if the mapping failed
+ */
+void *pixel_pool_alloc(size_t size);
+
+/* size must be what the block was allocated with; NULL is ignored */
+void pixel_pool_free(void *pixels, size_t size);
+
+/* Cheap when nothing is due; meant to run once per frame */
+void pixel_pool_trim(void);
+
+/* Unmap every cached block */
+void pixel_pool_release(void);
+
+#endif /* ICM_PIXEL_POOL_H */
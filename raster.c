@@ -0,0 +1,919 @@
+#include "raster.h"
+#include <stdlib.h>
+#include <string.h>
+#include <wlr/util/log.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RASTER_X86 1
+#include <immintrin.h>
+#define RASTER_TARGET(isa) __attribute__((target(isa)))
+#elif defined(__ARM_NEON)
+#define RASTER_NEON 1
+#include <arm_neon.h>
+#endif
+
+/* round(x / 255) for x <= 255 * 255, without a divide */
+static inline uint32_t div255(uint32_t x) {
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+static inline uint32_t over_pixel(uint32_t d, uint32_t s, uint32_t a) {
+    uint32_t ia = 255 - a;
+    uint32_t r = div255(((s >> 16) & 0xFF) * a + ((d >> 16) & 0xFF) * ia);
+    uint32_t g = div255(((s >> 8) & 0xFF) * a + ((d >> 8) & 0xFF) * ia);
+    uint32_t b = div255((s & 0xFF) * a + (d & 0xFF) * ia);
+    uint32_t oa = a + div255((d >> 24) * ia);
+    return oa << 24 | r << 16 | g << 8 | b;
+}
+
+/* Scalar reference kernels; the SIMD versions finish their tails with these */
+
+static void fill_scalar(uint32_t *dst, uint32_t color, size_t n) {
+    for (size_t i = 0; i < n; i++) dst[i] = color;
+}
+
+static void fill_blend_scalar(uint32_t *dst, uint32_t color, size_t n) {
+    uint32_t a = color >> 24;
+    if (a == 0) return;
+    if (a == 255) {
+        fill_scalar(dst, color, n);
+        return;
+    }
+    for (size_t i = 0; i < n; i++) dst[i] = over_pixel(dst[i], color, a);
+}
+
+static void copy_memcpy(uint32_t *dst, const uint32_t *src, size_t n) {
+    memcpy(dst, src, n * sizeof(*dst));
+}
+
+static void blend_scalar(uint32_t *dst, const uint32_t *src, size_t n, uint8_t alpha) {
+    for (size_t i = 0; i < n; i++) {
+        uint32_t s = src[i];
+        uint32_t a = s >> 24;
+        if (alpha != 255) a = div255(a * alpha);
+        if (a == 255) {
+            dst[i] = s;
+        } else if (a) {
+            dst[i] = over_pixel(dst[i], s, a);
+        }
+    }
+}
+
+static void premultiply_scalar(uint32_t *dst, const uint32_t *src, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        uint32_t s = src[i];
+        uint32_t a = s >> 24;
+        dst[i] = a << 24 |
+                 div255(((s >> 16) & 0xFF) * a) << 16 |
+                 div255(((s >> 8) & 0xFF) * a) << 8 |
+                 div255((s & 0xFF) * a);
+    }
+}
+
+/* 65536 * 255 / a, rounded, so unpremultiplying is a multiply and a shift */
+static uint32_t unpremultiply_recip[256];
+
+static const uint32_t *unpremultiply_table(void) {
+    if (!unpremultiply_recip[1]) {
+        for (uint32_t a = 1; a < 256; a++) {
+            unpremultiply_recip[a] = ((255u << 16) + a / 2) / a;
+        }
+    }
+    return unpremultiply_recip;
+}
+
+static inline uint32_t unpremultiply_channel(uint32_t c, uint32_t recip) {
+    c = (c * recip + 0x8000) >> 16;
+    return c > 255 ? 255 : c;
+}
+
+/* Division does not vectorize on these ISAs, so every set uses this one */
+static void unpremultiply_table_scalar(uint32_t *dst, const uint32_t *src, size_t n) {
+    const uint32_t *recip = unpremultiply_table();
+    for (size_t i = 0; i < n; i++) {
+        uint32_t s = src[i];
+        uint32_t a = s >> 24;
+        if (a == 0 || a == 255) {
+            dst[i] = a ? s : 0;
+            continue;
+        }
+        dst[i] = a << 24 |
+                 unpremultiply_channel((s >> 16) & 0xFF, recip[a]) << 16 |
+                 unpremultiply_channel((s >> 8) & 0xFF, recip[a]) << 8 |
+                 unpremultiply_channel(s & 0xFF, recip[a]);
+    }
+}
+
+static void swizzle_scalar(uint32_t *dst, const uint32_t *src, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        uint32_t s = src[i];
+        dst[i] = (s & 0xFF00FF00) | ((s >> 16) & 0xFF) | ((s & 0xFF) << 16);
+    }
+}
+
+/* Channels of a and b are 7-bit-weighted sums (at most 255 * 128) */
+static void lerp_rows_scalar(uint32_t *dst, const uint16_t *a, const uint16_t *b,
+                             size_t n, uint32_t frac) {
+    uint32_t wa = 128 - frac;
+    for (size_t i = 0; i < n; i++) {
+        uint32_t px = 0;
+        for (int c = 0; c < 4; c++) {
+            uint32_t v = (a[4 * i + c] * wa + b[4 * i + c] * frac + 8192) >> 14;
+            px |= v << (8 * c);
+        }
+        dst[i] = px;
+    }
+}
+
+static void accumulate_scalar(uint32_t *acc, const uint32_t *src, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        uint32_t s = src[i];
+        acc[4 * i] += s & 0xFF;
+        acc[4 * i + 1] += (s >> 8) & 0xFF;
+        acc[4 * i + 2] += (s >> 16) & 0xFF;
+        acc[4 * i + 3] += s >> 24;
+    }
+}
+
+static const struct RasterOps raster_scalar = {
+    .name = "scalar",
+    .fill = fill_scalar,
+    .fill_blend = fill_blend_scalar,
+    .copy = copy_memcpy,
+    .blend = blend_scalar,
+    .premultiply = premultiply_scalar,
+    .unpremultiply = unpremultiply_table_scalar,
+    .swizzle = swizzle_scalar,
+    .lerp_rows = lerp_rows_scalar,
+    .accumulate = accumulate_scalar,
+};
+
+#ifdef RASTER_X86
+
+/*
+ * SSE2 and AVX2 widen pixels to 16-bit lanes and blend all four channels with
+ * one formula by forcing the source alpha lane to 255 first: 255 * a / 255 is
+ * exactly a, so the alpha lane comes out as a + da * (255 - a) / 255.
+ */
+
+RASTER_TARGET("sse2") static inline __m128i div255_sse2(__m128i x) {
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+/* Broadcast each pixel's alpha lane to its four 16-bit lanes */
+RASTER_TARGET("sse2") static inline __m128i alpha_lanes_sse2(__m128i px16) {
+    return _mm_shufflehi_epi16(_mm_shufflelo_epi16(px16, 0xFF), 0xFF);
+}
+
+RASTER_TARGET("sse2") static void fill_sse2(uint32_t *dst, uint32_t color, size_t n) {
+    __m128i c = _mm_set1_epi32((int)color);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_si128((__m128i *)(dst + i), c);
+    }
+    fill_scalar(dst + i, color, n - i);
+}
+
+RASTER_TARGET("sse2") static void fill_blend_sse2(uint32_t *dst, uint32_t color, size_t n) {
+    uint32_t a = color >> 24;
+    if (a == 0) return;
+    if (a == 255) {
+        fill_sse2(dst, color, n);
+        return;
+    }
+
+    const __m128i zero = _mm_setzero_si128();
+    __m128i src = _mm_unpacklo_epi8(_mm_set1_epi32((int)(color | 0xFF000000)), zero);
+    __m128i pre = _mm_mullo_epi16(src, _mm_set1_epi16((short)a));
+    __m128i ia = _mm_set1_epi16((short)(255 - a));
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i lo = _mm_add_epi16(pre, _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), ia));
+        __m128i hi = _mm_add_epi16(pre, _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), ia));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(div255_sse2(lo), div255_sse2(hi)));
+    }
+    fill_blend_scalar(dst + i, color, n - i);
+}
+
+RASTER_TARGET("sse2") static void blend_sse2(uint32_t *dst, const uint32_t *src, size_t n, uint8_t alpha) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i amask = _mm_set1_epi32((int)0xFF000000);
+    const __m128i alpha255 = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+    const __m128i c255 = _mm_set1_epi16(255);
+    const __m128i galpha = _mm_set1_epi16(alpha);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        if (alpha == 255) {
+            __m128i sa = _mm_and_si128(s, amask);
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(sa, amask)) == 0xFFFF) {
+                _mm_storeu_si128((__m128i *)(dst + i), s);
+                continue;
+            }
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(sa, zero)) == 0xFFFF) continue;
+        }
+
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i s_lo = _mm_unpacklo_epi8(s, zero);
+        __m128i s_hi = _mm_unpackhi_epi8(s, zero);
+        __m128i a_lo = alpha_lanes_sse2(s_lo);
+        __m128i a_hi = alpha_lanes_sse2(s_hi);
+        if (alpha != 255) {
+            a_lo = div255_sse2(_mm_mullo_epi16(a_lo, galpha));
+            a_hi = div255_sse2(_mm_mullo_epi16(a_hi, galpha));
+        }
+        s_lo = _mm_or_si128(s_lo, alpha255);
+        s_hi = _mm_or_si128(s_hi, alpha255);
+
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(s_lo, a_lo),
+                                   _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), _mm_sub_epi16(c255, a_lo)));
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(s_hi, a_hi),
+                                   _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), _mm_sub_epi16(c255, a_hi)));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(div255_sse2(lo), div255_sse2(hi)));
+    }
+    blend_scalar(dst + i, src + i, n - i, alpha);
+}
+
+RASTER_TARGET("sse2") static void premultiply_sse2(uint32_t *dst, const uint32_t *src, size_t n) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i color_lanes = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+    const __m128i alpha255 = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i s_lo = _mm_unpacklo_epi8(s, zero);
+        __m128i s_hi = _mm_unpackhi_epi8(s, zero);
+        /* Scale color lanes by alpha and the alpha lane by 255 */
+        __m128i m_lo = _mm_or_si128(_mm_and_si128(alpha_lanes_sse2(s_lo), color_lanes), alpha255);
+        __m128i m_hi = _mm_or_si128(_mm_and_si128(alpha_lanes_sse2(s_hi), color_lanes), alpha255);
+        __m128i lo = div255_sse2(_mm_mullo_epi16(s_lo, m_lo));
+        __m128i hi = div255_sse2(_mm_mullo_epi16(s_hi, m_hi));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+    premultiply_scalar(dst + i, src + i, n - i);
+}
+
+RASTER_TARGET("sse2") static void swizzle_sse2(uint32_t *dst, const uint32_t *src, size_t n) {
+    const __m128i ga = _mm_set1_epi32((int)0xFF00FF00);
+    const __m128i low = _mm_set1_epi32(0xFF);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i r = _mm_and_si128(_mm_srli_epi32(s, 16), low);
+        __m128i b = _mm_slli_epi32(_mm_and_si128(s, low), 16);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(_mm_and_si128(s, ga), _mm_or_si128(r, b)));
+    }
+    swizzle_scalar(dst + i, src + i, n - i);
+}
+
+/* madd pairs each lane of a with the same lane of b, giving 32-bit sums */
+RASTER_TARGET("sse2") static inline __m128i lerp2_sse2(const uint16_t *a, const uint16_t *b, __m128i w) {
+    __m128i va = _mm_loadu_si128((const __m128i *)a);
+    __m128i vb = _mm_loadu_si128((const __m128i *)b);
+    const __m128i round = _mm_set1_epi32(8192);
+    __m128i lo = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(va, vb), w), round), 14);
+    __m128i hi = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(va, vb), w), round), 14);
+    return _mm_packs_epi32(lo, hi);
+}
+
+RASTER_TARGET("sse2") static void lerp_rows_sse2(uint32_t *dst, const uint16_t *a, const uint16_t *b,
+                                                 size_t n, uint32_t frac) {
+    __m128i w = _mm_set1_epi32((int)(frac << 16 | (128 - frac)));
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i p01 = lerp2_sse2(a + 4 * i, b + 4 * i, w);
+        __m128i p23 = lerp2_sse2(a + 4 * i + 8, b + 4 * i + 8, w);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(p01, p23));
+    }
+    lerp_rows_scalar(dst + i, a + 4 * i, b + 4 * i, n - i, frac);
+}
+
+RASTER_TARGET("sse2") static void accumulate_sse2(uint32_t *acc, const uint32_t *src, size_t n) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i lo = _mm_unpacklo_epi8(s, zero);
+        __m128i hi = _mm_unpackhi_epi8(s, zero);
+        __m128i parts[4] = {
+            _mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero),
+            _mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero),
+        };
+        __m128i *out = (__m128i *)(acc + 4 * i);
+        for (int k = 0; k < 4; k++) {
+            _mm_storeu_si128(out + k, _mm_add_epi32(_mm_loadu_si128(out + k), parts[k]));
+        }
+    }
+    accumulate_scalar(acc + 4 * i, src + i, n - i);
+}
+
+static const struct RasterOps raster_sse2 = {
+    .name = "sse2",
+    .fill = fill_sse2,
+    .fill_blend = fill_blend_sse2,
+    .copy = copy_memcpy,
+    .blend = blend_sse2,
+    .premultiply = premultiply_sse2,
+    .unpremultiply = unpremultiply_table_scalar,
+    .swizzle = swizzle_sse2,
+    .lerp_rows = lerp_rows_sse2,
+    .accumulate = accumulate_sse2,
+};
+
+/* AVX2 covers the fill and blend paths. The one-pass conversions and the
+ * scaling kernels stay on SSE2: their lane-crossing packs would need extra
+ * permutes and they are bound by the scalar gathers around them anyway. */
+
+RASTER_TARGET("avx2") static inline __m256i div255_avx2(__m256i x) {
+    x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+RASTER_TARGET("avx2") static inline __m256i alpha_lanes_avx2(__m256i px16) {
+    return _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(px16, 0xFF), 0xFF);
+}
+
+RASTER_TARGET("avx2") static void fill_avx2(uint32_t *dst, uint32_t color, size_t n) {
+    __m256i c = _mm256_set1_epi32((int)color);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_si256((__m256i *)(dst + i), c);
+    }
+    fill_sse2(dst + i, color, n - i);
+}
+
+RASTER_TARGET("avx2") static void fill_blend_avx2(uint32_t *dst, uint32_t color, size_t n) {
+    uint32_t a = color >> 24;
+    if (a == 0) return;
+    if (a == 255) {
+        fill_avx2(dst, color, n);
+        return;
+    }
+
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i src = _mm256_unpacklo_epi8(_mm256_set1_epi32((int)(color | 0xFF000000)), zero);
+    __m256i pre = _mm256_mullo_epi16(src, _mm256_set1_epi16((short)a));
+    __m256i ia = _mm256_set1_epi16((short)(255 - a));
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+        __m256i lo = _mm256_add_epi16(pre, _mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), ia));
+        __m256i hi = _mm256_add_epi16(pre, _mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), ia));
+        _mm256_storeu_si256((__m256i *)(dst + i),
+                            _mm256_packus_epi16(div255_avx2(lo), div255_avx2(hi)));
+    }
+    fill_blend_sse2(dst + i, color, n - i);
+}
+
+RASTER_TARGET("avx2") static void blend_avx2(uint32_t *dst, const uint32_t *src, size_t n, uint8_t alpha) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i amask = _mm256_set1_epi32((int)0xFF000000);
+    const __m256i alpha255 = _mm256_set1_epi64x(0x00FF000000000000LL);
+    const __m256i c255 = _mm256_set1_epi16(255);
+    const __m256i galpha = _mm256_set1_epi16(alpha);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i s = _mm256_loadu_si256((const __m256i *)(src + i));
+        if (alpha == 255) {
+            __m256i sa = _mm256_and_si256(s, amask);
+            if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(sa, amask)) == -1) {
+                _mm256_storeu_si256((__m256i *)(dst + i), s);
+                continue;
+            }
+            if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(sa, zero)) == -1) continue;
+        }
+
+        __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+        __m256i s_lo = _mm256_unpacklo_epi8(s, zero);
+        __m256i s_hi = _mm256_unpackhi_epi8(s, zero);
+        __m256i a_lo = alpha_lanes_avx2(s_lo);
+        __m256i a_hi = alpha_lanes_avx2(s_hi);
+        if (alpha != 255) {
+            a_lo = div255_avx2(_mm256_mullo_epi16(a_lo, galpha));
+            a_hi = div255_avx2(_mm256_mullo_epi16(a_hi, galpha));
+        }
+        s_lo = _mm256_or_si256(s_lo, alpha255);
+        s_hi = _mm256_or_si256(s_hi, alpha255);
+
+        __m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(s_lo, a_lo),
+                                      _mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero),
+                                                         _mm256_sub_epi16(c255, a_lo)));
+        __m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(s_hi, a_hi),
+                                      _mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero),
+                                                         _mm256_sub_epi16(c255, a_hi)));
+        _mm256_storeu_si256((__m256i *)(dst + i),
+                            _mm256_packus_epi16(div255_avx2(lo), div255_avx2(hi)));
+    }
+    blend_sse2(dst + i, src + i, n - i, alpha);
+}
+
+static const struct RasterOps raster_avx2 = {
+    .name = "avx2",
+    .fill = fill_avx2,
+    .fill_blend = fill_blend_avx2,
+    .copy = copy_memcpy,
+    .blend = blend_avx2,
+    .premultiply = premultiply_sse2,
+    .unpremultiply = unpremultiply_table_scalar,
+    .swizzle = swizzle_sse2,
+    .lerp_rows = lerp_rows_sse2,
+    .accumulate = accumulate_sse2,
+};
+
+#endif /* RASTER_X86 */
+
+#ifdef RASTER_NEON
+
+/*
+ * NEON deinterleaves eight pixels into per-channel vectors with vld4, so the
+ * alpha channel is handled on its own instead of through a forced lane.
+ * Memory order is B, G, R, A.
+ */
+
+static inline uint8x8_t div255_neon(uint16x8_t x) {
+    return vrshrn_n_u16(vrsraq_n_u16(x, x, 8), 8);
+}
+
+static void fill_neon(uint32_t *dst, uint32_t color, size_t n) {
+    uint32x4_t c = vdupq_n_u32(color);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        vst1q_u32(dst + i, c);
+    }
+    fill_scalar(dst + i, color, n - i);
+}
+
+static void fill_blend_neon(uint32_t *dst, uint32_t color, size_t n) {
+    uint32_t a = color >> 24;
+    if (a == 0) return;
+    if (a == 255) {
+        fill_neon(dst, color, n);
+        return;
+    }
+
+    uint16x8_t pre[3];
+    for (int c = 0; c < 3; c++) {
+        pre[c] = vdupq_n_u16((uint16_t)(((color >> (8 * c)) & 0xFF) * a));
+    }
+    uint8x8_t va = vdup_n_u8((uint8_t)a);
+    uint8x8_t ia = vdup_n_u8((uint8_t)(255 - a));
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint8x8x4_t d = vld4_u8((const uint8_t *)(dst + i));
+        for (int c = 0; c < 3; c++) {
+            d.val[c] = div255_neon(vmlal_u8(pre[c], d.val[c], ia));
+        }
+        d.val[3] = vadd_u8(va, div255_neon(vmull_u8(d.val[3], ia)));
+        vst4_u8((uint8_t *)(dst + i), d);
+    }
+    fill_blend_scalar(dst + i, color, n - i);
+}
+
+static void blend_neon(uint32_t *dst, const uint32_t *src, size_t n, uint8_t alpha) {
+    uint8x8_t galpha = vdup_n_u8(alpha);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint8x8x4_t s = vld4_u8((const uint8_t *)(src + i));
+        uint8x8_t a = s.val[3];
+        if (alpha != 255) {
+            a = div255_neon(vmull_u8(a, galpha));
+        } else {
+            uint64_t sa = vget_lane_u64(vreinterpret_u64_u8(a), 0);
+            if (sa == UINT64_MAX) {
+                vst1q_u32(dst + i, vld1q_u32(src + i));
+                vst1q_u32(dst + i + 4, vld1q_u32(src + i + 4));
+                continue;
+            }
+            if (sa == 0) continue;
+        }
+
+        uint8x8x4_t d = vld4_u8((const uint8_t *)(dst + i));
+        uint8x8_t ia = vmvn_u8(a);
+        for (int c = 0; c < 3; c++) {
+            d.val[c] = div255_neon(vmlal_u8(vmull_u8(s.val[c], a), d.val[c], ia));
+        }
+        d.val[3] = vadd_u8(a, div255_neon(vmull_u8(d.val[3], ia)));
+        vst4_u8((uint8_t *)(dst + i), d);
+    }
+    blend_scalar(dst + i, src + i, n - i, alpha);
+}
+
+static void premultiply_neon(uint32_t *dst, const uint32_t *src, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint8x8x4_t s = vld4_u8((const uint8_t *)(src + i));
+        for (int c = 0; c < 3; c++) {
+            s.val[c] = div255_neon(vmull_u8(s.val[c], s.val[3]));
+        }
+        vst4_u8((uint8_t *)(dst + i), s);
+    }
+    premultiply_scalar(dst + i, src + i, n - i);
+}
+
+static void swizzle_neon(uint32_t *dst, const uint32_t *src, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint8x16x4_t s = vld4q_u8((const uint8_t *)(src + i));
+        uint8x16_t b = s.val[0];
+        s.val[0] = s.val[2];
+        s.val[2] = b;
+        vst4q_u8((uint8_t *)(dst + i), s);
+    }
+    swizzle_scalar(dst + i, src + i, n - i);
+}
+
+static inline uint16x4_t lerp1_neon(const uint16_t *a, const uint16_t *b,
+                                    uint16x4_t wa, uint16x4_t wb) {
+    uint32x4_t sum = vmlal_u16(vmull_u16(vld1_u16(a), wa), vld1_u16(b), wb);
+    return vrshrn_n_u32(sum, 14);
+}
+
+static void lerp_rows_neon(uint32_t *dst, const uint16_t *a, const uint16_t *b,
+                           size_t n, uint32_t frac) {
+    uint16x4_t wa = vdup_n_u16((uint16_t)(128 - frac));
+    uint16x4_t wb = vdup_n_u16((uint16_t)frac);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        uint16x8_t p = vcombine_u16(lerp1_neon(a + 4 * i, b + 4 * i, wa, wb),
+                                    lerp1_neon(a + 4 * i + 4, b + 4 * i + 4, wa, wb));
+        vst1_u8((uint8_t *)(dst + i), vqmovn_u16(p));
+    }
+    lerp_rows_scalar(dst + i, a + 4 * i, b + 4 * i, n - i, frac);
+}
+
+static void accumulate_neon(uint32_t *acc, const uint32_t *src, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        uint8x16_t s = vld1q_u8((const uint8_t *)(src + i));
+        uint16x8_t lo = vmovl_u8(vget_low_u8(s));
+        uint16x8_t hi = vmovl_u8(vget_high_u8(s));
+        uint32_t *out = acc + 4 * i;
+        vst1q_u32(out, vaddw_u16(vld1q_u32(out), vget_low_u16(lo)));
+        vst1q_u32(out + 4, vaddw_u16(vld1q_u32(out + 4), vget_high_u16(lo)));
+        vst1q_u32(out + 8, vaddw_u16(vld1q_u32(out + 8), vget_low_u16(hi)));
+        vst1q_u32(out + 12, vaddw_u16(vld1q_u32(out + 12), vget_high_u16(hi)));
+    }
+    accumulate_scalar(acc + 4 * i, src + i, n - i);
+}
+
+static const struct RasterOps raster_neon = {
+    .name = "neon",
+    .fill = fill_neon,
+    .fill_blend = fill_blend_neon,
+    .copy = copy_memcpy,
+    .blend = blend_neon,
+    .premultiply = premultiply_neon,
+    .unpremultiply = unpremultiply_table_scalar,
+    .swizzle = swizzle_neon,
+    .lerp_rows = lerp_rows_neon,
+    .accumulate = accumulate_neon,
+};
+
+#endif /* RASTER_NEON */
+
+const struct RasterOps *raster_ops = &raster_scalar;
+
+void raster_init(void) {
+    const struct RasterOps *available[3];
+    size_t count = 0;
+    available[count++] = &raster_scalar;
+#ifdef RASTER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        available[count++] = &raster_sse2;
+        if (__builtin_cpu_supports("avx2")) {
+            available[count++] = &raster_avx2;
+        }
+    }
+#elif defined(RASTER_NEON)
+    available[count++] = &raster_neon;
+#endif
+
+    const struct RasterOps *ops = available[count - 1];
+    const char *env = getenv("ICM_RASTER");
+    if (env) {
+        size_t i = 0;
+        while (i < count && strcmp(env, available[i]->name) != 0) i++;
+        if (i < count) {
+            ops = available[i];
+        } else {
+            wlr_log(WLR_ERROR, "raster: ICM_RASTER=%s is not available here", env);
+        }
+    }
+
+    unpremultiply_table();
+    raster_ops = ops;
+    wlr_log(WLR_INFO, "raster: using %s kernels", ops->name);
+}
+
+struct RasterSpan {
+    int32_t x, y;
+    int32_t src_x, src_y;
+    int32_t width, height;
+};
+
+/* Clip a rect to dst and, if given, the source region to src */
+static bool clip_span(const struct RasterImage *dst, const struct RasterImage *src,
+                      int64_t x, int64_t y, int64_t src_x, int64_t src_y,
+                      int64_t width, int64_t height, struct RasterSpan *span) {
+    if (!dst->pixels || (src && !src->pixels)) return false;
+
+    if (x < 0) { src_x -= x; width += x; x = 0; }
+    if (y < 0) { src_y -= y; height += y; y = 0; }
+    if (width > dst->width - x) width = dst->width - x;
+    if (height > dst->height - y) height = dst->height - y;
+    if (src) {
+        if (width > src->width - src_x) width = src->width - src_x;
+        if (height > src->height - src_y) height = src->height - src_y;
+    }
+    if (width <= 0 || height <= 0) return false;
+
+    span->x = (int32_t)x;
+    span->y = (int32_t)y;
+    span->src_x = (int32_t)src_x;
+    span->src_y = (int32_t)src_y;
+    span->width = (int32_t)width;
+    span->height = (int32_t)height;
+    return true;
+}
+
+static void fill_span(const struct RasterImage *dst, const struct RasterSpan *span,
+                      void (*fill)(uint32_t *dst, uint32_t color, size_t n), uint32_t color) {
+    uint32_t *row = dst->pixels + (size_t)span->y * dst->stride + span->x;
+    /* Full-width rects are one contiguous run */
+    if (span->width == dst->stride) {
+        fill(row, color, (size_t)span->width * span->height);
+        return;
+    }
+    for (int32_t i = 0; i < span->height; i++, row += dst->stride) {
+        fill(row, color, span->width);
+    }
+}
+
+void raster_fill_rect(const struct RasterImage *dst, int32_t x, int32_t y,
+                      uint32_t width, uint32_t height, uint32_t color) {
+    struct RasterSpan span;
+    if (!clip_span(dst, NULL, x, y, 0, 0, width, height, &span)) return;
+    fill_span(dst, &span, raster_ops->fill, color);
+}
+
+void raster_blend_rect(const struct RasterImage *dst, int32_t x, int32_t y,
+                       uint32_t width, uint32_t height, uint32_t color) {
+    struct RasterSpan span;
+    if ((color >> 24) == 0) return;
+    if (!clip_span(dst, NULL, x, y, 0, 0, width, height, &span)) return;
+    fill_span(dst, &span, raster_ops->fill_blend, color);
+}
+
+void raster_copy_rect(const struct RasterImage *dst, int32_t x, int32_t y,
+                      const struct RasterImage *src, uint32_t src_x, uint32_t src_y,
+                      uint32_t width, uint32_t height) {
+    struct RasterSpan span;
+    if (!clip_span(dst, src, x, y, src_x, src_y, width, height, &span)) return;
+
+    uint32_t *out = dst->pixels + (size_t)span.y * dst->stride + span.x;
+    const uint32_t *in = src->pixels + (size_t)span.src_y * src->stride + span.src_x;
+    for (int32_t i = 0; i < span.height; i++, out += dst->stride, in += src->stride) {
+        raster_ops->copy(out, in, span.width);
+    }
+}
+
+void raster_blend_image(const struct RasterImage *dst, int32_t x, int32_t y,
+                        const struct RasterImage *src, uint32_t src_x, uint32_t src_y,
+                        uint32_t width, uint32_t height, uint8_t alpha) {
+    struct RasterSpan span;
+    if (alpha == 0) return;
+    if (!clip_span(dst, src, x, y, src_x, src_y, width, height, &span)) return;
+
+    uint32_t *out = dst->pixels + (size_t)span.y * dst->stride + span.x;
+    const uint32_t *in = src->pixels + (size_t)span.src_y * src->stride + span.src_x;
+    for (int32_t i = 0; i < span.height; i++, out += dst->stride, in += src->stride) {
+        raster_ops->blend(out, in, span.width, alpha);
+    }
+}
+
+/*
+ * Scaling works a destination row at a time: the source rows it needs are
+ * premultiplied if needed, filtered horizontally into a scratch row, and that
+ * row is blended like any unscaled one. The scratch rows are kept between
+ * calls; like the rest of icm's drawing this assumes a single thread.
+ */
+static struct {
+    uint32_t *map_a, *map_b;        /* per output column: index and fraction or range */
+    uint32_t *row;                  /* one output row */
+    uint32_t *src_row;              /* one premultiplied source row */
+    uint16_t *taps[2];              /* horizontally filtered source rows */
+    uint32_t *acc;                  /* box sums, four per source column */
+    size_t cols, src_cols;
+} scratch;
+
+static int scratch_reserve(size_t cols, size_t src_cols) {
+    if (cols > scratch.cols) {
+        uint32_t *map_a = realloc(scratch.map_a, cols * sizeof(uint32_t));
+        if (map_a) scratch.map_a = map_a;
+        uint32_t *map_b = realloc(scratch.map_b, cols * sizeof(uint32_t));
+        if (map_b) scratch.map_b = map_b;
+        uint32_t *row = realloc(scratch.row, cols * sizeof(uint32_t));
+        if (row) scratch.row = row;
+        uint16_t *tap0 = realloc(scratch.taps[0], cols * 4 * sizeof(uint16_t));
+        if (tap0) scratch.taps[0] = tap0;
+        uint16_t *tap1 = realloc(scratch.taps[1], cols * 4 * sizeof(uint16_t));
+        if (tap1) scratch.taps[1] = tap1;
+        if (!map_a || !map_b || !row || !tap0 || !tap1) return -1;
+        scratch.cols = cols;
+    }
+    if (src_cols > scratch.src_cols) {
+        uint32_t *src_row = realloc(scratch.src_row, src_cols * sizeof(uint32_t));
+        if (src_row) scratch.src_row = src_row;
+        uint32_t *acc = realloc(scratch.acc, src_cols * 4 * sizeof(uint32_t));
+        if (acc) scratch.acc = acc;
+        if (!src_row || !acc) return -1;
+        scratch.src_cols = src_cols;
+    }
+    return 0;
+}
+
+/* Source sample for output index i, centers aligned: index and 7-bit fraction */
+static void bilinear_tap(uint64_t i, uint32_t out_size, uint32_t in_size,
+                         uint32_t *index, uint32_t *frac) {
+    double u = ((double)i + 0.5) * in_size / out_size - 0.5;
+    uint64_t fixed = u > 0 ? (uint64_t)(u * 128.0 + 0.5) : 0;
+    if ((fixed >> 7) >= in_size - 1) {
+        *index = in_size - 1;
+        *frac = 0;
+        return;
+    }
+    *index = (uint32_t)(fixed >> 7);
+    *frac = (uint32_t)(fixed & 127);
+}
+
+static uint32_t nearest_tap(uint64_t i, uint32_t out_size, uint32_t in_size) {
+    uint64_t index = (uint64_t)(((double)i + 0.5) * in_size / out_size);
+    return index < in_size ? (uint32_t)index : in_size - 1;
+}
+
+/* Source range [first, last) covered by output index i, at least one wide */
+static void box_range(uint64_t i, uint32_t out_size, uint32_t in_size,
+                      uint32_t *first, uint32_t *last) {
+    uint64_t lo = (uint64_t)((double)i * in_size / out_size);
+    uint64_t hi = (uint64_t)((double)(i + 1) * in_size / out_size);
+    if (lo >= in_size) lo = in_size - 1;
+    if (hi <= lo) hi = lo + 1;
+    if (hi > in_size) hi = in_size;
+    *first = (uint32_t)lo;
+    *last = (uint32_t)hi;
+}
+
+/* Source row r of the region, premultiplied unless the image is opaque; only
+ * columns [first, last) are valid */
+static const uint32_t *source_row(const struct RasterImage *src, const uint32_t *base, uint32_t r,
+                                  uint32_t first, uint32_t last, bool opaque) {
+    const uint32_t *row = base + (size_t)r * src->stride;
+    if (opaque) return row;
+    raster_ops->premultiply(scratch.src_row + first, row + first, last - first);
+    return scratch.src_row;
+}
+
+static void bilinear_filter_row(uint16_t *out, const uint32_t *row, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        uint32_t p0 = row[scratch.map_a[i]];
+        uint32_t frac = scratch.map_b[i];
+        uint32_t p1 = frac ? row[scratch.map_a[i] + 1] : p0;
+        for (int c = 0; c < 4; c++) {
+            out[4 * i + c] = (uint16_t)(((p0 >> (8 * c)) & 0xFF) * (128 - frac) +
+                                        ((p1 >> (8 * c)) & 0xFF) * frac);
+        }
+    }
+}
+
+static void box_filter_row(uint32_t *out, uint32_t rows, uint32_t first_col, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        uint32_t c0 = scratch.map_a[i] - first_col;
+        uint32_t c1 = scratch.map_b[i] - first_col;
+        uint32_t count = rows * (c1 - c0);
+        uint64_t recip = ((1ull << 32) + count - 1) / count;
+        uint32_t px = 0;
+        for (int k = 0; k < 4; k++) {
+            uint64_t sum = count / 2;
+            for (uint32_t c = c0; c < c1; c++) sum += scratch.acc[4 * c + k];
+            /* The rounded-up reciprocal overshoots 255 for huge boxes */
+            uint64_t v = (sum * recip) >> 32;
+            px |= (uint32_t)(v > 255 ? 255 : v) << (8 * k);
+        }
+        out[i] = px;
+    }
+}
+
+int raster_scale_image(const struct RasterImage *dst, int32_t x, int32_t y,
+                       uint32_t width, uint32_t height,
+                       const struct RasterImage *src, uint32_t src_x, uint32_t src_y,
+                       uint32_t src_width, uint32_t src_height,
+                       enum RasterFilter filter, uint8_t alpha, bool opaque) {
+    if (alpha == 0 || !dst->pixels || !src->pixels || width == 0 || height == 0) return 0;
+    if (src_x >= (uint32_t)src->width || src_y >= (uint32_t)src->height) return 0;
+    if (src_width > src->width - src_x) src_width = src->width - src_x;
+    if (src_height > src->height - src_y) src_height = src->height - src_y;
+    if (src_width == 0 || src_height == 0) return 0;
+
+    /* Visible part of the destination rect, relative to (x, y) */
+    int64_t i0 = x < 0 ? -(int64_t)x : 0;
+    int64_t j0 = y < 0 ? -(int64_t)y : 0;
+    int64_t i1 = width < (int64_t)dst->width - x ? width : (int64_t)dst->width - x;
+    int64_t j1 = height < (int64_t)dst->height - y ? height : (int64_t)dst->height - y;
+    if (i0 >= i1 || j0 >= j1) return 0;
+
+    size_t cols = (size_t)(i1 - i0);
+    if (scratch_reserve(cols, src_width) < 0) return -1;
+
+    const uint32_t *base = src->pixels + (size_t)src_y * src->stride + src_x;
+    uint32_t *out = dst->pixels + (size_t)(y + j0) * dst->stride + (x + i0);
+    bool copy = opaque && alpha == 255;
+
+    /* Only the source columns the visible part samples are converted or summed */
+    uint32_t first_col = 0, last_col = 0;
+    for (size_t i = 0; i < cols; i++) {
+        uint64_t col = (uint64_t)i0 + i;
+        switch (filter) {
+        case RASTER_FILTER_NEAREST:
+            scratch.map_a[i] = nearest_tap(col, width, src_width);
+            break;
+        case RASTER_FILTER_BILINEAR:
+            bilinear_tap(col, width, src_width, &scratch.map_a[i], &scratch.map_b[i]);
+            break;
+        case RASTER_FILTER_BOX:
+            box_range(col, width, src_width, &scratch.map_a[i], &scratch.map_b[i]);
+            break;
+        }
+    }
+    if (filter == RASTER_FILTER_BILINEAR) {
+        first_col = scratch.map_a[0];
+        last_col = scratch.map_a[cols - 1] + 1 + (scratch.map_b[cols - 1] ? 1 : 0);
+    } else if (filter == RASTER_FILTER_BOX) {
+        first_col = scratch.map_a[0];
+        last_col = scratch.map_b[cols - 1];
+    }
+
+    int64_t cached[2] = { -1, -1 };
+    for (int64_t j = j0; j < j1; j++, out += dst->stride) {
+        uint32_t *row = copy ? out : scratch.row;
+
+        switch (filter) {
+        case RASTER_FILTER_NEAREST: {
+            const uint32_t *in = base + (size_t)nearest_tap(j, height, src_height) * src->stride;
+            for (size_t i = 0; i < cols; i++) row[i] = in[scratch.map_a[i]];
+            break;
+        }
+        case RASTER_FILTER_BILINEAR: {
+            uint32_t r, frac;
+            bilinear_tap(j, height, src_height, &r, &frac);
+            /* Rows move down monotonically, so the lower row of one output
+             * row is often the upper row of the next */
+            if (cached[0] != r) {
+                if (cached[1] == r) {
+                    uint16_t *swap = scratch.taps[0];
+                    scratch.taps[0] = scratch.taps[1];
+                    scratch.taps[1] = swap;
+                    cached[1] = cached[0];
+                } else {
+                    bilinear_filter_row(scratch.taps[0],
+                                        source_row(src, base, r, first_col, last_col, opaque), cols);
+                }
+                cached[0] = r;
+            }
+            if (frac && cached[1] != r + 1) {
+                bilinear_filter_row(scratch.taps[1],
+                                    source_row(src, base, r + 1, first_col, last_col, opaque), cols);
+                cached[1] = r + 1;
+            }
+            raster_ops->lerp_rows(row, scratch.taps[0], frac ? scratch.taps[1] : scratch.taps[0],
+                                  cols, frac);
+            if (!opaque) raster_ops->unpremultiply(row, row, cols);
+            break;
+        }
+        case RASTER_FILTER_BOX: {
+            uint32_t r0, r1;
+            box_range(j, height, src_height, &r0, &r1);
+            memset(scratch.acc, 0, (last_col - first_col) * 4 * sizeof(uint32_t));
+            for (uint32_t r = r0; r < r1; r++) {
+                const uint32_t *in = source_row(src, base, r, first_col, last_col, opaque);
+                raster_ops->accumulate(scratch.acc, in + first_col, last_col - first_col);
+            }
+            box_filter_row(row, r1 - r0, first_col, cols);
+            if (!opaque) raster_ops->unpremultiply(row, row, cols);
+            break;
+        }
+        }
+
+        if (!copy) raster_ops->blend(out, row, cols, alpha);
+    }
+    return 0;
+}
+
+bool raster_is_opaque(const uint32_t *pixels, size_t n) {
+    uint32_t all = 0xFF000000;
+    for (size_t i = 0; i < n; i++) all &= pixels[i];
+    return all == 0xFF000000;
+}
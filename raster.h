@@ -0,0 +1,122 @@
+#ifndef ICM_RASTER_H
+#define ICM_RASTER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * CPU pixel kernels for drawing into IPC buffers.
+ *
+ * Pixels are 32-bit words in the buffers' native ARGB8888 layout (0xAARRGGBB).
+ * Blending is source-over with straight source colors: color channels become
+ * (s * a + d * (255 - a)) / 255 and alpha becomes a + da * (255 - a) / 255,
+ * rounded, where a is the source alpha scaled by any global alpha.
+ *
+ * Every row kernel has a scalar reference and SSE2, AVX2 and NEON versions
+ * where they pay off. raster_init() picks the best set the CPU supports; until
+ * then the scalar set is used. ICM_RASTER=scalar|sse2|avx2|neon in the
+ * environment forces one of the sets the CPU supports, which is handy when
+ * chasing a rendering bug.
+ */
+
+struct RasterOps {
+    const char *name;
+    void (*fill)(uint32_t *dst, uint32_t color, size_t n);
+    void (*fill_blend)(uint32_t *dst, uint32_t color, size_t n);
+    void (*copy)(uint32_t *dst, const uint32_t *src, size_t n);
+    void (*blend)(uint32_t *dst, const uint32_t *src, size_t n, uint8_t alpha);
+    /* These three may run in place (dst == src) */
+    void (*premultiply)(uint32_t *dst, const uint32_t *src, size_t n);
+    void (*unpremultiply)(uint32_t *dst, const uint32_t *src, size_t n);
+    void (*swizzle)(uint32_t *dst, const uint32_t *src, size_t n);   /* swap R and B */
+    /* Scaling: a and b hold four 16-bit channels per pixel, weighted by 128 */
+    void (*lerp_rows)(uint32_t *dst, const uint16_t *a, const uint16_t *b, size_t n, uint32_t frac);
+    void (*accumulate)(uint32_t *acc, const uint32_t *src, size_t n);  /* 4 sums per pixel */
+};
+
+extern const struct RasterOps *raster_ops;
+
+void raster_init(void);
+
+/* A 32-bit pixel grid; stride is in pixels */
+struct RasterImage {
+    uint32_t *pixels;
+    int32_t width, height;
+    int32_t stride;
+};
+
+/* Rect helpers clip against the images and do nothing for empty results */
+void raster_fill_rect(const struct RasterImage *dst, int32_t x, int32_t y,
+                      uint32_t width, uint32_t height, uint32_t color);
+void raster_blend_rect(const struct RasterImage *dst, int32_t x, int32_t y,
+                       uint32_t width, uint32_t height, uint32_t color);
+void raster_copy_rect(const struct RasterImage *dst, int32_t x, int32_t y,
+                      const struct RasterImage *src, uint32_t src_x, uint32_t src_y,
+                      uint32_t width, uint32_t height);
+void raster_blend_image(const struct RasterImage *dst, int32_t x, int32_t y,
+                        const struct RasterImage *src, uint32_t src_x, uint32_t src_y,
+                        uint32_t width, uint32_t height, uint8_t alpha);
+
+enum RasterFilter {
+    RASTER_FILTER_NEAREST,
+    RASTER_FILTER_BILINEAR,         /* 7-bit weights, edge pixels repeat */
+    RASTER_FILTER_BOX,              /* area average, for shrinking */
+};
+
+/**
+ * Draw the src_width x src_height region of src at (x, y) scaled to
+ * width x height, blended at alpha. The source region is clamped to src.
+ * Translucent sources are filtered premultiplied so transparent pixels do
+ * not bleed their color; pass opaque when every source pixel has alpha 255
+ * to skip that.
+ *
+ * @return 0 on success, -1 if scratch rows could not be allocated
+ */
+int raster_scale_image(const struct RasterImage *dst, int32_t x, int32_t y,
+                       uint32_t width, uint32_t height,
+                       const struct RasterImage *src, uint32_t src_x, uint32_t src_y,
+                       uint32_t src_width, uint32_t src_height,
+                       enum RasterFilter filter, uint8_t alpha, bool opaque);
+
+enum RasterFillRule {
+    RASTER_FILL_NONZERO,
+    RASTER_FILL_EVENODD,
+};
+
+struct RasterPoint {
+    float x, y;                     /* pixel corners sit on whole numbers */
+};
+
+/**
+ * Fill the area enclosed by closed contours with color, anti-aliased by exact
+ * pixel coverage. Contour i runs from the end of contour i - 1 (or point 0) up
+ * to contour_ends[i] exclusive and is closed back to its first point. Points
+ * may lie outside dst. Without antialias, pixels at least half covered are
+ * set to color, alpha included, and the rest left alone.
+ *
+ * @return 0 on success, -1 if the edge table could not be allocated
+ */
+int raster_fill_path(const struct RasterImage *dst, const struct RasterPoint *points,
+                     const uint32_t *contour_ends, size_t num_contours,
+                     enum RasterFillRule rule, uint32_t color, bool antialias);
+
+/* A width-wide line with square caps reaching width / 2 past each end */
+int raster_stroke_line(const struct RasterImage *dst, float x0, float y0, float x1, float y1,
+                       float width, uint32_t color, bool antialias);
+
+/**
+ * Draw an axis-aligned ellipse with radii rx, ry. A stroke of 0 fills it,
+ * otherwise the outline is stroke wide and centered on the radii. Edges fall
+ * off over one pixel of distance to the outline, or without antialias pixels
+ * at least half covered are set to color as raster_fill_path does.
+ *
+ * @return 0 on success, -1 if the scratch row could not be allocated
+ */
+int raster_draw_ellipse(const struct RasterImage *dst, float cx, float cy, float rx, float ry,
+                        float stroke, uint32_t color, bool antialias);
+
+/* True if every pixel has alpha 255 */
+bool raster_is_opaque(const uint32_t *pixels, size_t n);
+
+#endif /* ICM_RASTER_H */
@@ -0,0 +1,414 @@
+#include "raster.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Anti-aliased path filling with an active edge table, plus the strokes and
+ * ellipses built on the same span writer.
+ *
+ * Edges are sorted by their top and walked a pixel row at a time. Each active
+ * edge adds its signed area into a per-row accumulation buffer; a running sum
+ * along the row then gives the winding-weighted coverage of every pixel,
+ * exactly for non-overlapping edges. The fill rule is applied to that sum, and
+ * runs of fully covered pixels go to the fill_blend kernel while edge pixels
+ * are collected and blended as one row. Aliased drawing has no edge pixels and
+ * stores its runs with the fill kernel, like DRAW_RECT does.
+ *
+ * Edges are split where they cross the left and right image borders and the
+ * outside parts pinned to the border, so everything left of the image still
+ * contributes its winding without the buffer growing past the image.
+ */
+
+struct PathEdge {
+    float x0, y0, x1, y1;           /* y0 < y1 */
+    float dxdy;
+    float dir;                      /* +1 downwards, -1 upwards */
+};
+
+struct EdgeList {
+    struct PathEdge *edges;
+    size_t count, capacity;
+};
+
+/* Per-row buffers, kept between calls; drawing is single threaded */
+static struct {
+    float *acc;                     /* width + 2 area deltas */
+    uint32_t *pixels;               /* edge pixels waiting to be blended */
+    uint32_t *active;               /* indices into the edge list */
+    size_t width, active_capacity;
+} path_scratch;
+
+static int push_edge(struct EdgeList *list, float x0, float y0, float x1, float y1) {
+    if (y0 == y1) return 0;
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 16;
+        struct PathEdge *edges = realloc(list->edges, capacity * sizeof(*edges));
+        if (!edges) return -1;
+        list->edges = edges;
+        list->capacity = capacity;
+    }
+
+    struct PathEdge *edge = &list->edges[list->count++];
+    edge->dir = y0 < y1 ? 1.0f : -1.0f;
+    if (y0 > y1) {
+        float t = x0; x0 = x1; x1 = t;
+        t = y0; y0 = y1; y1 = t;
+    }
+    edge->x0 = x0;
+    edge->y0 = y0;
+    edge->x1 = x1;
+    edge->y1 = y1;
+    edge->dxdy = (x1 - x0) / (y1 - y0);
+    return 0;
+}
+
+/* Split at x = 0 and x = width, pinning the outside pieces to the border */
+static int add_edge(struct EdgeList *list, float x0, float y0, float x1, float y1, float width) {
+    const float borders[2] = { 0.0f, width };
+    for (int i = 0; i < 2; i++) {
+        float b = borders[i];
+        if ((x0 < b) != (x1 < b) && x0 != b && x1 != b) {
+            float y = y0 + (b - x0) * (y1 - y0) / (x1 - x0);
+            if (add_edge(list, x0, y0, b, y, width) < 0) return -1;
+            return add_edge(list, b, y, x1, y1, width);
+        }
+    }
+    x0 = fminf(fmaxf(x0, 0.0f), width);
+    x1 = fminf(fmaxf(x1, 0.0f), width);
+    return push_edge(list, x0, y0, x1, y1);
+}
+
+static int compare_edge_top(const void *a, const void *b) {
+    const struct PathEdge *ea = a, *eb = b;
+    return (ea->y0 > eb->y0) - (ea->y0 < eb->y0);
+}
+
+/* Add the area a segment within one row covers to the right of it; d is its
+ * signed height. The running sum of acc then gives per-pixel coverage. */
+static void accumulate_segment(float *acc, float x, float xnext, float d) {
+    float x0 = fminf(x, xnext), x1 = fmaxf(x, xnext);
+    float x0floor = floorf(x0);
+    int x0i = (int)x0floor;
+    float x1ceil = ceilf(x1);
+    int x1i = (int)x1ceil;
+
+    if (x1i <= x0i + 1) {
+        float xmf = 0.5f * (x + xnext) - x0floor;
+        acc[x0i] += d - d * xmf;
+        acc[x0i + 1] += d * xmf;
+        return;
+    }
+
+    float s = 1.0f / (x1 - x0);
+    float x0f = x0 - x0floor;
+    float a0 = 0.5f * s * (1.0f - x0f) * (1.0f - x0f);
+    float x1f = x1 - x1ceil + 1.0f;
+    float am = 0.5f * s * x1f * x1f;
+    acc[x0i] += d * a0;
+    if (x1i == x0i + 2) {
+        acc[x0i + 1] += d * (1.0f - a0 - am);
+    } else {
+        float a1 = s * (1.5f - x0f);
+        acc[x0i + 1] += d * (a1 - a0);
+        for (int xi = x0i + 2; xi < x1i - 1; xi++) acc[xi] += d * s;
+        float a2 = a1 + (float)(x1i - x0i - 3) * s;
+        acc[x1i - 1] += d * (1.0f - a2 - am);
+    }
+    acc[x1i] += d * am;
+}
+
+static float apply_rule(float winding, enum RasterFillRule rule) {
+    float w = fabsf(winding);
+    if (rule == RASTER_FILL_EVENODD) {
+        w = fmodf(w, 2.0f);
+        return w > 1.0f ? 2.0f - w : w;
+    }
+    return w > 1.0f ? 1.0f : w;
+}
+
+enum RunKind { RUN_EMPTY, RUN_FULL, RUN_EDGE };
+
+/* Collects a row left to right into runs: full runs go to fill_blend, or
+ * fill when aliased, and edge pixels are staged in path_scratch.pixels and
+ * blended together */
+struct SpanWriter {
+    uint32_t *row;
+    uint32_t color, color_a;
+    bool antialias;
+    enum RunKind kind;
+    int run_start;
+};
+
+static void span_begin(struct SpanWriter *w, uint32_t *row, int x,
+                       uint32_t color, bool antialias) {
+    w->row = row;
+    w->color = color;
+    w->color_a = color >> 24;
+    w->antialias = antialias;
+    w->kind = RUN_EMPTY;
+    w->run_start = x;
+}
+
+static void span_flush(struct SpanWriter *w, int end) {
+    int start = w->run_start;
+    if (end <= start) return;
+    if (w->kind == RUN_FULL) {
+        if (w->antialias) {
+            raster_ops->fill_blend(w->row + start, w->color, end - start);
+        } else {
+            raster_ops->fill(w->row + start, w->color, end - start);
+        }
+    } else if (w->kind == RUN_EDGE) {
+        raster_ops->blend(w->row + start, path_scratch.pixels + start, end - start, 255);
+    }
+}
+
+/* Continue the row with kind from x on */
+static void span_run(struct SpanWriter *w, int x, enum RunKind kind) {
+    if (kind == w->kind) return;
+    span_flush(w, x);
+    w->kind = kind;
+    w->run_start = x;
+}
+
+static void span_pixel(struct SpanWriter *w, int x, float coverage) {
+    if (!w->antialias) {
+        span_run(w, x, coverage >= 0.5f ? RUN_FULL : RUN_EMPTY);
+        return;
+    }
+    uint32_t a = (uint32_t)(coverage * w->color_a + 0.5f);
+    enum RunKind kind = a == 0 ? RUN_EMPTY : a >= w->color_a ? RUN_FULL : RUN_EDGE;
+    if (kind == RUN_EDGE) path_scratch.pixels[x] = a << 24 | (w->color & 0x00FFFFFF);
+    span_run(w, x, kind);
+}
+
+static void span_end(struct SpanWriter *w, int x) {
+    span_flush(w, x);
+    w->kind = RUN_EMPTY;
+    w->run_start = x;
+}
+
+/* Turn one row of area deltas into pixels, clearing acc as it goes */
+static void render_row(uint32_t *row, int x_start, int x_end, enum RasterFillRule rule,
+                       uint32_t color, bool antialias) {
+    float *acc = path_scratch.acc;
+    float winding = 0.0f;
+    struct SpanWriter w;
+    span_begin(&w, row, x_start, color, antialias);
+
+    for (int x = x_start; x < x_end; x++) {
+        winding += acc[x];
+        acc[x] = 0.0f;
+        span_pixel(&w, x, apply_rule(winding, rule));
+    }
+    span_end(&w, x_end);
+}
+
+static int path_scratch_reserve(size_t width, size_t edges) {
+    if (width > path_scratch.width) {
+        float *acc = realloc(path_scratch.acc, (width + 2) * sizeof(float));
+        if (acc) path_scratch.acc = acc;
+        uint32_t *pixels = realloc(path_scratch.pixels, width * sizeof(uint32_t));
+        if (pixels) path_scratch.pixels = pixels;
+        if (!acc || !pixels) return -1;
+        /* New tail must start cleared; rows clear what they touch */
+        memset(path_scratch.acc + path_scratch.width, 0,
+               (width + 2 - path_scratch.width) * sizeof(float));
+        path_scratch.width = width;
+    }
+    if (edges > path_scratch.active_capacity) {
+        uint32_t *active = realloc(path_scratch.active, edges * sizeof(uint32_t));
+        if (!active) return -1;
+        path_scratch.active = active;
+        path_scratch.active_capacity = edges;
+    }
+    return 0;
+}
+
+int raster_fill_path(const struct RasterImage *dst, const struct RasterPoint *points,
+                     const uint32_t *contour_ends, size_t num_contours,
+                     enum RasterFillRule rule, uint32_t color, bool antialias) {
+    if (!dst->pixels || dst->width <= 0 || dst->height <= 0) return 0;
+    if (antialias && (color >> 24) == 0) return 0;
+
+    struct EdgeList list = {0};
+    float width = (float)dst->width;
+    uint32_t first = 0;
+    for (size_t c = 0; c < num_contours; c++) {
+        uint32_t end = contour_ends[c];
+        for (uint32_t i = first; i < end; i++) {
+            const struct RasterPoint *p = &points[i];
+            const struct RasterPoint *q = &points[i + 1 < end ? i + 1 : first];
+            if (add_edge(&list, p->x, p->y, q->x, q->y, width) < 0) {
+                free(list.edges);
+                return -1;
+            }
+        }
+        first = end;
+    }
+    if (list.count == 0) return 0;
+    if (path_scratch_reserve(dst->width, list.count) < 0) {
+        free(list.edges);
+        return -1;
+    }
+
+    qsort(list.edges, list.count, sizeof(*list.edges), compare_edge_top);
+    float bottom = list.edges[0].y1;
+    for (size_t i = 1; i < list.count; i++) bottom = fmaxf(bottom, list.edges[i].y1);
+
+    int row_start = (int)fmaxf(floorf(list.edges[0].y0), 0.0f);
+    int row_end = (int)fminf(ceilf(bottom), (float)dst->height);
+    size_t next = 0, num_active = 0;
+    uint32_t *active = path_scratch.active;
+
+    for (int y = row_start; y < row_end; y++) {
+        float top = (float)y, low = (float)(y + 1);
+        while (next < list.count && list.edges[next].y0 < low) {
+            active[num_active++] = next++;
+        }
+
+        int x_min = dst->width, x_max = 0;
+        size_t kept = 0;
+        for (size_t i = 0; i < num_active; i++) {
+            const struct PathEdge *edge = &list.edges[active[i]];
+            if (edge->y1 <= top) continue;
+            active[kept++] = active[i];
+
+            float ya = fmaxf(top, edge->y0);
+            float yb = fminf(low, edge->y1);
+            if (yb <= ya) continue;
+            float xa = edge->x0 + (ya - edge->y0) * edge->dxdy;
+            float xb = edge->x0 + (yb - edge->y0) * edge->dxdy;
+            /* Float error can push an interpolated end a hair past the border */
+            xa = fminf(fmaxf(xa, 0.0f), width);
+            xb = fminf(fmaxf(xb, 0.0f), width);
+            accumulate_segment(path_scratch.acc, xa, xb, (yb - ya) * edge->dir);
+
+            int lo = (int)floorf(fminf(xa, xb));
+            int hi = (int)ceilf(fmaxf(xa, xb)) + 2;
+            if (lo < x_min) x_min = lo;
+            if (hi > x_max) x_max = hi;
+        }
+        num_active = kept;
+        if (x_min >= x_max) continue;
+
+        uint32_t *row = dst->pixels + (size_t)y * dst->stride;
+        int x_end = x_max < dst->width ? x_max : dst->width;
+        render_row(row, x_min, x_end, rule, color, antialias);
+        /* Deltas past the image only ever sum to the same winding; drop them */
+        for (int x = x_end; x < x_max && x < dst->width + 2; x++) path_scratch.acc[x] = 0.0f;
+    }
+
+    free(list.edges);
+    return 0;
+}
+
+int raster_stroke_line(const struct RasterImage *dst, float x0, float y0, float x1, float y1,
+                       float width, uint32_t color, bool antialias) {
+    float dx = x1 - x0, dy = y1 - y0;
+    float length = sqrtf(dx * dx + dy * dy);
+    float half = width * 0.5f;
+
+    /* Unit direction scaled to half the width; a point becomes a square */
+    float ux = half, uy = 0.0f;
+    if (length > 0.0f) {
+        ux = dx / length * half;
+        uy = dy / length * half;
+    }
+
+    struct RasterPoint quad[4] = {
+        { x0 - ux + uy, y0 - uy - ux },
+        { x1 + ux + uy, y1 + uy - ux },
+        { x1 + ux - uy, y1 + uy + ux },
+        { x0 - ux - uy, y0 - uy + ux },
+    };
+    uint32_t end = 4;
+    return raster_fill_path(dst, quad, &end, 1, RASTER_FILL_NONZERO, color, antialias);
+}
+
+/* Signed distance to the ellipse outline, negative inside. Exact for circles,
+ * a first-order estimate otherwise, which is plenty for a pixel of falloff. */
+static float ellipse_distance(float px, float py, float rx, float ry) {
+    if (rx == ry) return sqrtf(px * px + py * py) - rx;
+    float k0 = sqrtf((px / rx) * (px / rx) + (py / ry) * (py / ry));
+    float k1 = sqrtf((px / (rx * rx)) * (px / (rx * rx)) + (py / (ry * ry)) * (py / (ry * ry)));
+    if (k1 == 0.0f) return -fminf(rx, ry);
+    return k0 * (k0 - 1.0f) / k1;
+}
+
+/* Half the width of an ellipse at height dy from its center, if it reaches */
+static bool ellipse_half_width(float rx, float ry, float dy, float *half) {
+    if (rx <= 0.0f || ry <= 0.0f || fabsf(dy) >= ry) return false;
+    float t = dy / ry;
+    *half = rx * sqrtf(1.0f - t * t);
+    return true;
+}
+
+int raster_draw_ellipse(const struct RasterImage *dst, float cx, float cy, float rx, float ry,
+                        float stroke, uint32_t color, bool antialias) {
+    if (!dst->pixels || dst->width <= 0 || dst->height <= 0) return 0;
+    if (antialias && (color >> 24) == 0) return 0;
+    if (rx < 0.0f || ry < 0.0f) return 0;
+    if (path_scratch_reserve(dst->width, 0) < 0) return -1;
+
+    /* Pixels inside `solid` are fully covered and those inside `hole` are
+     * empty; only the band between them needs a distance per pixel */
+    float outer = stroke > 0.0f ? stroke * 0.5f : 0.0f;
+    float reach_x = rx + outer + 1.0f, reach_y = ry + outer + 1.0f;
+    float solid_x = -1.0f, solid_y = -1.0f, hole_x = -1.0f, hole_y = -1.0f;
+    if (stroke > 0.0f) {
+        hole_x = rx - outer - 1.0f;
+        hole_y = ry - outer - 1.0f;
+    } else {
+        solid_x = rx - 1.0f;
+        solid_y = ry - 1.0f;
+    }
+
+    int y_start = (int)fmaxf(floorf(cy - reach_y), 0.0f);
+    int y_end = (int)fminf(ceilf(cy + reach_y), (float)dst->height);
+    float width = (float)dst->width;
+
+    for (int y = y_start; y < y_end; y++) {
+        float dy = (float)y + 0.5f - cy;
+        float half;
+        if (!ellipse_half_width(reach_x, reach_y, dy, &half)) continue;
+        int x_start = (int)fmaxf(floorf(cx - half), 0.0f);
+        int x_end = (int)fminf(ceilf(cx + half), width);
+        if (x_start >= x_end) continue;
+
+        /* Pixel centers within [skip_start, skip_end) need no distance */
+        int skip_start = x_end, skip_end = x_end;
+        enum RunKind skip_kind = RUN_EMPTY;
+        if (ellipse_half_width(solid_x, solid_y, dy, &half)) {
+            skip_kind = RUN_FULL;
+        } else if (!ellipse_half_width(hole_x, hole_y, dy, &half)) {
+            half = -1.0f;
+        }
+        if (half >= 0.0f) {
+            skip_start = (int)fmaxf(ceilf(cx - half - 0.5f), (float)x_start);
+            skip_end = (int)fminf(floorf(cx + half - 0.5f) + 1.0f, (float)x_end);
+            if (skip_start >= skip_end) skip_start = skip_end = x_end;
+        }
+
+        struct SpanWriter w;
+        span_begin(&w, dst->pixels + (size_t)y * dst->stride, x_start, color, antialias);
+        for (int x = x_start; x < x_end; x++) {
+            if (x == skip_start) {
+                span_run(&w, x, skip_kind);
+                x = skip_end - 1;
+                continue;
+            }
+            float d = ellipse_distance((float)x + 0.5f - cx, dy, rx, ry);
+            float coverage;
+            if (stroke > 0.0f) {
+                coverage = fminf(outer + 0.5f - fabsf(d), fminf(stroke, 1.0f));
+            } else {
+                coverage = 0.5f - d;
+            }
+            span_pixel(&w, x, fminf(fmaxf(coverage, 0.0f), 1.0f));
+        }
+        span_end(&w, x_end);
+    }
+    return 0;
+}
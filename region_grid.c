@@ -0,0 +1,207 @@
+#include "region_grid.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define REGION_GRID_MIN_CAPACITY 16
+
+struct CellSpan {
+    int32_t cx0, cy0, cx1, cy1;
+    uint64_t cells;                 /* 0 for empty rects */
+};
+
+static struct CellSpan cell_span(const struct RegionGridRect *rect) {
+    struct CellSpan span = {0};
+    if (rect->width == 0 || rect->height == 0) return span;
+
+    int64_t x1 = (int64_t)rect->x + rect->width - 1;
+    int64_t y1 = (int64_t)rect->y + rect->height - 1;
+    if (x1 > INT32_MAX) x1 = INT32_MAX;
+    if (y1 > INT32_MAX) y1 = INT32_MAX;
+    span.cx0 = rect->x >> REGION_GRID_CELL_SHIFT;
+    span.cy0 = rect->y >> REGION_GRID_CELL_SHIFT;
+    span.cx1 = (int32_t)x1 >> REGION_GRID_CELL_SHIFT;
+    span.cy1 = (int32_t)y1 >> REGION_GRID_CELL_SHIFT;
+    span.cells = (uint64_t)(span.cx1 - span.cx0 + 1) * (uint64_t)(span.cy1 - span.cy0 + 1);
+    return span;
+}
+
+static int rect_contains(const struct RegionGridRect *rect, int32_t x, int32_t y) {
+    return x >= rect->x && (int64_t)x < (int64_t)rect->x + rect->width &&
+           y >= rect->y && (int64_t)y < (int64_t)rect->y + rect->height;
+}
+
+static uint32_t cell_index(const struct RegionGrid *grid, int32_t cx, int32_t cy) {
+    uint32_t h = ((uint32_t)cx * 73856093u) ^ ((uint32_t)cy * 19349663u);
+    return (h * 2654435769u) & (grid->capacity - 1);
+}
+
+static struct RegionGridCell *find_cell(const struct RegionGrid *grid, int32_t cx, int32_t cy) {
+    if (grid->used == 0) return NULL;
+
+    uint32_t mask = grid->capacity - 1;
+    for (uint32_t i = cell_index(grid, cx, cy);; i = (i + 1) & mask) {
+        struct RegionGridCell *cell = &grid->cells[i];
+        if (!cell->used) return NULL;
+        if (cell->cx == cx && cell->cy == cy) return cell;
+    }
+}
+
+/* Make room for extra new cells so no cell moves while a region is added */
+static int reserve_cells(struct RegionGrid *grid, uint32_t extra) {
+    uint32_t capacity = grid->capacity ? grid->capacity : REGION_GRID_MIN_CAPACITY;
+    while ((uint64_t)(grid->used + extra) * 4 > (uint64_t)capacity * 3) capacity *= 2;
+    if (capacity == grid->capacity) return 0;
+
+    struct RegionGridCell *cells = calloc(capacity, sizeof(*cells));
+    if (!cells) return -1;
+
+    struct RegionGridCell *old = grid->cells;
+    uint32_t old_capacity = grid->capacity;
+    grid->cells = cells;
+    grid->capacity = capacity;
+
+    for (uint32_t i = 0; i < old_capacity; i++) {
+        if (!old[i].used) continue;
+        uint32_t j = cell_index(grid, old[i].cx, old[i].cy);
+        while (cells[j].used) j = (j + 1) & (capacity - 1);
+        cells[j] = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+static struct RegionGridCell *add_cell(struct RegionGrid *grid, int32_t cx, int32_t cy) {
+    struct RegionGridCell *cell = find_cell(grid, cx, cy);
+    if (cell) return cell;
+
+    uint32_t mask = grid->capacity - 1;
+    uint32_t i = cell_index(grid, cx, cy);
+    while (grid->cells[i].used) i = (i + 1) & mask;
+
+    cell = &grid->cells[i];
+    cell->cx = cx;
+    cell->cy = cy;
+    cell->used = 1;
+    grid->used++;
+    return cell;
+}
+
+static int push_entry(struct RegionGridEntry **entries, uint32_t *count, uint32_t *capacity,
+                      const struct RegionGridRect *rect, void *data) {
+    if (*count == *capacity) {
+        uint32_t new_capacity = *capacity ? *capacity * 2 : 4;
+        struct RegionGridEntry *grown = realloc(*entries, new_capacity * sizeof(*grown));
+        if (!grown) return -1;
+        *entries = grown;
+        *capacity = new_capacity;
+    }
+    (*entries)[(*count)++] = (struct RegionGridEntry){ .rect = *rect, .data = data };
+    return 0;
+}
+
+static void drop_entry(struct RegionGridEntry *entries, uint32_t *count, void *data) {
+    for (uint32_t i = 0; i < *count; i++) {
+        if (entries[i].data == data) {
+            entries[i] = entries[--(*count)];
+            return;
+        }
+    }
+}
+
+void region_grid_init(struct RegionGrid *grid) {
+    memset(grid, 0, sizeof(*grid));
+}
+
+void region_grid_finish(struct RegionGrid *grid) {
+    for (uint32_t i = 0; i < grid->capacity; i++) {
+        free(grid->cells[i].entries);
+    }
+    free(grid->cells);
+    free(grid->large);
+    memset(grid, 0, sizeof(*grid));
+}
+
+int region_grid_insert(struct RegionGrid *grid, const struct RegionGridRect *rect, void *data) {
+    struct CellSpan span = cell_span(rect);
+    if (span.cells == 0) {
+        grid->count++;
+        return 0;
+    }
+
+    if (span.cells > REGION_GRID_MAX_CELLS) {
+        if (push_entry(&grid->large, &grid->num_large, &grid->large_capacity, rect, data) < 0) {
+            return -1;
+        }
+        grid->count++;
+        return 0;
+    }
+
+    if (reserve_cells(grid, (uint32_t)span.cells) < 0) return -1;
+
+    for (int32_t cy = span.cy0; cy <= span.cy1; cy++) {
+        for (int32_t cx = span.cx0; cx <= span.cx1; cx++) {
+            struct RegionGridCell *cell = add_cell(grid, cx, cy);
+            if (push_entry(&cell->entries, &cell->count, &cell->capacity, rect, data) < 0) {
+                /* Undo the cells already filled, in the same order */
+                for (int32_t uy = span.cy0; uy <= cy; uy++) {
+                    for (int32_t ux = span.cx0; ux <= span.cx1; ux++) {
+                        if (uy == cy && ux == cx) break;
+                        struct RegionGridCell *done = find_cell(grid, ux, uy);
+                        drop_entry(done->entries, &done->count, data);
+                    }
+                }
+                return -1;
+            }
+        }
+    }
+    grid->count++;
+    return 0;
+}
+
+void region_grid_remove(struct RegionGrid *grid, const struct RegionGridRect *rect, void *data) {
+    struct CellSpan span = cell_span(rect);
+    if (span.cells > REGION_GRID_MAX_CELLS) {
+        drop_entry(grid->large, &grid->num_large, data);
+    } else if (span.cells > 0) {
+        for (int32_t cy = span.cy0; cy <= span.cy1; cy++) {
+            for (int32_t cx = span.cx0; cx <= span.cx1; cx++) {
+                struct RegionGridCell *cell = find_cell(grid, cx, cy);
+                if (cell) drop_entry(cell->entries, &cell->count, data);
+            }
+        }
+    }
+    if (grid->count > 0) grid->count--;
+}
+
+size_t region_grid_query(const struct RegionGrid *grid, int32_t x, int32_t y,
+                         void **out, size_t max) {
+    size_t hits = 0;
+
+    const struct RegionGridCell *cell = find_cell(grid, x >> REGION_GRID_CELL_SHIFT,
+                                                  y >> REGION_GRID_CELL_SHIFT);
+    if (cell) {
+        for (uint32_t i = 0; i < cell->count; i++) {
+            if (!rect_contains(&cell->entries[i].rect, x, y)) continue;
+            if (hits < max) out[hits] = cell->entries[i].data;
+            hits++;
+        }
+    }
+    for (uint32_t i = 0; i < grid->num_large; i++) {
+        if (!rect_contains(&grid->large[i].rect, x, y)) continue;
+        if (hits < max) out[hits] = grid->large[i].data;
+        hits++;
+    }
+    return hits;
+}
+
+size_t region_grid_query_all(const struct RegionGrid *grid, int32_t x, int32_t y,
+                             void ***out, size_t *capacity) {
+    size_t hits = region_grid_query(grid, x, y, *out, *capacity);
+    if (hits <= *capacity) return hits;
+
+    void **grown = realloc(*out, hits * sizeof(*grown));
+    if (!grown) return *capacity;
+    *out = grown;
+    *capacity = hits;
+    return region_grid_query(grid, x, y, *out, *capacity);
+}
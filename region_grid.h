@@ -0,0 +1,83 @@
+#ifndef ICM_REGION_GRID_H
+#define ICM_REGION_GRID_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Spatial index for the click regions of one window.
+ *
+ * A sparse uniform grid: window-local space is cut into square cells and each
+ * cell lists the regions overlapping it, so a hit test only looks at regions
+ * near the point. Cells sit in an open-addressing hash keyed on their
+ * coordinates, so the grid needs no bounds and empty space costs nothing.
+ * Regions covering too many cells go on a short list every query scans.
+ *
+ * Cells that empty out are kept for reuse; the whole grid is dropped when its
+ * window has no regions left.
+ */
+
+#define REGION_GRID_CELL_SHIFT 6    /* 64px cells */
+#define REGION_GRID_MAX_CELLS 64    /* larger regions go on the large list */
+
+struct RegionGridRect {
+    int32_t x, y;
+    uint32_t width, height;
+};
+
+struct RegionGridEntry {
+    struct RegionGridRect rect;
+    void *data;
+};
+
+struct RegionGridCell {
+    int32_t cx, cy;
+    uint8_t used;
+    uint32_t count;
+    uint32_t capacity;
+    struct RegionGridEntry *entries;
+};
+
+struct RegionGrid {
+    struct RegionGridCell *cells;
+    uint32_t capacity;              /* power of two, 0 until the first insert */
+    uint32_t used;
+    struct RegionGridEntry *large;
+    uint32_t num_large;
+    uint32_t large_capacity;
+    uint32_t count;                 /* regions, not cell entries */
+};
+
+void region_grid_init(struct RegionGrid *grid);
+void region_grid_finish(struct RegionGrid *grid);
+
+/**
+ * Index data under rect. Empty rects are accepted but never hit.
+ *
+ * @return 0 on success, -1 on allocation failure (nothing is indexed)
+ */
+int region_grid_insert(struct RegionGrid *grid, const struct RegionGridRect *rect, void *data);
+
+/**
+ * Remove data; rect must be the one it was inserted with.
+ */
+void region_grid_remove(struct RegionGrid *grid, const struct RegionGridRect *rect, void *data);
+
+/**
+ * Collect the data of every region containing (x, y).
+ *
+ * @return Number of hits; at most max are stored in out
+ */
+size_t region_grid_query(const struct RegionGrid *grid, int32_t x, int32_t y,
+                         void **out, size_t max);
+
+/**
+ * Like region_grid_query, but grows *out (of *capacity entries) with realloc
+ * until every hit fits. If growing fails the hits that fit are kept.
+ *
+ * @return Number of hits stored in *out
+ */
+size_t region_grid_query_all(const struct RegionGrid *grid, int32_t x, int32_t y,
+                             void ***out, size_t *capacity);
+
+#endif /* ICM_REGION_GRID_H */
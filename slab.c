@@ -0,0 +1,128 @@
+#include "slab.h"
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SLAB_CHUNK_ITEMS 64
+#define SLAB_NONE UINT32_MAX
+
+struct SlabHeader {
+    uint32_t handle;                /* generation | index */
+    uint32_t dense_index;           /* SLAB_NONE while free */
+    uint32_t next_free;
+};
+
+#define SLAB_HEADER_SIZE \
+    ((sizeof(struct SlabHeader) + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1))
+
+static struct SlabHeader *header_at(const struct Slab *slab, uint32_t index) {
+    uint8_t *chunk = slab->chunks[index / SLAB_CHUNK_ITEMS];
+    return (struct SlabHeader *)(chunk + (index % SLAB_CHUNK_ITEMS) * slab->stride);
+}
+
+static struct SlabHeader *header_of(const void *item) {
+    return (struct SlabHeader *)((uint8_t *)item - SLAB_HEADER_SIZE);
+}
+
+static uint32_t next_generation(uint32_t handle) {
+    uint32_t gen = (handle >> SLAB_INDEX_BITS) + 1;
+    if (gen >= (1u << (32 - SLAB_INDEX_BITS))) gen = 1;
+    return gen << SLAB_INDEX_BITS;
+}
+
+void slab_init(struct Slab *slab, size_t item_size) {
+    memset(slab, 0, sizeof(*slab));
+    size_t align = alignof(max_align_t);
+    slab->stride = SLAB_HEADER_SIZE + ((item_size + align - 1) & ~(align - 1));
+    slab->free_head = SLAB_NONE;
+}
+
+void slab_finish(struct Slab *slab) {
+    for (uint32_t i = 0; i < slab->num_chunks; i++) {
+        free(slab->chunks[i]);
+    }
+    free(slab->chunks);
+    free(slab->dense);
+    memset(slab, 0, sizeof(*slab));
+    slab->free_head = SLAB_NONE;
+}
+
+static int add_chunk(struct Slab *slab) {
+    uint32_t first = slab->num_chunks * SLAB_CHUNK_ITEMS;
+    if (first + SLAB_CHUNK_ITEMS > SLAB_INDEX_MASK + 1) return -1;
+
+    uint8_t **chunks = realloc(slab->chunks, (slab->num_chunks + 1) * sizeof(*chunks));
+    if (!chunks) return -1;
+    slab->chunks = chunks;
+
+    uint8_t *chunk = calloc(SLAB_CHUNK_ITEMS, slab->stride);
+    if (!chunk) return -1;
+    slab->chunks[slab->num_chunks++] = chunk;
+
+    /* Thread the new slots onto the free list lowest index first */
+    for (uint32_t i = SLAB_CHUNK_ITEMS; i-- > 0;) {
+        struct SlabHeader *hdr = header_at(slab, first + i);
+        hdr->handle = (1u << SLAB_INDEX_BITS) | (first + i);
+        hdr->dense_index = SLAB_NONE;
+        hdr->next_free = slab->free_head;
+        slab->free_head = first + i;
+    }
+    return 0;
+}
+
+void *slab_alloc(struct Slab *slab) {
+    if (slab->count == slab->dense_capacity) {
+        uint32_t capacity = slab->dense_capacity ? slab->dense_capacity * 2 : SLAB_CHUNK_ITEMS;
+        void **dense = realloc(slab->dense, capacity * sizeof(*dense));
+        if (!dense) return NULL;
+        slab->dense = dense;
+        slab->dense_capacity = capacity;
+    }
+    if (slab->free_head == SLAB_NONE && add_chunk(slab) < 0) {
+        return NULL;
+    }
+
+    struct SlabHeader *hdr = header_at(slab, slab->free_head);
+    slab->free_head = hdr->next_free;
+    hdr->next_free = SLAB_NONE;
+    hdr->dense_index = slab->count;
+
+    void *item = (uint8_t *)hdr + SLAB_HEADER_SIZE;
+    memset(item, 0, slab->stride - SLAB_HEADER_SIZE);
+    slab->dense[slab->count++] = item;
+    return item;
+}
+
+void slab_free(struct Slab *slab, void *item) {
+    if (!item) return;
+    struct SlabHeader *hdr = header_of(item);
+    if (hdr->dense_index == SLAB_NONE) return;
+
+    /* Keep allocation order: stacking and id fallback depend on it */
+    uint32_t at = hdr->dense_index;
+    memmove(&slab->dense[at], &slab->dense[at + 1],
+            (slab->count - at - 1) * sizeof(*slab->dense));
+    slab->count--;
+    for (uint32_t i = at; i < slab->count; i++) {
+        header_of(slab->dense[i])->dense_index = i;
+    }
+
+    uint32_t index = hdr->handle & SLAB_INDEX_MASK;
+    hdr->handle = next_generation(hdr->handle) | index;
+    hdr->dense_index = SLAB_NONE;
+    hdr->next_free = slab->free_head;
+    slab->free_head = index;
+}
+
+uint32_t slab_handle(const void *item) {
+    return item ? header_of(item)->handle : 0;
+}
+
+void *slab_get(const struct Slab *slab, uint32_t handle) {
+    uint32_t index = handle & SLAB_INDEX_MASK;
+    if (handle == 0 || index >= slab->num_chunks * SLAB_CHUNK_ITEMS) return NULL;
+
+    struct SlabHeader *hdr = header_at(slab, index);
+    if (hdr->handle != handle || hdr->dense_index == SLAB_NONE) return NULL;
+    return (uint8_t *)hdr + SLAB_HEADER_SIZE;
+}
@@ -0,0 +1,60 @@
+#ifndef ICM_SLAB_H
+#define ICM_SLAB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Fixed-size object storage for IPC buffers and images.
+ *
+ * Items live in chunks that are never moved, so pointers stay valid until the
+ * item is freed. Freed slots go on a free list and are handed out again before
+ * a new chunk is allocated. Live items are also kept in a dense array in
+ * allocation order, which is what per-frame loops walk.
+ *
+ * Every item has a 32-bit handle: the slot index in the low SLAB_INDEX_BITS and
+ * a generation in the rest. Freeing a slot bumps its generation, so a handle
+ * kept past the item's lifetime resolves to NULL instead of a reused slot.
+ * Handle 0 is never issued.
+ */
+
+#define SLAB_INDEX_BITS 20
+#define SLAB_INDEX_MASK ((1u << SLAB_INDEX_BITS) - 1)
+
+struct Slab {
+    size_t stride;                  /* header + item, rounded up */
+    uint8_t **chunks;
+    uint32_t num_chunks;
+    uint32_t free_head;             /* first free slot, UINT32_MAX if none */
+    void **dense;                   /* live items in allocation order */
+    uint32_t count;
+    uint32_t dense_capacity;
+};
+
+void slab_init(struct Slab *slab, size_t item_size);
+
+/**
+ * Release all chunks. Items still allocated are dropped without any cleanup.
+ */
+void slab_finish(struct Slab *slab);
+
+/**
+ * @return A zeroed item, or NULL on allocation failure
+ */
+void *slab_alloc(struct Slab *slab);
+void slab_free(struct Slab *slab, void *item);
+
+uint32_t slab_handle(const void *item);
+
+/**
+ * @return The item for handle, or NULL if it has been freed since
+ */
+void *slab_get(const struct Slab *slab, uint32_t handle);
+
+/* Iterate live items in allocation order. The body must not free items. */
+#define slab_for_each(pos, slab) \
+    for (uint32_t pos##_i = 0; \
+         pos##_i < (slab)->count && ((pos) = (slab)->dense[pos##_i], 1); \
+         pos##_i++)
+
+#endif /* ICM_SLAB_H */
@@ -0,0 +1,54 @@
+#include "../region_grid.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NUM_REGIONS 200
+
+static int ids[NUM_REGIONS];
+
+/* More overlapping regions than any fixed hit buffer the server used */
+static void test_many_overlapping(void) {
+    struct RegionGrid grid;
+    region_grid_init(&grid);
+
+    for (int i = 0; i < NUM_REGIONS; i++) {
+        ids[i] = i;
+        /* Small rects live in cells, big ones on the large list */
+        struct RegionGridRect rect = i % 2 ? (struct RegionGridRect){ 0, 0, 100, 100 }
+                                           : (struct RegionGridRect){ -5000, -5000, 10000, 10000 };
+        assert(region_grid_insert(&grid, &rect, &ids[i]) == 0);
+    }
+
+    void *fixed[64];
+    assert(region_grid_query(&grid, 10, 10, fixed, 64) == NUM_REGIONS);
+
+    void **hits = NULL;
+    size_t capacity = 0;
+    size_t n = region_grid_query_all(&grid, 10, 10, &hits, &capacity);
+    assert(n == NUM_REGIONS);
+    assert(capacity >= NUM_REGIONS);
+
+    bool seen[NUM_REGIONS] = {false};
+    for (size_t i = 0; i < n; i++) {
+        int id = *(int *)hits[i];
+        assert(!seen[id]);
+        seen[id] = true;
+    }
+
+    /* Outside the small rects only the large ones hit, and nothing regrows */
+    void **before = hits;
+    n = region_grid_query_all(&grid, 500, 500, &hits, &capacity);
+    assert(n == NUM_REGIONS / 2);
+    assert(hits == before);
+
+    free(hits);
+    region_grid_finish(&grid);
+}
+
+int main(void) {
+    test_many_overlapping();
+    printf("region_grid: ok\n");
+    return 0;
+}
@@ -0,0 +1,96 @@
+#include "window_registry.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define WINDOW_REGISTRY_MIN_CAPACITY 64
+
+/* Fibonacci hashing; window ids are mostly sequential */
+static uint32_t slot_index(const struct WindowRegistry *reg, uint32_t id) {
+    return (id * 2654435769u) & (reg->capacity - 1);
+}
+
+void window_registry_init(struct WindowRegistry *reg) {
+    memset(reg, 0, sizeof(*reg));
+}
+
+void window_registry_finish(struct WindowRegistry *reg) {
+    free(reg->slots);
+    memset(reg, 0, sizeof(*reg));
+}
+
+struct WindowSlot *window_registry_find(const struct WindowRegistry *reg, uint32_t id) {
+    if (reg->count == 0) return NULL;
+
+    uint32_t mask = reg->capacity - 1;
+    for (uint32_t i = slot_index(reg, id);; i = (i + 1) & mask) {
+        struct WindowSlot *slot = &reg->slots[i];
+        if (!slot->used) return NULL;
+        if (slot->id == id) return slot;
+    }
+}
+
+static int grow(struct WindowRegistry *reg) {
+    uint32_t capacity = reg->capacity ? reg->capacity * 2 : WINDOW_REGISTRY_MIN_CAPACITY;
+    struct WindowSlot *slots = calloc(capacity, sizeof(*slots));
+    if (!slots) return -1;
+
+    struct WindowSlot *old = reg->slots;
+    uint32_t old_capacity = reg->capacity;
+    reg->slots = slots;
+    reg->capacity = capacity;
+
+    for (uint32_t i = 0; i < old_capacity; i++) {
+        if (!old[i].used) continue;
+        uint32_t j = slot_index(reg, old[i].id);
+        while (slots[j].used) j = (j + 1) & (capacity - 1);
+        slots[j] = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+struct WindowSlot *window_registry_insert(struct WindowRegistry *reg, uint32_t id) {
+    struct WindowSlot *slot = window_registry_find(reg, id);
+    if (slot) return slot;
+
+    /* Keep the load factor under 3/4 so probe runs stay short */
+    if ((reg->count + 1) * 4 > reg->capacity * 3 && grow(reg) < 0) {
+        return NULL;
+    }
+
+    uint32_t mask = reg->capacity - 1;
+    uint32_t i = slot_index(reg, id);
+    while (reg->slots[i].used) i = (i + 1) & mask;
+
+    slot = &reg->slots[i];
+    memset(slot, 0, sizeof(*slot));
+    slot->id = id;
+    slot->used = 1;
+    reg->count++;
+    return slot;
+}
+
+void window_registry_release(struct WindowRegistry *reg, struct WindowSlot *slot) {
+    if (!slot || slot->buffer_count || slot->buffer || slot->view || slot->layer_surf ||
+        slot->regions || slot->subscribers) {
+        return;
+    }
+
+    /* Backward-shift deletion: pull later members of the probe run into the
+     * hole so lookups never need tombstones */
+    uint32_t mask = reg->capacity - 1;
+    uint32_t hole = slot - reg->slots;
+    uint32_t i = hole;
+    for (;;) {
+        i = (i + 1) & mask;
+        if (!reg->slots[i].used) break;
+        uint32_t home = slot_index(reg, reg->slots[i].id);
+        /* Move the entry if its home is not inside (hole, i] */
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            reg->slots[hole] = reg->slots[i];
+            hole = i;
+        }
+    }
+    memset(&reg->slots[hole], 0, sizeof(reg->slots[hole]));
+    reg->count--;
+}
@@ -0,0 +1,60 @@
+#ifndef ICM_WINDOW_REGISTRY_H
+#define ICM_WINDOW_REGISTRY_H
+
+#include <stdint.h>
+
+/**
+ * Window id lookup shared by IPC buffers, Views and layer surfaces.
+ *
+ * An open-addressing hash map (linear probing, backward-shift deletion) from
+ * window id to everything registered under that id. IPC buffer ids are picked
+ * by clients and can collide with the ids the compositor hands out, so a slot
+ * keeps one pointer per kind and lookups apply the precedence the handlers
+ * have always used: buffer, then view, then layer surface.
+ */
+
+struct BufferEntry;
+struct View;
+struct LayerSurface;
+struct RegionGrid;
+struct WindowSubscribers;
+
+struct WindowSlot {
+    uint32_t id;
+    uint8_t used;
+    uint32_t buffer_count;          /* buffers sharing the id; buffer is the newest */
+    struct BufferEntry *buffer;
+    struct View *view;
+    struct LayerSurface *layer_surf;
+    struct RegionGrid *regions;     /* click regions registered on the id */
+    struct WindowSubscribers *subscribers;  /* clients taking its input events */
+};
+
+struct WindowRegistry {
+    struct WindowSlot *slots;
+    uint32_t capacity;              /* power of two, 0 until the first insert */
+    uint32_t count;
+};
+
+void window_registry_init(struct WindowRegistry *reg);
+void window_registry_finish(struct WindowRegistry *reg);
+
+/**
+ * @return The slot for id, or NULL if nothing is registered under it
+ */
+struct WindowSlot *window_registry_find(const struct WindowRegistry *reg, uint32_t id);
+
+/**
+ * Find the slot for id, adding an empty one if needed. Inserting may move
+ * slots, so pointers from earlier calls must not be kept across it.
+ *
+ * @return The slot, or NULL if the table could not grow
+ */
+struct WindowSlot *window_registry_insert(struct WindowRegistry *reg, uint32_t id);
+
+/**
+ * Drop the slot once nothing is registered in it any more.
+ */
+void window_registry_release(struct WindowRegistry *reg, struct WindowSlot *slot);
+
+#endif /* ICM_WINDOW_REGISTRY_H */